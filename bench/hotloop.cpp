@@ -0,0 +1,277 @@
+/**
+ * @file
+ * @brief Hot loop benchmark.
+ *
+ * Compares a hot loop containing disabled logging statements expanded inline (as macros
+ * used to expand before Record constructor, destructor and Record::Commit() became cold
+ * functions) with the same loop using QL_DEBUG. Code of QL_DEBUG, which creates a record
+ * is considered unlikely, so compiler moves it to cold part of the function (e.g.
+ * "OutlinedLoop.cold" in .text.unlikely section) and only the enabled check stays in the
+ * hot loop. Sizes of hot and cold parts of each loop are read from symbol table of the
+ * executable. Instructions per cycle are measured with
+ * perf_event_open(). If hardware counters are not available (e.g. in a container or a
+ * virtual machine), only time per iteration is reported.
+ *
+ * Usage: hotloop [iterations]
+ */
+
+#define QL_LOG_INIT_FUNC ql_logInitFuncNone
+
+#include "../include/ql.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <elf.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Record constructed by inline code. Equivalent of Record before its constructor and
+ * destructor became cold functions.
+ */
+class InlineRecord
+{
+	public:
+		explicit InlineRecord(ql::LogStream & logStream):
+		    m_stream(Stream())
+		{
+			static_cast<ql::RecordBuf *>(m_stream.rdbuf())->setTarget(logStream.rdbuf());
+			m_stream.clear();
+			m_stream.flags(logStream.flags());
+			m_stream.precision(logStream.precision());
+			m_stream.fill(logStream.fill());
+			m_stream.width(0);
+		}
+
+		~InlineRecord()
+		{
+			static_cast<ql::RecordBuf *>(m_stream.rdbuf())->discard();
+		}
+
+		std::ostream & stream()
+		{
+			return m_stream;
+		}
+
+	private:
+		static std::ostream & Stream()
+		{
+			static thread_local ql::RecordBuf buf;
+			static thread_local std::ostream stream(& buf);
+			return stream;
+		}
+
+	private:
+		std::ostream & m_stream;
+};
+
+/**
+ * Inline expansion of QL_DEBUG, which formats the record at the call site.
+ */
+#define INLINE_DEBUG(EXPR) (!::ql::Log::Instance().debugStream().enabled() ? (void)0 : (void)(InlineRecord(::ql::Log::Instance().debugStream()).stream() << "Debug message: " << EXPR << ::ql::Trace(::ql::Log::Instance().debugStream().traceFlags(), QL_CALL_SITE(QL_LEVEL_DEBUG), __FUNCTION__) << ::ql::Record::End))
+
+/**
+ * Loop body with eight logging statements.
+ */
+#define LOOP_BODY(LOG) \
+	for (std::size_t i = 0; i < iterations; i++) { \
+		std::uint64_t x = data[i & mask]; \
+		acc = acc * 31 + x; \
+		LOG("x: " << x << " acc: " << acc); \
+		acc ^= acc >> 7; \
+		LOG("shifted acc: " << acc << " iteration: " << i); \
+		acc += x * x; \
+		LOG("square: " << x * x); \
+		acc ^= acc << 11; \
+		LOG("acc: " << std::hex << acc << std::dec << " at " << i); \
+		acc -= x >> 3; \
+		LOG("x/8: " << (x >> 3) << " acc: " << acc); \
+		acc = (acc << 5) | (acc >> 59); \
+		LOG("rotated acc: " << acc); \
+		acc += i; \
+		LOG("i: " << i << " x: " << x << " acc: " << acc << " ratio: " << static_cast<double>(x) / static_cast<double>(acc + 1)); \
+		acc ^= x; \
+		LOG("final acc: " << acc); \
+	}
+
+extern "C" {
+
+__attribute__((noinline))
+std::uint64_t InlineLoop(const std::vector<std::uint64_t> & data, std::size_t iterations)
+{
+	std::size_t mask = data.size() - 1;
+	std::uint64_t acc = 0;
+	LOOP_BODY(INLINE_DEBUG)
+	return acc;
+}
+
+__attribute__((noinline))
+std::uint64_t OutlinedLoop(const std::vector<std::uint64_t> & data, std::size_t iterations)
+{
+	std::size_t mask = data.size() - 1;
+	std::uint64_t acc = 0;
+	LOOP_BODY(QL_DEBUG)
+	return acc;
+}
+
+}
+
+/**
+ * Get size of a function from symbol table of the executable.
+ * @param name symbol name.
+ * @return size of the function in bytes or 0 if symbol has not been found.
+ */
+std::size_t SymbolSize(const char * name)
+{
+	std::size_t result = 0;
+	std::ifstream file("/proc/self/exe", std::ifstream::binary);
+	std::vector<char> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (image.size() < sizeof(Elf64_Ehdr))
+		return 0;
+
+	Elf64_Ehdr header;
+	std::memcpy(& header, image.data(), sizeof(header));
+	for (std::size_t i = 0; i < header.e_shnum; i++) {
+		Elf64_Shdr section;
+		std::memcpy(& section, image.data() + header.e_shoff + i * header.e_shentsize, sizeof(section));
+		if (section.sh_type != SHT_SYMTAB)
+			continue;
+
+		Elf64_Shdr strings;
+		std::memcpy(& strings, image.data() + header.e_shoff + section.sh_link * header.e_shentsize, sizeof(strings));
+		for (std::size_t offset = 0; offset + sizeof(Elf64_Sym) <= section.sh_size; offset += sizeof(Elf64_Sym)) {
+			Elf64_Sym symbol;
+			std::memcpy(& symbol, image.data() + section.sh_offset + offset, sizeof(symbol));
+			if (ELF64_ST_TYPE(symbol.st_info) == STT_FUNC && std::strcmp(image.data() + strings.sh_offset + symbol.st_name, name) == 0)
+				result += symbol.st_size;
+		}
+	}
+	return result;
+}
+
+/**
+ * Group of hardware counters: instructions and cycles of the calling thread.
+ */
+class Counters
+{
+	public:
+		Counters():
+		    m_leader(Open(PERF_COUNT_HW_CPU_CYCLES, -1)),
+		    m_member(m_leader == -1 ? -1 : Open(PERF_COUNT_HW_INSTRUCTIONS, m_leader))
+		{
+		}
+
+		~Counters()
+		{
+			if (m_member != -1)
+				close(m_member);
+			if (m_leader != -1)
+				close(m_leader);
+		}
+
+		bool available() const
+		{
+			return m_member != -1;
+		}
+
+		void start()
+		{
+			ioctl(m_leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(m_leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+
+		bool stop(std::uint64_t & cycles, std::uint64_t & instructions)
+		{
+			ioctl(m_leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+			struct
+			{
+				std::uint64_t count;
+				std::uint64_t values[2];
+			} group;
+			if (read(m_leader, & group, sizeof(group)) != static_cast<ssize_t>(sizeof(group)) || group.count != 2)
+				return false;
+			cycles = group.values[0];
+			instructions = group.values[1];
+			return true;
+		}
+
+	private:
+		static int Open(std::uint64_t config, int group)
+		{
+			perf_event_attr attr;
+			std::memset(& attr, 0, sizeof(attr));
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.size = sizeof(attr);
+			attr.config = config;
+			attr.disabled = group == -1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP;
+			return static_cast<int>(syscall(__NR_perf_event_open, & attr, 0, -1, group, 0));
+		}
+
+	private:
+		int m_leader;
+		int m_member;
+};
+
+typedef std::uint64_t (* Loop)(const std::vector<std::uint64_t> &, std::size_t);
+
+void Run(const char * name, Loop loop, const std::vector<std::uint64_t> & data, std::size_t iterations, Counters & counters)
+{
+	std::size_t hotSize = SymbolSize(name);
+	std::size_t coldSize = SymbolSize((std::string(name) + ".cold").c_str());
+
+	// Warm up.
+	std::uint64_t result = loop(data, iterations / 10);
+
+	std::uint64_t cycles = 0;
+	std::uint64_t instructions = 0;
+	bool counted = false;
+	if (counters.available())
+		counters.start();
+	std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+	result += loop(data, iterations);
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	if (counters.available())
+		counted = counters.stop(cycles, instructions);
+
+	double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count()) / static_cast<double>(iterations);
+	if (counted && cycles != 0)
+		std::printf("%-14s %10lu %10lu %10.3f %8.3f %12.1f   (%lx)\n", name, static_cast<unsigned long>(hotSize), static_cast<unsigned long>(coldSize), ns, static_cast<double>(instructions) / static_cast<double>(cycles), static_cast<double>(instructions) / static_cast<double>(iterations), static_cast<unsigned long>(result & 0xff));
+	else
+		std::printf("%-14s %10lu %10lu %10.3f %8s %12s   (%lx)\n", name, static_cast<unsigned long>(hotSize), static_cast<unsigned long>(coldSize), ns, "n/a", "n/a", static_cast<unsigned long>(result & 0xff));
+}
+
+int main(int argc, char * argv[])
+{
+	std::size_t iterations = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 100000000;
+
+	std::vector<std::uint64_t> data(1024);
+	std::uint64_t seed = 88172645463325252ull;
+	for (std::size_t i = 0; i < data.size(); i++) {
+		seed ^= seed << 13;
+		seed ^= seed >> 7;
+		seed ^= seed << 17;
+		data[i] = seed;
+	}
+
+	Counters counters;
+	if (!counters.available())
+		std::fprintf(stderr, "Hardware counters are not available, IPC is not measured.\n");
+
+	std::printf("%-14s %10s %10s %10s %8s %12s\n", "loop", "hot bytes", "cold bytes", "ns/iter", "IPC", "instr/iter");
+	Run("InlineLoop", InlineLoop, data, iterations, counters);
+	Run("OutlinedLoop", OutlinedLoop, data, iterations, counters);
+	return EXIT_SUCCESS;
+}
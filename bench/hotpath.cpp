@@ -0,0 +1,314 @@
+/**
+ * @file
+ * @brief Logging hot path benchmark.
+ *
+ * Measures latency (p50, p99, p99.9) and throughput of logging macros. Starting from
+ * baseline configuration (QL_NOTE, single null sink, file, line and function trace,
+ * 32 character message, single thread) one parameter at a time is varied:
+ * 	- macro - QL_DEBUG, QL_NOTE, QL_WARN, QL_ERROR, QL_INFO, QL_NOTEF.
+ * 	- sink - disabled stream, single null sink, /dev/null std::ofstream, 2 and 8 null sinks.
+ * 	- trace - combinations of trace flags.
+ * 	- size - message size.
+ * 	- threads - number of producer threads.
+ * 	.
+ * Latency of each call is measured with steady clock. Timer overhead is measured
+ * beforehand and subtracted.
+ *
+ * Usage: hotpath [--csv | --json] [messages per thread]
+ */
+
+#define QL_LOG_INIT_FUNC ql_logInitFuncNone
+
+#include "../include/ql.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Sink, which discards everything.
+ */
+class NullBuf: public std::streambuf
+{
+	protected:
+		virtual int_type overflow(int_type c)
+		{
+			return traits_type::not_eof(c);
+		}
+
+		virtual std::streamsize xsputn(const char_type *, std::streamsize n)
+		{
+			return n;
+		}
+};
+
+enum macro_t {
+	DEBUG_MACRO,
+	NOTE_MACRO,
+	WARN_MACRO,
+	ERROR_MACRO,
+	INFO_MACRO,
+	NOTEF_MACRO
+};
+
+enum sink_t {
+	DISABLED_SINK,
+	NULL_SINK,
+	DEVNULL_SINK,
+	SINKS_2,
+	SINKS_8
+};
+
+enum format_t {
+	TABLE_FORMAT,
+	CSV_FORMAT,
+	JSON_FORMAT
+};
+
+struct Config
+{
+	const char * axis;
+	macro_t macro;
+	sink_t sink;
+	int traceFlags;
+	std::size_t size;
+	unsigned threads;
+};
+
+struct Result
+{
+	double p50;
+	double p99;
+	double p999;
+	double mean;
+	double rate;
+};
+
+const char * MacroName(macro_t macro)
+{
+	static const char * names[] = {"QL_DEBUG", "QL_NOTE", "QL_WARN", "QL_ERROR", "QL_INFO", "QL_NOTEF"};
+	return names[macro];
+}
+
+const char * SinkName(sink_t sink)
+{
+	static const char * names[] = {"disabled", "null", "devnull", "2sinks", "8sinks"};
+	return names[sink];
+}
+
+std::string TraceName(int flags)
+{
+	if (flags == 0)
+		return "none";
+
+	std::string result;
+	const char * names[] = {"FILE", "LINE", "FUNCTION", "DATE", "MSEC", "USEC", "NSEC", "UTC", "ISO8601"};
+	for (int i = 0; i < 9; i++)
+		if (flags & (1 << i)) {
+			if (!result.empty())
+				result += '|';
+			result += names[i];
+		}
+	return result;
+}
+
+void Log(macro_t macro, const std::string & message)
+{
+	switch (macro) {
+		case DEBUG_MACRO:
+			QL_DEBUG(message);
+			break;
+		case NOTE_MACRO:
+			QL_NOTE(message);
+			break;
+		case WARN_MACRO:
+			QL_WARN(message);
+			break;
+		case ERROR_MACRO:
+			QL_ERROR(message);
+			break;
+		case NOTEF_MACRO:
+			QL_NOTEF("{}", message);
+			break;
+		default:
+			QL_INFO(message);
+	}
+}
+
+double TimerOverhead()
+{
+	double best = 1e9;
+	for (int i = 0; i < 1000; i++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		best = std::min(best, std::chrono::duration<double, std::nano>(end - start).count());
+	}
+	return best;
+}
+
+Result Run(const Config & config, unsigned messages, double overhead)
+{
+	ql::Log & log = ql::Log::Instance();
+	std::vector<NullBuf> nullBufs(8);
+	std::ofstream devNull;
+	std::size_t sinks = 0;
+	switch (config.sink) {
+		case NULL_SINK:
+			sinks = 1;
+			break;
+		case SINKS_2:
+			sinks = 2;
+			break;
+		case SINKS_8:
+			sinks = 8;
+			break;
+		case DEVNULL_SINK:
+			devNull.open("/dev/null");
+			log.combinedStream().attachStream(devNull);
+			break;
+		default:
+			break;
+	}
+	for (std::size_t i = 0; i < sinks; i++)
+		log.combinedStream().attachBuffer(& nullBufs[i]);
+	log.setTraceFlags(config.traceFlags);
+	log.infoStream().setTraceFlags(config.traceFlags);
+
+	std::string message(config.size, 'x');
+	std::vector<std::vector<double> > latencies(config.threads);
+	std::vector<std::thread> workers;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned t = 0; t < config.threads; t++)
+		workers.push_back(std::thread([t, messages, overhead, & config, & message, & latencies]() {
+			std::vector<double> & samples = latencies[t];
+			samples.reserve(messages);
+			for (unsigned i = 0; i < messages; i++) {
+				std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+				Log(config.macro, message);
+				std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+				samples.push_back(std::max(0.0, std::chrono::duration<double, std::nano>(end - begin).count() - overhead));
+			}
+		}));
+	for (std::size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	for (std::size_t i = 0; i < sinks; i++)
+		log.combinedStream().detachBuffer(& nullBufs[i]);
+	if (config.sink == DEVNULL_SINK)
+		log.combinedStream().detachStream(devNull);
+
+	std::vector<double> all;
+	for (std::size_t t = 0; t < latencies.size(); t++)
+		all.insert(all.end(), latencies[t].begin(), latencies[t].end());
+	std::sort(all.begin(), all.end());
+	double sum = 0.0;
+	for (std::size_t i = 0; i < all.size(); i++)
+		sum += all[i];
+
+	Result result;
+	result.p50 = all[all.size() / 2];
+	result.p99 = all[all.size() * 99 / 100];
+	result.p999 = all[all.size() * 999 / 1000];
+	result.mean = sum / static_cast<double>(all.size());
+	result.rate = static_cast<double>(all.size()) / elapsed.count();
+	return result;
+}
+
+void Print(format_t format, const Config & config, const Result & result, bool first)
+{
+	std::string trace = TraceName(config.traceFlags);
+	switch (format) {
+		case CSV_FORMAT:
+			if (first)
+				std::printf("axis,macro,sink,trace,size,threads,p50_ns,p99_ns,p999_ns,mean_ns,messages_per_s\n");
+			std::printf("%s,%s,%s,%s,%lu,%u,%.1f,%.1f,%.1f,%.1f,%.0f\n", config.axis, MacroName(config.macro), SinkName(config.sink), trace.c_str(),
+					static_cast<unsigned long>(config.size), config.threads, result.p50, result.p99, result.p999, result.mean, result.rate);
+			break;
+		case JSON_FORMAT:
+			std::printf("%s\n  {\"axis\": \"%s\", \"macro\": \"%s\", \"sink\": \"%s\", \"trace\": \"%s\", \"size\": %lu, \"threads\": %u, "
+					"\"p50_ns\": %.1f, \"p99_ns\": %.1f, \"p999_ns\": %.1f, \"mean_ns\": %.1f, \"messages_per_s\": %.0f}",
+					first ? "[" : ",", config.axis, MacroName(config.macro), SinkName(config.sink), trace.c_str(),
+					static_cast<unsigned long>(config.size), config.threads, result.p50, result.p99, result.p999, result.mean, result.rate);
+			break;
+		default:
+			if (first)
+				std::printf("%-8s %-9s %-9s %-28s %5s %7s %9s %9s %9s %9s %14s\n", "axis", "macro", "sink", "trace", "size", "threads", "p50 ns", "p99 ns", "p99.9 ns", "mean ns", "messages/s");
+			std::printf("%-8s %-9s %-9s %-28s %5lu %7u %9.1f %9.1f %9.1f %9.1f %14.0f\n", config.axis, MacroName(config.macro), SinkName(config.sink), trace.c_str(),
+					static_cast<unsigned long>(config.size), config.threads, result.p50, result.p99, result.p999, result.mean, result.rate);
+	}
+	std::fflush(stdout);
+}
+
+int main(int argc, char * argv[])
+{
+	format_t format = TABLE_FORMAT;
+	unsigned messages = 100000;
+	for (int i = 1; i < argc; i++)
+		if (std::strcmp(argv[i], "--csv") == 0)
+			format = CSV_FORMAT;
+		else if (std::strcmp(argv[i], "--json") == 0)
+			format = JSON_FORMAT;
+		else
+			messages = static_cast<unsigned>(std::atoi(argv[i]));
+
+	const int defaultTrace = ql::Trace::FILE | ql::Trace::LINE | ql::Trace::FUNCTION;
+	const Config baseline = {"baseline", NOTE_MACRO, NULL_SINK, defaultTrace, 32, 1};
+	std::vector<Config> configs;
+	configs.push_back(baseline);
+
+	macro_t macros[] = {DEBUG_MACRO, WARN_MACRO, ERROR_MACRO, INFO_MACRO, NOTEF_MACRO};
+	for (std::size_t i = 0; i < sizeof(macros) / sizeof(macros[0]); i++) {
+		Config config = baseline;
+		config.axis = "macro";
+		config.macro = macros[i];
+		configs.push_back(config);
+	}
+
+	sink_t sinks[] = {DISABLED_SINK, DEVNULL_SINK, SINKS_2, SINKS_8};
+	for (std::size_t i = 0; i < sizeof(sinks) / sizeof(sinks[0]); i++) {
+		Config config = baseline;
+		config.axis = "sink";
+		config.sink = sinks[i];
+		configs.push_back(config);
+	}
+
+	int traces[] = {0, ql::Trace::FILE | ql::Trace::LINE, ql::Trace::DATE, ql::Trace::DATE | ql::Trace::MSEC, ql::Trace::DATE | ql::Trace::USEC | ql::Trace::UTC | ql::Trace::ISO8601, defaultTrace | ql::Trace::DATE | ql::Trace::MSEC};
+	for (std::size_t i = 0; i < sizeof(traces) / sizeof(traces[0]); i++) {
+		Config config = baseline;
+		config.axis = "trace";
+		config.traceFlags = traces[i];
+		configs.push_back(config);
+	}
+
+	std::size_t sizes[] = {0, 128, 1024, 8192};
+	for (std::size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		Config config = baseline;
+		config.axis = "size";
+		config.size = sizes[i];
+		configs.push_back(config);
+	}
+
+	unsigned threads[] = {2, 4, 8};
+	for (std::size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+		Config config = baseline;
+		config.axis = "threads";
+		config.threads = threads[i];
+		configs.push_back(config);
+	}
+
+	double overhead = TimerOverhead();
+	Run(baseline, messages, overhead);	// Warm up.
+	for (std::size_t i = 0; i < configs.size(); i++)
+		Print(format, configs[i], Run(configs[i], messages, overhead), i == 0);
+	if (format == JSON_FORMAT)
+		std::printf("\n]\n");
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,228 @@
+/**
+ * @file
+ * @brief Multithreaded throughput benchmark.
+ *
+ * Several threads issue QL_NOTE records concurrently. Output is checked line by line, so
+ * that torn (interleaved) records are counted. The same is done with records written
+ * directly to note stream (stream << ... << std::endl), which are assembled in
+ * thread-local staging buffers of LogBuf rather than by Record. Results are compared
+ * against naive log buffer, which simply wraps each streambuf call with a mutex.
+ *
+ * Program exits with EXIT_FAILURE if any record written through QL has been torn or lost,
+ * so it can be used as a stress test (make check).
+ *
+ * Usage: threads [threads] [records per thread]
+ */
+
+#define QL_LOG_INIT_FUNC ql_logInitFuncNone
+
+#include "../include/ql.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Sink, which validates received lines. Each line must have the form produced by
+ * LogRecord(): "Note: t<thread> r<record> <payload>" followed by optional trace.
+ */
+class CheckingBuf: public std::streambuf
+{
+	public:
+		CheckingBuf():
+		    m_lines(0),
+		    m_torn(0)
+		{
+		}
+
+		unsigned long lines() const
+		{
+			return m_lines;
+		}
+
+		unsigned long torn() const
+		{
+			return m_torn;
+		}
+
+	protected:
+		virtual int_type overflow(int_type c)
+		{
+			if (!traits_type::eq_int_type(c, traits_type::eof()))
+				put(traits_type::to_char_type(c));
+			return traits_type::not_eof(c);
+		}
+
+		virtual std::streamsize xsputn(const char_type * s, std::streamsize n)
+		{
+			for (std::streamsize i = 0; i < n; i++)
+				put(s[i]);
+			return n;
+		}
+
+	private:
+		void put(char c)
+		{
+			if (c != '\n') {
+				m_line.push_back(c);
+				return;
+			}
+			m_lines++;
+			if (!valid(m_line))
+				m_torn++;
+			m_line.clear();
+		}
+
+		static bool valid(const std::string & line)
+		{
+			unsigned t, r;
+			int n = 0;
+			if (std::sscanf(line.c_str(), "Note: t%u r%u %n", & t, & r, & n) != 2 || n == 0)
+				return false;
+			std::string::size_type payloadEnd = line.find(' ', static_cast<std::string::size_type>(n));
+			std::string payload = line.substr(static_cast<std::string::size_type>(n), payloadEnd == std::string::npos ? std::string::npos : payloadEnd - static_cast<std::string::size_type>(n));
+			return payload == std::string(r % 64, static_cast<char>('a' + t % 26));
+		}
+
+	private:
+		std::string m_line;
+		unsigned long m_lines;
+		unsigned long m_torn;
+};
+
+/**
+ * Naive log buffer. Each call is forwarded to the target buffer under a mutex.
+ */
+class NaiveLogBuf: public std::streambuf
+{
+	public:
+		explicit NaiveLogBuf(std::streambuf * target):
+		    m_target(target)
+		{
+		}
+
+	protected:
+		virtual int sync()
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_target->pubsync();
+		}
+
+		virtual int_type overflow(int_type c)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_target->sputc(traits_type::to_char_type(c));
+		}
+
+		virtual std::streamsize xsputn(const char_type * s, std::streamsize n)
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			return m_target->sputn(s, n);
+		}
+
+	private:
+		std::mutex m_mutex;
+		std::streambuf * m_target;
+};
+
+struct Result
+{
+	double seconds;
+	unsigned long lines;
+	unsigned long torn;
+};
+
+template <typename FUNC>
+Result Run(unsigned threads, unsigned records, CheckingBuf & sink, FUNC func)
+{
+	std::vector<std::thread> workers;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned t = 0; t < threads; t++)
+		workers.push_back(std::thread([t, records, & func]() {
+			std::string payloads[64];
+			for (unsigned i = 0; i < 64; i++)
+				payloads[i] = std::string(i, static_cast<char>('a' + t % 26));
+			for (unsigned r = 0; r < records; r++)
+				func(t, r, payloads[r % 64]);
+		}));
+	for (std::size_t i = 0; i < workers.size(); i++)
+		workers[i].join();
+	std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+	Result result;
+	result.seconds = elapsed.count();
+	result.lines = sink.lines();
+	result.torn = sink.torn();
+	return result;
+}
+
+void Print(const char * name, unsigned threads, unsigned records, const Result & result)
+{
+	double total = static_cast<double>(threads) * records;
+	std::printf("%-8s threads: %2u records: %9.0f time: %8.3f s  rate: %12.0f records/s  ns/record: %8.1f  lines: %9lu  torn: %lu\n",
+			name, threads, total, result.seconds, total / result.seconds, result.seconds * 1e9 / total, result.lines, result.torn);
+}
+
+/**
+ * Check result.
+ * @return @p true if all the records have been received and none of them has been torn.
+ */
+bool Check(const char * name, unsigned threads, unsigned records, const Result & result)
+{
+	if (result.torn == 0 && result.lines == static_cast<unsigned long>(threads) * records)
+		return true;
+
+	std::fprintf(stderr, "%s: %lu torn records, %lu of %lu lines received\n", name, result.torn, result.lines, static_cast<unsigned long>(threads) * records);
+	return false;
+}
+
+int main(int argc, char * argv[])
+{
+	unsigned threads = argc > 1 ? static_cast<unsigned>(std::atoi(argv[1])) : 4;
+	unsigned records = argc > 2 ? static_cast<unsigned>(std::atoi(argv[2])) : 100000;
+	bool ok = true;
+
+	{
+		CheckingBuf sink;
+		ql::Log::Instance().combinedStream().attachBuffer(& sink);
+		ql::Log::Instance().setTraceFlags(0);
+		Result result = Run(threads, records, sink, [](unsigned t, unsigned r, const std::string & payload) {
+			QL_NOTE("t" << t << " r" << r << " " << payload);
+		});
+		ql::Log::Instance().combinedStream().detachBuffer(& sink);
+		Print("ql", threads, records, result);
+		ok &= Check("ql", threads, records, result);
+	}
+
+	{
+		CheckingBuf sink;
+		ql::LogStream & stream = ql::Log::Instance().noteStream();
+		ql::Log::Instance().combinedStream().attachBuffer(& sink);
+		Result result = Run(threads, records, sink, [& stream](unsigned t, unsigned r, const std::string & payload) {
+			// State of std::ostream (width, iostate) must not be shared by threads, so each
+			// of them writes through its own stream to the same LogBuf.
+			static thread_local std::ostream out(stream.rdbuf());
+			out << "Note: " << "t" << t << " r" << r << " " << payload << std::endl;
+		});
+		ql::Log::Instance().combinedStream().detachBuffer(& sink);
+		Print("stream", threads, records, result);
+		ok &= Check("stream", threads, records, result);
+	}
+
+	{
+		CheckingBuf sink;
+		NaiveLogBuf naiveBuf(& sink);
+		Result result = Run(threads, records, sink, [& naiveBuf](unsigned t, unsigned r, const std::string & payload) {
+			static thread_local std::ostream naive(& naiveBuf);
+			naive << "Note: " << "t" << t << " r" << r << " " << payload << std::endl;
+		});
+		Print("naive", threads, records, result);
+	}
+
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
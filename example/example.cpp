@@ -11,8 +11,8 @@
 //#define QL_NO_INFO 	///< Turns off QL_INFO macro.
 //#define QL_NO_FATAL 	///< Turns off QL_FATAL macro.
 //#define QL_NO_LOG	///< Turns off QL_DEBUG, QL_NOTE and QL_WARN macros.
-
-#define QL_NO_STD_PUT_TIME	// Define if C++11 std::put_time is not available.
+//#define QL_MIN_LEVEL QL_LEVEL_WARN	///< Turns off macros of levels lower than QL_LEVEL_WARN.
+//#define QL_LOG_EXPLICIT_INIT	///< Log is created by ql::Log::Init() instead of on first use.
 
 #include "../include/ql.hpp"
 
@@ -20,6 +20,9 @@
 
 int main(int, char * [])
 {
+	// Create the log at startup, so that first record does not pay for its construction.
+	ql::Log::Init();
+
 	// Configure release mode logging style with date instead of file, line, function.
 #ifndef EXAMPLE_DEBUG
 	ql::Log::Instance().setTraceFlags(ql::Trace::DATE);
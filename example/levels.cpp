@@ -0,0 +1,48 @@
+/**
+ * @file
+ * @brief Fixture of size report.
+ *
+ * Every macro family is used at every level. Each message contains marker of its level
+ * (e.g. "qlf-debug"), so that size report can check, that markers of levels stripped by
+ * QL_MIN_LEVEL do not make it to the binary. Category "fixture.strict" has its own
+ * compile-time level (QL_LEVEL_WARN), so markers of its lower levels (e.g.
+ * "qlf-strict-debug") must never be found in optimized binary.
+ *
+ * Program is meant to be compiled by "make size-report" rather than run.
+ */
+
+#include "../include/ql.hpp"
+
+QL_DECLARE_CATEGORY(fixtureCategory, "fixture")
+
+QL_DECLARE_CATEGORY_MIN_LEVEL(strictCategory, "fixture.strict", QL_LEVEL_WARN)
+
+#define FIXTURE(LEVEL, MARKER) \
+	QL_##LEVEL("qlf-" MARKER " stream " << argc); \
+	QL_##LEVEL##F("qlf-" MARKER " formatted {}", argc); \
+	QL_##LEVEL##_KV("qlf-" MARKER " kv", "argc", argc); \
+	QL_##LEVEL##_BIN("qlf-" MARKER " binary {}", argc); \
+	QL_##LEVEL##_CAT(fixtureCategory, "qlf-" MARKER " category " << argc); \
+	QL_##LEVEL##_CAT(strictCategory, "qlf-strict-" MARKER " category " << argc); \
+	QL_##LEVEL##_DEDUP("qlf-" MARKER " dedup " << argc); \
+	QL_##LEVEL##_RATE_LIMITED(10, 10, "qlf-" MARKER " rate limited " << argc); \
+	QL_##LEVEL##_EVERY_N(10, "qlf-" MARKER " every n " << argc); \
+	QL_##LEVEL##_FIRST_N(10, "qlf-" MARKER " first n " << argc); \
+	QL_##LEVEL##_SAMPLED(0.5, "qlf-" MARKER " sampled " << argc); \
+	QL_##LEVEL##_TO(ql::Log::Instance(), "qlf-" MARKER " to " << argc)
+
+int main(int argc, char * [])
+{
+	FIXTURE(DEBUG, "debug");
+	FIXTURE(NOTE, "note");
+	FIXTURE(INFO, "info");
+	FIXTURE(WARN, "warn");
+	FIXTURE(ERROR, "error");
+
+	if (argc > 1) {
+		QL_CRITICAL("qlf-critical stream " << argc);
+		QL_CRITICALF("qlf-critical formatted {}", argc);
+	}
+
+	return 0;
+}
@@ -0,0 +1,494 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_ASYNCWRITER_HPP
+#define QL_ASYNCWRITER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+
+/**
+ * Number of characters, which can be stored directly inside asynchronous queue slot.
+ * Longer records are copied to a separately allocated memory block. Together with slot
+ * header default value makes a slot four cache lines long. Other values are rounded up
+ * to cache line by slot alignment.
+ */
+#ifndef QL_ASYNC_SLOT_SIZE
+	#define QL_ASYNC_SLOT_SIZE 208
+#endif
+
+namespace ql {
+
+/**
+ * Asynchronous writer. Asynchronous writer owns bounded, lock-free, multi-producer queue
+ * of log records and a background thread, which passes queued records to their targets.
+ * Producers only copy finished record into the queue, so they do not block on I/O.
+ *
+ * Queue is implemented as a ring buffer of fixed size slots, with sequence number stored
+ * in each slot (D. Vyukov's bounded queue). What happens when the queue is full depends
+ * on overflow policy:
+ * 	- BLOCK - producer waits until writer thread frees a slot.
+ * 	- DROP_NEWEST - record that does not fit is discarded.
+ * 	- DROP_OLDEST - oldest queued record is discarded to make room for the new one.
+ * 	.
+ * Number of dropped records is available through droppedCount(). Each dropped record is
+ * also reported to its target (see Target::dropRecord()). Writer thread also reports
+ * dropped records by writing a notice to the target of the next record it writes.
+ *
+ * Slot may hold a batch of records instead of a single one. Number of records in the batch
+ * and an opaque context pointer are passed back to the target (see Target::writeRecords()),
+ * so that the target can account for the records and tell, how they should be written.
+ *
+ * Slots are aligned to cache line and position of producers, position of writer thread
+ * and the remaining members are kept in separate cache lines, so that producers and
+ * writer thread do not invalidate each other's cache lines, except the slot being passed.
+ * Because over-aligned types are not allocated with proper alignment by new expression
+ * before C++17, class provides its own allocation functions.
+ */
+class AsyncWriter
+{
+	public:
+		/**
+		 * Record target. Receives records on the writer thread.
+		 */
+		class Target
+		{
+			public:
+				/**
+				 * Write record.
+				 * @param s record characters.
+				 * @param n number of characters.
+				 */
+				virtual void writeRecord(const char * s, std::size_t n) = 0;
+
+				/**
+				 * Write batch of records. Default implementation calls writeRecord().
+				 * @param s records characters.
+				 * @param n number of characters.
+				 * @param count number of records.
+				 * @param context context pointer given to push().
+				 */
+				virtual void writeRecords(const char * s, std::size_t n, std::size_t count, const void * context);
+
+				/**
+				 * Record dropped. Called, when record of the target has been discarded due
+				 * to queue overflow - either the record being pushed (DROP_NEWEST) or the
+				 * oldest queued record (DROP_OLDEST). Function is called once for each record
+				 * of a dropped batch. Default implementation does nothing.
+				 */
+				virtual void dropRecord() {}
+
+			protected:
+				~Target() {}
+		};
+
+		enum overflowPolicy_t {
+			BLOCK,
+			DROP_NEWEST,
+			DROP_OLDEST
+		};
+
+	public:
+		/**
+		 * Constructor. Starts writer thread.
+		 * @param queueSize number of queue slots. It is rounded up to the power of two.
+		 * @param policy overflow policy.
+		 */
+		explicit AsyncWriter(std::size_t queueSize = 8192, overflowPolicy_t policy = BLOCK);
+
+		/**
+		 * Destructor. Writes all queued records and stops writer thread.
+		 */
+		~AsyncWriter();
+
+		/**
+		 * Push record into the queue.
+		 * @param target record target.
+		 * @param s record characters.
+		 * @param n number of characters.
+		 * @param count number of records, if @a s contains batch of records.
+		 * @param context context pointer passed to Target::writeRecords().
+		 * @return @p true if record has been queued, @p false if it has been dropped.
+		 */
+		bool push(Target * target, const char * s, std::size_t n, std::size_t count = 1, const void * context = nullptr);
+
+		/**
+		 * Drain the queue. Blocks until all the records queued before the call are passed
+		 * to their targets.
+		 */
+		void drain();
+
+		/**
+		 * Get queue size.
+		 * @return number of queue slots.
+		 */
+		std::size_t queueSize() const;
+
+		/**
+		 * Get overflow policy.
+		 * @return overflow policy.
+		 */
+		overflowPolicy_t overflowPolicy() const;
+
+		/**
+		 * Get number of dropped records.
+		 * @return number of records dropped since writer has been created.
+		 */
+		std::size_t droppedCount() const;
+
+		/**
+		 * Check whether function is called from any asynchronous writer thread.
+		 * @return @p true if calling thread is writer thread, @p false otherwise.
+		 */
+		static bool IsWriterThread();
+
+		static void * operator new(std::size_t size);
+
+		static void operator delete(void * ptr);
+
+	private:
+		static const std::size_t CACHE_LINE_SIZE = 64;
+
+		struct alignas(CACHE_LINE_SIZE) Slot
+		{
+			std::atomic<std::size_t> seq;
+			Target * target;
+			std::size_t size;
+			std::size_t count;
+			const void * context;
+			char * heap;
+			char data[QL_ASYNC_SLOT_SIZE];
+		};
+
+	private:
+		AsyncWriter(const AsyncWriter & other);	// = delete
+
+		AsyncWriter & operator =(const AsyncWriter & other); // = delete
+
+		static bool & WriterThreadFlag();
+
+		static std::size_t RoundUpPowerOfTwo(std::size_t n);
+
+		/**
+		 * Allocate memory aligned to cache line.
+		 * @param size number of bytes.
+		 * @return allocated memory, which must be released by FreeAligned().
+		 */
+		static void * AllocateAligned(std::size_t size);
+
+		static void FreeAligned(void * ptr);
+
+		/**
+		 * Report dropped records to their target.
+		 * @param target target of the records.
+		 * @param count number of records.
+		 */
+		static void Drop(Target * target, std::size_t count);
+
+		bool tryPush(Target * target, const char * s, std::size_t n, std::size_t count, const void * context);
+
+		Slot * tryPop(std::size_t & pos);
+
+		void release(Slot * slot, std::size_t pos);
+
+		void wake();
+
+		void run();
+
+	private:
+		Slot * m_slots;
+		std::size_t m_mask;
+		overflowPolicy_t m_policy;
+		std::atomic<bool> m_sleeping;
+		std::atomic<bool> m_stop;
+		alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_enqueuePos;	///< Written by producers.
+		std::atomic<std::size_t> m_dropped;
+		alignas(CACHE_LINE_SIZE) std::atomic<std::size_t> m_dequeuePos;	///< Written by writer thread.
+		std::atomic<std::size_t> m_completed;
+		std::size_t m_reported;
+		alignas(CACHE_LINE_SIZE) std::mutex m_mutex;
+		std::condition_variable m_cond;
+		std::thread m_thread;
+};
+
+
+inline
+AsyncWriter::AsyncWriter(std::size_t queueSize, overflowPolicy_t policy):
+    m_slots(0),
+    m_mask(RoundUpPowerOfTwo(queueSize) - 1),
+    m_policy(policy),
+    m_sleeping(false),
+    m_stop(false),
+    m_enqueuePos(0),
+    m_dropped(0),
+    m_dequeuePos(0),
+    m_completed(0),
+    m_reported(0)
+{
+	m_slots = static_cast<Slot *>(AllocateAligned(sizeof(Slot) * (m_mask + 1)));
+	for (std::size_t i = 0; i <= m_mask; i++) {
+		new (& m_slots[i]) Slot;
+		m_slots[i].seq.store(i, std::memory_order_relaxed);
+	}
+	m_thread = std::thread(& AsyncWriter::run, this);
+}
+
+inline
+AsyncWriter::~AsyncWriter()
+{
+	m_stop.store(true);
+	wake();
+	m_thread.join();
+	FreeAligned(m_slots);
+}
+
+inline
+void AsyncWriter::Target::writeRecords(const char * s, std::size_t n, std::size_t , const void * )
+{
+	writeRecord(s, n);
+}
+
+inline
+bool AsyncWriter::push(Target * target, const char * s, std::size_t n, std::size_t count, const void * context)
+{
+	unsigned spins = 0;
+	while (!tryPush(target, s, n, count, context)) {
+		switch (m_policy) {
+			case DROP_NEWEST:
+				Drop(target, count);
+				m_dropped.fetch_add(count, std::memory_order_relaxed);
+				return false;
+			case DROP_OLDEST: {
+				std::size_t pos;
+				if (Slot * slot = tryPop(pos)) {
+					Drop(slot->target, slot->count);
+					m_dropped.fetch_add(slot->count, std::memory_order_relaxed);
+					release(slot, pos);
+				}
+				break;
+			}
+			default:
+				// Writer may be sleeping only if the queue has been empty a moment ago, but let's not rely on it.
+				wake();
+				if (++spins < 64)
+					std::this_thread::yield();
+				else
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+		}
+	}
+
+	// Pairs with the fence in run(); either writer sees the record or producer sees the sleeping flag.
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (m_sleeping.load(std::memory_order_relaxed))
+		wake();
+	return true;
+}
+
+inline
+void AsyncWriter::drain()
+{
+	if (IsWriterThread())
+		return;
+
+	std::size_t pos = m_enqueuePos.load();
+	unsigned spins = 0;
+	while (m_completed.load(std::memory_order_acquire) < pos) {
+		wake();
+		if (++spins < 64)
+			std::this_thread::yield();
+		else
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+}
+
+inline
+std::size_t AsyncWriter::queueSize() const
+{
+	return m_mask + 1;
+}
+
+inline
+AsyncWriter::overflowPolicy_t AsyncWriter::overflowPolicy() const
+{
+	return m_policy;
+}
+
+inline
+std::size_t AsyncWriter::droppedCount() const
+{
+	return m_dropped.load(std::memory_order_relaxed);
+}
+
+inline
+bool AsyncWriter::IsWriterThread()
+{
+	return WriterThreadFlag();
+}
+
+inline
+void * AsyncWriter::operator new(std::size_t size)
+{
+	return AllocateAligned(size);
+}
+
+inline
+void AsyncWriter::operator delete(void * ptr)
+{
+	FreeAligned(ptr);
+}
+
+inline
+bool & AsyncWriter::WriterThreadFlag()
+{
+	static thread_local bool flag = false;
+	return flag;
+}
+
+inline
+std::size_t AsyncWriter::RoundUpPowerOfTwo(std::size_t n)
+{
+	std::size_t result = 2;
+	while (result < n)
+		result <<= 1;
+	return result;
+}
+
+inline
+void * AsyncWriter::AllocateAligned(std::size_t size)
+{
+	// Pointer to the allocated block is stored right before the aligned memory.
+	char * block = static_cast<char *>(::operator new(size + sizeof(void *) + CACHE_LINE_SIZE - 1));
+	std::uintptr_t aligned = (reinterpret_cast<std::uintptr_t>(block) + sizeof(void *) + CACHE_LINE_SIZE - 1) & ~static_cast<std::uintptr_t>(CACHE_LINE_SIZE - 1);
+	reinterpret_cast<void **>(aligned)[-1] = block;
+	return reinterpret_cast<void *>(aligned);
+}
+
+inline
+void AsyncWriter::FreeAligned(void * ptr)
+{
+	if (ptr != nullptr)
+		::operator delete(static_cast<void **>(ptr)[-1]);
+}
+
+inline
+void AsyncWriter::Drop(Target * target, std::size_t count)
+{
+	for (std::size_t i = 0; i < count; i++)
+		target->dropRecord();
+}
+
+inline
+bool AsyncWriter::tryPush(Target * target, const char * s, std::size_t n, std::size_t count, const void * context)
+{
+	Slot * slot;
+	std::size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+	for (;;) {
+		slot = & m_slots[pos & m_mask];
+		std::size_t seq = slot->seq.load(std::memory_order_acquire);
+		if (seq == pos) {
+			if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				break;
+		} else if (seq < pos)
+			return false;	// Queue is full.
+		else
+			pos = m_enqueuePos.load(std::memory_order_relaxed);
+	}
+
+	slot->target = target;
+	slot->size = n;
+	slot->count = count;
+	slot->context = context;
+	if (n <= sizeof(slot->data)) {
+		slot->heap = 0;
+		std::memcpy(slot->data, s, n);
+	} else {
+		slot->heap = new char[n];
+		std::memcpy(slot->heap, s, n);
+	}
+	slot->seq.store(pos + 1, std::memory_order_release);
+	return true;
+}
+
+inline
+AsyncWriter::Slot * AsyncWriter::tryPop(std::size_t & pos)
+{
+	Slot * slot;
+	pos = m_dequeuePos.load(std::memory_order_relaxed);
+	for (;;) {
+		slot = & m_slots[pos & m_mask];
+		std::size_t seq = slot->seq.load(std::memory_order_acquire);
+		if (seq == pos + 1) {
+			if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				return slot;
+		} else if (seq < pos + 1)
+			return 0;	// Queue is empty.
+		else
+			pos = m_dequeuePos.load(std::memory_order_relaxed);
+	}
+}
+
+inline
+void AsyncWriter::release(Slot * slot, std::size_t pos)
+{
+	delete[] slot->heap;
+	slot->heap = 0;
+	slot->seq.store(pos + m_mask + 1, std::memory_order_release);
+	m_completed.fetch_add(1, std::memory_order_release);
+}
+
+inline
+void AsyncWriter::wake()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cond.notify_one();
+}
+
+inline
+void AsyncWriter::run()
+{
+	WriterThreadFlag() = true;
+	for (;;) {
+		std::size_t pos;
+		if (Slot * slot = tryPop(pos)) {
+			std::size_t dropped = m_dropped.load(std::memory_order_relaxed);
+			if (dropped != m_reported) {
+				char notice[96];
+				int len = std::snprintf(notice, sizeof(notice), "QL: %lu log records dropped due to asynchronous queue overflow.\n", static_cast<unsigned long>(dropped - m_reported));
+				slot->target->writeRecord(notice, static_cast<std::size_t>(len));
+				m_reported = dropped;
+			}
+			slot->target->writeRecords(slot->heap ? slot->heap : slot->data, slot->size, slot->count, slot->context);
+			release(slot, pos);
+			continue;
+		}
+
+		if (m_stop.load())
+			break;
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_sleeping.store(true, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (m_dequeuePos.load(std::memory_order_relaxed) == m_enqueuePos.load(std::memory_order_relaxed) && !m_stop.load())
+			m_cond.wait_for(lock, std::chrono::milliseconds(10));
+		m_sleeping.store(false, std::memory_order_relaxed);
+	}
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
@@ -0,0 +1,927 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_BINARYLOG_HPP
+#define QL_BINARYLOG_HPP
+
+#include "AsyncWriter.hpp"
+#include "CallSite.hpp"
+#include "Formatter.hpp"
+#include "Level.hpp"
+#include "Log.hpp"
+#include "TimeStamp.hpp"
+#include "Trace.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Maximal size of encoded binary record. String arguments, which do not fit, are truncated.
+ * By default it is equal to QL_ASYNC_SLOT_SIZE, so that records are stored directly in
+ * slots of asynchronous writer queue. Larger records are copied to separately allocated
+ * memory blocks.
+ */
+#ifndef QL_BINARY_RECORD_SIZE
+	#define QL_BINARY_RECORD_SIZE QL_ASYNC_SLOT_SIZE
+#endif
+
+namespace ql {
+
+/**
+ * Binary log. Binary log is meant for the hottest paths, where even formatting of the
+ * message is too expensive. Macro call (see QL_DEBUG_BIN) only copies call site ID, raw
+ * time stamp and raw bytes of the arguments into a record, which is passed to the queue
+ * of asynchronous writer. Call sites are described by CallSite objects; format string,
+ * function name and argument signature are static strings, thus records carry only their
+ * addresses. Message is rendered on writer thread or offline:
+ * 	- text mode - records are rendered on writer thread and written to Log streams
+ * 	corresponding to levels of the call sites. Trace flags of the streams are respected,
+ * 	but the date is taken from the record time stamp.
+ * 	- file mode - records are written to binary file, together with dictionary of call
+ * 	sites (level, format string, file, line, function and argument signature). Each call
+ * 	site is described once, before its first record. File can be rendered by ql-decode
+ * 	tool or Decode() function.
+ * 	.
+ * Binary log is used by macros after it has been activated with SetActive(). QL_CRITICAL and
+ * QL_FATAL macros flush active binary log (see FlushActive()) before the program is
+ * terminated.
+ *
+ * Binary file starts with 16 byte header ("QLBINLOG" magic, 32 bit version and 32 bit byte
+ * order mark) followed by entries. Each entry starts with kind character:
+ * 	- 'S' - call site: 32 bit ID, 32 bit level, 32 bit line and four strings (format, file,
+ * 	function, signature). Strings are stored as 32 bit length followed by characters.
+ * 	- 'R' - record: 32 bit call site ID, 64 bit time stamp (nanoseconds since epoch),
+ * 	32 bit size and encoded arguments.
+ * 	- 'N' - notice: string (e.g. notice about dropped records).
+ * 	.
+ * Integers are stored in native byte order. Arguments are encoded according to signature
+ * codes: 'i', 'u' - 64 bit signed and unsigned integer, 'd' - double, 'f' - float,
+ * 'b' - 8 bit boolean, 'c' - character, 'p' - 64 bit pointer value, 's' - string. Long
+ * double arguments are stored as double. Float arguments are kept in single precision,
+ * so that they are rendered with the shortest digits of float. Files of version 1 have
+ * no 'f' code and they are still decoded.
+ */
+class BinaryLog:
+	private AsyncWriter::Target
+{
+	public:
+		static const std::uint32_t VERSION = 2;	///< Version of binary file format.
+
+		static const std::uint32_t BYTE_ORDER_MARK = 0x01020304;	///< Byte order mark of binary file.
+
+		/**
+		 * Constructor. Creates binary log in text mode.
+		 * @param queueSize number of queue slots.
+		 * @param policy overflow policy of the queue.
+		 */
+		explicit BinaryLog(std::size_t queueSize = 8192, AsyncWriter::overflowPolicy_t policy = AsyncWriter::BLOCK);
+
+		/**
+		 * Constructor. Creates binary log in file mode.
+		 * @param fileName name of the file. File is truncated.
+		 * @param queueSize number of queue slots.
+		 * @param policy overflow policy of the queue.
+		 */
+		explicit BinaryLog(const char * fileName, std::size_t queueSize = 8192, AsyncWriter::overflowPolicy_t policy = AsyncWriter::BLOCK);
+
+		/**
+		 * Destructor. Deactivates the log, if it is active, and writes all queued records.
+		 */
+		~BinaryLog();
+
+		/**
+		 * Get active binary log.
+		 * @return active binary log or @p nullptr if none is active.
+		 */
+		static BinaryLog * Active();
+
+		/**
+		 * Set active binary log. Active binary log is used by macros.
+		 * @param log binary log. Use @p nullptr to deactivate binary logging.
+		 */
+		static void SetActive(BinaryLog * log);
+
+		/**
+		 * Flush active binary log. Function does nothing if no binary log is active.
+		 *
+		 * @see flush().
+		 */
+		static void FlushActive();
+
+		/**
+		 * Check whether records of given level are accepted by active binary log.
+		 * @param level one of QL_LEVEL_* values.
+		 * @return @p true if there is active binary log and level is not below its
+		 * threshold.
+		 */
+		static bool Enabled(int level);
+
+		/**
+		 * Write record to active binary log.
+		 * @param site call site.
+		 * @param function function name.
+		 * @param format format string. It must be a string literal, because only its
+		 * address is recorded.
+		 * @param args arguments.
+		 */
+		template <typename... ARGS>
+		static void Write(const CallSite & site, const char * function, const char * format, const ARGS & ... args);
+
+		/**
+		 * Decode binary file.
+		 * @param in input file.
+		 * @param out output file.
+		 * @param traceFlags trace flags used to render records.
+		 * @return @p true on success, @p false if input is not a binary log or it is
+		 * corrupted.
+		 */
+		static bool Decode(std::FILE * in, std::FILE * out, int traceFlags);
+
+		/**
+		 * Check whether log is open.
+		 * @return @p true in text mode or if file has been successfully opened in file mode.
+		 */
+		bool isOpen() const;
+
+		/**
+		 * Get level threshold.
+		 * @return level threshold.
+		 */
+		int level() const;
+
+		/**
+		 * Set level threshold. Records below the threshold are not written.
+		 * @param level one of QL_LEVEL_* values.
+		 */
+		void setLevel(int level);
+
+		/**
+		 * Write record.
+		 * @param site call site.
+		 * @param function function name.
+		 * @param format format string. It must be a string literal, because only its
+		 * address is recorded.
+		 * @param args arguments.
+		 */
+		template <typename... ARGS>
+		void write(const CallSite & site, const char * function, const char * format, const ARGS & ... args);
+
+		/**
+		 * Flush. Blocks until queued records are written and flushes the file.
+		 */
+		void flush();
+
+		/**
+		 * Get number of dropped records.
+		 * @return number of records dropped due to queue overflow.
+		 */
+		std::size_t droppedCount() const;
+
+	private:
+		static const char RECORD = '\0';
+
+		/**
+		 * Record header: kind, addresses of call site, format string, function name and
+		 * argument signature and time stamp.
+		 */
+		static const std::size_t HEADER_SIZE = 1 + sizeof(const CallSite *) + 3 * sizeof(const char *) + sizeof(std::int64_t);
+
+		class Encoder
+		{
+			public:
+				/**
+				 * Constructor.
+				 * @param buffer output buffer.
+				 * @param stringBudget number of characters available for strings.
+				 */
+				Encoder(char * buffer, std::size_t stringBudget);
+
+				void put(bool b);
+
+				void put(char c);
+
+				void put(int i);
+
+				void put(long i);
+
+				void put(long long i);
+
+				void put(unsigned u);
+
+				void put(unsigned long u);
+
+				void put(unsigned long long u);
+
+				void put(float f);
+
+				void put(double d);
+
+				void put(long double d);
+
+				void put(const void * p);
+
+				void put(const char * s);
+
+				void put(const std::string & s);
+
+				void putArgs();
+
+				template <typename ARG, typename... ARGS>
+				void putArgs(const ARG & arg, const ARGS & ... args);
+
+				char * end() const;
+
+			private:
+				template <typename T>
+				void putValue(const T & value);
+
+				void putString(const char * s, std::size_t n);
+
+			private:
+				char * m_pos;
+				std::size_t m_stringBudget;
+		};
+
+		struct Site
+		{
+			int level;
+			std::size_t line;
+			const char * format;
+			const char * file;
+			const char * function;
+			const char * signature;
+		};
+
+		template <typename... ARGS>
+		struct Signature;
+
+	private:
+		BinaryLog(const BinaryLog & other);	// = delete
+
+		BinaryLog & operator =(const BinaryLog & other); // = delete
+
+		static std::atomic<BinaryLog *> & ActiveLog();
+
+		static constexpr char TypeCode(const bool *) { return 'b'; }
+		static constexpr char TypeCode(const char *) { return 'c'; }
+		static constexpr char TypeCode(const signed char *) { return 'i'; }
+		static constexpr char TypeCode(const short *) { return 'i'; }
+		static constexpr char TypeCode(const int *) { return 'i'; }
+		static constexpr char TypeCode(const long *) { return 'i'; }
+		static constexpr char TypeCode(const long long *) { return 'i'; }
+		static constexpr char TypeCode(const unsigned char *) { return 'u'; }
+		static constexpr char TypeCode(const unsigned short *) { return 'u'; }
+		static constexpr char TypeCode(const unsigned *) { return 'u'; }
+		static constexpr char TypeCode(const unsigned long *) { return 'u'; }
+		static constexpr char TypeCode(const unsigned long long *) { return 'u'; }
+		static constexpr char TypeCode(const float *) { return 'f'; }
+		static constexpr char TypeCode(const double *) { return 'd'; }
+		static constexpr char TypeCode(const long double *) { return 'd'; }
+		static constexpr char TypeCode(const char * const *) { return 's'; }
+		static constexpr char TypeCode(char * const *) { return 's'; }
+		static constexpr char TypeCode(const std::string *) { return 's'; }
+		template <std::size_t N>
+		static constexpr char TypeCode(const char (*)[N]) { return 's'; }
+		template <typename T>
+		static constexpr char TypeCode(T * const *) { return 'p'; }
+
+		/**
+		 * Get size of fixed part of encoded arguments.
+		 * @param signature argument signature.
+		 * @return number of bytes occupied by encoded arguments, excluding string characters.
+		 */
+		static constexpr std::size_t FixedSize(const char * signature);
+
+		static const char * Prefix(int level);
+
+		static LogStream & Stream(int level);
+
+		/**
+		 * Render record.
+		 * @param formatter formatter.
+		 * @param site call site.
+		 * @param timestamp time stamp.
+		 * @param args encoded arguments.
+		 * @param size size of encoded arguments.
+		 * @param traceFlags trace flags.
+		 * @return @p true on success, @p false if arguments do not match signature.
+		 */
+		static bool Render(Formatter & formatter, const Site & site, std::int64_t timestamp, const char * args, std::size_t size, int traceFlags);
+
+		static bool RenderArg(Formatter & formatter, char code, const char * & pos, const char * end);
+
+		static void RenderTrace(Formatter & formatter, const Site & site, std::int64_t timestamp, int traceFlags);
+
+		template <typename T>
+		static bool ReadValue(std::FILE * in, T & value);
+
+		static bool ReadString(std::FILE * in, std::string & s);
+
+		template <typename T>
+		void writeValue(const T & value);
+
+		void writeString(const char * s);
+
+		void writeString(const char * s, std::size_t n);
+
+		void writeSite(const Site & site, std::uint32_t id);
+
+		//AsyncWriter::Target
+		virtual void writeRecord(const char * s, std::size_t n);
+
+	private:
+		std::atomic<int> m_level;
+		bool m_toFile;
+		std::FILE * m_file;
+		std::unordered_map<const CallSite *, std::uint32_t> m_ids;	///< File IDs of call sites. Accessed only by writer thread.
+		AsyncWriter * m_writer;
+};
+
+/**
+ * Argument signature. Contains type code of each argument.
+ */
+template <typename... ARGS>
+struct BinaryLog::Signature
+{
+	static constexpr char value[sizeof...(ARGS) + 1] = {TypeCode(static_cast<const ARGS *>(nullptr))..., '\0'};
+};
+
+template <typename... ARGS>
+constexpr char BinaryLog::Signature<ARGS...>::value[sizeof...(ARGS) + 1];
+
+
+inline
+BinaryLog::BinaryLog(std::size_t queueSize, AsyncWriter::overflowPolicy_t policy):
+    m_level(QL_LEVEL_DEBUG),
+    m_toFile(false),
+    m_file(nullptr),
+    m_writer(nullptr)
+{
+	m_writer = new AsyncWriter(queueSize, policy);
+}
+
+inline
+BinaryLog::BinaryLog(const char * fileName, std::size_t queueSize, AsyncWriter::overflowPolicy_t policy):
+    m_level(QL_LEVEL_DEBUG),
+    m_toFile(true),
+    m_file(std::fopen(fileName, "wb")),
+    m_writer(nullptr)
+{
+	if (m_file != nullptr) {
+		std::setvbuf(m_file, nullptr, _IOFBF, 65536);
+		std::fwrite("QLBINLOG", 1, 8, m_file);
+		writeValue(static_cast<std::uint32_t>(VERSION));
+		writeValue(static_cast<std::uint32_t>(BYTE_ORDER_MARK));
+	}
+	m_writer = new AsyncWriter(queueSize, policy);
+}
+
+inline
+BinaryLog::~BinaryLog()
+{
+	BinaryLog * self = this;
+	ActiveLog().compare_exchange_strong(self, nullptr);
+	delete m_writer;
+	if (m_file != nullptr)
+		std::fclose(m_file);
+}
+
+inline
+BinaryLog * BinaryLog::Active()
+{
+	return ActiveLog().load(std::memory_order_acquire);
+}
+
+inline
+void BinaryLog::SetActive(BinaryLog * log)
+{
+	ActiveLog().store(log, std::memory_order_release);
+}
+
+inline
+void BinaryLog::FlushActive()
+{
+	if (BinaryLog * log = Active())
+		log->flush();
+}
+
+inline
+bool BinaryLog::Enabled(int level)
+{
+	BinaryLog * log = Active();
+	return log != nullptr && level >= log->m_level.load(std::memory_order_relaxed);
+}
+
+template <typename... ARGS>
+void BinaryLog::Write(const CallSite & site, const char * function, const char * format, const ARGS & ... args)
+{
+	if (BinaryLog * log = Active())
+		log->write(site, function, format, args...);
+}
+
+inline
+bool BinaryLog::Decode(std::FILE * in, std::FILE * out, int traceFlags)
+{
+	char magic[8];
+	std::uint32_t version;
+	std::uint32_t byteOrderMark;
+	if (std::fread(magic, 1, sizeof(magic), in) != sizeof(magic) || std::memcmp(magic, "QLBINLOG", sizeof(magic)) != 0
+			|| !ReadValue(in, version) || version == 0 || version > VERSION || !ReadValue(in, byteOrderMark) || byteOrderMark != BYTE_ORDER_MARK)
+		return false;
+
+	std::vector<Site> sites;
+	std::deque<std::string> strings;	// Deque does not move its elements, so that sites can point to them.
+	std::string args;
+	for (int kind = std::fgetc(in); kind != EOF; kind = std::fgetc(in)) {
+		switch (kind) {
+			case 'S': {
+				std::uint32_t id;
+				std::uint32_t level;
+				std::uint32_t line;
+				if (!ReadValue(in, id) || id != sites.size() || !ReadValue(in, level) || !ReadValue(in, line))
+					return false;
+				for (int i = 0; i < 4; i++) {
+					strings.push_back(std::string());
+					if (!ReadString(in, strings.back()))
+						return false;
+				}
+				Site site;
+				site.level = static_cast<int>(level);
+				site.line = line;
+				site.format = strings[strings.size() - 4].c_str();
+				site.file = strings[strings.size() - 3].c_str();
+				site.function = strings[strings.size() - 2].c_str();
+				site.signature = strings[strings.size() - 1].c_str();
+				sites.push_back(site);
+				break;
+			}
+			case 'R': {
+				std::uint32_t id;
+				std::int64_t timestamp;
+				if (!ReadValue(in, id) || id >= sites.size() || !ReadValue(in, timestamp) || !ReadString(in, args))
+					return false;
+				Formatter formatter;
+				if (!Render(formatter, sites[id], timestamp, args.data(), args.size(), traceFlags))
+					return false;
+				std::fwrite(formatter.data(), 1, formatter.size(), out);
+				break;
+			}
+			case 'N':
+				if (!ReadString(in, args))
+					return false;
+				std::fwrite(args.data(), 1, args.size(), out);
+				break;
+			default:
+				return false;
+		}
+	}
+	return true;
+}
+
+inline
+bool BinaryLog::isOpen() const
+{
+	return !m_toFile || m_file != nullptr;
+}
+
+inline
+int BinaryLog::level() const
+{
+	return m_level.load(std::memory_order_relaxed);
+}
+
+inline
+void BinaryLog::setLevel(int level)
+{
+	m_level.store(level, std::memory_order_relaxed);
+}
+
+template <typename... ARGS>
+void BinaryLog::write(const CallSite & site, const char * function, const char * format, const ARGS & ... args)
+{
+	static_assert(HEADER_SIZE + FixedSize(Signature<ARGS...>::value) <= QL_BINARY_RECORD_SIZE, "Arguments do not fit into QL_BINARY_RECORD_SIZE.");
+
+	char record[QL_BINARY_RECORD_SIZE];
+	const CallSite * id = & site;
+	const char * signature = Signature<ARGS...>::value;
+	std::int64_t timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+	char * pos = record;
+	*pos++ = RECORD;
+	std::memcpy(pos, & id, sizeof(id));
+	pos += sizeof(id);
+	std::memcpy(pos, & format, sizeof(format));
+	pos += sizeof(format);
+	std::memcpy(pos, & function, sizeof(function));
+	pos += sizeof(function);
+	std::memcpy(pos, & signature, sizeof(signature));
+	pos += sizeof(signature);
+	std::memcpy(pos, & timestamp, sizeof(timestamp));
+
+	Encoder encoder(record + HEADER_SIZE, QL_BINARY_RECORD_SIZE - HEADER_SIZE - FixedSize(Signature<ARGS...>::value));
+	encoder.putArgs(args...);
+	m_writer->push(this, record, static_cast<std::size_t>(encoder.end() - record));
+}
+
+inline
+void BinaryLog::flush()
+{
+	m_writer->drain();
+	if (m_file != nullptr)
+		std::fflush(m_file);
+}
+
+inline
+std::size_t BinaryLog::droppedCount() const
+{
+	return m_writer->droppedCount();
+}
+
+inline
+BinaryLog::Encoder::Encoder(char * buffer, std::size_t stringBudget):
+    m_pos(buffer),
+    m_stringBudget(stringBudget)
+{
+}
+
+inline
+void BinaryLog::Encoder::put(bool b)
+{
+	putValue(static_cast<std::uint8_t>(b));
+}
+
+inline
+void BinaryLog::Encoder::put(char c)
+{
+	putValue(c);
+}
+
+inline
+void BinaryLog::Encoder::put(int i)
+{
+	putValue(static_cast<std::int64_t>(i));
+}
+
+inline
+void BinaryLog::Encoder::put(long i)
+{
+	putValue(static_cast<std::int64_t>(i));
+}
+
+inline
+void BinaryLog::Encoder::put(long long i)
+{
+	putValue(static_cast<std::int64_t>(i));
+}
+
+inline
+void BinaryLog::Encoder::put(unsigned u)
+{
+	putValue(static_cast<std::uint64_t>(u));
+}
+
+inline
+void BinaryLog::Encoder::put(unsigned long u)
+{
+	putValue(static_cast<std::uint64_t>(u));
+}
+
+inline
+void BinaryLog::Encoder::put(unsigned long long u)
+{
+	putValue(static_cast<std::uint64_t>(u));
+}
+
+inline
+void BinaryLog::Encoder::put(float f)
+{
+	putValue(f);
+}
+
+inline
+void BinaryLog::Encoder::put(double d)
+{
+	putValue(d);
+}
+
+inline
+void BinaryLog::Encoder::put(long double d)
+{
+	putValue(static_cast<double>(d));
+}
+
+inline
+void BinaryLog::Encoder::put(const void * p)
+{
+	putValue(static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(p)));
+}
+
+inline
+void BinaryLog::Encoder::put(const char * s)
+{
+	if (s == nullptr)
+		putString("(null)", 6);
+	else
+		putString(s, std::strlen(s));
+}
+
+inline
+void BinaryLog::Encoder::put(const std::string & s)
+{
+	putString(s.data(), s.size());
+}
+
+inline
+void BinaryLog::Encoder::putArgs()
+{
+}
+
+template <typename ARG, typename... ARGS>
+void BinaryLog::Encoder::putArgs(const ARG & arg, const ARGS & ... args)
+{
+	put(arg);
+	putArgs(args...);
+}
+
+inline
+char * BinaryLog::Encoder::end() const
+{
+	return m_pos;
+}
+
+template <typename T>
+void BinaryLog::Encoder::putValue(const T & value)
+{
+	std::memcpy(m_pos, & value, sizeof(value));
+	m_pos += sizeof(value);
+}
+
+inline
+void BinaryLog::Encoder::putString(const char * s, std::size_t n)
+{
+	if (n > m_stringBudget)
+		n = m_stringBudget;
+	m_stringBudget -= n;
+	putValue(static_cast<std::uint32_t>(n));
+	std::memcpy(m_pos, s, n);
+	m_pos += n;
+}
+
+inline
+std::atomic<BinaryLog *> & BinaryLog::ActiveLog()
+{
+	static std::atomic<BinaryLog *> log(nullptr);
+	return log;
+}
+
+inline
+constexpr std::size_t BinaryLog::FixedSize(const char * signature)
+{
+	return *signature == '\0' ? 0
+			: (*signature == 'b' || *signature == 'c' ? 1 : *signature == 's' || *signature == 'f' ? sizeof(std::uint32_t) : 8) + FixedSize(signature + 1);
+}
+
+inline
+const char * BinaryLog::Prefix(int level)
+{
+	switch (level) {
+		case QL_LEVEL_DEBUG:
+			return "Debug message: ";
+		case QL_LEVEL_NOTE:
+			return "Note: ";
+		case QL_LEVEL_WARN:
+			return "Warning: ";
+		case QL_LEVEL_ERROR:
+			return "Error: ";
+		case QL_LEVEL_CRITICAL:
+			return "Critical error: ";
+		case QL_LEVEL_FATAL:
+			return "Fatal error: ";
+		default:
+			return "";
+	}
+}
+
+inline
+LogStream & BinaryLog::Stream(int level)
+{
+	switch (level) {
+		case QL_LEVEL_DEBUG:
+			return Log::Instance().debugStream();
+		case QL_LEVEL_NOTE:
+			return Log::Instance().noteStream();
+		case QL_LEVEL_WARN:
+			return Log::Instance().warnStream();
+		case QL_LEVEL_ERROR:
+			return Log::Instance().errorStream();
+		case QL_LEVEL_CRITICAL:
+			return Log::Instance().criticalStream();
+		case QL_LEVEL_FATAL:
+			return Log::Instance().fatalStream();
+		default:
+			return Log::Instance().infoStream();
+	}
+}
+
+inline
+bool BinaryLog::Render(Formatter & formatter, const Site & site, std::int64_t timestamp, const char * args, std::size_t size, int traceFlags)
+{
+	const char * pos = args;
+	const char * end = args + size;
+	const char * signature = site.signature;
+	formatter.put(Prefix(site.level));
+	for (const char * format = formatter.literal(site.format); format != nullptr; format = formatter.literal(format))
+		if (*signature == '\0' || !RenderArg(formatter, *signature++, pos, end))
+			return false;
+	RenderTrace(formatter, site, timestamp, traceFlags);
+	formatter.newLine();
+	return true;
+}
+
+inline
+bool BinaryLog::RenderArg(Formatter & formatter, char code, const char * & pos, const char * end)
+{
+	std::size_t size = code == 'b' || code == 'c' ? 1 : code == 's' || code == 'f' ? sizeof(std::uint32_t) : 8;
+	if (static_cast<std::size_t>(end - pos) < size)
+		return false;
+
+	switch (code) {
+		case 'b':
+			formatter.put(*pos != 0);
+			break;
+		case 'c':
+			formatter.put(*pos);
+			break;
+		case 'i': {
+			std::int64_t i;
+			std::memcpy(& i, pos, sizeof(i));
+			formatter.put(static_cast<long long>(i));
+			break;
+		}
+		case 'u': {
+			std::uint64_t u;
+			std::memcpy(& u, pos, sizeof(u));
+			formatter.put(static_cast<unsigned long long>(u));
+			break;
+		}
+		case 'd': {
+			double d;
+			std::memcpy(& d, pos, sizeof(d));
+			formatter.put(d);
+			break;
+		}
+		case 'f': {
+			float f;
+			std::memcpy(& f, pos, sizeof(f));
+			formatter.put(f);
+			break;
+		}
+		case 'p': {
+			std::uint64_t p;
+			std::memcpy(& p, pos, sizeof(p));
+			formatter.put(reinterpret_cast<const void *>(static_cast<std::uintptr_t>(p)));
+			break;
+		}
+		case 's': {
+			std::uint32_t n;
+			std::memcpy(& n, pos, sizeof(n));
+			if (static_cast<std::size_t>(end - pos) - size < n)
+				return false;
+			formatter.put(pos + size, n);
+			pos += n;
+			break;
+		}
+		default:
+			return false;
+	}
+	pos += size;
+	return true;
+}
+
+inline
+void BinaryLog::RenderTrace(Formatter & formatter, const Site & site, std::int64_t timestamp, int traceFlags)
+{
+	if (traceFlags & (Trace::FILE | Trace::LINE | Trace::FUNCTION | Trace::DATE))
+		formatter.put(Trace(traceFlags, site.file, site.line, site.function), static_cast<std::time_t>(timestamp / 1000000000), static_cast<long>(timestamp % 1000000000));
+}
+
+template <typename T>
+bool BinaryLog::ReadValue(std::FILE * in, T & value)
+{
+	return std::fread(& value, sizeof(value), 1, in) == 1;
+}
+
+inline
+bool BinaryLog::ReadString(std::FILE * in, std::string & s)
+{
+	std::uint32_t n;
+	if (!ReadValue(in, n))
+		return false;
+	s.resize(n);
+	return n == 0 || std::fread(& s[0], 1, n, in) == n;
+}
+
+template <typename T>
+void BinaryLog::writeValue(const T & value)
+{
+	std::fwrite(& value, sizeof(value), 1, m_file);
+}
+
+inline
+void BinaryLog::writeString(const char * s)
+{
+	writeString(s, s == nullptr ? 0 : std::strlen(s));
+}
+
+inline
+void BinaryLog::writeString(const char * s, std::size_t n)
+{
+	writeValue(static_cast<std::uint32_t>(n));
+	std::fwrite(s, 1, n, m_file);
+}
+
+inline
+void BinaryLog::writeSite(const Site & site, std::uint32_t id)
+{
+	std::fputc('S', m_file);
+	writeValue(id);
+	writeValue(static_cast<std::uint32_t>(site.level));
+	writeValue(static_cast<std::uint32_t>(site.line));
+	writeString(site.format);
+	writeString(site.file);
+	writeString(site.function);
+	writeString(site.signature);
+}
+
+inline
+void BinaryLog::writeRecord(const char * s, std::size_t n)
+{
+	if (n == 0 || (m_toFile && m_file == nullptr))
+		return;
+
+	if (s[0] != RECORD) {
+		// Notice from asynchronous writer.
+		if (m_toFile) {
+			std::fputc('N', m_file);
+			writeString(s, n);
+		} else
+			Log::Instance().warnStream().rdbuf()->putRecord(s, n);
+		return;
+	}
+
+	const CallSite * callSite;
+	Site site;
+	std::int64_t timestamp;
+	const char * pos = s + 1;
+	std::memcpy(& callSite, pos, sizeof(callSite));
+	pos += sizeof(callSite);
+	std::memcpy(& site.format, pos, sizeof(site.format));
+	pos += sizeof(site.format);
+	std::memcpy(& site.function, pos, sizeof(site.function));
+	pos += sizeof(site.function);
+	std::memcpy(& site.signature, pos, sizeof(site.signature));
+	pos += sizeof(site.signature);
+	std::memcpy(& timestamp, pos, sizeof(timestamp));
+	site.level = callSite->level();
+	site.line = callSite->line();
+	site.file = callSite->file();
+
+	if (m_toFile) {
+		std::unordered_map<const CallSite *, std::uint32_t>::iterator it = m_ids.find(callSite);
+		if (it == m_ids.end()) {
+			it = m_ids.insert(std::make_pair(callSite, static_cast<std::uint32_t>(m_ids.size()))).first;
+			writeSite(site, it->second);
+		}
+		std::fputc('R', m_file);
+		writeValue(it->second);
+		writeValue(timestamp);
+		writeString(s + HEADER_SIZE, n - HEADER_SIZE);
+	} else {
+		LogStream & stream = Stream(site.level);
+		if (!stream.enabled())
+			return;
+
+		Formatter formatter;
+		if (Render(formatter, site, timestamp, s + HEADER_SIZE, n - HEADER_SIZE, stream.traceFlags()))
+			stream.rdbuf()->putRecord(formatter.data(), formatter.size());
+	}
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
@@ -0,0 +1,255 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_CALLSITE_HPP
+#define QL_CALLSITE_HPP
+
+#include "Level.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+#define QL_IMPL_STRINGIFY_HELPER(X) #X
+#define QL_IMPL_STRINGIFY(X) QL_IMPL_STRINGIFY_HELPER(X)
+
+/**
+ * File name used by call site descriptors. If QL_TRACE_BASENAME is defined, directory
+ * part of __FILE__ is stripped at compile time.
+ */
+#ifdef QL_TRACE_BASENAME
+	#define QL_IMPL_FILE ::ql::CallSite::BaseName(__FILE__)
+#else
+	#define QL_IMPL_FILE __FILE__
+#endif
+
+/**
+ * Call site descriptor. Expands to a reference to static CallSite object describing the
+ * place, where macro has been expanded. Descriptor is constant-initialized, so obtaining
+ * it costs neither static initialization guard check nor any computation at run time.
+ * @param LEVEL one of QL_LEVEL_* values.
+ * @return reference to const CallSite object.
+ */
+#define QL_CALL_SITE(LEVEL) ([]() -> const ::ql::CallSite & { static ::ql::CallSite ql_callSite(LEVEL, QL_IMPL_FILE, __LINE__, QL_IMPL_STRINGIFY(__LINE__)); return ql_callSite; }())
+
+namespace ql {
+
+/**
+ * Call site. Describes static properties of the place, where log record is issued: level,
+ * file name, line number and function name. Besides that call site holds trace suffixes
+ * (e.g. " [file: main.cpp line: 12 function: main]") for each combination of Trace::FILE,
+ * Trace::LINE and Trace::FUNCTION flags. Each suffix is rendered only once, when it is
+ * requested for the first time, so that numbers are not formatted for each record.
+ *
+ * Call sites are intended to be static objects created by QL_CALL_SITE macro. Line number
+ * text is provided by the preprocessor. Function name can not be obtained in constant
+ * expression (especially within lambda), thus it is passed, when suffix is requested.
+ *
+ * Call site is also a key, which may be used by other features to keep per call site data.
+ */
+class CallSite
+{
+	public:
+		/**
+		 * Constructor.
+		 * @param level one of QL_LEVEL_* values.
+		 * @param file file name.
+		 * @param line line number.
+		 * @param lineText line number as a string.
+		 */
+		constexpr CallSite(int level, const char * file, std::size_t line, const char * lineText);
+
+		/**
+		 * Get level.
+		 * @return one of QL_LEVEL_* values.
+		 */
+		int level() const;
+
+		/**
+		 * Get file name.
+		 * @return file name.
+		 */
+		const char * file() const;
+
+		/**
+		 * Get line number.
+		 * @return line number.
+		 */
+		std::size_t line() const;
+
+		/**
+		 * Get line number text.
+		 * @return line number as a string.
+		 */
+		const char * lineText() const;
+
+		/**
+		 * Get function name.
+		 * @return function name or @p nullptr if it is not known yet.
+		 */
+		const char * function() const;
+
+		/**
+		 * Get trace suffix.
+		 * @param flags trace flags. Only Trace::FILE, Trace::LINE and Trace::FUNCTION are
+		 * taken into account.
+		 * @param function function name.
+		 * @return suffix. Suffix is an empty string if none of the flags is set or it
+		 * starts with " [" and ends with "]" otherwise.
+		 */
+		const std::string & suffix(int flags, const char * function) const;
+
+		/**
+		 * Strip directory part of the path.
+		 * @param path file path.
+		 * @return pointer to the first character of file name within @a path.
+		 */
+		static constexpr const char * BaseName(const char * path);
+
+	private:
+		enum {
+			SUFFIX_FLAGS = 7	///< Trace::FILE | Trace::LINE | Trace::FUNCTION.
+		};
+
+		struct Suffixes
+		{
+			std::atomic<const std::string *> text[SUFFIX_FLAGS + 1];
+		};
+
+	private:
+		static constexpr const char * BaseName(const char * path, const char * last);
+
+		const std::string * render(int flags) const;
+
+	private:
+		int m_level;
+		const char * m_file;
+		std::size_t m_line;
+		const char * m_lineText;
+		mutable std::atomic<const char *> m_function;
+		mutable std::atomic<Suffixes *> m_suffixes;	///< Allocated on demand and never released, so that call site remains trivially destructible.
+};
+
+
+inline
+constexpr CallSite::CallSite(int level, const char * file, std::size_t line, const char * lineText):
+    m_level(level),
+    m_file(file),
+    m_line(line),
+    m_lineText(lineText),
+    m_function(nullptr),
+    m_suffixes(nullptr)
+{
+}
+
+inline
+int CallSite::level() const
+{
+	return m_level;
+}
+
+inline
+const char * CallSite::file() const
+{
+	return m_file;
+}
+
+inline
+std::size_t CallSite::line() const
+{
+	return m_line;
+}
+
+inline
+const char * CallSite::lineText() const
+{
+	return m_lineText;
+}
+
+inline
+const char * CallSite::function() const
+{
+	return m_function.load(std::memory_order_acquire);
+}
+
+inline
+const std::string & CallSite::suffix(int flags, const char * function) const
+{
+	flags &= SUFFIX_FLAGS;
+
+	Suffixes * suffixes = m_suffixes.load(std::memory_order_acquire);
+	if (suffixes != nullptr) {
+		const std::string * text = suffixes->text[flags].load(std::memory_order_acquire);
+		if (text != nullptr)
+			return *text;
+	} else {
+		suffixes = new Suffixes();
+		Suffixes * expected = nullptr;
+		if (!m_suffixes.compare_exchange_strong(expected, suffixes, std::memory_order_acq_rel)) {
+			delete suffixes;
+			suffixes = expected;
+		}
+	}
+
+	if (m_function.load(std::memory_order_acquire) == nullptr)
+		m_function.store(function, std::memory_order_release);
+
+	const std::string * text = render(flags);
+	const std::string * expected = nullptr;
+	if (!suffixes->text[flags].compare_exchange_strong(expected, text, std::memory_order_acq_rel)) {
+		delete text;
+		text = expected;
+	}
+	return *text;
+}
+
+inline
+constexpr const char * CallSite::BaseName(const char * path)
+{
+	return BaseName(path, path);
+}
+
+inline
+constexpr const char * CallSite::BaseName(const char * path, const char * last)
+{
+	return *path == '\0' ? last : BaseName(path + 1, (*path == '/' || *path == '\\') ? path + 1 : last);
+}
+
+inline
+const std::string * CallSite::render(int flags) const
+{
+	std::string * text = new std::string;
+	if (flags == 0)
+		return text;
+
+	char sep = '[';
+	text->push_back(' ');
+	if (flags & 1) {	// Trace::FILE
+		text->push_back(sep);
+		text->append("file: ").append(m_file);
+		sep = ' ';
+	}
+	if (flags & 2) {	// Trace::LINE
+		text->push_back(sep);
+		text->append("line: ").append(m_lineText);
+		sep = ' ';
+	}
+	if (flags & 4) {	// Trace::FUNCTION
+		const char * function = m_function.load(std::memory_order_acquire);
+		text->push_back(sep);
+		text->append("function: ").append(function != nullptr ? function : "");
+	}
+	text->push_back(']');
+	return text;
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
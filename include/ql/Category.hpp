@@ -0,0 +1,428 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_CATEGORY_HPP
+#define QL_CATEGORY_HPP
+
+#include "Level.hpp"
+#include "LogStream.hpp"
+#include "Record.hpp"
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * Declare category accessor. Expands to inline function @a ID, which returns category
+ * named @a NAME. Macro can be used in a header, so that the same category is shared by
+ * several translation units. Compile-time level of the category is QL_MIN_LEVEL.
+ * @param ID name of accessor function.
+ * @param NAME dot separated category name (e.g. "storage.cache").
+ *
+ * @see ql::Category.
+ */
+#define QL_DECLARE_CATEGORY(ID, NAME) QL_DECLARE_CATEGORY_MIN_LEVEL(ID, NAME, QL_MIN_LEVEL)
+
+/**
+ * Declare category accessor with compile-time level. Category macros (e.g. QL_DEBUG_CAT)
+ * of levels below @a LEVEL are stripped - they generate neither code nor data. Stripping
+ * relies on constant folding, so it takes place only with optimization enabled. Besides
+ * accessor @a ID, macro defines constexpr function named by @a ID followed by
+ * "_qlMinLevel", which returns @a LEVEL.
+ * @param ID name of accessor function.
+ * @param NAME dot separated category name (e.g. "storage.cache").
+ * @param LEVEL one of QL_LEVEL_* values.
+ *
+ * @see ql::Category.
+ */
+#define QL_DECLARE_CATEGORY_MIN_LEVEL(ID, NAME, LEVEL) inline ::ql::Category & ID() { static ::ql::Category & ql_category = ::ql::Category::Get(NAME); return ql_category; } constexpr int ID##_qlMinLevel() { return LEVEL; }
+
+/**
+ * Compile-time level of a category.
+ * @param ID name of accessor function declared with QL_DECLARE_CATEGORY or
+ * QL_DECLARE_CATEGORY_MIN_LEVEL.
+ * @return constant expression of one of QL_LEVEL_* values.
+ */
+#define QL_IMPL_CATEGORY_MIN_LEVEL(ID) ID##_qlMinLevel()
+
+/**
+ * Category site. Expands to a reference to static Category::Site object of the place,
+ * where macro has been expanded.
+ * @return reference to Category::Site object.
+ */
+#define QL_IMPL_CATEGORY_SITE() ([]() -> ::ql::Category::Site & { static ::ql::Category::Site ql_categorySite; return ql_categorySite; }())
+
+namespace ql {
+
+/**
+ * Log category. Categories are named after modules of the program and organized in a
+ * hierarchy by dot separated names, e.g. "storage.cache" is a child of "storage", which
+ * is a child of root category (named by an empty string). Categories are created on first
+ * use and they are never destroyed, so references to them remain valid for the whole
+ * lifetime of the program.
+ *
+ * Each category has a threshold - minimal level of records, which are let through.
+ * Category, which does not have its own threshold inherits it from its parent. Threshold
+ * of root category is QL_LEVEL_DEBUG, unless set otherwise. Effective level is kept in an
+ * atomic variable of the category and it is updated for the whole subtree, whenever
+ * threshold changes. Effective level is also cached by call sites of category macros (see
+ * Site), so that checking the level of disabled record costs a single relaxed load and
+ * comparison. Level of a category complements level streams of Log - record is issued
+ * only if its category lets it through and there is a device to write it to.
+ *
+ * Each category has its own log stream, which is attached to the stream of its parent.
+ * Records of a category are put to the level stream of Log (e.g. Log::debugStream()) and
+ * to the stream of the category, so that devices attached to the stream of the category
+ * receive records of the category and all its subcategories, in addition to devices
+ * reachable from level stream. Device reachable from both streams receives the record
+ * once (see LogBuf::putRecord()). Stream of root category does not have any device
+ * attached by default.
+ *
+ * Categories are used through accessors declared with QL_DECLARE_CATEGORY and category
+ * variants of logging macros (e.g. QL_DEBUG_CAT). Accessor declared with
+ * QL_DECLARE_CATEGORY_MIN_LEVEL additionally strips macros of lower levels at compile
+ * time.
+ * @code
+ * QL_DECLARE_CATEGORY(cacheCategory, "storage.cache")
+ *
+ * ql::Category::Get("storage").setLevel(QL_LEVEL_DEBUG);
+ * QL_DEBUG_CAT(cacheCategory, "evicted " << key);
+ * @endcode
+ */
+class Category
+{
+	public:
+		/**
+		 * Category cache of a call site. Site resolves category on first use and then
+		 * keeps pointer to it together with a copy of effective level of the category.
+		 * Site is registered in the category, so that the copy is updated, whenever level
+		 * of the category changes. Site has constexpr constructor, so static sites are
+		 * constant-initialized and accessing them does not involve guard variable. Sites
+		 * are never unregistered, thus they must be static objects.
+		 */
+		class Site
+		{
+			public:
+				/**
+				 * Constructor.
+				 */
+				constexpr Site();
+
+				/**
+				 * Check whether record should be issued. Disabled level is rejected with a
+				 * single relaxed load and comparison of cached level. Otherwise category
+				 * is resolved and checked by Category::enabled().
+				 * @param level one of QL_LEVEL_* values.
+				 * @param accessor category accessor, which is called on first use.
+				 * @param levelStream level stream of Log, which is going to receive the
+				 * record.
+				 * @return @p true if record should be issued.
+				 */
+				bool enabled(int level, Category & (*accessor)(), const LogStream & levelStream);
+
+				/**
+				 * Get category.
+				 * @param accessor category accessor, which is called on first use.
+				 * @return category.
+				 */
+				Category & get(Category & (*accessor)());
+
+			private:
+				friend class Category;
+
+				Category & resolve(Category & (*accessor)());
+
+			private:
+				std::atomic<int> m_level;	///< Effective level of the category or -1 until category is resolved.
+				std::atomic<Category *> m_category;
+				Site * m_next;	///< Next site of the category. Guarded by registry mutex.
+		};
+
+	public:
+		/**
+		 * Get root category.
+		 * @return root category.
+		 */
+		static Category & Root();
+
+		/**
+		 * Get category. Category and its ancestors are created if they do not exist.
+		 * @param name dot separated category name. Empty string denotes root category.
+		 * @return category.
+		 */
+		static Category & Get(const std::string & name);
+
+		/**
+		 * Get name.
+		 * @return full, dot separated name of the category.
+		 */
+		const std::string & name() const;
+
+		/**
+		 * Get parent.
+		 * @return parent category or @p nullptr for root category.
+		 */
+		Category * parent() const;
+
+		/**
+		 * Get effective level.
+		 * @return minimal level of records, which are let through.
+		 */
+		int level() const;
+
+		/**
+		 * Get threshold.
+		 * @return threshold set for the category or -1, if threshold is inherited.
+		 */
+		int threshold() const;
+
+		/**
+		 * Set threshold. Effective levels of subcategories, which inherit threshold are
+		 * updated.
+		 * @param level minimal level of records, which are let through. One of
+		 * QL_LEVEL_* values.
+		 */
+		void setLevel(int level);
+
+		/**
+		 * Reset threshold, so that it is inherited from parent category.
+		 */
+		void resetLevel();
+
+		/**
+		 * Check whether level is enabled.
+		 * @param level one of QL_LEVEL_* values.
+		 * @return @p true if records of given level are let through.
+		 */
+		bool enabled(int level) const;
+
+		/**
+		 * Check whether record should be issued.
+		 * @param level one of QL_LEVEL_* values.
+		 * @param levelStream level stream of Log, which is going to receive the record.
+		 * @return @p true if records of given level are let through and either level
+		 * stream or stream of the category is enabled.
+		 */
+		bool enabled(int level, const LogStream & levelStream) const;
+
+		/**
+		 * Get stream. Devices attached to the stream receive records of the category and
+		 * its subcategories.
+		 * @return log stream of the category.
+		 */
+		LogStream & stream();
+
+	private:
+		struct Registry
+		{
+			std::mutex mutex;
+			std::map<std::string, Category *> categories;
+		};
+
+	private:
+		Category(const std::string & name, Category * parent);
+
+		Category(const Category & other);	// = delete
+
+		Category & operator =(const Category & other); // = delete
+
+		static Registry & Categories();
+
+		/**
+		 * Update effective level of the category and subcategories, which inherit
+		 * threshold. Registry mutex must be locked.
+		 */
+		void propagate();
+
+	private:
+		std::string m_name;
+		Category * m_parent;
+		std::vector<Category *> m_children;
+		int m_threshold;
+		std::atomic<int> m_level;
+		Site * m_sites;	///< Registered call sites. Guarded by registry mutex.
+		LogStream m_stream;
+};
+
+
+inline
+constexpr Category::Site::Site():
+    m_level(-1),
+    m_category(nullptr),
+    m_next(nullptr)
+{
+}
+
+inline
+bool Category::Site::enabled(int level, Category & (*accessor)(), const LogStream & levelStream)
+{
+	if (level < m_level.load(std::memory_order_relaxed))
+		return false;
+
+	return get(accessor).enabled(level, levelStream);
+}
+
+inline
+Category & Category::Site::get(Category & (*accessor)())
+{
+	Category * category = m_category.load(std::memory_order_acquire);
+	if (category == nullptr)
+		return resolve(accessor);
+	return *category;
+}
+
+inline QL_IMPL_COLD
+Category & Category::Site::resolve(Category & (*accessor)())
+{
+	// Accessor locks registry mutex by itself, so it is called before locking it here.
+	Category & category = accessor();
+	std::lock_guard<std::mutex> lock(Categories().mutex);
+	if (m_category.load(std::memory_order_relaxed) == nullptr) {
+		m_next = category.m_sites;
+		category.m_sites = this;
+		m_level.store(category.level(), std::memory_order_relaxed);
+		m_category.store(& category, std::memory_order_release);
+	}
+	return category;
+}
+
+inline
+Category & Category::Root()
+{
+	return Get(std::string());
+}
+
+inline
+Category & Category::Get(const std::string & name)
+{
+	Registry & registry = Categories();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+	std::map<std::string, Category *>::iterator it = registry.categories.find(name);
+	if (it != registry.categories.end())
+		return *it->second;
+
+	// Create missing ancestors from the top.
+	Category * parent = registry.categories[std::string()];
+	std::string::size_type begin = 0;
+	for (;;) {
+		std::string::size_type end = name.find('.', begin);
+		std::string path = name.substr(0, end);
+		Category *& category = registry.categories[path];
+		if (category == nullptr) {
+			category = new Category(path, parent);
+			parent->m_children.push_back(category);
+		}
+		if (end == std::string::npos)
+			return *category;
+		parent = category;
+		begin = end + 1;
+	}
+}
+
+inline
+const std::string & Category::name() const
+{
+	return m_name;
+}
+
+inline
+Category * Category::parent() const
+{
+	return m_parent;
+}
+
+inline
+int Category::level() const
+{
+	return m_level.load(std::memory_order_relaxed);
+}
+
+inline
+int Category::threshold() const
+{
+	std::lock_guard<std::mutex> lock(Categories().mutex);
+	return m_threshold;
+}
+
+inline
+void Category::setLevel(int level)
+{
+	std::lock_guard<std::mutex> lock(Categories().mutex);
+	m_threshold = level;
+	propagate();
+}
+
+inline
+void Category::resetLevel()
+{
+	std::lock_guard<std::mutex> lock(Categories().mutex);
+	m_threshold = m_parent == nullptr ? QL_LEVEL_DEBUG : -1;
+	propagate();
+}
+
+inline
+bool Category::enabled(int level) const
+{
+	return level >= m_level.load(std::memory_order_relaxed);
+}
+
+inline
+bool Category::enabled(int level, const LogStream & levelStream) const
+{
+	return enabled(level) && (levelStream.enabled() || m_stream.enabled());
+}
+
+inline
+LogStream & Category::stream()
+{
+	return m_stream;
+}
+
+inline
+Category::Category(const std::string & name, Category * parent):
+    m_name(name),
+    m_parent(parent),
+    m_threshold(parent == nullptr ? QL_LEVEL_DEBUG : -1),
+    m_level(parent == nullptr ? QL_LEVEL_DEBUG : parent->level()),
+    m_sites(nullptr)
+{
+	if (parent != nullptr)
+		m_stream.attachStream(parent->m_stream);
+}
+
+inline
+Category::Registry & Category::Categories()
+{
+	// Registry and categories are never destroyed, so that they can be used by
+	// destructors of other static objects.
+	static Registry * registry = []() {
+		Registry * result = new Registry;
+		result->categories[std::string()] = new Category(std::string(), nullptr);
+		return result;
+	}();
+	return *registry;
+}
+
+inline
+void Category::propagate()
+{
+	m_level.store(m_threshold >= 0 ? m_threshold : m_parent->level(), std::memory_order_relaxed);
+	for (Site * site = m_sites; site != nullptr; site = site->m_next)
+		site->m_level.store(m_level.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	for (std::vector<Category *>::iterator child = m_children.begin(); child != m_children.end(); ++child)
+		if ((*child)->m_threshold < 0)
+			(*child)->propagate();
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
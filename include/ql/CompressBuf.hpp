@@ -0,0 +1,823 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_COMPRESSBUF_HPP
+#define QL_COMPRESSBUF_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <time.h>
+
+#ifdef QL_HAVE_ZLIB
+	#include <zlib.h>
+#endif
+
+/**
+ * Default size of CompressBuf block in bytes. Characters are compressed in blocks of this
+ * size.
+ */
+#ifndef QL_COMPRESS_BLOCK_SIZE
+	#define QL_COMPRESS_BLOCK_SIZE (64 * 1024)
+#endif
+
+/**
+ * Number of CompressBuf blocks. One block is filled by the writer, while others wait for
+ * compression or are being compressed.
+ */
+#ifndef QL_COMPRESS_BLOCK_COUNT
+	#define QL_COMPRESS_BLOCK_COUNT 4
+#endif
+
+/**
+ * Minimal interval in milliseconds between syncs of CompressBuf, which hand over
+ * partially filled block for compression.
+ */
+#ifndef QL_COMPRESS_SYNC_INTERVAL
+	#define QL_COMPRESS_SYNC_INTERVAL 1000
+#endif
+
+namespace ql {
+
+/**
+ * Compressing buffer. Buffer compresses characters and writes them to the target buffer.
+ * Characters are collected in blocks, which are compressed by a worker thread, so that
+ * writing to the buffer costs just copying characters. When all blocks wait for
+ * compression, writer waits for the worker (such stalls are counted in statistics).
+ *
+ * Following formats are available:
+ * 	- LZ4 - LZ4 frame format with independent blocks and content checksum. Compressor
+ * 	is built into the library. Output can be decompressed with lz4 tool.
+ * 	- GZIP - gzip stream produced by zlib. Available if QL_HAVE_ZLIB macro is defined
+ * 	(program must be linked with zlib).
+ * 	.
+ *
+ * To keep compression efficient, syncing the buffer hands over partially filled block
+ * only if at least QL_COMPRESS_SYNC_INTERVAL milliseconds have passed since previous
+ * block has been handed over. Thus, when the buffer is attached to a log stream with
+ * FlushPolicy::INTERVAL, output is compressed and written to the target with bounded
+ * latency. Use flush() to compress and write everything immediately. Compressed stream is
+ * completed, when buffer is destroyed.
+ *
+ * Buffer is not thread-safe by itself. When it is attached to LogStream, writes are
+ * serialized by the log stream. Target buffer is accessed only by the worker thread.
+ *
+ * @code
+ * std::filebuf fileBuf;
+ * fileBuf.open("app.log.lz4", std::ios_base::out | std::ios_base::binary);
+ * ql::CompressBuf compressBuf(& fileBuf);
+ * ql::Log::Instance().debugStream().attachBuffer(& compressBuf);
+ * @endcode
+ */
+class CompressBuf: public std::streambuf
+{
+	public:
+		enum format_t {
+			LZ4,
+#ifdef QL_HAVE_ZLIB
+			GZIP
+#endif
+		};
+
+		struct Statistics
+		{
+			std::uint64_t inputBytes;			///< Number of characters compressed.
+			std::uint64_t outputBytes;			///< Number of bytes written to the target.
+			std::uint64_t blocks;				///< Number of compressed blocks.
+			std::uint64_t compressNanoseconds;	///< CPU time spent by the worker thread on compression.
+			std::uint64_t stalls;				///< Number of times writer had to wait for a free block.
+			std::uint64_t stallNanoseconds;		///< Time writer spent waiting for free blocks.
+			std::uint64_t errors;				///< Number of failed writes or syncs of the target.
+
+			/**
+			 * Get compression ratio.
+			 * @return ratio of input bytes to output bytes.
+			 */
+			double ratio() const;
+		};
+
+	public:
+		/**
+		 * Constructor. Starts the worker thread.
+		 * @param target target buffer, which receives compressed output.
+		 * @param format compression format.
+		 * @param blockSize block size in bytes. For LZ4 it is limited to 4 MiB.
+		 * @param level compression level (GZIP only, 1-9).
+		 */
+		explicit CompressBuf(std::streambuf * target, format_t format = LZ4, std::size_t blockSize = QL_COMPRESS_BLOCK_SIZE, int level = 6);
+
+		/**
+		 * Destructor. Compresses remaining characters, completes compressed stream, syncs
+		 * the target and stops the worker thread.
+		 */
+		virtual ~CompressBuf();
+
+		/**
+		 * Get target.
+		 * @return target buffer.
+		 */
+		std::streambuf * target() const;
+
+		/**
+		 * Get format.
+		 * @return compression format.
+		 */
+		format_t format() const;
+
+		/**
+		 * Compress characters written so far, write them to the target and sync it. Function
+		 * waits until the worker is done.
+		 * @return @p true on success, @p false if writing to the target has failed.
+		 */
+		bool flush();
+
+		/**
+		 * Get statistics.
+		 * @return snapshot of statistics.
+		 */
+		Statistics statistics() const;
+
+		/**
+		 * Get file name suffix.
+		 * @param format compression format.
+		 * @return customary file name suffix for the format (including dot).
+		 */
+		static const char * Suffix(format_t format);
+
+		/**
+		 * Compress file.
+		 * @param inFileName name of the file to be compressed.
+		 * @param outFileName name of the compressed file. Existing file is overwritten.
+		 * @param format compression format.
+		 * @return @p true on success, @p false otherwise.
+		 */
+		static bool CompressFile(const std::string & inFileName, const std::string & outFileName, format_t format = LZ4);
+
+	protected:
+		//std::streambuf
+		virtual int sync();
+
+		//std::streambuf
+		virtual int_type overflow(int_type c);
+
+		//std::streambuf
+		virtual std::streamsize xsputn(const char_type * s, std::streamsize n);
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		enum mode_t {
+			CONTINUE,	///< Compress block.
+			FLUSH,		///< Compress block, write everything to the target and sync it.
+			FINISH		///< Compress block and complete compressed stream.
+		};
+
+		struct Block
+		{
+			std::vector<char> data;
+			std::size_t size;
+			mode_t mode;
+		};
+
+		/**
+		 * XXH32 hash, used as LZ4 frame checksum.
+		 */
+		struct Checksum
+		{
+			explicit Checksum(std::uint32_t seed = 0);
+
+			void update(const char * s, std::size_t n);
+
+			std::uint32_t digest() const;
+
+			static std::uint32_t Round(std::uint32_t acc, std::uint32_t input);
+
+			static std::uint32_t Rotl(std::uint32_t x, int r);
+
+			static std::uint32_t Read32(const unsigned char * p);
+
+			std::uint32_t seed;
+			std::uint32_t v[4];
+			std::uint64_t total;
+			unsigned char mem[16];
+			std::size_t memSize;
+		};
+
+		static const std::uint32_t PRIME32_1 = 2654435761u;
+		static const std::uint32_t PRIME32_2 = 2246822519u;
+		static const std::uint32_t PRIME32_3 = 3266489917u;
+		static const std::uint32_t PRIME32_4 = 668265263u;
+		static const std::uint32_t PRIME32_5 = 374761393u;
+
+		static const std::uint32_t LZ4_MAGIC = 0x184d2204;
+		static const int LZ4_HASH_LOG = 12;
+
+		CompressBuf(const CompressBuf & other);	// = delete
+
+		CompressBuf & operator =(const CompressBuf & other); // = delete
+
+		/**
+		 * Compress LZ4 block.
+		 * @param src source characters.
+		 * @param n number of characters.
+		 * @param dst destination. Must be able to hold at least Lz4Bound(n) bytes.
+		 * @param table hash table of 2^LZ4_HASH_LOG entries.
+		 * @return size of compressed block.
+		 */
+		static std::size_t Lz4Compress(const char * src, std::size_t n, char * dst, std::uint32_t * table);
+
+		static std::size_t Lz4Bound(std::size_t n);
+
+		static char * Lz4PutLength(char * dst, std::size_t length);
+
+		static void Put32(char * dst, std::uint32_t value);
+
+		static std::uint64_t ThreadCpuTime();
+
+		/**
+		 * Hand over current block to the worker and take a free block.
+		 * @param mode compression mode.
+		 */
+		void submit(mode_t mode);
+
+		/**
+		 * Wait until the worker has processed all blocks.
+		 */
+		void wait();
+
+		void run();
+
+		void process(Block & block);
+
+		void compressLz4(const Block & block);
+
+#ifdef QL_HAVE_ZLIB
+		void compressGzip(const Block & block);
+#endif
+
+		void writeTarget(const char * s, std::size_t n);
+
+	private:
+		std::streambuf * m_target;
+		format_t m_format;
+		std::size_t m_blockSize;
+		std::vector<Block> m_blocks;
+		Block * m_current;
+		std::deque<Block *> m_queue;
+		std::deque<Block *> m_free;
+		Clock::time_point m_submittedAt;
+		std::vector<char> m_output;
+		std::vector<std::uint32_t> m_table;
+		Checksum m_checksum;
+#ifdef QL_HAVE_ZLIB
+		z_stream m_zstream;
+#endif
+		std::atomic<std::uint64_t> m_inputBytes;
+		std::atomic<std::uint64_t> m_outputBytes;
+		std::atomic<std::uint64_t> m_blockCount;
+		std::atomic<std::uint64_t> m_compressNanoseconds;
+		std::atomic<std::uint64_t> m_stalls;
+		std::atomic<std::uint64_t> m_stallNanoseconds;
+		std::atomic<std::uint64_t> m_errors;
+		bool m_stop;
+		mutable std::mutex m_mutex;
+		std::condition_variable m_cond;		///< Signals worker, that block has been queued.
+		std::condition_variable m_doneCond;	///< Signals writer, that block has been processed.
+		std::thread m_thread;
+};
+
+
+inline
+double CompressBuf::Statistics::ratio() const
+{
+	return outputBytes != 0 ? static_cast<double>(inputBytes) / static_cast<double>(outputBytes) : 0.0;
+}
+
+inline
+CompressBuf::CompressBuf(std::streambuf * target, format_t format, std::size_t blockSize, int level):
+    m_target(target),
+    m_format(format),
+    m_blockSize(blockSize != 0 ? blockSize : 1),
+    m_blocks(QL_COMPRESS_BLOCK_COUNT),
+    m_current(nullptr),
+    m_submittedAt(Clock::now()),
+    m_inputBytes(0),
+    m_outputBytes(0),
+    m_blockCount(0),
+    m_compressNanoseconds(0),
+    m_stalls(0),
+    m_stallNanoseconds(0),
+    m_errors(0),
+    m_stop(false)
+{
+	if (m_format == LZ4) {
+		// Frame descriptor: version 01, independent blocks, content checksum and maximal
+		// block size.
+		if (m_blockSize > 4 * 1024 * 1024)
+			m_blockSize = 4 * 1024 * 1024;
+		unsigned char bd = 4;
+		while ((std::size_t(1) << (8 + 2 * bd)) < m_blockSize)
+			bd++;
+		char header[7];
+		Put32(header, LZ4_MAGIC);
+		header[4] = 0x64;
+		header[5] = static_cast<char>(bd << 4);
+		Checksum descriptor;
+		descriptor.update(header + 4, 2);
+		header[6] = static_cast<char>((descriptor.digest() >> 8) & 0xff);
+		writeTarget(header, sizeof(header));
+		m_output.resize(4 + Lz4Bound(m_blockSize));
+		m_table.resize(std::size_t(1) << LZ4_HASH_LOG);
+	}
+#ifdef QL_HAVE_ZLIB
+	else {
+		std::memset(& m_zstream, 0, sizeof(m_zstream));
+		// Window bits increased by 16 select gzip wrapper.
+		if (deflateInit2(& m_zstream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+			m_errors.fetch_add(1, std::memory_order_relaxed);
+		m_output.resize(m_blockSize + 1024);
+	}
+#else
+	(void)level;
+#endif
+
+	for (std::vector<Block>::iterator i = m_blocks.begin(); i != m_blocks.end(); ++i) {
+		i->data.resize(m_blockSize);
+		i->size = 0;
+		i->mode = CONTINUE;
+		m_free.push_back(& *i);
+	}
+	m_current = m_free.front();
+	m_free.pop_front();
+	setp(m_current->data.data(), m_current->data.data() + m_blockSize);
+
+	m_thread = std::thread(& CompressBuf::run, this);
+}
+
+inline
+CompressBuf::~CompressBuf()
+{
+	submit(FINISH);
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cond.notify_one();
+	m_thread.join();
+#ifdef QL_HAVE_ZLIB
+	if (m_format == GZIP)
+		deflateEnd(& m_zstream);
+#endif
+}
+
+inline
+std::streambuf * CompressBuf::target() const
+{
+	return m_target;
+}
+
+inline
+CompressBuf::format_t CompressBuf::format() const
+{
+	return m_format;
+}
+
+inline
+bool CompressBuf::flush()
+{
+	std::uint64_t errors = m_errors.load(std::memory_order_relaxed);
+	submit(FLUSH);
+	wait();
+	return m_errors.load(std::memory_order_relaxed) == errors;
+}
+
+inline
+CompressBuf::Statistics CompressBuf::statistics() const
+{
+	Statistics result;
+	result.inputBytes = m_inputBytes.load(std::memory_order_relaxed);
+	result.outputBytes = m_outputBytes.load(std::memory_order_relaxed);
+	result.blocks = m_blockCount.load(std::memory_order_relaxed);
+	result.compressNanoseconds = m_compressNanoseconds.load(std::memory_order_relaxed);
+	result.stalls = m_stalls.load(std::memory_order_relaxed);
+	result.stallNanoseconds = m_stallNanoseconds.load(std::memory_order_relaxed);
+	result.errors = m_errors.load(std::memory_order_relaxed);
+	return result;
+}
+
+inline
+const char * CompressBuf::Suffix(format_t format)
+{
+	switch (format) {
+#ifdef QL_HAVE_ZLIB
+		case GZIP:
+			return ".gz";
+#endif
+		default:
+			return ".lz4";
+	}
+}
+
+inline
+bool CompressBuf::CompressFile(const std::string & inFileName, const std::string & outFileName, format_t format)
+{
+	std::filebuf in;
+	if (in.open(inFileName.c_str(), std::ios_base::in | std::ios_base::binary) == nullptr)
+		return false;
+	std::filebuf out;
+	if (out.open(outFileName.c_str(), std::ios_base::out | std::ios_base::trunc | std::ios_base::binary) == nullptr)
+		return false;
+
+	bool result;
+	{
+		CompressBuf compressBuf(& out, format);
+		char buff[64 * 1024];
+		std::streamsize n;
+		while ((n = in.sgetn(buff, sizeof(buff))) > 0)
+			compressBuf.sputn(buff, n);
+		result = compressBuf.flush();
+	}
+	return out.close() != nullptr && result;
+}
+
+inline
+int CompressBuf::sync()
+{
+	if (pptr() != pbase() && Clock::now() - m_submittedAt >= std::chrono::milliseconds(QL_COMPRESS_SYNC_INTERVAL))
+		submit(FLUSH);
+	return 0;
+}
+
+inline
+CompressBuf::int_type CompressBuf::overflow(int_type c)
+{
+	if (traits_type::eq_int_type(c, traits_type::eof()))
+		return traits_type::not_eof(c);
+
+	submit(CONTINUE);
+	*pptr() = traits_type::to_char_type(c);
+	pbump(1);
+	return c;
+}
+
+inline
+std::streamsize CompressBuf::xsputn(const char_type * s, std::streamsize n)
+{
+	std::size_t count = static_cast<std::size_t>(n);
+	while (count != 0) {
+		std::size_t avail = static_cast<std::size_t>(epptr() - pptr());
+		if (avail == 0) {
+			submit(CONTINUE);
+			continue;
+		}
+		std::size_t chunk = count < avail ? count : avail;
+		traits_type::copy(pptr(), s, chunk);
+		pbump(static_cast<int>(chunk));
+		s += chunk;
+		count -= chunk;
+	}
+	return n;
+}
+
+inline
+std::size_t CompressBuf::Lz4Compress(const char * src, std::size_t n, char * dst, std::uint32_t * table)
+{
+	// Last match must start at least 12 bytes before the end of the block and last 5
+	// bytes are always literals.
+	const std::size_t MFLIMIT = 12;
+	const std::size_t LASTLITERALS = 5;
+	const std::size_t MINMATCH = 4;
+
+	const unsigned char * base = reinterpret_cast<const unsigned char *>(src);
+	const unsigned char * ip = base;
+	const unsigned char * anchor = base;
+	const unsigned char * end = base + n;
+	char * op = dst;
+
+	if (n > MFLIMIT) {
+		const unsigned char * mflimit = end - MFLIMIT;
+		const unsigned char * matchlimit = end - LASTLITERALS;
+		std::memset(table, 0, sizeof(std::uint32_t) << LZ4_HASH_LOG);
+		unsigned searches = 0;
+		ip++;
+		while (ip < mflimit) {
+			std::uint32_t sequence;
+			std::memcpy(& sequence, ip, 4);
+			std::uint32_t hash = (sequence * PRIME32_1) >> (32 - LZ4_HASH_LOG);
+			const unsigned char * ref = base + table[hash];
+			table[hash] = static_cast<std::uint32_t>(ip - base);
+
+			std::uint32_t candidate;
+			std::memcpy(& candidate, ref, 4);
+			if (ref >= ip || ip - ref > 65535 || candidate != sequence) {
+				// Skip faster over incompressible data.
+				ip += 1 + (searches++ >> 6);
+				continue;
+			}
+			searches = 0;
+
+			while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+				ip--;
+				ref--;
+			}
+			const unsigned char * matchEnd = ip + MINMATCH;
+			const unsigned char * refEnd = ref + MINMATCH;
+			while (matchEnd < matchlimit && *matchEnd == *refEnd) {
+				matchEnd++;
+				refEnd++;
+			}
+
+			std::size_t literals = static_cast<std::size_t>(ip - anchor);
+			std::size_t matchLength = static_cast<std::size_t>(matchEnd - ip) - MINMATCH;
+			char * token = op++;
+			*token = static_cast<char>((literals < 15 ? literals : 15) << 4 | (matchLength < 15 ? matchLength : 15));
+			if (literals >= 15)
+				op = Lz4PutLength(op, literals - 15);
+			std::memcpy(op, anchor, literals);
+			op += literals;
+			std::size_t offset = static_cast<std::size_t>(ip - ref);
+			*op++ = static_cast<char>(offset & 0xff);
+			*op++ = static_cast<char>(offset >> 8);
+			if (matchLength >= 15)
+				op = Lz4PutLength(op, matchLength - 15);
+
+			ip = matchEnd;
+			anchor = ip;
+		}
+	}
+
+	std::size_t literals = static_cast<std::size_t>(end - anchor);
+	*op++ = static_cast<char>((literals < 15 ? literals : 15) << 4);
+	if (literals >= 15)
+		op = Lz4PutLength(op, literals - 15);
+	std::memcpy(op, anchor, literals);
+	op += literals;
+	return static_cast<std::size_t>(op - dst);
+}
+
+inline
+std::size_t CompressBuf::Lz4Bound(std::size_t n)
+{
+	return n + n / 255 + 16;
+}
+
+inline
+char * CompressBuf::Lz4PutLength(char * dst, std::size_t length)
+{
+	while (length >= 255) {
+		*dst++ = static_cast<char>(255);
+		length -= 255;
+	}
+	*dst++ = static_cast<char>(length);
+	return dst;
+}
+
+inline
+void CompressBuf::Put32(char * dst, std::uint32_t value)
+{
+	dst[0] = static_cast<char>(value & 0xff);
+	dst[1] = static_cast<char>((value >> 8) & 0xff);
+	dst[2] = static_cast<char>((value >> 16) & 0xff);
+	dst[3] = static_cast<char>((value >> 24) & 0xff);
+}
+
+inline
+std::uint64_t CompressBuf::ThreadCpuTime()
+{
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, & ts);
+	return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000 + static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+inline
+void CompressBuf::submit(mode_t mode)
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_current->size = static_cast<std::size_t>(pptr() - pbase());
+	m_current->mode = mode;
+	m_queue.push_back(m_current);
+	m_cond.notify_one();
+	m_submittedAt = Clock::now();
+
+	if (m_free.empty()) {
+		m_stalls.fetch_add(1, std::memory_order_relaxed);
+		Clock::time_point start = Clock::now();
+		while (m_free.empty())
+			m_doneCond.wait(lock);
+		m_stallNanoseconds.fetch_add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count()), std::memory_order_relaxed);
+	}
+	m_current = m_free.front();
+	m_free.pop_front();
+	setp(m_current->data.data(), m_current->data.data() + m_blockSize);
+}
+
+inline
+void CompressBuf::wait()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_queue.empty())
+		m_doneCond.wait(lock);
+}
+
+inline
+void CompressBuf::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		while (m_queue.empty() && !m_stop)
+			m_cond.wait(lock);
+		if (m_queue.empty())
+			break;
+
+		// Block stays in the queue while it is processed, so that wait() knows, when
+		// worker is done.
+		Block * block = m_queue.front();
+		lock.unlock();
+		process(*block);
+		lock.lock();
+		m_queue.pop_front();
+		m_free.push_back(block);
+		m_doneCond.notify_all();
+	}
+}
+
+inline
+void CompressBuf::process(Block & block)
+{
+	std::uint64_t start = ThreadCpuTime();
+#ifdef QL_HAVE_ZLIB
+	if (m_format == GZIP)
+		compressGzip(block);
+	else
+#endif
+		compressLz4(block);
+	m_compressNanoseconds.fetch_add(ThreadCpuTime() - start, std::memory_order_relaxed);
+	m_inputBytes.fetch_add(block.size, std::memory_order_relaxed);
+	if (block.size != 0)
+		m_blockCount.fetch_add(1, std::memory_order_relaxed);
+
+	if (block.mode != CONTINUE && m_target->pubsync() == -1)
+		m_errors.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline
+void CompressBuf::compressLz4(const Block & block)
+{
+	if (block.size != 0) {
+		m_checksum.update(block.data.data(), block.size);
+		std::size_t size = Lz4Compress(block.data.data(), block.size, m_output.data() + 4, m_table.data());
+		if (size >= block.size) {
+			// Incompressible data is stored as is, marked by the highest bit of block size.
+			Put32(m_output.data(), static_cast<std::uint32_t>(block.size) | 0x80000000u);
+			std::memcpy(m_output.data() + 4, block.data.data(), block.size);
+			size = block.size;
+		} else
+			Put32(m_output.data(), static_cast<std::uint32_t>(size));
+		writeTarget(m_output.data(), 4 + size);
+	}
+
+	if (block.mode == FINISH) {
+		// End mark followed by content checksum.
+		char trailer[8];
+		Put32(trailer, 0);
+		Put32(trailer + 4, m_checksum.digest());
+		writeTarget(trailer, sizeof(trailer));
+	}
+}
+
+#ifdef QL_HAVE_ZLIB
+inline
+void CompressBuf::compressGzip(const Block & block)
+{
+	int flush = block.mode == FINISH ? Z_FINISH : block.mode == FLUSH ? Z_SYNC_FLUSH : Z_NO_FLUSH;
+	m_zstream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(block.data.data()));
+	m_zstream.avail_in = static_cast<uInt>(block.size);
+	do {
+		m_zstream.next_out = reinterpret_cast<Bytef *>(m_output.data());
+		m_zstream.avail_out = static_cast<uInt>(m_output.size());
+		if (deflate(& m_zstream, flush) == Z_STREAM_ERROR) {
+			m_errors.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		writeTarget(m_output.data(), m_output.size() - m_zstream.avail_out);
+	} while (m_zstream.avail_out == 0);
+}
+#endif
+
+inline
+void CompressBuf::writeTarget(const char * s, std::size_t n)
+{
+	if (n == 0)
+		return;
+	if (m_target->sputn(s, static_cast<std::streamsize>(n)) != static_cast<std::streamsize>(n))
+		m_errors.fetch_add(1, std::memory_order_relaxed);
+	m_outputBytes.fetch_add(n, std::memory_order_relaxed);
+}
+
+inline
+CompressBuf::Checksum::Checksum(std::uint32_t p_seed):
+    seed(p_seed),
+    total(0),
+    memSize(0)
+{
+	v[0] = seed + PRIME32_1 + PRIME32_2;
+	v[1] = seed + PRIME32_2;
+	v[2] = seed;
+	v[3] = seed - PRIME32_1;
+}
+
+inline
+void CompressBuf::Checksum::update(const char * s, std::size_t n)
+{
+	const unsigned char * p = reinterpret_cast<const unsigned char *>(s);
+	const unsigned char * end = p + n;
+	total += n;
+
+	if (memSize + n < 16) {
+		std::memcpy(mem + memSize, p, n);
+		memSize += n;
+		return;
+	}
+
+	if (memSize != 0) {
+		std::memcpy(mem + memSize, p, 16 - memSize);
+		p += 16 - memSize;
+		for (int i = 0; i < 4; i++)
+			v[i] = Round(v[i], Read32(mem + 4 * i));
+		memSize = 0;
+	}
+
+	for (; p + 16 <= end; p += 16)
+		for (int i = 0; i < 4; i++)
+			v[i] = Round(v[i], Read32(p + 4 * i));
+
+	memSize = static_cast<std::size_t>(end - p);
+	std::memcpy(mem, p, memSize);
+}
+
+inline
+std::uint32_t CompressBuf::Checksum::digest() const
+{
+	std::uint32_t h;
+	if (total >= 16)
+		h = Rotl(v[0], 1) + Rotl(v[1], 7) + Rotl(v[2], 12) + Rotl(v[3], 18);
+	else
+		h = seed + PRIME32_5;
+	h += static_cast<std::uint32_t>(total);
+
+	const unsigned char * p = mem;
+	const unsigned char * end = mem + memSize;
+	for (; p + 4 <= end; p += 4)
+		h = Rotl(h + Read32(p) * PRIME32_3, 17) * PRIME32_4;
+	for (; p < end; p++)
+		h = Rotl(h + *p * PRIME32_5, 11) * PRIME32_1;
+
+	h ^= h >> 15;
+	h *= PRIME32_2;
+	h ^= h >> 13;
+	h *= PRIME32_3;
+	h ^= h >> 16;
+	return h;
+}
+
+inline
+std::uint32_t CompressBuf::Checksum::Round(std::uint32_t acc, std::uint32_t input)
+{
+	return Rotl(acc + input * PRIME32_2, 13) * PRIME32_1;
+}
+
+inline
+std::uint32_t CompressBuf::Checksum::Rotl(std::uint32_t x, int r)
+{
+	return (x << r) | (x >> (32 - r));
+}
+
+inline
+std::uint32_t CompressBuf::Checksum::Read32(const unsigned char * p)
+{
+	return static_cast<std::uint32_t>(p[0]) | static_cast<std::uint32_t>(p[1]) << 8 | static_cast<std::uint32_t>(p[2]) << 16 | static_cast<std::uint32_t>(p[3]) << 24;
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
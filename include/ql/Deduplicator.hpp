@@ -0,0 +1,230 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_DEDUPLICATOR_HPP
+#define QL_DEDUPLICATOR_HPP
+
+#include "CallSite.hpp"
+#include "LogStream.hpp"
+#include "Record.hpp"
+#include "RecordBuf.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+
+/**
+ * Interval in seconds, after which summary of suppressed duplicates is written, even if
+ * duplicates keep coming.
+ */
+#ifndef QL_DEDUP_SUMMARY_INTERVAL
+	#define QL_DEDUP_SUMMARY_INTERVAL 10
+#endif
+
+/**
+ * Deduplicator of a call site. Expands to a reference to static Deduplicator object.
+ * @return reference to Deduplicator object.
+ */
+#define QL_IMPL_DEDUPLICATOR() ([]() -> ::ql::Deduplicator & { static ::ql::Deduplicator ql_deduplicator(QL_DEDUP_SUMMARY_INTERVAL); return ql_deduplicator; }())
+
+namespace ql {
+
+/**
+ * Deduplicator. Collapses consecutive identical records issued from the same call site.
+ * Record, which is the same as the previous one, is suppressed. Summary (e.g. "Warning:
+ * suppressed 1000 similar messages") is written before the next distinct record and
+ * periodically, while duplicates keep coming. Records are compared by hash of the message
+ * (prefix and message expression, but not the trace).
+ *
+ * Deduplicators are intended to be static objects created by deduplicating macros (e.g.
+ * QL_WARN_DEDUP). Filter object is put into Record stream after message expression. If
+ * record is a duplicate, filter discards it and sets badbit on the stream, so that
+ * nothing else is put into the record and it is not committed. Macros use commit(), which
+ * applies the filter and commits the record with the same call site descriptor.
+ */
+class Deduplicator
+{
+	public:
+		/**
+		 * Record stream filter.
+		 */
+		struct Filter
+		{
+			Deduplicator * deduplicator;
+			const char * prefix;
+			const CallSite * site;
+			const char * function;
+			int flags;
+		};
+
+	public:
+		/**
+		 * Constructor.
+		 * @param interval summary interval in seconds.
+		 */
+		constexpr Deduplicator(unsigned interval);
+
+		/**
+		 * Create filter.
+		 * @param prefix prefix of summary record.
+		 * @param site call site.
+		 * @param function function name.
+		 * @param flags trace flags.
+		 * @return filter, which can be put into Record stream.
+		 */
+		Filter filter(const char * prefix, const CallSite & site, const char * function, int flags);
+
+		/**
+		 * Filter and commit record. Filter is applied to the record and if record is not a
+		 * duplicate, it is committed (see Record::Commit()).
+		 * @param stream Record stream containing formatted message.
+		 * @param logStream log stream, which receives the record.
+		 * @param prefix prefix of summary record.
+		 * @param site call site.
+		 * @param function function name.
+		 */
+		void commit(std::ostream & stream, const LogStream & logStream, const char * prefix, const CallSite & site, const char * function);
+
+		/**
+		 * Get number of suppressed records.
+		 * @return number of records suppressed since last summary.
+		 */
+		std::size_t suppressed() const;
+
+		/**
+		 * Apply filter to Record stream. Function is called, when filter is put into the
+		 * stream.
+		 * @param s Record stream.
+		 * @param filter filter.
+		 */
+		void apply(std::ostream & s, const Filter & filter);
+
+	private:
+		static std::uint64_t Hash(const char * s, std::size_t n);
+
+		static std::int64_t Seconds();
+
+		void writeSummary(LogBuf * target, const Filter & filter, std::size_t suppressed);
+
+	private:
+		std::int64_t m_interval;
+		std::atomic<std::uint64_t> m_last;	///< Hash of last record.
+		std::atomic<std::size_t> m_suppressed;
+		std::atomic<std::int64_t> m_lastSummary;	///< Time of last summary in seconds.
+};
+
+
+
+inline
+constexpr Deduplicator::Deduplicator(unsigned interval):
+    m_interval(interval),
+    m_last(0),
+    m_suppressed(0),
+    m_lastSummary(0)
+{
+}
+
+inline
+Deduplicator::Filter Deduplicator::filter(const char * prefix, const CallSite & site, const char * function, int flags)
+{
+	Filter result = {this, prefix, & site, function, flags};
+	return result;
+}
+
+inline QL_IMPL_COLD
+void Deduplicator::commit(std::ostream & stream, const LogStream & logStream, const char * prefix, const CallSite & site, const char * function)
+{
+	if (stream.good())
+		apply(stream, filter(prefix, site, function, logStream.traceFlags()));
+	Record::Commit(stream, logStream, site, function);
+}
+
+inline
+std::size_t Deduplicator::suppressed() const
+{
+	return m_suppressed.load(std::memory_order_relaxed);
+}
+
+inline
+std::uint64_t Deduplicator::Hash(const char * s, std::size_t n)
+{
+	// FNV-1a.
+	std::uint64_t hash = 14695981039346656037ULL;
+	for (std::size_t i = 0; i < n; i++) {
+		hash ^= static_cast<unsigned char>(s[i]);
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+inline
+std::int64_t Deduplicator::Seconds()
+{
+	return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline
+void Deduplicator::apply(std::ostream & s, const Filter & filter)
+{
+	// Filter is used only with Record streams.
+	RecordBuf * buf = static_cast<RecordBuf *>(s.rdbuf());
+	std::uint64_t hash = Hash(buf->data(), buf->size());
+	if (m_last.exchange(hash, std::memory_order_relaxed) != hash) {
+		std::size_t suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+		if (suppressed != 0)
+			writeSummary(buf->target(), filter, suppressed);
+		m_lastSummary.store(Seconds(), std::memory_order_relaxed);
+		return;
+	}
+
+	m_suppressed.fetch_add(1, std::memory_order_relaxed);
+	buf->discard();
+	s.setstate(std::ios_base::badbit);
+
+	std::int64_t now = Seconds();
+	std::int64_t last = m_lastSummary.load(std::memory_order_relaxed);
+	if (now - last >= m_interval && m_lastSummary.compare_exchange_strong(last, now, std::memory_order_relaxed)) {
+		std::size_t suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+		if (suppressed != 0)
+			writeSummary(buf->target(), filter, suppressed);
+	}
+}
+
+inline
+void Deduplicator::writeSummary(LogBuf * target, const Filter & filter, std::size_t suppressed)
+{
+	if (target == nullptr)
+		return;
+
+	char count[32];
+	std::snprintf(count, sizeof(count), "%lu", static_cast<unsigned long>(suppressed));
+	std::string summary(filter.prefix);
+	summary += "suppressed ";
+	summary += count;
+	summary += " similar messages";
+	summary += filter.site->suffix(filter.flags, filter.function);
+	summary += '\n';
+	target->putRecord(summary.data(), summary.size());
+}
+
+}
+
+inline
+std::ostream & operator <<(std::ostream & s, const ql::Deduplicator::Filter & filter)
+{
+	if (s.good())
+		filter.deduplicator->apply(s, filter);
+	return s;
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
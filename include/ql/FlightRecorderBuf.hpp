@@ -0,0 +1,548 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_FLIGHTRECORDERBUF_HPP
+#define QL_FLIGHTRECORDERBUF_HPP
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/**
+ * Maximal number of flight recorders, which are dumped by signal handler.
+ */
+#ifndef QL_FLIGHT_RECORDERS_MAX
+	#define QL_FLIGHT_RECORDERS_MAX 8
+#endif
+
+/**
+ * Size of alternate signal stack installed by FlightRecorderBuf::InstallSignalHandlers().
+ */
+#ifndef QL_FLIGHT_RECORDER_SIGNAL_STACK_SIZE
+	#define QL_FLIGHT_RECORDER_SIGNAL_STACK_SIZE 65536
+#endif
+
+namespace ql {
+
+/**
+ * Flight recorder buffer. Flight recorder keeps most recent output in a fixed size
+ * circular buffer in memory. Writing is just copying characters into the ring, so debug
+ * and note streams may be attached to the recorder in production at low cost. Contents of
+ * the ring are dumped, when something goes wrong:
+ * 	- when a record is written to Trigger buffer, which is intended to be attached to
+ * 	critical and fatal streams.
+ * 	- when the process receives fatal signal (SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT),
+ * 	if signal handlers have been installed with InstallSignalHandlers().
+ * 	- when dump() is called explicitly.
+ * 	.
+ * Recorder is dumped automatically only once. Dump writes to a file given by
+ * setDumpFile() or to standard error by default. Dump uses only async-signal-safe
+ * functions.
+ *
+ * Ring may be placed in a memory-mapped file, so that it survives the process, even if
+ * process is killed without a chance to dump it. Contents of such file can be decoded with
+ * ql-flightdump tool. Ring image consists of a Header followed by the ring data.
+ *
+ * @code
+ * ql::FlightRecorderBuf recorder(4 * 1024 * 1024);
+ * ql::FlightRecorderBuf::Trigger trigger(& recorder);
+ * recorder.setDumpFile("crash.log");
+ * ql::FlightRecorderBuf::InstallSignalHandlers();
+ * ql::Log::Instance().debugStream().attachBuffer(& recorder);
+ * ql::Log::Instance().noteStream().attachBuffer(& recorder);
+ * ql::Log::Instance().criticalStream().attachBuffer(& recorder);
+ * ql::Log::Instance().fatalStream().attachBuffer(& recorder);
+ * ql::Log::Instance().criticalStream().attachBuffer(& trigger);
+ * ql::Log::Instance().fatalStream().attachBuffer(& trigger);
+ * @endcode
+ */
+class FlightRecorderBuf: public std::streambuf
+{
+	public:
+		/**
+		 * Ring image header.
+		 */
+		struct Header
+		{
+			char magic[8];				///< Magic characters "QLFLTREC".
+			std::uint32_t version;		///< Format version.
+			std::uint32_t headerSize;	///< Size of the header in bytes.
+			std::uint64_t capacity;		///< Ring capacity in bytes.
+			std::atomic<std::uint64_t> head;	///< Total number of bytes written to the ring.
+		};
+
+		/**
+		 * Trigger buffer. Writing a record to the trigger dumps the recorder.
+		 */
+		class Trigger: public std::streambuf
+		{
+			public:
+				/**
+				 * Constructor.
+				 * @param recorder flight recorder to be dumped.
+				 */
+				explicit Trigger(FlightRecorderBuf * recorder);
+
+			protected:
+				//std::streambuf
+				virtual int_type overflow(int_type c);
+
+				//std::streambuf
+				virtual std::streamsize xsputn(const char_type * s, std::streamsize n);
+
+			private:
+				FlightRecorderBuf * m_recorder;
+		};
+
+		static const std::uint32_t VERSION = 1;	///< Version of ring image format.
+
+	public:
+		/**
+		 * Constructor. Ring is allocated on the heap.
+		 * @param capacity ring capacity in bytes. Must be greater than zero.
+		 */
+		explicit FlightRecorderBuf(std::size_t capacity);
+
+		/**
+		 * Constructor. Ring is placed in memory-mapped file. Existing file is overwritten.
+		 * @param fileName name of the file.
+		 * @param capacity ring capacity in bytes. Must be greater than zero.
+		 */
+		FlightRecorderBuf(const std::string & fileName, std::size_t capacity);
+
+		/**
+		 * Destructor.
+		 */
+		virtual ~FlightRecorderBuf();
+
+		/**
+		 * Check whether ring is available.
+		 * @return @p true if ring has been allocated or mapped, @p false otherwise.
+		 */
+		bool isOpen() const;
+
+		/**
+		 * Get ring capacity.
+		 * @return ring capacity in bytes.
+		 */
+		std::size_t capacity() const;
+
+		/**
+		 * Set dump file. Function is not async-signal-safe.
+		 * @param fileName name of the file, to which automatic dumps are appended. Pass
+		 * empty string to dump to standard error.
+		 */
+		void setDumpFile(const std::string & fileName);
+
+		/**
+		 * Dump ring contents. Function is async-signal-safe.
+		 * @param fd file descriptor.
+		 * @return @p true on success, @p false if writing failed.
+		 */
+		bool dump(int fd) const;
+
+		/**
+		 * Dump ring contents to the dump file, unless recorder has been dumped automatically
+		 * already. Function is async-signal-safe.
+		 * @return @p true if recorder has been dumped, @p false otherwise.
+		 */
+		bool dumpOnce();
+
+		/**
+		 * Dump ring image. Characters are written in the order they were written to the
+		 * ring. If ring has wrapped around, partial line at the beginning is skipped.
+		 * Function is async-signal-safe.
+		 * @param image ring image (header followed by ring data).
+		 * @param size size of the image in bytes.
+		 * @param fd file descriptor.
+		 * @return @p true on success, @p false if image is invalid or writing failed.
+		 */
+		static bool DumpImage(const char * image, std::size_t size, int fd);
+
+		/**
+		 * Install signal handlers. On fatal signal all existing flight recorders are dumped
+		 * once, then previous signal handler is restored and the signal is raised again.
+		 * Handlers are installed only once; subsequent calls do nothing. Handlers run on an
+		 * alternate signal stack, so that recorders are dumped also on stack overflow. The
+		 * alternate stack is installed for the calling thread only (unless the thread has
+		 * one already), because signal stacks are per-thread. Stack overflow in other threads
+		 * is not dumped, unless these threads install their own alternate stacks with
+		 * sigaltstack().
+		 */
+		static void InstallSignalHandlers();
+
+	protected:
+		//std::streambuf
+		virtual int_type overflow(int_type c);
+
+		//std::streambuf
+		virtual std::streamsize xsputn(const char_type * s, std::streamsize n);
+
+	private:
+		FlightRecorderBuf(const FlightRecorderBuf & other);	// = delete
+
+		FlightRecorderBuf & operator =(const FlightRecorderBuf & other); // = delete
+
+		static std::atomic<FlightRecorderBuf *> * Recorders();
+
+		static bool WriteAll(int fd, const char * s, std::size_t n);
+
+		static int * Signals();
+
+		static struct sigaction * OldActions();
+
+		static void InstallSignalStack();
+
+		static void SignalHandler(int signal);
+
+		Header * header() const;
+
+		void init(std::size_t capacity);
+
+		void registerRecorder();
+
+		void unregisterRecorder();
+
+	private:
+		char * m_image;
+		std::size_t m_imageSize;
+		bool m_mapped;
+		std::atomic<bool> m_dumped;
+		std::vector<char> m_dumpFile;	///< Null terminated name of dump file, so that it can be accessed in signal handler.
+};
+
+
+inline
+FlightRecorderBuf::Trigger::Trigger(FlightRecorderBuf * recorder):
+    m_recorder(recorder)
+{
+}
+
+inline
+FlightRecorderBuf::Trigger::int_type FlightRecorderBuf::Trigger::overflow(int_type c)
+{
+	m_recorder->dumpOnce();
+	return traits_type::not_eof(c);
+}
+
+inline
+std::streamsize FlightRecorderBuf::Trigger::xsputn(const char_type *, std::streamsize n)
+{
+	m_recorder->dumpOnce();
+	return n;
+}
+
+inline
+FlightRecorderBuf::FlightRecorderBuf(std::size_t capacity):
+    m_image(nullptr),
+    m_imageSize(sizeof(Header) + capacity),
+    m_mapped(false),
+    m_dumped(false)
+{
+	m_image = new (std::nothrow) char[m_imageSize];
+	init(capacity);
+}
+
+inline
+FlightRecorderBuf::FlightRecorderBuf(const std::string & fileName, std::size_t capacity):
+    m_image(nullptr),
+    m_imageSize(sizeof(Header) + capacity),
+    m_mapped(true),
+    m_dumped(false)
+{
+	int fd = ::open(fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd != -1) {
+		if (ftruncate(fd, static_cast<off_t>(m_imageSize)) == 0) {
+			void * map = mmap(nullptr, m_imageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+			if (map != MAP_FAILED)
+				m_image = static_cast<char *>(map);
+		}
+		::close(fd);
+	}
+	init(capacity);
+}
+
+inline
+FlightRecorderBuf::~FlightRecorderBuf()
+{
+	unregisterRecorder();
+	if (m_image == nullptr)
+		return;
+
+	header()->~Header();
+	if (m_mapped)
+		munmap(m_image, m_imageSize);
+	else
+		delete[] m_image;
+}
+
+inline
+bool FlightRecorderBuf::isOpen() const
+{
+	return m_image != nullptr;
+}
+
+inline
+std::size_t FlightRecorderBuf::capacity() const
+{
+	return m_imageSize - sizeof(Header);
+}
+
+inline
+void FlightRecorderBuf::setDumpFile(const std::string & fileName)
+{
+	std::vector<char> dumpFile(fileName.begin(), fileName.end());
+	dumpFile.push_back('\0');
+	m_dumpFile.swap(dumpFile);
+}
+
+inline
+bool FlightRecorderBuf::dump(int fd) const
+{
+	if (m_image == nullptr)
+		return false;
+
+	return DumpImage(m_image, m_imageSize, fd);
+}
+
+inline
+bool FlightRecorderBuf::dumpOnce()
+{
+	if (m_dumped.exchange(true))
+		return false;
+
+	if (m_dumpFile.size() <= 1)
+		return dump(STDERR_FILENO);
+
+	int fd = ::open(m_dumpFile.data(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (fd == -1)
+		return false;
+	bool result = dump(fd);
+	::close(fd);
+	return result;
+}
+
+inline
+bool FlightRecorderBuf::DumpImage(const char * image, std::size_t size, int fd)
+{
+	if (size < sizeof(Header))
+		return false;
+
+	const Header * header = reinterpret_cast<const Header *>(image);
+	if (std::memcmp(header->magic, "QLFLTREC", sizeof(header->magic)) != 0 || header->version != VERSION || header->headerSize != sizeof(Header) || header->capacity == 0 || header->capacity > size - sizeof(Header))
+		return false;
+
+	const char * data = image + sizeof(Header);
+	std::size_t capacity = static_cast<std::size_t>(header->capacity);
+	std::uint64_t head = header->head.load(std::memory_order_acquire);
+	if (head <= capacity)
+		return WriteAll(fd, data, static_cast<std::size_t>(head));
+
+	// Ring has wrapped around. Oldest character is at the head position.
+	std::size_t pos = static_cast<std::size_t>(head % capacity);
+	std::size_t begin = pos;
+	while (begin < capacity && data[begin] != '\n')
+		begin++;
+	if (begin < capacity)
+		return WriteAll(fd, data + begin + 1, capacity - begin - 1) && WriteAll(fd, data, pos);
+
+	const char * newline = static_cast<const char *>(std::memchr(data, '\n', pos));
+	if (newline == nullptr)
+		return true;
+	return WriteAll(fd, newline + 1, pos - static_cast<std::size_t>(newline + 1 - data));
+}
+
+inline
+void FlightRecorderBuf::InstallSignalHandlers()
+{
+	// Second call would save our own handler as the previous one and chaining would loop.
+	static std::atomic<bool> installed(false);
+	if (installed.exchange(true))
+		return;
+
+	InstallSignalStack();
+
+	struct sigaction action;
+	std::memset(& action, 0, sizeof(action));
+	action.sa_handler = & SignalHandler;
+	sigemptyset(& action.sa_mask);
+	action.sa_flags = SA_ONSTACK;
+	for (int i = 0; Signals()[i] != 0; i++)
+		sigaction(Signals()[i], & action, & OldActions()[i]);
+}
+
+inline
+FlightRecorderBuf::int_type FlightRecorderBuf::overflow(int_type c)
+{
+	if (traits_type::eq_int_type(c, traits_type::eof()))
+		return traits_type::not_eof(c);
+
+	char_type ch = traits_type::to_char_type(c);
+	xsputn(& ch, 1);
+	return c;
+}
+
+inline
+std::streamsize FlightRecorderBuf::xsputn(const char_type * s, std::streamsize n)
+{
+	if (m_image == nullptr)
+		return n;
+
+	Header * h = header();
+	char * data = m_image + sizeof(Header);
+	std::size_t capacity = static_cast<std::size_t>(h->capacity);
+	std::size_t count = static_cast<std::size_t>(n);
+	std::uint64_t head = h->head.load(std::memory_order_relaxed);
+
+	// Only the tail of a record longer than the whole ring is kept.
+	if (count > capacity) {
+		s += count - capacity;
+		head += count - capacity;
+		count = capacity;
+	}
+	std::size_t pos = static_cast<std::size_t>(head % capacity);
+	std::size_t first = capacity - pos < count ? capacity - pos : count;
+	std::memcpy(data + pos, s, first);
+	std::memcpy(data, s + first, count - first);
+	h->head.store(head + count, std::memory_order_release);
+	return n;
+}
+
+inline
+std::atomic<FlightRecorderBuf *> * FlightRecorderBuf::Recorders()
+{
+	static std::atomic<FlightRecorderBuf *> recorders[QL_FLIGHT_RECORDERS_MAX];
+	return recorders;
+}
+
+inline
+bool FlightRecorderBuf::WriteAll(int fd, const char * s, std::size_t n)
+{
+	while (n > 0) {
+		ssize_t written = ::write(fd, s, n);
+		if (written == -1) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		s += written;
+		n -= static_cast<std::size_t>(written);
+	}
+	return true;
+}
+
+inline
+int * FlightRecorderBuf::Signals()
+{
+	static int signals[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT, 0};
+	return signals;
+}
+
+inline
+struct sigaction * FlightRecorderBuf::OldActions()
+{
+	static struct sigaction oldActions[5];
+	return oldActions;
+}
+
+inline
+void FlightRecorderBuf::InstallSignalStack()
+{
+	stack_t current;
+	if (sigaltstack(nullptr, & current) == 0 && !(current.ss_flags & SS_DISABLE))
+		return;
+
+	static char stack[QL_FLIGHT_RECORDER_SIGNAL_STACK_SIZE];
+	stack_t altStack;
+	std::memset(& altStack, 0, sizeof(altStack));
+	altStack.ss_sp = stack;
+	altStack.ss_size = sizeof(stack);
+	altStack.ss_flags = 0;
+	sigaltstack(& altStack, nullptr);
+}
+
+inline
+void FlightRecorderBuf::SignalHandler(int signal)
+{
+	for (std::size_t i = 0; i < QL_FLIGHT_RECORDERS_MAX; i++)
+		if (FlightRecorderBuf * recorder = Recorders()[i].load())
+			recorder->dumpOnce();
+
+	for (int i = 0; Signals()[i] != 0; i++)
+		if (Signals()[i] == signal)
+			sigaction(signal, & OldActions()[i], nullptr);
+	raise(signal);
+}
+
+inline
+FlightRecorderBuf::Header * FlightRecorderBuf::header() const
+{
+	return reinterpret_cast<Header *>(m_image);
+}
+
+inline
+void FlightRecorderBuf::init(std::size_t capacity)
+{
+	if (m_image == nullptr)
+		return;
+
+	if (capacity == 0) {
+		if (m_mapped)
+			munmap(m_image, m_imageSize);
+		else
+			delete[] m_image;
+		m_image = nullptr;
+		return;
+	}
+
+	Header * h = new (m_image) Header;
+	std::memcpy(h->magic, "QLFLTREC", sizeof(h->magic));
+	h->version = VERSION;
+	h->headerSize = sizeof(Header);
+	h->capacity = capacity;
+	h->head.store(0, std::memory_order_release);
+	registerRecorder();
+}
+
+inline
+void FlightRecorderBuf::registerRecorder()
+{
+	for (std::size_t i = 0; i < QL_FLIGHT_RECORDERS_MAX; i++) {
+		FlightRecorderBuf * expected = nullptr;
+		if (Recorders()[i].compare_exchange_strong(expected, this))
+			return;
+	}
+}
+
+inline
+void FlightRecorderBuf::unregisterRecorder()
+{
+	for (std::size_t i = 0; i < QL_FLIGHT_RECORDERS_MAX; i++) {
+		FlightRecorderBuf * expected = this;
+		if (Recorders()[i].compare_exchange_strong(expected, nullptr))
+			return;
+	}
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
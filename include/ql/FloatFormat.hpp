@@ -0,0 +1,786 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_FLOATFORMAT_HPP
+#define QL_FLOATFORMAT_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+namespace ql {
+
+/**
+ * Floating point number format. Number is printed with the shortest sequence of decimal
+ * digits, which reads back as the same value of its own type, so that for example 0.1f
+ * is printed as "0.1" and not as digits of its double precision value. Notation is the
+ * one of "%g" conversion with trailing zeros removed and with precision equal to the
+ * larger of 15 and the number of digits (e.g. "0.1", "100000", "1e+20", "1.5e-07").
+ * Formatting does not depend on the locale - decimal point is always a dot - and it does
+ * not allocate memory.
+ *
+ * Digits of float and double numbers are generated by Grisu3 algorithm (F. Loitsch,
+ * "Printing Floating-Point Numbers Quickly and Accurately with Integers"), which uses
+ * 64 bit integer arithmetic and a table of cached powers of ten. Grisu3 detects numbers
+ * (about 0.5% of them), for which it can not prove that its result is the shortest one.
+ * These numbers and long double numbers, whose significand with boundaries does not fit
+ * into 64 bits, are handled by exact algorithm of R. G. Burger and R. K. Dybvig, which
+ * uses big integers allocated on the stack.
+ */
+class FloatFormat
+{
+	public:
+		enum {
+			MAX_SIZE = std::numeric_limits<long double>::max_digits10 + 12	///< Maximal length of formatted number, including terminating null character.
+		};
+
+	public:
+		/**
+		 * @name Format number
+		 * Format floating point number.
+		 * @param buf output buffer, which must be able to hold at least MAX_SIZE characters.
+		 * @param x number.
+		 * @return length of formatted number. Buffer is null-terminated.
+		 */
+		//@{
+		static std::size_t Format(char * buf, float x);
+
+		static std::size_t Format(char * buf, double x);
+
+		static std::size_t Format(char * buf, long double x);
+		//@}
+
+	private:
+		/**
+		 * Floating point number with 64 bit significand (f * 2^e).
+		 */
+		struct DiyFp
+		{
+			std::uint64_t f;
+			int e;
+		};
+
+		struct CachedPower
+		{
+			std::uint64_t f;
+			int e;	///< Binary exponent.
+			int k;	///< Decimal exponent.
+		};
+
+		/**
+		 * Non-negative big integer of fixed capacity, which is large enough for exact
+		 * algorithm applied to numbers of type @a T.
+		 */
+		template <typename T>
+		class Bignum
+		{
+			public:
+				Bignum();
+
+				void set(std::uint32_t u);
+
+				/**
+				 * Set value to integral floating point number.
+				 * @param x non-negative integral number.
+				 */
+				void setIntegral(T x);
+
+				void shiftLeft(std::size_t bits);
+
+				void multiply(std::uint32_t factor);
+
+				void multiplyPow10(int exponent);
+
+				void add(const Bignum & other);
+
+				/**
+				 * Subtract other number, which must not be greater than this one.
+				 * @param other number to subtract.
+				 */
+				void subtract(const Bignum & other);
+
+				static int Compare(const Bignum & a, const Bignum & b);
+
+			private:
+				static const int BITS = std::numeric_limits<T>::max_exponent > std::numeric_limits<T>::digits - std::numeric_limits<T>::min_exponent ? std::numeric_limits<T>::max_exponent : std::numeric_limits<T>::digits - std::numeric_limits<T>::min_exponent;
+				static const std::size_t WORDS = static_cast<std::size_t>(BITS + 2 * std::numeric_limits<T>::digits + 64) / 32;
+
+				std::uint32_t m_words[WORDS];	///< Words in little endian order.
+				std::size_t m_size;	///< Number of used words. Most significant word is non-zero.
+		};
+
+		static const int MIN_TARGET_EXPONENT = -60;	///< Minimal binary exponent of scaled numbers in Grisu3.
+		static const int MAX_TARGET_EXPONENT = -32;	///< Maximal binary exponent of scaled numbers in Grisu3.
+
+	private:
+		template <typename T>
+		static std::size_t FormatNumber(char * buf, T x);
+
+		/**
+		 * @name Generate digits
+		 * Generate the shortest digits of positive finite number.
+		 * @param x number.
+		 * @param digits output buffer for digits.
+		 * @param exponent decimal exponent of the first digit.
+		 * @return number of digits.
+		 */
+		//@{
+		static int Digits(float x, char * digits, int & exponent);
+
+		static int Digits(double x, char * digits, int & exponent);
+
+		static int Digits(long double x, char * digits, int & exponent);
+		//@}
+
+		/**
+		 * Generate digits with Grisu3 algorithm.
+		 * @param significand significand of the number.
+		 * @param binaryExponent binary exponent of the number.
+		 * @param closer whether lower boundary is closer to the number than the upper one.
+		 * @param digits output buffer for digits.
+		 * @param length number of digits.
+		 * @param exponent decimal exponent of the first digit.
+		 * @return @p true on success, @p false if digits could not be proven the shortest.
+		 */
+		static bool Grisu3(std::uint64_t significand, int binaryExponent, bool closer, char * digits, int & length, int & exponent);
+
+		static bool DigitGen(DiyFp low, DiyFp w, DiyFp high, char * digits, int & length, int & kappa);
+
+		static bool RoundWeed(char * digits, int length, std::uint64_t distanceTooHighW, std::uint64_t unsafeInterval, std::uint64_t rest, std::uint64_t tenKappa, std::uint64_t unit);
+
+		static DiyFp Normalize(DiyFp x);
+
+		static DiyFp Multiply(DiyFp x, DiyFp y);
+
+		/**
+		 * Get cached power of ten with binary exponent in given range.
+		 * @param minExponent minimal binary exponent.
+		 * @param maxExponent maximal binary exponent.
+		 * @return cached power.
+		 */
+		static const CachedPower & GetCachedPower(int minExponent, int maxExponent);
+
+		/**
+		 * Generate digits with exact algorithm of Burger and Dybvig.
+		 * @param x positive finite number.
+		 * @param digits output buffer for digits.
+		 * @param exponent decimal exponent of the first digit.
+		 * @return number of digits.
+		 */
+		template <typename T>
+		static int Exact(T x, char * digits, int & exponent);
+
+		/**
+		 * Print digits in "%g" notation.
+		 * @param buf output buffer.
+		 * @param negative whether number is negative.
+		 * @param digits digits.
+		 * @param length number of digits.
+		 * @param exponent decimal exponent of the first digit.
+		 * @return length of printed number.
+		 */
+		static std::size_t Print(char * buf, bool negative, const char * digits, int length, int exponent);
+
+		static std::size_t Copy(char * buf, const char * s);
+};
+
+
+inline
+std::size_t FloatFormat::Format(char * buf, float x)
+{
+	return FormatNumber(buf, x);
+}
+
+inline
+std::size_t FloatFormat::Format(char * buf, double x)
+{
+	return FormatNumber(buf, x);
+}
+
+inline
+std::size_t FloatFormat::Format(char * buf, long double x)
+{
+	return FormatNumber(buf, x);
+}
+
+template <typename T>
+FloatFormat::Bignum<T>::Bignum():
+    m_size(0)
+{
+}
+
+template <typename T>
+void FloatFormat::Bignum<T>::set(std::uint32_t u)
+{
+	m_words[0] = u;
+	m_size = u != 0 ? 1 : 0;
+}
+
+template <typename T>
+void FloatFormat::Bignum<T>::setIntegral(T x)
+{
+	const T base = static_cast<T>(4294967296.0);
+	m_size = 0;
+	while (x > 0) {
+		T word = std::fmod(x, base);
+		m_words[m_size++] = static_cast<std::uint32_t>(word);
+		x = (x - word) / base;
+	}
+}
+
+template <typename T>
+void FloatFormat::Bignum<T>::shiftLeft(std::size_t bits)
+{
+	if (m_size == 0)
+		return;
+
+	std::size_t words = bits / 32;
+	unsigned shift = static_cast<unsigned>(bits % 32);
+	if (shift != 0) {
+		std::uint32_t carry = 0;
+		for (std::size_t i = 0; i < m_size; i++) {
+			std::uint32_t word = m_words[i];
+			m_words[i] = (word << shift) | carry;
+			carry = word >> (32 - shift);
+		}
+		if (carry != 0)
+			m_words[m_size++] = carry;
+	}
+	if (words != 0) {
+		std::memmove(m_words + words, m_words, m_size * sizeof(std::uint32_t));
+		std::memset(m_words, 0, words * sizeof(std::uint32_t));
+		m_size += words;
+	}
+}
+
+template <typename T>
+void FloatFormat::Bignum<T>::multiply(std::uint32_t factor)
+{
+	std::uint64_t carry = 0;
+	for (std::size_t i = 0; i < m_size; i++) {
+		std::uint64_t product = static_cast<std::uint64_t>(m_words[i]) * factor + carry;
+		m_words[i] = static_cast<std::uint32_t>(product);
+		carry = product >> 32;
+	}
+	if (carry != 0)
+		m_words[m_size++] = static_cast<std::uint32_t>(carry);
+}
+
+template <typename T>
+void FloatFormat::Bignum<T>::multiplyPow10(int exponent)
+{
+	static const std::uint32_t powers[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+	for (; exponent >= 9; exponent -= 9)
+		multiply(1000000000);
+	if (exponent > 0)
+		multiply(powers[exponent]);
+}
+
+template <typename T>
+void FloatFormat::Bignum<T>::add(const Bignum & other)
+{
+	std::size_t size = m_size > other.m_size ? m_size : other.m_size;
+	std::uint64_t carry = 0;
+	for (std::size_t i = 0; i < size; i++) {
+		std::uint64_t sum = carry;
+		if (i < m_size)
+			sum += m_words[i];
+		if (i < other.m_size)
+			sum += other.m_words[i];
+		m_words[i] = static_cast<std::uint32_t>(sum);
+		carry = sum >> 32;
+	}
+	m_size = size;
+	if (carry != 0)
+		m_words[m_size++] = static_cast<std::uint32_t>(carry);
+}
+
+template <typename T>
+void FloatFormat::Bignum<T>::subtract(const Bignum & other)
+{
+	std::uint32_t borrow = 0;
+	for (std::size_t i = 0; i < m_size; i++) {
+		std::uint64_t subtrahend = static_cast<std::uint64_t>(i < other.m_size ? other.m_words[i] : 0) + borrow;
+		borrow = m_words[i] < subtrahend ? 1 : 0;
+		m_words[i] = static_cast<std::uint32_t>(m_words[i] - subtrahend);
+	}
+	while (m_size > 0 && m_words[m_size - 1] == 0)
+		m_size--;
+}
+
+template <typename T>
+int FloatFormat::Bignum<T>::Compare(const Bignum & a, const Bignum & b)
+{
+	if (a.m_size != b.m_size)
+		return a.m_size < b.m_size ? -1 : 1;
+
+	for (std::size_t i = a.m_size; i > 0; i--)
+		if (a.m_words[i - 1] != b.m_words[i - 1])
+			return a.m_words[i - 1] < b.m_words[i - 1] ? -1 : 1;
+	return 0;
+}
+
+template <typename T>
+std::size_t FloatFormat::FormatNumber(char * buf, T x)
+{
+	bool negative = std::signbit(x);
+	if (std::isnan(x))
+		return Copy(buf, negative ? "-nan" : "nan");
+	if (std::isinf(x))
+		return Copy(buf, negative ? "-inf" : "inf");
+	if (x == 0)
+		return Print(buf, negative, "0", 1, 0);
+
+	char digits[MAX_SIZE];
+	int exponent;
+	int length = Digits(negative ? -x : x, digits, exponent);
+	return Print(buf, negative, digits, length, exponent);
+}
+
+inline
+int FloatFormat::Digits(float x, char * digits, int & exponent)
+{
+	static_assert(std::numeric_limits<float>::is_iec559 && sizeof(float) == sizeof(std::uint32_t), "Float must be IEEE 754 single precision number.");
+
+	std::uint32_t bits;
+	std::memcpy(& bits, & x, sizeof(bits));
+	std::uint64_t significand = bits & 0x7FFFFF;
+	int biasedExponent = static_cast<int>((bits >> 23) & 0xFF);
+	int binaryExponent = -149;
+	if (biasedExponent != 0) {
+		significand |= 0x800000;
+		binaryExponent = biasedExponent - 150;
+	}
+	int length;
+	if (Grisu3(significand, binaryExponent, significand == 0x800000 && biasedExponent > 1, digits, length, exponent))
+		return length;
+	return Exact(x, digits, exponent);
+}
+
+inline
+int FloatFormat::Digits(double x, char * digits, int & exponent)
+{
+	static_assert(std::numeric_limits<double>::is_iec559 && sizeof(double) == sizeof(std::uint64_t), "Double must be IEEE 754 double precision number.");
+
+	std::uint64_t bits;
+	std::memcpy(& bits, & x, sizeof(bits));
+	std::uint64_t significand = bits & 0xFFFFFFFFFFFFFULL;
+	int biasedExponent = static_cast<int>((bits >> 52) & 0x7FF);
+	int binaryExponent = -1074;
+	if (biasedExponent != 0) {
+		significand |= 0x10000000000000ULL;
+		binaryExponent = biasedExponent - 1075;
+	}
+	int length;
+	if (Grisu3(significand, binaryExponent, significand == 0x10000000000000ULL && biasedExponent > 1, digits, length, exponent))
+		return length;
+	return Exact(x, digits, exponent);
+}
+
+inline
+int FloatFormat::Digits(long double x, char * digits, int & exponent)
+{
+	// Long double, which is the same as double (e.g. with MSVC), takes the fast path.
+	if (std::numeric_limits<long double>::digits == std::numeric_limits<double>::digits && std::numeric_limits<long double>::max_exponent == std::numeric_limits<double>::max_exponent)
+		return Digits(static_cast<double>(x), digits, exponent);
+	return Exact(x, digits, exponent);
+}
+
+inline
+bool FloatFormat::Grisu3(std::uint64_t significand, int binaryExponent, bool closer, char * digits, int & length, int & exponent)
+{
+	DiyFp w = {significand, binaryExponent};
+	w = Normalize(w);
+
+	// Boundaries are halfway to the neighbouring numbers. Lower boundary is closer, if
+	// significand is a power of two (predecessor has smaller exponent).
+	DiyFp plus = {(significand << 1) + 1, binaryExponent - 1};
+	plus = Normalize(plus);
+	DiyFp minus = {(significand << 1) - 1, binaryExponent - 1};
+	if (closer) {
+		minus.f = (significand << 2) - 1;
+		minus.e = binaryExponent - 2;
+	}
+	minus.f <<= minus.e - plus.e;
+	minus.e = plus.e;
+
+	const CachedPower & power = GetCachedPower(MIN_TARGET_EXPONENT - (w.e + 64), MAX_TARGET_EXPONENT - (w.e + 64));
+	DiyFp c = {power.f, power.e};
+	int kappa;
+	if (!DigitGen(Multiply(minus, c), Multiply(w, c), Multiply(plus, c), digits, length, kappa))
+		return false;
+
+	exponent = length - 1 + kappa - power.k;
+	return true;
+}
+
+inline
+bool FloatFormat::DigitGen(DiyFp low, DiyFp w, DiyFp high, char * digits, int & length, int & kappa)
+{
+	// Scaled boundaries are imprecise by one unit. Digits are generated for too high
+	// boundary, until the rest falls into unsafe interval.
+	std::uint64_t unit = 1;
+	std::uint64_t tooLow = low.f - unit;
+	std::uint64_t tooHigh = high.f + unit;
+	std::uint64_t unsafeInterval = tooHigh - tooLow;
+	int shift = -w.e;
+	std::uint64_t one = static_cast<std::uint64_t>(1) << shift;
+	std::uint32_t integrals = static_cast<std::uint32_t>(tooHigh >> shift);
+	std::uint64_t fractionals = tooHigh & (one - 1);
+
+	std::uint32_t divisor = 1;
+	kappa = 1;
+	while (static_cast<std::uint64_t>(divisor) * 10 <= integrals) {
+		divisor *= 10;
+		kappa++;
+	}
+
+	length = 0;
+	while (kappa > 0) {
+		digits[length++] = static_cast<char>('0' + integrals / divisor);
+		integrals %= divisor;
+		kappa--;
+		std::uint64_t rest = (static_cast<std::uint64_t>(integrals) << shift) + fractionals;
+		if (rest < unsafeInterval)
+			return RoundWeed(digits, length, tooHigh - w.f, unsafeInterval, rest, static_cast<std::uint64_t>(divisor) << shift, unit);
+		divisor /= 10;
+	}
+
+	for (;;) {
+		fractionals *= 10;
+		unit *= 10;
+		unsafeInterval *= 10;
+		digits[length++] = static_cast<char>('0' + (fractionals >> shift));
+		fractionals &= one - 1;
+		kappa--;
+		if (fractionals < unsafeInterval)
+			return RoundWeed(digits, length, (tooHigh - w.f) * unit, unsafeInterval, fractionals, one, unit);
+	}
+}
+
+inline
+bool FloatFormat::RoundWeed(char * digits, int length, std::uint64_t distanceTooHighW, std::uint64_t unsafeInterval, std::uint64_t rest, std::uint64_t tenKappa, std::uint64_t unit)
+{
+	// Move last digit towards the number, while result stays within unsafe interval.
+	std::uint64_t smallDistance = distanceTooHighW - unit;
+	std::uint64_t bigDistance = distanceTooHighW + unit;
+	while (rest < smallDistance && unsafeInterval - rest >= tenKappa && (rest + tenKappa < smallDistance || smallDistance - rest >= rest + tenKappa - smallDistance)) {
+		digits[length - 1]--;
+		rest += tenKappa;
+	}
+
+	// Imprecision of the number does not allow to decide, which digit is the closest.
+	if (rest < bigDistance && unsafeInterval - rest >= tenKappa && (rest + tenKappa < bigDistance || bigDistance - rest > rest + tenKappa - bigDistance))
+		return false;
+
+	// Result must be safely inside of the interval.
+	return 2 * unit <= rest && rest <= unsafeInterval - 4 * unit;
+}
+
+inline
+FloatFormat::DiyFp FloatFormat::Normalize(DiyFp x)
+{
+	while ((x.f & 0xFFC0000000000000ULL) == 0) {
+		x.f <<= 10;
+		x.e -= 10;
+	}
+	while ((x.f & 0x8000000000000000ULL) == 0) {
+		x.f <<= 1;
+		x.e--;
+	}
+	return x;
+}
+
+inline
+FloatFormat::DiyFp FloatFormat::Multiply(DiyFp x, DiyFp y)
+{
+	const std::uint64_t mask = 0xFFFFFFFFULL;
+	std::uint64_t a = x.f >> 32;
+	std::uint64_t b = x.f & mask;
+	std::uint64_t c = y.f >> 32;
+	std::uint64_t d = y.f & mask;
+	std::uint64_t ac = a * c;
+	std::uint64_t bc = b * c;
+	std::uint64_t ad = a * d;
+	std::uint64_t bd = b * d;
+	std::uint64_t middle = (bd >> 32) + (ad & mask) + (bc & mask);
+	middle += 1ULL << 31;	// Round.
+	DiyFp result = {ac + (ad >> 32) + (bc >> 32) + (middle >> 32), x.e + y.e + 64};
+	return result;
+}
+
+inline
+const FloatFormat::CachedPower & FloatFormat::GetCachedPower(int minExponent, int maxExponent)
+{
+	// Powers of ten from 10^-348 to 10^340 with step of 8.
+	static const CachedPower powers[] = {
+		{0xfa8fd5a0081c0288ULL, -1220, -348},
+		{0xbaaee17fa23ebf76ULL, -1193, -340},
+		{0x8b16fb203055ac76ULL, -1166, -332},
+		{0xcf42894a5dce35eaULL, -1140, -324},
+		{0x9a6bb0aa55653b2dULL, -1113, -316},
+		{0xe61acf033d1a45dfULL, -1087, -308},
+		{0xab70fe17c79ac6caULL, -1060, -300},
+		{0xff77b1fcbebcdc4fULL, -1034, -292},
+		{0xbe5691ef416bd60cULL, -1007, -284},
+		{0x8dd01fad907ffc3cULL, -980, -276},
+		{0xd3515c2831559a83ULL, -954, -268},
+		{0x9d71ac8fada6c9b5ULL, -927, -260},
+		{0xea9c227723ee8bcbULL, -901, -252},
+		{0xaecc49914078536dULL, -874, -244},
+		{0x823c12795db6ce57ULL, -847, -236},
+		{0xc21094364dfb5637ULL, -821, -228},
+		{0x9096ea6f3848984fULL, -794, -220},
+		{0xd77485cb25823ac7ULL, -768, -212},
+		{0xa086cfcd97bf97f4ULL, -741, -204},
+		{0xef340a98172aace5ULL, -715, -196},
+		{0xb23867fb2a35b28eULL, -688, -188},
+		{0x84c8d4dfd2c63f3bULL, -661, -180},
+		{0xc5dd44271ad3cdbaULL, -635, -172},
+		{0x936b9fcebb25c996ULL, -608, -164},
+		{0xdbac6c247d62a584ULL, -582, -156},
+		{0xa3ab66580d5fdaf6ULL, -555, -148},
+		{0xf3e2f893dec3f126ULL, -529, -140},
+		{0xb5b5ada8aaff80b8ULL, -502, -132},
+		{0x87625f056c7c4a8bULL, -475, -124},
+		{0xc9bcff6034c13053ULL, -449, -116},
+		{0x964e858c91ba2655ULL, -422, -108},
+		{0xdff9772470297ebdULL, -396, -100},
+		{0xa6dfbd9fb8e5b88fULL, -369, -92},
+		{0xf8a95fcf88747d94ULL, -343, -84},
+		{0xb94470938fa89bcfULL, -316, -76},
+		{0x8a08f0f8bf0f156bULL, -289, -68},
+		{0xcdb02555653131b6ULL, -263, -60},
+		{0x993fe2c6d07b7facULL, -236, -52},
+		{0xe45c10c42a2b3b06ULL, -210, -44},
+		{0xaa242499697392d3ULL, -183, -36},
+		{0xfd87b5f28300ca0eULL, -157, -28},
+		{0xbce5086492111aebULL, -130, -20},
+		{0x8cbccc096f5088ccULL, -103, -12},
+		{0xd1b71758e219652cULL, -77, -4},
+		{0x9c40000000000000ULL, -50, 4},
+		{0xe8d4a51000000000ULL, -24, 12},
+		{0xad78ebc5ac620000ULL, 3, 20},
+		{0x813f3978f8940984ULL, 30, 28},
+		{0xc097ce7bc90715b3ULL, 56, 36},
+		{0x8f7e32ce7bea5c70ULL, 83, 44},
+		{0xd5d238a4abe98068ULL, 109, 52},
+		{0x9f4f2726179a2245ULL, 136, 60},
+		{0xed63a231d4c4fb27ULL, 162, 68},
+		{0xb0de65388cc8ada8ULL, 189, 76},
+		{0x83c7088e1aab65dbULL, 216, 84},
+		{0xc45d1df942711d9aULL, 242, 92},
+		{0x924d692ca61be758ULL, 269, 100},
+		{0xda01ee641a708deaULL, 295, 108},
+		{0xa26da3999aef774aULL, 322, 116},
+		{0xf209787bb47d6b85ULL, 348, 124},
+		{0xb454e4a179dd1877ULL, 375, 132},
+		{0x865b86925b9bc5c2ULL, 402, 140},
+		{0xc83553c5c8965d3dULL, 428, 148},
+		{0x952ab45cfa97a0b3ULL, 455, 156},
+		{0xde469fbd99a05fe3ULL, 481, 164},
+		{0xa59bc234db398c25ULL, 508, 172},
+		{0xf6c69a72a3989f5cULL, 534, 180},
+		{0xb7dcbf5354e9beceULL, 561, 188},
+		{0x88fcf317f22241e2ULL, 588, 196},
+		{0xcc20ce9bd35c78a5ULL, 614, 204},
+		{0x98165af37b2153dfULL, 641, 212},
+		{0xe2a0b5dc971f303aULL, 667, 220},
+		{0xa8d9d1535ce3b396ULL, 694, 228},
+		{0xfb9b7cd9a4a7443cULL, 720, 236},
+		{0xbb764c4ca7a44410ULL, 747, 244},
+		{0x8bab8eefb6409c1aULL, 774, 252},
+		{0xd01fef10a657842cULL, 800, 260},
+		{0x9b10a4e5e9913129ULL, 827, 268},
+		{0xe7109bfba19c0c9dULL, 853, 276},
+		{0xac2820d9623bf429ULL, 880, 284},
+		{0x80444b5e7aa7cf85ULL, 907, 292},
+		{0xbf21e44003acdd2dULL, 933, 300},
+		{0x8e679c2f5e44ff8fULL, 960, 308},
+		{0xd433179d9c8cb841ULL, 986, 316},
+		{0x9e19db92b4e31ba9ULL, 1013, 324},
+		{0xeb96bf6ebadf77d9ULL, 1039, 332},
+		{0xaf87023b9bf0ee6bULL, 1066, 340}
+	};
+	static const int FIRST_POWER = -348;
+	static const int POWER_STEP = 8;
+
+	int k = static_cast<int>(std::ceil((minExponent + 63) * 0.30102999566398114));
+	int index = (k - FIRST_POWER - 1) / POWER_STEP + 1;
+	while (index + 1 < static_cast<int>(sizeof(powers) / sizeof(powers[0])) && powers[index].e < minExponent)
+		index++;
+	while (index > 0 && powers[index].e > maxExponent)
+		index--;
+	return powers[index];
+}
+
+template <typename T>
+int FloatFormat::Exact(T x, char * digits, int & exponent)
+{
+	const int p = std::numeric_limits<T>::digits;
+	const int minExponent = std::numeric_limits<T>::min_exponent;
+
+	// Number is significand * 2^binaryExponent, where significand is an integer.
+	int e;
+	std::frexp(x, & e);
+	int binaryExponent = (e < minExponent ? minExponent : e) - p;
+	T significand = std::ldexp(x, -binaryExponent);
+	bool closer = e > minExponent && significand == std::ldexp(static_cast<T>(1), p - 1);
+	bool even = std::fmod(significand, static_cast<T>(2)) == 0;
+
+	// Number is r / s and distances to the boundaries are mPlus / s and mMinus / s.
+	// Numerators and denominator are scaled, so that they are integers.
+	Bignum<T> r;
+	Bignum<T> s;
+	Bignum<T> mPlus;
+	Bignum<T> mMinus;
+	r.setIntegral(significand);
+	if (binaryExponent >= 0) {
+		r.shiftLeft(static_cast<std::size_t>(binaryExponent) + (closer ? 2u : 1u));
+		s.set(closer ? 4 : 2);
+		mPlus.set(1);
+		mPlus.shiftLeft(static_cast<std::size_t>(binaryExponent) + (closer ? 1u : 0u));
+		mMinus.set(1);
+		mMinus.shiftLeft(static_cast<std::size_t>(binaryExponent));
+	} else {
+		r.shiftLeft(closer ? 2u : 1u);
+		s.set(1);
+		s.shiftLeft(static_cast<std::size_t>(-binaryExponent) + (closer ? 2u : 1u));
+		mPlus.set(closer ? 2 : 1);
+		mMinus.set(1);
+	}
+
+	// Estimate decimal exponent k, so that upper boundary is below 10^k, then fix it up.
+	int k = static_cast<int>(std::ceil((e - 1) * 0.30102999566398114 - 1e-10));
+	if (k >= 0)
+		s.multiplyPow10(k);
+	else {
+		r.multiplyPow10(-k);
+		mPlus.multiplyPow10(-k);
+		mMinus.multiplyPow10(-k);
+	}
+	Bignum<T> high;
+	for (;;) {
+		high = r;
+		high.add(mPlus);
+		int cmp = Bignum<T>::Compare(high, s);
+		if (even ? cmp < 0 : cmp <= 0)
+			break;
+		s.multiply(10);
+		k++;
+	}
+
+	int length = 0;
+	for (;;) {
+		r.multiply(10);
+		mPlus.multiply(10);
+		mMinus.multiply(10);
+		char digit = '0';
+		while (Bignum<T>::Compare(r, s) >= 0) {
+			r.subtract(s);
+			digit++;
+		}
+		high = r;
+		high.add(mPlus);
+		int lowCmp = Bignum<T>::Compare(r, mMinus);
+		int highCmp = Bignum<T>::Compare(high, s);
+		bool lowReached = even ? lowCmp <= 0 : lowCmp < 0;
+		bool highReached = even ? highCmp >= 0 : highCmp > 0;
+		if (!lowReached && !highReached) {
+			digits[length++] = digit;
+			continue;
+		}
+
+		if (lowReached && highReached) {
+			// Both digits are within boundaries, the closer one is taken.
+			high = r;
+			high.shiftLeft(1);
+			int cmp = Bignum<T>::Compare(high, s);
+			if (cmp > 0 || (cmp == 0 && (digit - '0') % 2 != 0))
+				digit++;
+		} else if (highReached)
+			digit++;
+		digits[length++] = digit;
+		break;
+	}
+	exponent = k - 1;
+	return length;
+}
+
+inline
+std::size_t FloatFormat::Print(char * buf, bool negative, const char * digits, int length, int exponent)
+{
+	while (length > 1 && digits[length - 1] == '0')
+		length--;
+
+	char * p = buf;
+	if (negative)
+		*p++ = '-';
+	int precision = length > 15 ? length : 15;
+	std::size_t count = static_cast<std::size_t>(length);
+	if (exponent < -4 || exponent >= precision) {
+		*p++ = digits[0];
+		if (length > 1) {
+			*p++ = '.';
+			std::memcpy(p, digits + 1, count - 1);
+			p += count - 1;
+		}
+		*p++ = 'e';
+		*p++ = exponent < 0 ? '-' : '+';
+		unsigned u = static_cast<unsigned>(exponent < 0 ? -exponent : exponent);
+		if (u < 10)
+			*p++ = '0';
+		char buff[8];
+		char * end = buff + sizeof(buff);
+		char * begin = end;
+		do {
+			*--begin = static_cast<char>('0' + u % 10);
+			u /= 10;
+		} while (u != 0);
+		std::memcpy(p, begin, static_cast<std::size_t>(end - begin));
+		p += end - begin;
+	} else if (exponent < 0) {
+		*p++ = '0';
+		*p++ = '.';
+		for (int i = -1; i > exponent; i--)
+			*p++ = '0';
+		std::memcpy(p, digits, count);
+		p += count;
+	} else if (length <= exponent + 1) {
+		std::memcpy(p, digits, count);
+		p += count;
+		for (int i = length; i <= exponent; i++)
+			*p++ = '0';
+	} else {
+		std::size_t integral = static_cast<std::size_t>(exponent + 1);
+		std::memcpy(p, digits, integral);
+		p += integral;
+		*p++ = '.';
+		std::memcpy(p, digits + integral, count - integral);
+		p += count - integral;
+	}
+	*p = '\0';
+	return static_cast<std::size_t>(p - buf);
+}
+
+inline
+std::size_t FloatFormat::Copy(char * buf, const char * s)
+{
+	std::size_t size = std::strlen(s);
+	std::memcpy(buf, s, size + 1);
+	return size;
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
@@ -0,0 +1,100 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_FLUSHPOLICY_HPP
+#define QL_FLUSHPOLICY_HPP
+
+#include <cstddef>
+
+namespace ql {
+
+/**
+ * Flush policy. Flush policy decides, when buffers attached to a log stream are forced to
+ * sync (for file streams it means a write() system call). Following modes are available:
+ * 	- ALWAYS - buffers are synced after each record. This is the default.
+ * 	- NEVER - buffers are never forced to sync. They sync by themselves, when their
+ * 	internal buffers are full or when they are destroyed.
+ * 	- BYTES - buffers are synced, when at least @a n bytes have been written since last sync.
+ * 	- RECORDS - buffers are synced, when at least @a n records have been written since
+ * 	last sync.
+ * 	- INTERVAL - buffers are synced every @a n milliseconds by a timer, if anything has
+ * 	been written since last sync.
+ * 	.
+ *
+ * Policy belongs to a log stream and bytes, records and time are counted per stream.
+ * Device attached to several streams is synced by each of them according to its own
+ * policy.
+ */
+struct FlushPolicy
+{
+	enum mode_t {
+		ALWAYS,
+		NEVER,
+		BYTES,
+		RECORDS,
+		INTERVAL
+	};
+
+	explicit FlushPolicy(mode_t mode = ALWAYS, std::size_t n = 0);
+
+	static FlushPolicy Always();
+
+	static FlushPolicy Never();
+
+	static FlushPolicy EveryBytes(std::size_t bytes);
+
+	static FlushPolicy EveryRecords(std::size_t records);
+
+	static FlushPolicy EveryMilliseconds(std::size_t interval);
+
+	mode_t mode;
+	std::size_t n;
+};
+
+inline
+FlushPolicy::FlushPolicy(mode_t p_mode, std::size_t p_n):
+    mode(p_mode),
+    n(p_n)
+{
+}
+
+inline
+FlushPolicy FlushPolicy::Always()
+{
+	return FlushPolicy(ALWAYS);
+}
+
+inline
+FlushPolicy FlushPolicy::Never()
+{
+	return FlushPolicy(NEVER);
+}
+
+inline
+FlushPolicy FlushPolicy::EveryBytes(std::size_t bytes)
+{
+	return FlushPolicy(BYTES, bytes);
+}
+
+inline
+FlushPolicy FlushPolicy::EveryRecords(std::size_t records)
+{
+	return FlushPolicy(RECORDS, records);
+}
+
+inline
+FlushPolicy FlushPolicy::EveryMilliseconds(std::size_t interval)
+{
+	return FlushPolicy(INTERVAL, interval);
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
@@ -0,0 +1,551 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_FORMATTER_HPP
+#define QL_FORMATTER_HPP
+
+#include "CallSite.hpp"
+#include "FloatFormat.hpp"
+#include "TimeStamp.hpp"
+#include "Trace.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+/**
+ * Size of thread-local buffers used by Formatter. Longer records are truncated.
+ */
+#ifndef QL_FORMAT_BUFFER_SIZE
+	#define QL_FORMAT_BUFFER_SIZE 1024
+#endif
+
+#define QL_IMPL_FIRST(...) QL_IMPL_FIRST_HELPER(__VA_ARGS__, 0)
+#define QL_IMPL_FIRST_HELPER(FIRST, ...) FIRST
+
+/**
+ * Compile time format check. Expands to lambda expression, which contains static
+ * assertion, that number of placeholders in format string matches number of arguments.
+ * @param ... format string literal followed by arguments.
+ */
+#define QL_IMPL_FORMAT_CHECK(...) []() { static_assert(::ql::Formatter::CountPlaceholders(QL_IMPL_FIRST(__VA_ARGS__)) + 1 == sizeof(::ql::Formatter::ArgCount(__VA_ARGS__)), "Number of {} placeholders does not match number of arguments."); }
+
+namespace ql {
+
+/**
+ * Formatter. Formats records of QL_DEBUGF-style macros without iostreams. Format string
+ * contains "{}" placeholders, which are replaced by subsequent arguments ("{{" and "}}"
+ * produce literal braces). Integers, characters, booleans, strings and pointers are
+ * formatted by hand-written routines, floating point numbers are formatted by
+ * FloatFormat. Record (prefix, message, trace and new line character) is assembled in
+ * thread-local fixed size buffer (QL_FORMAT_BUFFER_SIZE) and passed to the log buffer
+ * with a single LogBuf::putRecord() call, so formatting does not allocate memory.
+ *
+ * Formatters may be nested (e.g. log buffer renders structured record for its sinks while
+ * the record of outer formatter is being written, or a sink logs a record by itself).
+ * Each nesting level uses its own thread-local buffer; formatters nested deeper than
+ * NESTED_BUFFERS levels allocate their buffers on the heap.
+ */
+class Formatter
+{
+	public:
+		static const std::size_t NESTED_BUFFERS = 4;	///< Number of thread-local buffers.
+
+	public:
+		/**
+		 * Constructor. Formatter uses thread-local buffer of its nesting level.
+		 */
+		Formatter();
+
+		/**
+		 * Destructor.
+		 */
+		~Formatter();
+
+		/**
+		 * Format and write a record.
+		 * @param stream log stream (LogStream). Stream type is a template parameter, so
+		 * that this header does not depend on log buffers, which use Formatter.
+		 * @param prefix message prefix.
+		 * @param site call site.
+		 * @param function function name.
+		 * @param format format string.
+		 * @param args arguments.
+		 */
+		template <typename STREAM, typename... ARGS>
+		static void Write(STREAM & stream, const char * prefix, const CallSite & site, const char * function, const char * format, const ARGS & ... args);
+
+		/**
+		 * Count placeholders.
+		 * @param format format string.
+		 * @return number of "{}" placeholders in the format string.
+		 */
+		static constexpr std::size_t CountPlaceholders(const char * format);
+
+		/**
+		 * Count arguments. Function is not defined - it is intended to be used only in
+		 * sizeof expression.
+		 * @return reference to array of the size equal to number of arguments.
+		 */
+		template <typename... ARGS>
+		static char (& ArgCount(const ARGS & ...))[sizeof...(ARGS)];
+
+		/**
+		 * Format message.
+		 * @param format format string.
+		 * @param args arguments.
+		 */
+		template <typename... ARGS>
+		void format(const char * format, const ARGS & ... args);
+
+		/**
+		 * Put literal part of format string up to the next placeholder.
+		 * @param format format string.
+		 * @return pointer to the character after placeholder or @p nullptr if there are no
+		 * more placeholders.
+		 */
+		const char * literal(const char * format);
+
+		/**
+		 * Append new line character. Buffer always has room for one new line character,
+		 * which terminates the record.
+		 */
+		void newLine();
+
+		/**
+		 * @name Put value
+		 * Append formatted value to the buffer. Characters, which do not fit into the
+		 * buffer are dropped.
+		 */
+		//@{
+		void put(const char * s, std::size_t n);
+
+		void put(const char * s);
+
+		void put(const std::string & s);
+
+		void put(char c);
+
+		void put(bool b);
+
+		void put(int i);
+
+		void put(long i);
+
+		void put(long long i);
+
+		void put(unsigned u);
+
+		void put(unsigned long u);
+
+		void put(unsigned long long u);
+
+		void put(float f);
+
+		void put(double d);
+
+		void put(long double d);
+
+		void put(const void * p);
+
+		void put(const Trace & trace);
+
+		/**
+		 * Put trace with the date of given time stamp instead of current date.
+		 * @param trace trace.
+		 * @param sec seconds since epoch.
+		 * @param nsec nanoseconds.
+		 */
+		void put(const Trace & trace, std::time_t sec, long nsec);
+		//@}
+
+		/**
+		 * Get formatted characters.
+		 * @return pointer to formatted characters.
+		 */
+		const char * data() const;
+
+		/**
+		 * Get number of formatted characters.
+		 * @return number of characters.
+		 */
+		std::size_t size() const;
+
+	private:
+		Formatter(const Formatter & other);	// = delete
+
+		Formatter & operator =(const Formatter & other); // = delete
+
+		static char * Buffer(std::size_t depth);
+
+		static std::size_t & Depth();
+
+		static constexpr std::size_t CountPlaceholders(const char * format, std::size_t count);
+
+		void formatArgs(const char * format);
+
+		template <typename ARG, typename... ARGS>
+		void formatArgs(const char * format, const ARG & arg, const ARGS & ... args);
+
+		void putUnsigned(unsigned long long u, bool negative);
+
+	private:
+		std::size_t m_depth;
+		char * m_buffer;
+		std::size_t m_size;
+		std::size_t m_capacity;
+};
+
+
+inline
+Formatter::Formatter():
+    m_depth(Depth()++),
+    m_buffer(Buffer(m_depth)),
+    m_size(0),
+    m_capacity(QL_FORMAT_BUFFER_SIZE - 1)	// Leave room for new line character.
+{
+}
+
+inline
+Formatter::~Formatter()
+{
+	if (m_depth >= NESTED_BUFFERS)
+		delete[] m_buffer;
+	Depth()--;
+}
+
+template <typename STREAM, typename... ARGS>
+void Formatter::Write(STREAM & stream, const char * prefix, const CallSite & site, const char * function, const char * format, const ARGS & ... args)
+{
+	Formatter formatter;
+	formatter.put(prefix);
+	formatter.format(format, args...);
+	formatter.put(Trace(stream.traceFlags(), site, function));
+	formatter.newLine();
+	stream.rdbuf()->putRecord(formatter.data(), formatter.size());
+}
+
+inline
+constexpr std::size_t Formatter::CountPlaceholders(const char * format)
+{
+	return CountPlaceholders(format, 0);
+}
+
+template <typename... ARGS>
+void Formatter::format(const char * format, const ARGS & ... args)
+{
+	formatArgs(format, args...);
+}
+
+inline
+const char * Formatter::literal(const char * format)
+{
+	const char * begin = format;
+	for (;;) {
+		if (*format == '\0') {
+			put(begin, static_cast<std::size_t>(format - begin));
+			return nullptr;
+		}
+		if ((format[0] == '{' && format[1] == '{') || (format[0] == '}' && format[1] == '}')) {
+			put(begin, static_cast<std::size_t>(format - begin) + 1);
+			format += 2;
+			begin = format;
+		} else if (format[0] == '{' && format[1] == '}') {
+			put(begin, static_cast<std::size_t>(format - begin));
+			return format + 2;
+		} else
+			format++;
+	}
+}
+
+inline
+void Formatter::newLine()
+{
+	m_buffer[m_size++] = '\n';
+}
+
+inline
+void Formatter::put(const char * s, std::size_t n)
+{
+	if (n > m_capacity - m_size)
+		n = m_capacity - m_size;
+	std::memcpy(m_buffer + m_size, s, n);
+	m_size += n;
+}
+
+inline
+void Formatter::put(const char * s)
+{
+	if (s == nullptr)
+		put("(null)", 6);
+	else
+		put(s, std::strlen(s));
+}
+
+inline
+void Formatter::put(const std::string & s)
+{
+	put(s.data(), s.size());
+}
+
+inline
+void Formatter::put(char c)
+{
+	put(& c, 1);
+}
+
+inline
+void Formatter::put(bool b)
+{
+	if (b)
+		put("true", 4);
+	else
+		put("false", 5);
+}
+
+inline
+void Formatter::put(int i)
+{
+	put(static_cast<long long>(i));
+}
+
+inline
+void Formatter::put(long i)
+{
+	put(static_cast<long long>(i));
+}
+
+inline
+void Formatter::put(long long i)
+{
+	if (i < 0)
+		putUnsigned(0ULL - static_cast<unsigned long long>(i), true);
+	else
+		putUnsigned(static_cast<unsigned long long>(i), false);
+}
+
+inline
+void Formatter::put(unsigned u)
+{
+	putUnsigned(u, false);
+}
+
+inline
+void Formatter::put(unsigned long u)
+{
+	putUnsigned(u, false);
+}
+
+inline
+void Formatter::put(unsigned long long u)
+{
+	putUnsigned(u, false);
+}
+
+inline
+void Formatter::put(float f)
+{
+	char buff[FloatFormat::MAX_SIZE];
+	put(buff, FloatFormat::Format(buff, f));
+}
+
+inline
+void Formatter::put(double d)
+{
+	char buff[FloatFormat::MAX_SIZE];
+	put(buff, FloatFormat::Format(buff, d));
+}
+
+inline
+void Formatter::put(long double d)
+{
+	char buff[FloatFormat::MAX_SIZE];
+	put(buff, FloatFormat::Format(buff, d));
+}
+
+inline
+void Formatter::put(const void * p)
+{
+	static const char digits[] = "0123456789abcdef";
+	char buff[2 + sizeof(p) * 2];
+	char * end = buff + sizeof(buff);
+	char * begin = end;
+	std::uintptr_t u = reinterpret_cast<std::uintptr_t>(p);
+	do {
+		*--begin = digits[u & 0xf];
+		u >>= 4;
+	} while (u != 0);
+	*--begin = 'x';
+	*--begin = '0';
+	put(begin, static_cast<std::size_t>(end - begin));
+}
+
+inline
+void Formatter::put(const Trace & trace)
+{
+	std::time_t sec = 0;
+	long nsec = 0;
+	if (trace.flags & Trace::DATE)
+		TimeStamp::Now(sec, nsec, (trace.flags & (Trace::MSEC | Trace::USEC | Trace::NSEC)) != 0);
+	put(trace, sec, nsec);
+}
+
+inline
+void Formatter::put(const Trace & trace, std::time_t sec, long nsec)
+{
+	if (trace.flags == 0)
+		return;
+
+	if (trace.site != nullptr) {
+		const std::string & suffix = trace.site->suffix(trace.flags, trace.function);
+		if (!(trace.flags & Trace::DATE)) {
+			put(suffix);
+			return;
+		}
+
+		char buff[TimeStamp::MAX_SIZE];
+		std::size_t size = trace.formatDate(buff, sec, nsec);
+		if (suffix.empty())
+			put(" [date: ", 8);
+		else {
+			// Replace closing bracket of the suffix with the date.
+			put(suffix.data(), suffix.size() - 1);
+			put(" date: ", 7);
+		}
+		put(buff, size);
+		put(']');
+		return;
+	}
+
+	char sep = '[';
+	put(' ');
+	if (trace.flags & Trace::FILE) {
+		put(sep);
+		put("file: ", 6);
+		put(trace.file);
+		sep = ' ';
+	}
+	if (trace.flags & Trace::LINE) {
+		put(sep);
+		put("line: ", 6);
+		put(static_cast<unsigned long long>(trace.line));
+		sep = ' ';
+	}
+	if (trace.flags & Trace::FUNCTION) {
+		put(sep);
+		put("function: ", 10);
+		put(trace.function);
+		sep = ' ';
+	}
+	if (trace.flags & Trace::DATE) {
+		char buff[TimeStamp::MAX_SIZE];
+		std::size_t size = trace.formatDate(buff, sec, nsec);
+		put(sep);
+		put("date: ", 6);
+		put(buff, size);
+	}
+	put(']');
+}
+
+inline
+const char * Formatter::data() const
+{
+	return m_buffer;
+}
+
+inline
+std::size_t Formatter::size() const
+{
+	return m_size;
+}
+
+inline
+char * Formatter::Buffer(std::size_t depth)
+{
+	static thread_local char buffers[NESTED_BUFFERS][QL_FORMAT_BUFFER_SIZE];
+	if (depth < NESTED_BUFFERS)
+		return buffers[depth];
+
+	return new char[QL_FORMAT_BUFFER_SIZE];
+}
+
+inline
+std::size_t & Formatter::Depth()
+{
+	static thread_local std::size_t depth = 0;
+	return depth;
+}
+
+inline
+constexpr std::size_t Formatter::CountPlaceholders(const char * format, std::size_t count)
+{
+	return *format == '\0' ? count
+			: (format[0] == '{' && format[1] == '{') || (format[0] == '}' && format[1] == '}') ? CountPlaceholders(format + 2, count)
+			: format[0] == '{' && format[1] == '}' ? CountPlaceholders(format + 2, count + 1)
+			: CountPlaceholders(format + 1, count);
+}
+
+inline
+void Formatter::formatArgs(const char * format)
+{
+	// Placeholders are checked at compile time, so there should be none left.
+	literal(format);
+}
+
+template <typename ARG, typename... ARGS>
+void Formatter::formatArgs(const char * format, const ARG & arg, const ARGS & ... args)
+{
+	format = literal(format);
+	if (format == nullptr)
+		return;
+	put(arg);
+	formatArgs(format, args...);
+}
+
+inline
+void Formatter::putUnsigned(unsigned long long u, bool negative)
+{
+	static const char digits[] =
+			"00010203040506070809"
+			"10111213141516171819"
+			"20212223242526272829"
+			"30313233343536373839"
+			"40414243444546474849"
+			"50515253545556575859"
+			"60616263646566676869"
+			"70717273747576777879"
+			"80818283848586878889"
+			"90919293949596979899";
+
+	char buff[21];
+	char * end = buff + sizeof(buff);
+	char * begin = end;
+	while (u >= 100) {
+		unsigned pair = static_cast<unsigned>(u % 100) * 2;
+		u /= 100;
+		*--begin = digits[pair + 1];
+		*--begin = digits[pair];
+	}
+	if (u >= 10) {
+		unsigned pair = static_cast<unsigned>(u) * 2;
+		*--begin = digits[pair + 1];
+		*--begin = digits[pair];
+	} else
+		*--begin = static_cast<char>('0' + u);
+	if (negative)
+		put('-');
+	put(begin, static_cast<std::size_t>(end - begin));
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
@@ -0,0 +1,405 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_KVBUF_HPP
+#define QL_KVBUF_HPP
+
+#include "FloatFormat.hpp"
+#include "Formatter.hpp"
+#include "KvRecord.hpp"
+#include "Level.hpp"
+#include "TimeStamp.hpp"
+
+#include <cmath>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <streambuf>
+#include <string>
+
+#ifdef __SSE2__
+	#include <emmintrin.h>
+#endif
+
+namespace ql {
+
+/**
+ * Structured record buffer. Renders structured records (see KvRecord) as JSON lines or in
+ * logfmt format and writes them to target buffer. When KvBuf is attached to LogBuf,
+ * records issued by key-value macros (e.g. QL_WARN_KV) are passed to writeKvRecord()
+ * as structured records, instead of being rendered as text.
+ *
+ * JSON record contains "time" (ISO 8601, UTC, microseconds), "level" (see LevelName()),
+ * "message", "file", "line", "function" and field members. Floating point fields are
+ * formatted with FloatFormat, so they do not depend on the locale and read back as the
+ * same value. Example:
+ * @code
+ * {"time":"2017-01-01T12:00:00.000000+00:00","level":"warning","message":"slow request","file":"main.cpp","line":42,"function":"handle","user":7,"latency_us":1500}
+ * @endcode
+ * Logfmt record contains the same keys, but "message" is abbreviated to "msg":
+ * @code
+ * time=2017-01-01T12:00:00.000000+00:00 level=warning msg="slow request" file=main.cpp line=42 function=handle user=7 latency_us=1500
+ * @endcode
+ * Plain text records (e.g. issued by QL_WARN) are rendered as records containing only
+ * "message" member, which holds the text without trailing new line character.
+ *
+ * Strings are escaped by scanning 16 characters at a time with SSE2 instructions, if they
+ * are available, for characters, which need escaping. Such characters are rare, so most
+ * strings are copied as a whole.
+ *
+ * Buffer can be derived from to render structured records in a different way - see
+ * writeKvRecord().
+ */
+class KvBuf:
+	public std::streambuf
+{
+	public:
+		enum format_t {
+			JSON,	///< JSON lines.
+			LOGFMT	///< Logfmt.
+		};
+
+	public:
+		/**
+		 * Constructor.
+		 * @param target target buffer.
+		 * @param format output format.
+		 */
+		explicit KvBuf(std::streambuf * target, format_t format = JSON);
+
+		/**
+		 * Get output format.
+		 * @return output format.
+		 */
+		format_t format() const;
+
+		/**
+		 * Write structured record. Called by LogBuf, while writes to this buffer are
+		 * serialized.
+		 * @param record structured record.
+		 * @return @p true on success, @p false if target buffer failed to write the record.
+		 */
+		virtual bool writeKvRecord(const KvRecord & record);
+
+		/**
+		 * Find first character, which needs to be escaped.
+		 * @param s characters.
+		 * @param n number of characters.
+		 * @param logfmt whether to treat space and equals sign as special characters, which
+		 * force value to be quoted in logfmt format.
+		 * @return index of the first special character or @a n if there is none.
+		 */
+		static std::size_t FindSpecial(const char * s, std::size_t n, bool logfmt);
+
+		/**
+		 * Append escaped string. Quotation mark, backslash and control characters are
+		 * escaped according to JSON rules.
+		 * @param out output string.
+		 * @param s characters.
+		 * @param n number of characters.
+		 */
+		static void AppendEscaped(std::string & out, const char * s, std::size_t n);
+
+	protected:
+		//std::streambuf
+		virtual int sync();
+
+		//std::streambuf
+		virtual int_type overflow(int_type c);
+
+		//std::streambuf
+		virtual std::streamsize xsputn(const char_type * s, std::streamsize n);
+
+	private:
+		KvBuf(const KvBuf & other);	// = delete
+
+		KvBuf & operator =(const KvBuf & other); // = delete
+
+		void appendKey(const char * key, std::size_t n);
+
+		void appendString(const char * s, std::size_t n);
+
+		void appendNumber(const char * format, ...);
+
+		template <typename T>
+		void appendFloat(T x);
+
+		bool writeText(const char * s, std::size_t n);
+
+		bool flushOut();
+
+	private:
+		std::streambuf * m_target;
+		format_t m_format;
+		std::string m_text;	///< Plain text record being collected.
+		std::string m_out;	///< Rendered record.
+};
+
+
+inline
+KvBuf::KvBuf(std::streambuf * target, format_t format):
+    m_target(target),
+    m_format(format)
+{
+}
+
+inline
+KvBuf::format_t KvBuf::format() const
+{
+	return m_format;
+}
+
+inline
+bool KvBuf::writeKvRecord(const KvRecord & record)
+{
+	char date[TimeStamp::MAX_SIZE];
+	std::size_t dateSize = TimeStamp::Format(date, record.seconds(), record.nanoseconds(), 6, true, true);
+	const char * function = record.function() != nullptr ? record.function() : "";
+
+	m_out.clear();
+	if (m_format == JSON)
+		m_out.push_back('{');
+	appendKey("time", 4);
+	appendString(date, dateSize);
+	appendKey("level", 5);
+	appendString(LevelName(record.level()), std::strlen(LevelName(record.level())));
+	if (m_format == JSON)
+		appendKey("message", 7);
+	else
+		appendKey("msg", 3);
+	appendString(record.message(), record.messageSize());
+	appendKey("file", 4);
+	appendString(record.site().file(), std::strlen(record.site().file()));
+	appendKey("line", 4);
+	appendNumber("%lu", static_cast<unsigned long>(record.site().line()));
+	appendKey("function", 8);
+	appendString(function, std::strlen(function));
+
+	KvRecord::Field field = KvRecord::Field();
+	std::size_t pos = 0;
+	while (record.nextField(field, pos)) {
+		appendKey(field.key, field.keySize);
+		switch (field.type) {
+			case KvRecord::INT:
+				appendNumber("%lld", static_cast<long long>(field.i));
+				break;
+			case KvRecord::UINT:
+				appendNumber("%llu", static_cast<unsigned long long>(field.u));
+				break;
+			case KvRecord::DOUBLE:
+				appendFloat(field.d);
+				break;
+			case KvRecord::FLOAT:
+				appendFloat(field.f);
+				break;
+			case KvRecord::BOOL:
+				m_out.append(field.b ? "true" : "false");
+				break;
+			default:
+				appendString(field.str, field.strSize);
+		}
+	}
+	if (m_format == JSON)
+		m_out.push_back('}');
+	m_out.push_back('\n');
+	return flushOut();
+}
+
+inline
+std::size_t KvBuf::FindSpecial(const char * s, std::size_t n, bool logfmt)
+{
+	std::size_t i = 0;
+#ifdef __SSE2__
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i control = _mm_set1_epi8(0x1f);
+	const __m128i space = _mm_set1_epi8(' ');
+	const __m128i equals = _mm_set1_epi8('=');
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+		// Unsigned maximum of control character and 0x1f is 0x1f.
+		__m128i mask = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)), _mm_cmpeq_epi8(_mm_max_epu8(v, control), control));
+		if (logfmt)
+			mask = _mm_or_si128(mask, _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(v, equals)));
+		int bits = _mm_movemask_epi8(mask);
+		if (bits != 0)
+			return i + static_cast<std::size_t>(__builtin_ctz(static_cast<unsigned>(bits)));
+	}
+#endif
+	for (; i < n; i++) {
+		unsigned char c = static_cast<unsigned char>(s[i]);
+		if (c < 0x20 || c == '"' || c == '\\' || (logfmt && (c == ' ' || c == '=')))
+			return i;
+	}
+	return n;
+}
+
+inline
+void KvBuf::AppendEscaped(std::string & out, const char * s, std::size_t n)
+{
+	static const char hex[] = "0123456789abcdef";
+
+	for (;;) {
+		std::size_t i = FindSpecial(s, n, false);
+		out.append(s, i);
+		if (i == n)
+			return;
+
+		unsigned char c = static_cast<unsigned char>(s[i]);
+		switch (c) {
+			case '"':
+				out.append("\\\"", 2);
+				break;
+			case '\\':
+				out.append("\\\\", 2);
+				break;
+			case '\n':
+				out.append("\\n", 2);
+				break;
+			case '\r':
+				out.append("\\r", 2);
+				break;
+			case '\t':
+				out.append("\\t", 2);
+				break;
+			default: {
+				char u[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+				out.append(u, sizeof(u));
+			}
+		}
+		s += i + 1;
+		n -= i + 1;
+	}
+}
+
+inline
+int KvBuf::sync()
+{
+	return m_target->pubsync();
+}
+
+inline
+KvBuf::int_type KvBuf::overflow(int_type c)
+{
+	if (traits_type::eq_int_type(c, traits_type::eof()))
+		return traits_type::not_eof(c);
+
+	char ch = traits_type::to_char_type(c);
+	if (xsputn(& ch, 1) != 1)
+		return traits_type::eof();
+	return c;
+}
+
+inline
+std::streamsize KvBuf::xsputn(const char_type * s, std::streamsize n)
+{
+	// Plain text records come whole, but let's not rely on it and split them by new line.
+	const char * end = s + n;
+	for (const char * p = s; p != end; ) {
+		const char * nl = static_cast<const char *>(std::memchr(p, '\n', static_cast<std::size_t>(end - p)));
+		if (nl == nullptr) {
+			m_text.append(p, static_cast<std::size_t>(end - p));
+			break;
+		}
+		bool result;
+		if (m_text.empty())
+			result = writeText(p, static_cast<std::size_t>(nl - p));
+		else {
+			m_text.append(p, static_cast<std::size_t>(nl - p));
+			result = writeText(m_text.data(), m_text.size());
+			m_text.clear();
+		}
+		if (!result)
+			return nl - s;
+		p = nl + 1;
+	}
+	return n;
+}
+
+inline
+void KvBuf::appendKey(const char * key, std::size_t n)
+{
+	if (m_format == JSON) {
+		if (m_out.size() > 1)
+			m_out.push_back(',');
+		m_out.push_back('"');
+		AppendEscaped(m_out, key, n);
+		m_out.append("\":", 2);
+	} else {
+		if (!m_out.empty())
+			m_out.push_back(' ');
+		m_out.append(key, n);
+		m_out.push_back('=');
+	}
+}
+
+inline
+void KvBuf::appendString(const char * s, std::size_t n)
+{
+	if (m_format == LOGFMT && n != 0 && FindSpecial(s, n, true) == n) {
+		m_out.append(s, n);
+		return;
+	}
+
+	m_out.push_back('"');
+	AppendEscaped(m_out, s, n);
+	m_out.push_back('"');
+}
+
+inline
+void KvBuf::appendNumber(const char * format, ...)
+{
+	char buff[32];
+	va_list args;
+	va_start(args, format);
+	int len = std::vsnprintf(buff, sizeof(buff), format, args);
+	va_end(args);
+	if (len > 0)
+		m_out.append(buff, static_cast<std::size_t>(len) < sizeof(buff) ? static_cast<std::size_t>(len) : sizeof(buff) - 1);
+}
+
+template <typename T>
+void KvBuf::appendFloat(T x)
+{
+	if (m_format == JSON && !std::isfinite(x)) {
+		m_out.append("null");	// JSON has no representation of infinity and NaN.
+		return;
+	}
+
+	char buff[FloatFormat::MAX_SIZE];
+	m_out.append(buff, FloatFormat::Format(buff, x));
+}
+
+inline
+bool KvBuf::writeText(const char * s, std::size_t n)
+{
+	m_out.clear();
+	if (m_format == JSON) {
+		m_out.push_back('{');
+		appendKey("message", 7);
+	} else
+		appendKey("msg", 3);
+	appendString(s, n);
+	if (m_format == JSON)
+		m_out.push_back('}');
+	m_out.push_back('\n');
+	return flushOut();
+}
+
+inline
+bool KvBuf::flushOut()
+{
+	return m_target->sputn(m_out.data(), static_cast<std::streamsize>(m_out.size())) == static_cast<std::streamsize>(m_out.size());
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
@@ -0,0 +1,614 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_KVRECORD_HPP
+#define QL_KVRECORD_HPP
+
+#include "CallSite.hpp"
+#include "Formatter.hpp"
+#include "Level.hpp"
+#include "TimeStamp.hpp"
+#include "Trace.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <string>
+
+namespace ql {
+
+/**
+ * Structured key-value record. Level, message, call site, trace flags, time stamp and
+ * typed fields of the record are kept separately. Record is encoded by Write() into a
+ * contiguous block of bytes, which is passed through log buffers as a whole (see
+ * LogBuf::putKvRecord()). KvRecord object is a read-only view of encoded record.
+ *
+ * Sinks derived from KvBuf render structured records on their own (e.g. as JSON lines).
+ * Other sinks receive text rendering of the record, which looks like a record of
+ * QL_<LEVEL> macros with fields appended to the message as "key=value" pairs.
+ */
+class KvRecord
+{
+	public:
+		enum type_t {
+			INT,	///< 64 bit signed integer.
+			UINT,	///< 64 bit unsigned integer.
+			DOUBLE,	///< Floating point number.
+			BOOL,	///< Boolean.
+			STRING,	///< String.
+			FLOAT	///< Single precision floating point number.
+		};
+
+		/**
+		 * Field.
+		 */
+		struct Field
+		{
+			const char * key;
+			std::size_t keySize;
+			type_t type;
+			std::int64_t i;		///< Value of INT field.
+			std::uint64_t u;	///< Value of UINT field.
+			double d;			///< Value of DOUBLE field.
+			float f;			///< Value of FLOAT field.
+			bool b;				///< Value of BOOL field.
+			const char * str;	///< Characters of STRING field.
+			std::size_t strSize;	///< Number of characters of STRING field.
+		};
+
+	public:
+		/**
+		 * Constructor.
+		 * @param data encoded record.
+		 * @param size size of encoded record.
+		 */
+		KvRecord(const char * data, std::size_t size);
+
+		/**
+		 * Check whether record is valid.
+		 * @return @p true if data contains encoded record, @p false otherwise. Other
+		 * functions must not be called on invalid record.
+		 */
+		bool isValid() const;
+
+		/**
+		 * Get call site.
+		 * @return call site of the macro, which issued the record.
+		 */
+		const CallSite & site() const;
+
+		/**
+		 * Get level.
+		 * @return one of QL_LEVEL_* values.
+		 */
+		int level() const;
+
+		/**
+		 * Get function name.
+		 * @return name of the function, in which record has been issued.
+		 */
+		const char * function() const;
+
+		/**
+		 * Get message prefix.
+		 * @return prefix used in text rendering (e.g. "Warning: ").
+		 */
+		const char * prefix() const;
+
+		/**
+		 * Get trace flags.
+		 * @return trace flags of the stream at the moment, when record has been issued.
+		 */
+		int traceFlags() const;
+
+		/**
+		 * Get seconds of time stamp.
+		 * @return seconds since epoch.
+		 */
+		std::time_t seconds() const;
+
+		/**
+		 * Get nanoseconds of time stamp.
+		 * @return nanoseconds.
+		 */
+		long nanoseconds() const;
+
+		/**
+		 * Get message.
+		 * @return pointer to characters of the message. Message is not null terminated -
+		 * use messageSize() to obtain its length.
+		 */
+		const char * message() const;
+
+		/**
+		 * Get message size.
+		 * @return number of characters of the message.
+		 */
+		std::size_t messageSize() const;
+
+		/**
+		 * Get number of fields.
+		 * @return number of key-value fields of the record.
+		 */
+		std::size_t fieldCount() const;
+
+		/**
+		 * Read next field.
+		 * @param field field to be filled.
+		 * @param pos position of the field. It should be zero for the first field. On
+		 * return it is set to position of the next field.
+		 * @return @p true if field has been read, @p false if there are no more fields.
+		 */
+		bool nextField(Field & field, std::size_t & pos) const;
+
+		/**
+		 * Render record as text.
+		 * @param formatter formatter.
+		 */
+		void render(Formatter & formatter) const;
+
+		/**
+		 * Encode and write a record.
+		 * @param stream log stream (LogStream). Stream type is a template parameter, so
+		 * that this header does not depend on log buffers, which use KvRecord.
+		 * @param prefix message prefix.
+		 * @param site call site.
+		 * @param function function name.
+		 * @param message message (C string or std::string).
+		 * @param fields fields given as key, value pairs. Keys must be C strings. Values
+		 * may be integers, floating point numbers, booleans, characters, C strings or
+		 * std::string objects.
+		 */
+		template <typename STREAM, typename MESSAGE, typename... FIELDS>
+		static void Write(STREAM & stream, const char * prefix, const CallSite & site, const char * function, const MESSAGE & message, const FIELDS & ... fields);
+
+	private:
+		static const std::uint32_t MAGIC = 0x564b4c51;	///< "QLKV".
+
+		struct Header
+		{
+			std::uint32_t magic;
+			std::uint32_t fieldCount;
+			const CallSite * site;
+			const char * function;
+			const char * prefix;
+			std::int64_t sec;
+			std::int64_t nsec;
+			std::int32_t traceFlags;
+			std::uint32_t messageSize;
+		};
+
+		class Encoder
+		{
+			public:
+				explicit Encoder(std::string & buffer);
+
+				void putMessage(const char * s);
+
+				void putMessage(const std::string & s);
+
+				void putFields();
+
+				template <typename VALUE, typename... FIELDS>
+				void putFields(const char * key, const VALUE & value, const FIELDS & ... fields);
+
+			private:
+				template <typename T>
+				void putValue(const T & value);
+
+				void putString(const char * s, std::size_t n);
+
+				void putKey(type_t type, const char * key);
+
+				void put(const char * key, int i);
+
+				void put(const char * key, long i);
+
+				void put(const char * key, long long i);
+
+				void put(const char * key, unsigned u);
+
+				void put(const char * key, unsigned long u);
+
+				void put(const char * key, unsigned long long u);
+
+				void put(const char * key, float f);
+
+				void put(const char * key, double d);
+
+				void put(const char * key, long double d);
+
+				void put(const char * key, bool b);
+
+				void put(const char * key, char c);
+
+				void put(const char * key, const char * s);
+
+				void put(const char * key, const std::string & s);
+
+			private:
+				std::string & m_buffer;
+		};
+
+	private:
+		/**
+		 * Get encoding buffer of calling thread.
+		 * @return thread-local buffer.
+		 */
+		static std::string & Buffer();
+
+	private:
+		Header m_header;
+		const char * m_message;
+		const char * m_fields;
+		std::size_t m_fieldsSize;
+		bool m_valid;
+};
+
+
+inline
+KvRecord::KvRecord(const char * data, std::size_t size):
+    m_message(nullptr),
+    m_fields(nullptr),
+    m_fieldsSize(0),
+    m_valid(false)
+{
+	if (size < sizeof(Header))
+		return;
+
+	std::memcpy(& m_header, data, sizeof(Header));
+	if (m_header.magic != MAGIC || m_header.messageSize > size - sizeof(Header))
+		return;
+
+	m_message = data + sizeof(Header);
+	m_fields = m_message + m_header.messageSize;
+	m_fieldsSize = size - sizeof(Header) - m_header.messageSize;
+	m_valid = true;
+}
+
+inline
+bool KvRecord::isValid() const
+{
+	return m_valid;
+}
+
+inline
+const CallSite & KvRecord::site() const
+{
+	return *m_header.site;
+}
+
+inline
+int KvRecord::level() const
+{
+	return m_header.site->level();
+}
+
+inline
+const char * KvRecord::function() const
+{
+	return m_header.function;
+}
+
+inline
+const char * KvRecord::prefix() const
+{
+	return m_header.prefix;
+}
+
+inline
+int KvRecord::traceFlags() const
+{
+	return m_header.traceFlags;
+}
+
+inline
+std::time_t KvRecord::seconds() const
+{
+	return static_cast<std::time_t>(m_header.sec);
+}
+
+inline
+long KvRecord::nanoseconds() const
+{
+	return static_cast<long>(m_header.nsec);
+}
+
+inline
+const char * KvRecord::message() const
+{
+	return m_message;
+}
+
+inline
+std::size_t KvRecord::messageSize() const
+{
+	return m_header.messageSize;
+}
+
+inline
+std::size_t KvRecord::fieldCount() const
+{
+	return m_header.fieldCount;
+}
+
+inline
+bool KvRecord::nextField(Field & field, std::size_t & pos) const
+{
+	std::uint32_t keySize;
+	if (m_fieldsSize - pos < 1 + sizeof(keySize))
+		return false;
+
+	const char * p = m_fields + pos;
+	const char * end = m_fields + m_fieldsSize;
+	field.type = static_cast<type_t>(*p++);
+	std::memcpy(& keySize, p, sizeof(keySize));
+	p += sizeof(keySize);
+	if (static_cast<std::size_t>(end - p) < keySize)
+		return false;
+	field.key = p;
+	field.keySize = keySize;
+	p += keySize;
+
+	std::size_t valueSize = field.type == BOOL ? 1 : field.type == STRING || field.type == FLOAT ? sizeof(std::uint32_t) : 8;
+	if (static_cast<std::size_t>(end - p) < valueSize)
+		return false;
+	switch (field.type) {
+		case INT:
+			std::memcpy(& field.i, p, sizeof(field.i));
+			break;
+		case UINT:
+			std::memcpy(& field.u, p, sizeof(field.u));
+			break;
+		case DOUBLE:
+			std::memcpy(& field.d, p, sizeof(field.d));
+			break;
+		case FLOAT:
+			std::memcpy(& field.f, p, sizeof(field.f));
+			break;
+		case BOOL:
+			field.b = *p != 0;
+			break;
+		case STRING: {
+			std::uint32_t n;
+			std::memcpy(& n, p, sizeof(n));
+			if (static_cast<std::size_t>(end - p) - valueSize < n)
+				return false;
+			field.str = p + valueSize;
+			field.strSize = n;
+			p += n;
+			break;
+		}
+		default:
+			return false;
+	}
+	p += valueSize;
+	pos = static_cast<std::size_t>(p - m_fields);
+	return true;
+}
+
+inline
+void KvRecord::render(Formatter & formatter) const
+{
+	formatter.put(prefix());
+	formatter.put(message(), messageSize());
+	Field field = Field();
+	std::size_t pos = 0;
+	while (nextField(field, pos)) {
+		formatter.put(' ');
+		formatter.put(field.key, field.keySize);
+		formatter.put('=');
+		switch (field.type) {
+			case INT:
+				formatter.put(static_cast<long long>(field.i));
+				break;
+			case UINT:
+				formatter.put(static_cast<unsigned long long>(field.u));
+				break;
+			case DOUBLE:
+				formatter.put(field.d);
+				break;
+			case FLOAT:
+				formatter.put(field.f);
+				break;
+			case BOOL:
+				formatter.put(field.b);
+				break;
+			default:
+				formatter.put(field.str, field.strSize);
+		}
+	}
+	formatter.put(Trace(traceFlags(), site(), function()), seconds(), nanoseconds());
+	formatter.newLine();
+}
+
+template <typename STREAM, typename MESSAGE, typename... FIELDS>
+void KvRecord::Write(STREAM & stream, const char * prefix, const CallSite & site, const char * function, const MESSAGE & message, const FIELDS & ... fields)
+{
+	static_assert(sizeof...(FIELDS) % 2 == 0, "Fields must be given as key, value pairs.");
+
+	std::time_t sec;
+	long nsec;
+	TimeStamp::Now(sec, nsec);
+
+	Header header = Header();
+	header.magic = MAGIC;
+	header.fieldCount = sizeof...(FIELDS) / 2;
+	header.site = & site;
+	header.function = function;
+	header.prefix = prefix;
+	header.sec = sec;
+	header.nsec = nsec;
+	header.traceFlags = stream.traceFlags();
+
+	std::string & buffer = Buffer();
+	buffer.assign(reinterpret_cast<const char *>(& header), sizeof(header));
+	Encoder encoder(buffer);
+	encoder.putMessage(message);
+	header.messageSize = static_cast<std::uint32_t>(buffer.size() - sizeof(header));
+	std::memcpy(& buffer[0], & header, sizeof(header));
+	encoder.putFields(fields...);
+	stream.rdbuf()->putKvRecord(buffer.data(), buffer.size());
+}
+
+inline
+std::string & KvRecord::Buffer()
+{
+	static thread_local std::string buffer;
+	return buffer;
+}
+
+inline
+KvRecord::Encoder::Encoder(std::string & buffer):
+    m_buffer(buffer)
+{
+}
+
+inline
+void KvRecord::Encoder::putMessage(const char * s)
+{
+	if (s == nullptr)
+		m_buffer.append("(null)", 6);
+	else
+		m_buffer.append(s);
+}
+
+inline
+void KvRecord::Encoder::putMessage(const std::string & s)
+{
+	m_buffer.append(s);
+}
+
+inline
+void KvRecord::Encoder::putFields()
+{
+}
+
+template <typename VALUE, typename... FIELDS>
+void KvRecord::Encoder::putFields(const char * key, const VALUE & value, const FIELDS & ... fields)
+{
+	put(key, value);
+	putFields(fields...);
+}
+
+template <typename T>
+void KvRecord::Encoder::putValue(const T & value)
+{
+	m_buffer.append(reinterpret_cast<const char *>(& value), sizeof(value));
+}
+
+inline
+void KvRecord::Encoder::putString(const char * s, std::size_t n)
+{
+	putValue(static_cast<std::uint32_t>(n));
+	m_buffer.append(s, n);
+}
+
+inline
+void KvRecord::Encoder::putKey(type_t type, const char * key)
+{
+	m_buffer.push_back(static_cast<char>(type));
+	putString(key, std::strlen(key));
+}
+
+inline
+void KvRecord::Encoder::put(const char * key, int i)
+{
+	put(key, static_cast<long long>(i));
+}
+
+inline
+void KvRecord::Encoder::put(const char * key, long i)
+{
+	put(key, static_cast<long long>(i));
+}
+
+inline
+void KvRecord::Encoder::put(const char * key, long long i)
+{
+	putKey(INT, key);
+	putValue(static_cast<std::int64_t>(i));
+}
+
+inline
+void KvRecord::Encoder::put(const char * key, unsigned u)
+{
+	put(key, static_cast<unsigned long long>(u));
+}
+
+inline
+void KvRecord::Encoder::put(const char * key, unsigned long u)
+{
+	put(key, static_cast<unsigned long long>(u));
+}
+
+inline
+void KvRecord::Encoder::put(const char * key, unsigned long long u)
+{
+	putKey(UINT, key);
+	putValue(static_cast<std::uint64_t>(u));
+}
+
+inline
+void KvRecord::Encoder::put(const char * key, float f)
+{
+	putKey(FLOAT, key);
+	putValue(f);
+}
+
+inline
+void KvRecord::Encoder::put(const char * key, double d)
+{
+	putKey(DOUBLE, key);
+	putValue(d);
+}
+
+inline
+void KvRecord::Encoder::put(const char * key, long double d)
+{
+	// Long double field is kept with precision of double.
+	put(key, static_cast<double>(d));
+}
+
+inline
+void KvRecord::Encoder::put(const char * key, bool b)
+{
+	putKey(BOOL, key);
+	putValue(static_cast<std::uint8_t>(b));
+}
+
+inline
+void KvRecord::Encoder::put(const char * key, char c)
+{
+	putKey(STRING, key);
+	putString(& c, 1);
+}
+
+inline
+void KvRecord::Encoder::put(const char * key, const char * s)
+{
+	putKey(STRING, key);
+	if (s == nullptr)
+		putString("(null)", 6);
+	else
+		putString(s, std::strlen(s));
+}
+
+inline
+void KvRecord::Encoder::put(const char * key, const std::string & s)
+{
+	putKey(STRING, key);
+	putString(s.data(), s.size());
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
@@ -0,0 +1,74 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_LEVEL_HPP
+#define QL_LEVEL_HPP
+
+/**
+ * @name Levels
+ * Severity levels of log records. Levels are defined as preprocessor macros, so that
+ * they can be used in conditional compilation.
+ */
+//@{
+#define QL_LEVEL_DEBUG 0		///< Level of QL_DEBUG messages.
+#define QL_LEVEL_NOTE 1		///< Level of QL_NOTE messages.
+#define QL_LEVEL_INFO 2		///< Level of QL_INFO messages.
+#define QL_LEVEL_WARN 3		///< Level of QL_WARN messages.
+#define QL_LEVEL_ERROR 4		///< Level of QL_ERROR messages.
+#define QL_LEVEL_CRITICAL 5	///< Level of QL_CRITICAL messages.
+#define QL_LEVEL_FATAL 6		///< Level of QL_FATAL messages.
+//@}
+
+/**
+ * Minimal level of records compiled in. Macros of lower levels are turned off, as if
+ * QL_NO_DEBUG, QL_NO_NOTE, QL_NO_INFO, QL_NO_WARN or QL_NO_ERROR were defined, so they
+ * generate neither code nor data. QL_CRITICAL and QL_FATAL are never turned off by this
+ * setting, because they terminate the program. Must be defined before including QL files.
+ */
+#ifndef QL_MIN_LEVEL
+	#define QL_MIN_LEVEL QL_LEVEL_DEBUG
+#endif
+
+namespace ql {
+
+/**
+ * Get level name.
+ * @param level one of QL_LEVEL_* values.
+ * @return lower case name of the level.
+ */
+const char * LevelName(int level);
+
+
+inline
+const char * LevelName(int level)
+{
+	switch (level) {
+		case QL_LEVEL_DEBUG:
+			return "debug";
+		case QL_LEVEL_NOTE:
+			return "note";
+		case QL_LEVEL_INFO:
+			return "info";
+		case QL_LEVEL_WARN:
+			return "warning";
+		case QL_LEVEL_ERROR:
+			return "error";
+		case QL_LEVEL_CRITICAL:
+			return "critical";
+		case QL_LEVEL_FATAL:
+			return "fatal";
+		default:
+			return "unknown";
+	}
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
@@ -7,6 +7,18 @@
 #define QL_LOG_HPP
 
 #include "LogStream.hpp"
+#include "AsyncWriter.hpp"
+#include "Level.hpp"
+#include "PeriodicTask.hpp"
+#include "Record.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <type_traits>
 
 namespace ql { class Log; }
 
@@ -30,9 +42,15 @@ void ql_logInitFuncCout(ql::Log * log);
  * to customize initial stream attachments. By default ql_logInitFuncCout() is used. User
  * function must be defined in global namespace, because for convenience it will be
  * forwardly declared, using given macro value.
+ *
+ * Header <iostream> (and static initialization, which comes with it) is included only if
+ * default function is used. Otherwise ql_logInitFuncCout() is not defined.
  */
 #ifndef QL_LOG_INIT_FUNC
 	#define QL_LOG_INIT_FUNC ql_logInitFuncCout
+	#define QL_IMPL_LOG_INIT_FUNC_COUT
+
+	#include <iostream>
 #else
 	/*
 	 * For user convenience let's declare his initialization function so that (s)he will only
@@ -42,15 +60,24 @@ void ql_logInitFuncCout(ql::Log * log);
 	void QL_LOG_INIT_FUNC(ql::Log * log);
 #endif
 
+/**
+ * Interval in milliseconds, at which Log puts into its streams records batched by logs
+ * constructed with it as a parent (see ql::LogBuf::flushBatch()). It bounds delay of
+ * records of threads, which have stopped logging. Timer thread is started, when the first
+ * such log is constructed. Zero disables the timer.
+ */
+#ifndef QL_FORWARD_BATCH_INTERVAL
+	#define QL_FORWARD_BATCH_INTERVAL 100
+#endif
+
 namespace ql {
 
 /**
  * Log. Main class of QL log facility.
  *
- * This class is a singleton and can not be instantiated directly. To obtain instance
- * use Instance() function. For convenient usage of this class seven macros are defined
- * (in separate header) for logging purposes (QL_DEBUG, QL_NOTE, QL_WARN, QL_ERROR,
- * QL_CRITICAL, QL_FATAL, QL_INFO).
+ * Default Log instance can be obtained with Instance() function. For convenient usage of
+ * this class seven macros are defined (in separate header) for logging purposes (QL_DEBUG,
+ * QL_NOTE, QL_WARN, QL_ERROR, QL_CRITICAL, QL_FATAL, QL_INFO).
  *
  * Log class defines seven streams which are instances of LogStream class. Each of them
  * may be attached to any number of other streams. For example, to bring debug output
@@ -69,9 +96,71 @@ namespace ql {
  * Combined stream is already attached to seven previously described streams. By attaching
  * std::cout to combined stream, all seven streams will put the output, through combined
  * stream, to std::cout. Default stream attachment is defined by QL_LOG_INIT_FUNC macro.
+ *
+ * By default records are written to the attached streams by the thread, which issues
+ * them. Asynchronous mode can be turned on with enableAsync(). In asynchronous mode
+ * macros only copy finished records into a queue and dedicated writer thread writes them
+ * to the attached streams.
+ *
+ * By default Log is created on first use, thus each call of Instance() checks guard
+ * variable of function-local static object. If QL_LOG_EXPLICIT_INIT is defined, Log is
+ * kept in static storage instead and it has to be created by Init() at startup.
+ * Instance() then loads a pointer, which is null until Init() and after Shutdown(); in
+ * such case it returns placeholder log, which has no devices attached, so records are
+ * discarded. Construction does not happen in the middle of whatever first logs something
+ * and the Log is destroyed by Shutdown(), which is registered with std::atexit() by
+ * Init(). QL_LOG_EXPLICIT_INIT must be defined consistently in all translation units.
+ *
+ * By default attached streams are synced after each record. To reduce number of system
+ * calls issued by file streams, different flush policy can be set with setFlushPolicy().
+ *
+ * Each stream keeps statistics (number of records, bytes, time spent in attached streams,
+ * errors etc.). Snapshot of all of them can be obtained with statistics(). Statistics can
+ * also be written periodically to info stream (see enableStatisticsDump()). Records of the
+ * dump itself are included in statistics of info stream (and of any stream info stream is
+ * attached to), just like any other records.
+ *
+ * Besides default instance, Log objects can be constructed independently, e.g. one per
+ * tenant or per subsystem. Each of them has its own streams, trace flags, flush policy,
+ * statistics and asynchronous mode. Streams of log constructed with a parent forward their
+ * records to respective streams of the parent (see LogBuf::setForwardBuffer()). Records
+ * are written to devices attached to the log itself and they are collected in batches,
+ * which are put into streams of the parent at once, so that they pass asynchronous writer
+ * and flush policy of the parent and they are counted in its statistics, while shared
+ * state of the parent is touched once per batch. Devices attached to both logs are
+ * written only by the parent. Batches are put, when they are full, when the log is
+ * flushed and every QL_FORWARD_BATCH_INTERVAL milliseconds by timer of the parent, so
+ * until then records of the log may appear on devices of the parent after records, which
+ * have been logged to the parent directly later. Records are logged to a specific
+ * instance with macros taking log as their first argument (e.g. QL_DEBUG_TO) and
+ * ThreadInstance() gives each thread its own log with default instance as a parent.
+ * Defining QL_LOG_INSTANCE redirects all the macros, which do not take log argument, to
+ * another instance.
+ * @code
+ * ql::Log tenantLog(ql::Log::Instance());
+ * tenantLog.combinedStream().attachBuffer(& tenantFileBuf);
+ * QL_NOTE_TO(tenantLog, "request " << id << " accepted");
+ * @endcode
  */
 class Log
 {
+	public:
+		/**
+		 * Statistics. Snapshot of statistics of all the streams.
+		 */
+		struct Statistics
+		{
+			LogBuf::Statistics combined;
+			LogBuf::Statistics debug;
+			LogBuf::Statistics note;
+			LogBuf::Statistics warn;
+			LogBuf::Statistics error;
+			LogBuf::Statistics critical;
+			LogBuf::Statistics fatal;
+			LogBuf::Statistics info;
+			std::uint64_t asyncDropped;	///< Records dropped by asynchronous writer (see AsyncWriter::droppedCount()).
+		};
+
 	public:
 		/**
 		 * Get Log singleton instance.
@@ -79,7 +168,62 @@ class Log
 		 */
 		static Log & Instance();
 
+		/**
+		 * Get Log instance of the calling thread. Thread-local Log is constructed on first
+		 * use in each thread with Instance() as a parent, so that its records reach the
+		 * same devices as records of default instance. Its streams and their batches are not
+		 * shared with other threads. It is destroyed, when the thread exits. If
+		 * QL_LOG_EXPLICIT_INIT is defined, function must not be called before Init().
+		 * @return Log instance of the calling thread.
+		 */
+		static Log & ThreadInstance();
+
+		/**
+		 * Initialize Log. If QL_LOG_EXPLICIT_INIT is defined, function constructs Log in
+		 * static storage and registers Shutdown() with std::atexit(). It should be called
+		 * at startup (e.g. at the beginning of main()), before Log is used; until then
+		 * Instance() returns placeholder log without devices, so macros discard records.
+		 * Placeholder should not be configured - attachments and settings are not carried
+		 * over to the Log. Subsequent calls have no effect. Without QL_LOG_EXPLICIT_INIT
+		 * function merely creates Log instance, if it does not exist yet.
+		 */
+		static void Init();
+
+		/**
+		 * Shut down Log. Pending records are written and attached streams are flushed. If
+		 * QL_LOG_EXPLICIT_INIT is defined, Log is destroyed and Instance() returns
+		 * placeholder log again, so that records issued afterwards (e.g. by destructors of
+		 * static objects) are discarded. Function must not be called,
+		 * while other threads are logging. Without QL_LOG_EXPLICIT_INIT function only
+		 * flushes the Log, which is destroyed together with other static objects.
+		 */
+		static void Shutdown();
+
 	public:
+		/**
+		 * Default constructor. Constructs Log, which does not have any device attached.
+		 * Combined stream is attached to the other seven streams. Initialization function
+		 * (QL_LOG_INIT_FUNC) is not called.
+		 */
+		Log();
+
+		/**
+		 * Constructor. Constructs Log, whose streams forward records to respective streams
+		 * of @a parent. Trace flags and flush policies of the streams are copied from
+		 * @a parent. Timer of FlushPolicy::INTERVAL policy is not started, so buffers
+		 * attached to the log itself are synced, when a record is written after the
+		 * interval has elapsed, on flush() and when the log is destroyed.
+		 * @param parent parent log. Parent must outlive constructed log.
+		 */
+		explicit Log(Log & parent);
+
+		/**
+		 * Destructor. Writes pending records if asynchronous mode is enabled, syncs
+		 * attached buffers, which have not been synced since last record, and stops
+		 * forwarding records to the parent.
+		 */
+		~Log();
+
 		/**
 		 * Get debug stream.
 		 * @return debug stream.
@@ -146,12 +290,15 @@ class Log
 		 * Attach log. Attaches respectively seven streams (without combined) of other log to
 		 * streams of this log.
 		 * @param other other log.
+		 * @return @p true if all the streams have been attached, @p false if any attachment
+		 * has been rejected, because it would create a cycle (e.g. when @a other log is
+		 * already attached to this log).
 		 *
 		 * @note this function is useful when working with libraries.
 		 *
 		 * @see detachLog().
 		 */
-		void attachLog(Log & other);
+		bool attachLog(Log & other);
 
 		/**
 		 * Detach log. Detaches respectively seven streams (without combined) of other log
@@ -169,17 +316,152 @@ class Log
 		 */
 		void setTraceFlags(int flags);
 
+		/**
+		 * Set flush policy. Sets specified flush policy on streams of level lower than
+		 * @a flushLevel and on combined stream. Streams of level @a flushLevel and higher
+		 * always sync attached streams after each record. For example to sync attached
+		 * streams only on errors:
+		 * @code
+		 * ql::Log::Instance().setFlushPolicy(ql::FlushPolicy::Never(), QL_LEVEL_ERROR);
+		 * @endcode
+		 * If FlushPolicy::INTERVAL policy is set, timer thread is started, which syncs
+		 * attached streams periodically.
+		 * @param policy flush policy.
+		 * @param flushLevel one of QL_LEVEL_* values. Pass value greater than QL_LEVEL_FATAL
+		 * to set @a policy on all the streams.
+		 *
+		 * @note QL_CRITICAL and QL_FATAL macros call flush() regardless of the policy.
+		 *
+		 * @warning this function should not be called while other threads are logging.
+		 */
+		void setFlushPolicy(const FlushPolicy & policy, int flushLevel = QL_LEVEL_CRITICAL);
+
+		/**
+		 * Enable asynchronous mode. Records written to any of the eight streams are queued
+		 * and written to attached streams by a writer thread. If asynchronous mode is already
+		 * enabled, queue is drained and replaced by the new one.
+		 * @param queueSize maximal number of queued records.
+		 * @param policy policy applied, when the queue is full.
+		 *
+		 * @warning this function should not be called while other threads are logging.
+		 *
+		 * @see disableAsync(), flush().
+		 */
+		void enableAsync(std::size_t queueSize = 8192, AsyncWriter::overflowPolicy_t policy = AsyncWriter::BLOCK);
+
+		/**
+		 * Disable asynchronous mode. Queued records are written and writer thread is stopped.
+		 *
+		 * @warning this function should not be called while other threads are logging.
+		 *
+		 * @see enableAsync().
+		 */
+		void disableAsync();
+
+		/**
+		 * Get asynchronous writer.
+		 * @return asynchronous writer or @p nullptr if asynchronous mode is disabled.
+		 */
+		AsyncWriter * asyncWriter() const;
+
+		/**
+		 * Flush. In asynchronous mode blocks until all the records issued before the call
+		 * are written. Forces attached buffers to sync regardless of flush policy. Batched
+		 * records of this log and of logs constructed with it as a parent are put into
+		 * their parents. Log constructed with a parent flushes the parent too. Function is
+		 * called by QL_CRITICAL and QL_FATAL macros before the program is terminated.
+		 */
+		void flush();
+
+		/**
+		 * Get statistics.
+		 * @return snapshot of statistics of all the streams.
+		 */
+		Statistics statistics() const;
+
+		/**
+		 * Reset statistics of all the streams.
+		 */
+		void resetStatistics();
+
+		/**
+		 * Enable or disable sink timing on all the streams.
+		 * @param enabled whether time spent in sinks should be measured.
+		 *
+		 * @see LogBuf::setSinkTiming().
+		 */
+		void setSinkTiming(bool enabled);
+
+		/**
+		 * Enable periodic statistics dump. Timer thread writes statistics of streams, which
+		 * have received any records, to info stream. If dump is already enabled, interval
+		 * is changed. Dump records are counted in statistics of info stream, but info
+		 * stream is dumped only if it has received records other than dump records.
+		 * @param interval interval in milliseconds.
+		 *
+		 * @see disableStatisticsDump().
+		 */
+		void enableStatisticsDump(unsigned long interval);
+
+		/**
+		 * Disable periodic statistics dump.
+		 */
+		void disableStatisticsDump();
+
 	private:
 		/**
-		 * Default constructor. This class is a singleton and can not be instantiated
-		 * directly. Use Instance() method instead.
+		 * Tag selecting constructor of default instance.
 		 */
-		Log();
+		struct DefaultInstance {};
+
+	private:
+		/**
+		 * Constructor of default instance. Calls initialization function (QL_LOG_INIT_FUNC).
+		 */
+		explicit Log(DefaultInstance);
 
 		Log(const Log & other);	// = delete
 
 		Log & operator =(const Log & other); // = delete
 
+		/**
+		 * Get placeholder log. Placeholder is returned by Instance(), if
+		 * QL_LOG_EXPLICIT_INIT is defined and Log does not exist. It has no devices
+		 * attached and it is never destroyed, so that it can be used by destructors of
+		 * any static objects.
+		 * @return placeholder log.
+		 */
+		static Log & Placeholder();
+
+		void flushPending();
+
+		void flushBatches();
+
+		void dumpStatistics();
+
+		void dumpStatistics(const char * name, const LogBuf::Statistics & statistics);
+
+		void countStatisticsRecord();
+
+		void init();
+
+		void inherit(LogStream & stream, LogStream & parentStream);
+
+	private:
+		/**
+		 * Static storage of explicitly initialized Log. Storage is a static data member of
+		 * a class template, so that it can be defined in a header. Its members are
+		 * constant-initialized, so accessing them does not involve guard variable. Pointer
+		 * to the Log is null, unless Log has been constructed in @a data.
+		 */
+		template <typename T>
+		struct Storage
+		{
+			static typename std::aligned_storage<sizeof(T), alignof(T)>::type data;
+			static std::atomic<bool> initialized;
+			static std::atomic<T *> instance;
+		};
+
 	private:
 		LogStream m_combinedStream;
 		LogStream m_debugStream;
@@ -189,15 +471,79 @@ class Log
 		LogStream m_criticalStream;
 		LogStream m_fatalStream;
 		LogStream m_infoStream;
+		std::unique_ptr<AsyncWriter> m_asyncWriter;
+		std::unique_ptr<PeriodicTask> m_flushTask;
+		std::unique_ptr<PeriodicTask> m_statisticsTask;
+		std::unique_ptr<PeriodicTask> m_batchTask;
+		std::once_flag m_batchTaskFlag;
+		std::atomic<std::uint64_t> m_statisticsRecords;	///< Number of records written to info stream by statistics dump.
+		Log * m_parent;
 };
 
+template <typename T>
+typename std::aligned_storage<sizeof(T), alignof(T)>::type Log::Storage<T>::data;
+
+template <typename T>
+std::atomic<bool> Log::Storage<T>::initialized(false);
+
+template <typename T>
+std::atomic<T *> Log::Storage<T>::instance(nullptr);
+
 inline
 Log & Log::Instance()
 {
-	static Log instance;
+#ifdef QL_LOG_EXPLICIT_INIT
+	Log * log = Storage<Log>::instance.load(std::memory_order_acquire);
+	return log != nullptr ? *log : Placeholder();
+#else
+	static Log instance((DefaultInstance()));
+	return instance;
+#endif
+}
+
+inline
+Log & Log::ThreadInstance()
+{
+	static thread_local Log instance(Instance());
 	return instance;
 }
 
+inline
+void Log::Init()
+{
+#ifdef QL_LOG_EXPLICIT_INIT
+	if (Storage<Log>::initialized.exchange(true))
+		return;
+
+	Storage<Log>::instance.store(new (& Storage<Log>::data) Log((DefaultInstance())), std::memory_order_release);
+	std::atexit(Shutdown);
+#else
+	Instance();
+#endif
+}
+
+inline
+void Log::Shutdown()
+{
+#ifdef QL_LOG_EXPLICIT_INIT
+	if (!Storage<Log>::initialized.exchange(false))
+		return;
+
+	Log * log = Storage<Log>::instance.exchange(nullptr, std::memory_order_acq_rel);
+	log->flush();
+	log->~Log();
+#else
+	Instance().flush();
+#endif
+}
+
+inline QL_IMPL_COLD
+Log & Log::Placeholder()
+{
+	static Log & placeholder = *new Log;
+	return placeholder;
+}
+
 inline
 LogStream & Log::debugStream()
 {
@@ -247,15 +593,17 @@ LogStream & Log::combinedStream()
 }
 
 inline
-void Log::attachLog(Log & other)
+bool Log::attachLog(Log & other)
 {
-	m_debugStream.attachStream(other.debugStream());
-	m_noteStream.attachStream(other.noteStream());
-	m_warnStream.attachStream(other.warnStream());
-	m_errorStream.attachStream(other.errorStream());
-	m_criticalStream.attachStream(other.criticalStream());
-	m_fatalStream.attachStream(other.fatalStream());
-	m_infoStream.attachStream(other.infoStream());
+	bool result = true;
+	result &= m_debugStream.attachStream(other.debugStream());
+	result &= m_noteStream.attachStream(other.noteStream());
+	result &= m_warnStream.attachStream(other.warnStream());
+	result &= m_errorStream.attachStream(other.errorStream());
+	result &= m_criticalStream.attachStream(other.criticalStream());
+	result &= m_fatalStream.attachStream(other.fatalStream());
+	result &= m_infoStream.attachStream(other.infoStream());
+	return result;
 }
 
 inline
@@ -282,7 +630,271 @@ void Log::setTraceFlags(int flags)
 }
 
 inline
-Log::Log()
+void Log::setFlushPolicy(const FlushPolicy & policy, int flushLevel)
+{
+	m_flushTask.reset();
+	m_combinedStream.setFlushPolicy(policy);
+	m_debugStream.setFlushPolicy(QL_LEVEL_DEBUG < flushLevel ? policy : FlushPolicy::Always());
+	m_noteStream.setFlushPolicy(QL_LEVEL_NOTE < flushLevel ? policy : FlushPolicy::Always());
+	m_infoStream.setFlushPolicy(QL_LEVEL_INFO < flushLevel ? policy : FlushPolicy::Always());
+	m_warnStream.setFlushPolicy(QL_LEVEL_WARN < flushLevel ? policy : FlushPolicy::Always());
+	m_errorStream.setFlushPolicy(QL_LEVEL_ERROR < flushLevel ? policy : FlushPolicy::Always());
+	m_criticalStream.setFlushPolicy(QL_LEVEL_CRITICAL < flushLevel ? policy : FlushPolicy::Always());
+	m_fatalStream.setFlushPolicy(QL_LEVEL_FATAL < flushLevel ? policy : FlushPolicy::Always());
+	if (policy.mode == FlushPolicy::INTERVAL && policy.n > 0)
+		m_flushTask.reset(new PeriodicTask(policy.n, [this]() { flushPending(); }));
+}
+
+inline
+void Log::enableAsync(std::size_t queueSize, AsyncWriter::overflowPolicy_t policy)
+{
+	disableAsync();
+	m_asyncWriter.reset(new AsyncWriter(queueSize, policy));
+	m_combinedStream.rdbuf()->setAsyncWriter(m_asyncWriter.get());
+	m_debugStream.rdbuf()->setAsyncWriter(m_asyncWriter.get());
+	m_noteStream.rdbuf()->setAsyncWriter(m_asyncWriter.get());
+	m_warnStream.rdbuf()->setAsyncWriter(m_asyncWriter.get());
+	m_errorStream.rdbuf()->setAsyncWriter(m_asyncWriter.get());
+	m_criticalStream.rdbuf()->setAsyncWriter(m_asyncWriter.get());
+	m_fatalStream.rdbuf()->setAsyncWriter(m_asyncWriter.get());
+	m_infoStream.rdbuf()->setAsyncWriter(m_asyncWriter.get());
+}
+
+inline
+void Log::disableAsync()
+{
+	if (!m_asyncWriter)
+		return;
+
+	m_combinedStream.rdbuf()->setAsyncWriter(nullptr);
+	m_debugStream.rdbuf()->setAsyncWriter(nullptr);
+	m_noteStream.rdbuf()->setAsyncWriter(nullptr);
+	m_warnStream.rdbuf()->setAsyncWriter(nullptr);
+	m_errorStream.rdbuf()->setAsyncWriter(nullptr);
+	m_criticalStream.rdbuf()->setAsyncWriter(nullptr);
+	m_fatalStream.rdbuf()->setAsyncWriter(nullptr);
+	m_infoStream.rdbuf()->setAsyncWriter(nullptr);
+	m_asyncWriter.reset();	// Destructor writes remaining records.
+}
+
+inline
+AsyncWriter * Log::asyncWriter() const
+{
+	return m_asyncWriter.get();
+}
+
+inline
+void Log::flush()
+{
+	m_combinedStream.flush();
+	m_debugStream.flush();
+	m_noteStream.flush();
+	m_warnStream.flush();
+	m_errorStream.flush();
+	m_criticalStream.flush();
+	m_fatalStream.flush();
+	m_infoStream.flush();
+	if (m_asyncWriter) {
+		// In asynchronous mode streams do not sync attached buffers by themselves.
+		m_asyncWriter->drain();
+		m_combinedStream.rdbuf()->flushSinks();
+		m_debugStream.rdbuf()->flushSinks();
+		m_noteStream.rdbuf()->flushSinks();
+		m_warnStream.rdbuf()->flushSinks();
+		m_errorStream.rdbuf()->flushSinks();
+		m_criticalStream.rdbuf()->flushSinks();
+		m_fatalStream.rdbuf()->flushSinks();
+		m_infoStream.rdbuf()->flushSinks();
+	}
+	if (m_parent != nullptr)
+		m_parent->flush();
+}
+
+inline
+void Log::flushPending()
+{
+	m_combinedStream.rdbuf()->flushPending();
+	m_debugStream.rdbuf()->flushPending();
+	m_noteStream.rdbuf()->flushPending();
+	m_warnStream.rdbuf()->flushPending();
+	m_errorStream.rdbuf()->flushPending();
+	m_criticalStream.rdbuf()->flushPending();
+	m_fatalStream.rdbuf()->flushPending();
+	m_infoStream.rdbuf()->flushPending();
+}
+
+inline
+void Log::flushBatches()
+{
+	m_combinedStream.rdbuf()->flushBatch();
+	m_debugStream.rdbuf()->flushBatch();
+	m_noteStream.rdbuf()->flushBatch();
+	m_warnStream.rdbuf()->flushBatch();
+	m_errorStream.rdbuf()->flushBatch();
+	m_criticalStream.rdbuf()->flushBatch();
+	m_fatalStream.rdbuf()->flushBatch();
+	m_infoStream.rdbuf()->flushBatch();
+}
+
+inline
+Log::Statistics Log::statistics() const
+{
+	Statistics result;
+	result.combined = m_combinedStream.statistics();
+	result.debug = m_debugStream.statistics();
+	result.note = m_noteStream.statistics();
+	result.warn = m_warnStream.statistics();
+	result.error = m_errorStream.statistics();
+	result.critical = m_criticalStream.statistics();
+	result.fatal = m_fatalStream.statistics();
+	result.info = m_infoStream.statistics();
+	result.asyncDropped = m_asyncWriter ? m_asyncWriter->droppedCount() : 0;
+	return result;
+}
+
+inline
+void Log::resetStatistics()
+{
+	m_combinedStream.rdbuf()->resetStatistics();
+	m_debugStream.rdbuf()->resetStatistics();
+	m_noteStream.rdbuf()->resetStatistics();
+	m_warnStream.rdbuf()->resetStatistics();
+	m_errorStream.rdbuf()->resetStatistics();
+	m_criticalStream.rdbuf()->resetStatistics();
+	m_fatalStream.rdbuf()->resetStatistics();
+	m_infoStream.rdbuf()->resetStatistics();
+	m_statisticsRecords.store(0, std::memory_order_relaxed);
+}
+
+inline
+void Log::setSinkTiming(bool enabled)
+{
+	m_combinedStream.rdbuf()->setSinkTiming(enabled);
+	m_debugStream.rdbuf()->setSinkTiming(enabled);
+	m_noteStream.rdbuf()->setSinkTiming(enabled);
+	m_warnStream.rdbuf()->setSinkTiming(enabled);
+	m_errorStream.rdbuf()->setSinkTiming(enabled);
+	m_criticalStream.rdbuf()->setSinkTiming(enabled);
+	m_fatalStream.rdbuf()->setSinkTiming(enabled);
+	m_infoStream.rdbuf()->setSinkTiming(enabled);
+}
+
+inline
+void Log::enableStatisticsDump(unsigned long interval)
+{
+	m_statisticsTask.reset();
+	if (interval > 0)
+		m_statisticsTask.reset(new PeriodicTask(interval, [this]() { dumpStatistics(); }));
+}
+
+inline
+void Log::disableStatisticsDump()
+{
+	m_statisticsTask.reset();
+}
+
+inline
+void Log::dumpStatistics()
+{
+	Statistics s = statistics();
+	std::uint64_t statisticsRecords = m_statisticsRecords.load(std::memory_order_relaxed);
+	dumpStatistics("combined", s.combined);
+	dumpStatistics("debug", s.debug);
+	dumpStatistics("note", s.note);
+	dumpStatistics("warn", s.warn);
+	dumpStatistics("error", s.error);
+	dumpStatistics("critical", s.critical);
+	dumpStatistics("fatal", s.fatal);
+	if (s.info.records != statisticsRecords)
+		dumpStatistics("info", s.info);
+	if (s.asyncDropped != 0) {
+		Record(m_infoStream).stream() << "QL statistics: async_dropped=" << s.asyncDropped << Record::End;
+		countStatisticsRecord();
+	}
+}
+
+inline
+void Log::dumpStatistics(const char * name, const LogBuf::Statistics & statistics)
+{
+	if (statistics.records == 0)
+		return;
+
+	Record(m_infoStream).stream() << "QL statistics: stream=" << name
+			<< " records=" << statistics.records
+			<< " bytes=" << statistics.bytes
+			<< " overflow=" << statistics.overflowCalls
+			<< " xsputn=" << statistics.xsputnCalls
+			<< " sync=" << statistics.syncCalls
+			<< " sink_ns=" << statistics.sinkNanoseconds
+			<< " sink_errors=" << statistics.sinkErrors
+			<< " drops=" << statistics.drops << Record::End;
+	countStatisticsRecord();
+}
+
+inline
+void Log::countStatisticsRecord()
+{
+	if (m_infoStream.enabled())
+		m_statisticsRecords.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline QL_IMPL_COLD
+Log::Log():
+    m_statisticsRecords(0),
+    m_parent(nullptr)
+{
+	init();
+}
+
+inline QL_IMPL_COLD
+Log::Log(Log & parent):
+    m_statisticsRecords(0),
+    m_parent(& parent)
+{
+	init();
+	inherit(m_combinedStream, parent.combinedStream());
+	inherit(m_debugStream, parent.debugStream());
+	inherit(m_noteStream, parent.noteStream());
+	inherit(m_warnStream, parent.warnStream());
+	inherit(m_errorStream, parent.errorStream());
+	inherit(m_criticalStream, parent.criticalStream());
+	inherit(m_fatalStream, parent.fatalStream());
+	inherit(m_infoStream, parent.infoStream());
+	if (QL_FORWARD_BATCH_INTERVAL > 0)
+		std::call_once(parent.m_batchTaskFlag, [& parent]() { parent.m_batchTask.reset(new PeriodicTask(QL_FORWARD_BATCH_INTERVAL, [& parent]() { parent.flushBatches(); })); });
+}
+
+inline QL_IMPL_COLD
+Log::Log(DefaultInstance):
+    m_statisticsRecords(0),
+    m_parent(nullptr)
+{
+	init();
+	QL_LOG_INIT_FUNC(this);
+}
+
+inline
+Log::~Log()
+{
+	m_batchTask.reset();
+	m_statisticsTask.reset();
+	m_flushTask.reset();
+	disableAsync();
+	flushPending();
+	if (m_parent != nullptr) {
+		m_combinedStream.rdbuf()->setForwardBuffer(nullptr);
+		m_debugStream.rdbuf()->setForwardBuffer(nullptr);
+		m_noteStream.rdbuf()->setForwardBuffer(nullptr);
+		m_warnStream.rdbuf()->setForwardBuffer(nullptr);
+		m_errorStream.rdbuf()->setForwardBuffer(nullptr);
+		m_criticalStream.rdbuf()->setForwardBuffer(nullptr);
+		m_fatalStream.rdbuf()->setForwardBuffer(nullptr);
+		m_infoStream.rdbuf()->setForwardBuffer(nullptr);
+	}
+}
+
+inline
+void Log::init()
 {
 	m_infoStream.setTraceFlags(0);
 	m_combinedStream.setTraceFlags(0);
@@ -293,7 +905,14 @@ Log::Log()
 	m_criticalStream.attachStream(m_combinedStream);
 	m_fatalStream.attachStream(m_combinedStream);
 	m_infoStream.attachStream(m_combinedStream);
-	QL_LOG_INIT_FUNC(this);
+}
+
+inline
+void Log::inherit(LogStream & stream, LogStream & parentStream)
+{
+	stream.setTraceFlags(parentStream.traceFlags());
+	stream.setFlushPolicy(parentStream.flushPolicy());
+	stream.rdbuf()->setForwardBuffer(parentStream.rdbuf());
 }
 
 }
@@ -304,11 +923,13 @@ void ql_logInitFuncNone(ql::Log * )
 {
 }
 
+#ifdef QL_IMPL_LOG_INIT_FUNC_COUT
 inline
 void ql_logInitFuncCout(ql::Log * log)
 {
 	log->combinedStream().attachStream(std::cout);
 }
+#endif
 
 #endif
 
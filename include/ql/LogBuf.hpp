@@ -6,23 +6,132 @@
 #ifndef QL_LOGBUF_HPP
 #define QL_LOGBUF_HPP
 
+#include "AsyncWriter.hpp"
+#include "FlushPolicy.hpp"
+#include "KvBuf.hpp"
+#include "KvRecord.hpp"
+
+#include <chrono>
+#include <cstdint>
 #include <cstdlib>
-#include <iostream>
+#include <deque>
 #include <list>
+#include <ostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Size of batch of records forwarded by log buffer (see ql::LogBuf::setForwardBuffer()).
+ * Records are collected, until their total number of characters reaches this value, and
+ * then they are put into forward buffer at once. Zero disables batching.
+ */
+#ifndef QL_FORWARD_BATCH_SIZE
+	#define QL_FORWARD_BATCH_SIZE 4096
+#endif
 
 namespace ql {
 
 /**
- * Log buffer.
+ * Log buffer. Characters put into the buffer are collected until sync() is called (for
+ * example by std::endl or std::flush), then the whole record is written to each of the
+ * attached buffers.
+ *
+ * Each thread assembles its records in its own, thread-local staging buffer, so that
+ * records issued concurrently by multiple threads are not interleaved. Only writing of
+ * a complete record to the attached buffers is serialized. Log buffer has no put area,
+ * because put pointers of std::streambuf would be shared by all the threads, so each
+ * character put directly into the buffer costs a virtual call. Logging macros format
+ * records in RecordBuf, which owns a put area, and pass them with putRecord().
+ *
+ * Log buffers may be attached to each other forming a graph. Log buffer does not forward
+ * records to attached LogBuf objects one by one. Instead it keeps a flat table of sinks,
+ * which is a deduplicated set of buffers other than LogBuf, reachable from it directly or
+ * through other LogBuf objects. Whenever attachments change anywhere in the graph, new
+ * tables are published for all the affected buffers (read-copy-update). Writers do not
+ * take any lock to read sinks table and attachments may be changed safely, while other
+ * threads are logging. Replaced tables are deleted after grace period - when all the
+ * writers, which could have been using them have finished. Grace period is awaited after
+ * topology mutex is released, so that a sink may log or change attachments by itself.
+ * When detachBuffer() returns, detached buffer is no longer in use, unless detachBuffer()
+ * has been called by a sink, while it has been writing a record. Each sink is guarded by
+ * its own mutex, which is shared by all the tables, so that records written to the same
+ * device are serialized. Sink mutex is not recursive, so records, which a sink writes by
+ * itself to a buffer reaching it (e.g. to report an error), are queued by the thread and
+ * written to the sink, when it returns. Attachment, which would create a cycle is
+ * rejected.
+ *
+ * Log buffer is enabled if it can reach any device, that is if its sinks table is not
+ * empty. Checking this flag costs a single load.
+ *
+ * If asynchronous writer is set, records are pushed into asynchronous writer queue
+ * instead and they are written to the attached buffers by the writer thread.
+ *
+ * Log buffer may forward its records to another LogBuf (see setForwardBuffer()). Unlike
+ * attached LogBuf, which only contributes its sinks to the table, forward buffer receives
+ * the records themselves, after they have been written to sinks of this buffer. Records
+ * therefore pass asynchronous writer and flush policy of forward buffer and they are
+ * counted in its statistics. Records are collected in a batch of QL_FORWARD_BATCH_SIZE
+ * characters, which is put into forward buffer at once, so that shared counters, sink
+ * mutexes and queue slot of forward buffer are taken once per batch instead of once per
+ * record. Batch is put, when it is full, when the buffer is flushed (see flushBatch()),
+ * when forward buffer is replaced or when the buffer is destroyed. Sinks, which are also
+ * reached by forward buffer (or by its forward buffers), are marked in sinks table and
+ * they are written only by the last of them, so that each device receives the record
+ * once, even if forward buffer writes it asynchronously. Buffer is enabled also if its
+ * forward buffer is enabled.
+ *
+ * Flush policy decides, when sinks are forced to sync after a record has been written to
+ * them. By default sinks are synced after each record.
+ *
+ * Structured records (see KvRecord) are put with putKvRecord(). They are passed as
+ * structured records to attached KvBuf objects. Other sinks receive their text rendering,
+ * which is made once per record, only if there is such sink.
+ *
+ * Log buffer keeps statistics (see Statistics), which are updated with relaxed atomic
+ * operations. Time spent in sinks is measured only if sink timing is enabled, because it
+ * requires reading the clock twice per record.
  */
-class LogBuf: public std::streambuf
+class LogBuf: public std::streambuf,
+	private AsyncWriter::Target
 {
 	public:
+		/**
+		 * Statistics.
+		 */
+		struct Statistics
+		{
+			std::uint64_t records;			///< Number of records put into the buffer.
+			std::uint64_t bytes;			///< Number of characters of the records.
+			std::uint64_t overflowCalls;	///< Number of overflow() calls.
+			std::uint64_t xsputnCalls;		///< Number of xsputn() calls.
+			std::uint64_t syncCalls;		///< Number of sync() calls.
+			std::uint64_t sinkNanoseconds;	///< Time spent writing records to sinks, if sink timing is enabled.
+			std::uint64_t sinkErrors;		///< Number of failed writes or syncs of sinks.
+			std::uint64_t drops;			///< Number of records of this buffer discarded by asynchronous writer queue.
+		};
+
+	public:
+		/**
+		 * Default constructor.
+		 */
+		LogBuf();
+
+		/**
+		 * Destructor. Detaches buffer from all the LogBuf objects it is attached to.
+		 */
+		virtual ~LogBuf();
+
 		/**
 		 * Attach buffer.
 		 * @param buf pointer to std::streambuf object.
+		 * @return @p true if buffer has been attached, @p false if attachment would create
+		 * a cycle.
 		 */
-		void attachBuffer(std::streambuf * buf);
+		bool attachBuffer(std::streambuf * buf);
 
 		/**
 		 * Detach buffer.
@@ -33,8 +142,10 @@ class LogBuf: public std::streambuf
 		/**
 		 * Attach stream 's buffer. Defined for convenience.
 		 * @param buf pointer to std::streambuf object.
+		 * @return @p true if buffer has been attached, @p false if attachment would create
+		 * a cycle.
 		 */
-		void attachStream(std::ostream & stream);
+		bool attachStream(std::ostream & stream);
 
 		/**
 		 * Detach stream 's buffer.
@@ -42,6 +153,126 @@ class LogBuf: public std::streambuf
 		 */
 		void detachStream(std::ostream & stream);
 
+		/**
+		 * Put complete record. Record is written to attached buffers (or pushed into
+		 * asynchronous writer queue) as a whole, bypassing staging buffer of the calling
+		 * thread.
+		 * @param s record characters.
+		 * @param n number of characters.
+		 * @param exclude buffer, whose devices (including devices of its forward buffers)
+		 * are skipped, or @p nullptr. This allows to put the same record to two buffers,
+		 * so that device reachable from both of them receives it only once (see Record).
+		 * Devices are compared, when record is written to sinks, so in asynchronous mode
+		 * @a exclude must outlive records queued by asynchronous writer.
+		 */
+		void putRecord(const char * s, std::size_t n, const LogBuf * exclude = nullptr);
+
+		/**
+		 * Put structured record. Record is written to attached buffers (or pushed into
+		 * asynchronous writer queue) as a whole.
+		 * @param s encoded record (see KvRecord).
+		 * @param n size of encoded record.
+		 * @param exclude buffer, whose devices are skipped, or @p nullptr (see
+		 * putRecord()).
+		 */
+		void putKvRecord(const char * s, std::size_t n, const LogBuf * exclude = nullptr);
+
+		/**
+		 * Check whether buffer is enabled.
+		 * @return @p true if any device is reachable from this buffer, @p false otherwise.
+		 */
+		bool enabled() const;
+
+		/**
+		 * Get asynchronous writer.
+		 * @return asynchronous writer or @p nullptr if records are written synchronously.
+		 */
+		AsyncWriter * asyncWriter() const;
+
+		/**
+		 * Set asynchronous writer.
+		 * @param writer asynchronous writer, which is going to write records to attached
+		 * buffers. Pass @p nullptr to write records synchronously.
+		 */
+		void setAsyncWriter(AsyncWriter * writer);
+
+		/**
+		 * Get forward buffer.
+		 * @return buffer, to which records are forwarded or @p nullptr.
+		 */
+		LogBuf * forwardBuffer() const;
+
+		/**
+		 * Set forward buffer. Records put into this buffer are put into forward buffer
+		 * after they have been written to sinks of this buffer. Batch of previous forward
+		 * buffer is put into it, before it is replaced.
+		 * @param buf forward buffer or @p nullptr to stop forwarding. Forward buffer must
+		 * outlive this buffer or it must be replaced before it is destroyed, while no
+		 * records are being put into this buffer.
+		 * @return @p true if forward buffer has been set, @p false if forwarding would
+		 * create a cycle.
+		 */
+		bool setForwardBuffer(LogBuf * buf);
+
+		/**
+		 * Put batched records into forward buffer. Batches of buffers forwarding directly
+		 * to this buffer are put into this buffer first, so that records of buffers, which
+		 * are not used anymore (e.g. by idle threads) are not held back. Function is called
+		 * by sync(), if there is no record to commit (e.g. by std::flush) and by
+		 * flushPending().
+		 */
+		void flushBatch();
+
+		/**
+		 * Get flush policy.
+		 * @return flush policy.
+		 */
+		FlushPolicy flushPolicy() const;
+
+		/**
+		 * Set flush policy.
+		 * @param policy flush policy.
+		 */
+		void setFlushPolicy(const FlushPolicy & policy);
+
+		/**
+		 * Force sinks to sync.
+		 * @return 0 on success, -1 if any sink failed to sync.
+		 */
+		int flushSinks();
+
+		/**
+		 * Force sinks to sync if anything has been written to them since last sync forced
+		 * by this buffer. Function is intended to be called periodically, when flush policy
+		 * is FlushPolicy::INTERVAL, so that records are not held by sinks for too long
+		 * when nothing else is being logged. Batched records are flushed too (see
+		 * flushBatch()).
+		 */
+		void flushPending();
+
+		/**
+		 * Get statistics.
+		 * @return snapshot of statistics counters.
+		 */
+		Statistics statistics() const;
+
+		/**
+		 * Reset statistics counters to zero.
+		 */
+		void resetStatistics();
+
+		/**
+		 * Check whether sink timing is enabled.
+		 * @return @p true if time spent in sinks is measured.
+		 */
+		bool sinkTiming() const;
+
+		/**
+		 * Enable or disable sink timing.
+		 * @param enabled whether time spent in sinks should be measured.
+		 */
+		void setSinkTiming(bool enabled);
+
 	protected:
 		typedef std::list<std::streambuf *> BufsContainer;
 
@@ -67,29 +298,508 @@ class LogBuf: public std::streambuf
 		//std::streambuf
 		virtual std::streamsize xsputn(const char_type * s, std::streamsize n);
 
+		//AsyncWriter::Target
+		virtual void writeRecord(const char * s, std::size_t n);
+
+		//AsyncWriter::Target
+		virtual void writeRecords(const char * s, std::size_t n, std::size_t count, const void * context);
+
+		//AsyncWriter::Target
+		virtual void dropRecord();
+
 	private:
-		BufsContainer m_bufs;
+		struct Sink
+		{
+			std::streambuf * buf;
+			std::shared_ptr<std::mutex> mutex;
+			KvBuf * kv;	///< Sink as KvBuf or @p nullptr if it is not KvBuf.
+			bool forwarded;	///< Whether sink is written by forward buffer.
+		};
+
+		/**
+		 * Batch of records to be forwarded. Batch is kept separately from the buffer, so
+		 * that forward buffer can put it after topology mutex has been released, even if
+		 * the buffer is being destroyed meanwhile.
+		 */
+		struct Batch
+		{
+			Batch();
+
+			std::mutex mutex;	///< Guards records and count. Not held, while batch is being put.
+			std::string records;
+			std::size_t count;	///< Number of records.
+			std::recursive_mutex putMutex;	///< Serializes putting of the batch, so that batches keep their order.
+		};
+
+		/**
+		 * Asynchronous writer target of structured records.
+		 */
+		class KvTarget:
+			public AsyncWriter::Target
+		{
+			public:
+				explicit KvTarget(LogBuf * owner);
+
+				//AsyncWriter::Target
+				virtual void writeRecord(const char * s, std::size_t n);
+
+				//AsyncWriter::Target
+				virtual void writeRecords(const char * s, std::size_t n, std::size_t count, const void * context);
 
+				//AsyncWriter::Target
+				virtual void dropRecord();
+
+			private:
+				LogBuf * m_owner;
+		};
+
+		struct Counters
+		{
+			Counters():
+			    records(0),
+			    bytes(0),
+			    overflowCalls(0),
+			    xsputnCalls(0),
+			    syncCalls(0),
+			    sinkNanoseconds(0),
+			    sinkErrors(0),
+			    drops(0)
+			{
+			}
+
+			std::atomic<std::uint64_t> records;
+			std::atomic<std::uint64_t> bytes;
+			std::atomic<std::uint64_t> overflowCalls;
+			std::atomic<std::uint64_t> xsputnCalls;
+			std::atomic<std::uint64_t> syncCalls;
+			std::atomic<std::uint64_t> sinkNanoseconds;
+			std::atomic<std::uint64_t> sinkErrors;
+			std::atomic<std::uint64_t> drops;
+		};
+
+		struct SinksTable
+		{
+			std::vector<Sink> sinks;
+		};
+
+		/**
+		 * Readers of sinks tables of a buffer. Each reader is counted by one of two
+		 * counters, selected by the epoch. Grace period advances the epoch, so that new
+		 * readers are counted by the other counter and waits until the counter of previous
+		 * epoch drops to zero. Readers are kept separately from the buffer, so that retired
+		 * tables can be reclaimed after topology mutex has been released.
+		 */
+		struct Readers
+		{
+			Readers();
+
+			std::atomic<unsigned> epoch;
+			std::atomic<int> counts[2];
+			std::mutex mutex;	///< Serializes grace periods.
+		};
+
+		/**
+		 * Sinks table replaced by a newer one.
+		 */
+		struct Retired
+		{
+			std::shared_ptr<Readers> readers;	///< Readers of the buffer, which used the table.
+			std::unique_ptr<SinksTable> table;
+		};
+
+		typedef std::vector<Retired> RetiredContainer;
+
+		/**
+		 * Sink held by a thread. Sink is held, while its mutex is locked by the thread.
+		 */
+		struct HeldSink
+		{
+			const std::streambuf * buf;
+			std::string queued;	///< Records written by the sink to itself.
+		};
+
+		typedef std::vector<HeldSink> HeldSinksContainer;
+
+		/**
+		 * Staging slots. Slot is an index of staging buffer in a container of each thread.
+		 */
+		struct StagingSlots
+		{
+			StagingSlots();
+
+			std::mutex mutex;
+			std::vector<std::size_t> free;	///< Slots released by destroyed buffers.
+			std::size_t count;	///< Number of slots ever acquired.
+		};
+
+	private:
+		LogBuf(const LogBuf & other);	// = delete
+
+		LogBuf & operator =(const LogBuf & other); // = delete
+
+		static std::uint64_t NextId();
+
+		/**
+		 * Get staging slots. Slots are shared by all LogBuf objects.
+		 * @return staging slots.
+		 */
+		static StagingSlots & Slots();
+
+		/**
+		 * Acquire staging slot. Slots of destroyed buffers are reused, so that number of
+		 * staging buffers of a thread does not exceed number of LogBuf objects existing at
+		 * the same time.
+		 * @return free slot.
+		 */
+		static std::size_t AcquireStagingSlot();
+
+		/**
+		 * Release staging slot.
+		 * @param slot slot obtained by AcquireStagingSlot().
+		 */
+		static void ReleaseStagingSlot(std::size_t slot);
+
+		/**
+		 * Get topology mutex. Topology mutex guards links between LogBuf objects.
+		 * @return mutex shared by all LogBuf objects.
+		 */
+		static std::mutex & TopologyMutex();
+
+		/**
+		 * Get sink mutex. Mutex is shared by all the tables, which contain the sink and it
+		 * is destroyed together with the last of them. Topology mutex must be locked.
+		 * @param buf sink.
+		 * @return mutex, which serializes writes to a given sink.
+		 */
+		static std::shared_ptr<std::mutex> SinkMutex(std::streambuf * buf);
+
+		/**
+		 * Get sinks held by calling thread.
+		 * @return sinks, whose mutexes are locked by calling thread.
+		 */
+		static HeldSinksContainer & HeldSinks();
+
+		/**
+		 * Hold sink. Sink mutex must be locked by calling thread.
+		 * @param buf sink.
+		 */
+		static void Hold(const std::streambuf * buf);
+
+		/**
+		 * Release sink held by calling thread, which has been held last. Records queued
+		 * meanwhile are written to the sink before it is released.
+		 * @param buf sink.
+		 * @param flush whether sink should be synced.
+		 * @return number of failed writes and syncs.
+		 */
+		static std::uint64_t Release(std::streambuf * buf, bool flush);
+
+		/**
+		 * Get queue of records of sink held by calling thread.
+		 * @param buf sink.
+		 * @return queue of records or @p nullptr if sink is not held by calling thread.
+		 */
+		static std::string * Queue(const std::streambuf * buf);
+
+		/**
+		 * Get read depth of calling thread.
+		 * @return number of sinks tables currently acquired by calling thread.
+		 */
+		static int & ReadDepth();
+
+		/**
+		 * Wait for grace period. Function returns, when all the readers, which have acquired
+		 * sinks table before the call have released it.
+		 * @param readers readers of a buffer.
+		 */
+		static void Synchronize(Readers & readers);
+
+		/**
+		 * Delete retired sinks tables after grace period. If calling thread has acquired
+		 * any sinks table, it would wait for itself, so tables are deferred until next
+		 * call made by a thread, which has not. Topology mutex must not be locked.
+		 * @param retired retired tables. Container is cleared.
+		 */
+		static void Reclaim(RetiredContainer & retired);
+
+		static bool Contains(const SinksTable & table, const std::streambuf * buf);
+
+		/**
+		 * Check whether record put into a buffer is delivered to a sink. Tables of the
+		 * buffer and of its forward buffers are searched.
+		 * @param buf buffer, into which record has been put.
+		 * @param until forward buffer, at which search stops, or @p nullptr.
+		 * @param sink sink.
+		 * @return @p true if @a sink is in a table of @a buf or of its forward buffers
+		 * preceding @a until.
+		 */
+		static bool Delivers(const LogBuf * buf, const LogBuf * until, const std::streambuf * sink);
+
+		/**
+		 * Find attached LogBuf. Attached buffers are not dynamically casted, since buffers
+		 * other than LogBuf might have been destroyed without being detached. Topology
+		 * mutex must be locked.
+		 * @param buf attached buffer.
+		 * @return LogBuf object if @a buf is attached LogBuf, @p nullptr otherwise.
+		 */
+		LogBuf * findChild(const std::streambuf * buf) const;
+
+		/**
+		 * Find attached KvBuf. Topology mutex must be locked.
+		 * @param buf attached buffer.
+		 * @return KvBuf object if @a buf is attached KvBuf, @p nullptr otherwise.
+		 */
+		KvBuf * findKvBuf(const std::streambuf * buf) const;
+
+		/**
+		 * Check whether other buffer can be reached from this buffer. Topology mutex must be
+		 * locked.
+		 * @param other other buffer.
+		 * @return @p true if @a other is this buffer or it is attached to this buffer
+		 * directly or through other LogBuf objects.
+		 */
+		bool reaches(const std::streambuf * other) const;
+
+		/**
+		 * Collect sinks reachable from this buffer. Topology mutex must be locked.
+		 * @param table table to which sinks are appended.
+		 */
+		void collectSinks(SinksTable & table) const;
+
+		/**
+		 * Rebuild sinks table and rebuild tables of parents. Topology mutex must be locked.
+		 * @param retired container to which replaced tables are appended. They must be
+		 * passed to Reclaim() after topology mutex has been released.
+		 */
+		void rebuild(RetiredContainer & retired);
+
+		/**
+		 * Update enabled flag of this buffer and of buffers forwarding to it. Topology
+		 * mutex must be locked.
+		 */
+		void updateEnabled();
+
+		/**
+		 * Check whether sink is reached by forward buffers. Topology mutex must be locked.
+		 * @param buf sink.
+		 * @return @p true if @a buf is in a table of any of the forward buffers.
+		 */
+		bool forwards(const std::streambuf * buf) const;
+
+		/**
+		 * Mark sinks written by forward buffers in a new sinks table of this buffer and of
+		 * buffers forwarding to it. Topology mutex must be locked.
+		 * @param retired container to which replaced tables are appended.
+		 */
+		void updateForwarded(RetiredContainer & retired);
+
+		/**
+		 * Put records into the buffer.
+		 * @param s records characters.
+		 * @param n number of characters.
+		 * @param count number of records.
+		 * @param exclude buffer, whose devices are skipped, or @p nullptr (see
+		 * putRecord()).
+		 */
+		void putRecords(const char * s, std::size_t n, std::size_t count, const LogBuf * exclude);
+
+		/**
+		 * Put batch of records of a buffer forwarding to this buffer.
+		 * @param batch batch of records.
+		 * @param wait whether to wait, if batch is being put by another thread. Otherwise
+		 * batch is left to be put later.
+		 */
+		void putBatch(Batch & batch, bool wait);
+
+		/**
+		 * Acquire current sinks table for reading.
+		 * @param epoch variable, which receives epoch of the reader.
+		 * @return sinks table, which must be released by releaseSinks().
+		 */
+		SinksTable * acquireSinks(unsigned & epoch) const;
+
+		/**
+		 * Release sinks table.
+		 * @param epoch epoch obtained by acquireSinks().
+		 */
+		void releaseSinks(unsigned epoch) const;
+
+		/**
+		 * Account written records and decide whether sinks should be synced.
+		 * @param n number of characters of the records.
+		 * @param count number of records.
+		 * @return @p true if sinks should be synced according to flush policy.
+		 */
+		bool flushDue(std::size_t n, std::size_t count);
+
+		/**
+		 * Add to unflushed bytes or records and claim sync, when threshold is reached.
+		 * Counter is reset by the same compare-exchange, which adds to it, so that
+		 * concurrent writers neither lose increments nor sync twice for one threshold.
+		 * @param n number of bytes or records to add.
+		 * @return @p true if calling thread should sync sinks.
+		 */
+		bool claimFlush(std::size_t n);
+
+		/**
+		 * Get current time used by FlushPolicy::INTERVAL policy.
+		 * @return milliseconds of monotonic clock.
+		 */
+		static std::int64_t Milliseconds();
+
+		/**
+		 * Get staging buffer of calling thread.
+		 * @return record, which is being assembled by calling thread.
+		 */
+		std::string & staging();
+
+		/**
+		 * Write structured record to sinks.
+		 * @param s encoded record.
+		 * @param n size of encoded record.
+		 * @param exclude buffer, whose sinks are skipped, or @p nullptr.
+		 */
+		void writeKvRecord(const char * s, std::size_t n, const LogBuf * exclude);
+
+		/**
+		 * Write record to sinks.
+		 * @param s record characters or encoded structured record.
+		 * @param n number of characters or size of encoded structured record.
+		 * @param record structured record, which is passed to KvBuf sinks and rendered as
+		 * text for other sinks, or @p nullptr if @a s is a text record.
+		 * @param exclude buffer, whose sinks (including sinks of its forward buffers
+		 * preceding this buffer) are skipped, or @p nullptr.
+		 * @param count number of records in @a s.
+		 */
+		void writeSinks(const char * s, std::size_t n, const KvRecord * record, const LogBuf * exclude, std::size_t count);
+
+	private:
+		std::uint64_t m_id;
+		std::size_t m_stagingSlot;
+		BufsContainer m_bufs;	///< Directly attached buffers. Guarded by topology mutex.
+		std::list<LogBuf *> m_children;	///< Attached LogBuf objects. Guarded by topology mutex.
+		std::list<LogBuf *> m_parents;	///< LogBuf objects to which this buffer is attached. Guarded by topology mutex.
+		std::list<KvBuf *> m_kvBufs;	///< Attached KvBuf objects. Guarded by topology mutex.
+		std::list<LogBuf *> m_forwarders;	///< LogBuf objects forwarding to this buffer. Guarded by topology mutex.
+		std::atomic<SinksTable *> m_sinks;
+		std::shared_ptr<Readers> m_readers;
+		std::atomic<bool> m_enabled;
+		std::atomic<AsyncWriter *> m_asyncWriter;
+		std::atomic<LogBuf *> m_forward;
+		std::shared_ptr<Batch> m_batch;
+		std::atomic<int> m_flushMode;
+		std::atomic<std::size_t> m_flushThreshold;
+		std::atomic<std::size_t> m_unflushed;	///< Bytes or records written since last sync, depending on flush policy.
+		std::atomic<std::int64_t> m_lastFlush;	///< Time of last sync in milliseconds.
+		Counters m_counters;
+		std::atomic<bool> m_sinkTiming;
+		KvTarget m_kvTarget;
 };
 
 
 inline
-void LogBuf::attachBuffer(std::streambuf * buf)
+LogBuf::LogBuf():
+    m_id(NextId()),
+    m_stagingSlot(AcquireStagingSlot()),
+    m_sinks(new SinksTable),
+    m_readers(new Readers),
+    m_enabled(false),
+    m_asyncWriter(nullptr),
+    m_forward(nullptr),
+    m_batch(new Batch),
+    m_flushMode(FlushPolicy::ALWAYS),
+    m_flushThreshold(0),
+    m_unflushed(0),
+    m_lastFlush(0),
+    m_sinkTiming(false),
+    m_kvTarget(this)
+{
+	// Thread-local objects are destroyed in reverse order of construction. Held sinks are
+	// constructed first, so that they outlive thread-local buffers, which may write
+	// records to sinks, when they are destroyed (e.g. Log::ThreadInstance()).
+	HeldSinks();
+}
+
+inline
+LogBuf::~LogBuf()
 {
-	if (buf != this)
+	flushBatch();
+	RetiredContainer retired;
+	{
+		std::lock_guard<std::mutex> topologyLock(TopologyMutex());
+		for (std::list<LogBuf *>::iterator parent = m_parents.begin(); parent != m_parents.end(); ++parent) {
+			(*parent)->m_bufs.remove(this);
+			(*parent)->m_children.remove(this);
+			(*parent)->rebuild(retired);
+		}
+		for (std::list<LogBuf *>::iterator child = m_children.begin(); child != m_children.end(); ++child)
+			(*child)->m_parents.remove(this);
+		if (LogBuf * forward = m_forward.load())
+			forward->m_forwarders.remove(this);
+		for (std::list<LogBuf *>::iterator forwarder = m_forwarders.begin(); forwarder != m_forwarders.end(); ++forwarder) {
+			(*forwarder)->m_forward.store(nullptr);
+			(*forwarder)->updateEnabled();
+			(*forwarder)->updateForwarded(retired);
+		}
+	}
+	// Own table is reclaimed like replaced ones, so that buffer destroyed by a thread,
+	// which is reading any table (e.g. by a sink) does not wait for itself.
+	Retired own;
+	own.readers = m_readers;
+	own.table.reset(m_sinks.load());
+	retired.push_back(std::move(own));
+	Reclaim(retired);
+	ReleaseStagingSlot(m_stagingSlot);
+}
+
+inline
+bool LogBuf::attachBuffer(std::streambuf * buf)
+{
+	if (buf == nullptr)
+		return false;
+
+	RetiredContainer retired;
+	{
+		std::lock_guard<std::mutex> topologyLock(TopologyMutex());
+		LogBuf * child = dynamic_cast<LogBuf *>(buf);
+		if (buf == this || (child != nullptr && child->reaches(this)))
+			return false;
+
 		m_bufs.push_back(buf);
+		if (child != nullptr) {
+			m_children.push_back(child);
+			child->m_parents.push_back(this);
+		}
+		if (KvBuf * kv = dynamic_cast<KvBuf *>(buf))
+			m_kvBufs.push_back(kv);
+		rebuild(retired);
+	}
+	Reclaim(retired);
+	return true;
 }
 
 inline
 void LogBuf::detachBuffer(std::streambuf * buf)
 {
-	m_bufs.remove(buf);
+	RetiredContainer retired;
+	{
+		std::lock_guard<std::mutex> topologyLock(TopologyMutex());
+		if (LogBuf * child = findChild(buf)) {
+			m_children.remove(child);
+			child->m_parents.remove(this);
+		}
+		if (KvBuf * kv = findKvBuf(buf))
+			m_kvBufs.remove(kv);
+		m_bufs.remove(buf);
+		rebuild(retired);
+	}
+	Reclaim(retired);
 }
 
 inline
-void LogBuf::attachStream(std::ostream & stream)
+bool LogBuf::attachStream(std::ostream & stream)
 {
-	attachBuffer(stream.rdbuf());
+	return attachBuffer(stream.rdbuf());
 }
 
 inline
@@ -98,6 +808,181 @@ void LogBuf::detachStream(std::ostream & stream)
 	detachBuffer(stream.rdbuf());
 }
 
+inline
+void LogBuf::putRecord(const char * s, std::size_t n, const LogBuf * exclude)
+{
+	putRecords(s, n, 1, exclude);
+}
+
+inline
+void LogBuf::putKvRecord(const char * s, std::size_t n, const LogBuf * exclude)
+{
+	m_counters.records.fetch_add(1, std::memory_order_relaxed);
+	m_counters.bytes.fetch_add(n, std::memory_order_relaxed);
+	AsyncWriter * writer = asyncWriter();
+	if (writer != nullptr && !AsyncWriter::IsWriterThread())
+		writer->push(& m_kvTarget, s, n, 1, exclude);
+	else
+		writeKvRecord(s, n, exclude);
+	if (LogBuf * forward = forwardBuffer()) {
+		// Structured records are not batched. Batch is put first to keep order of records.
+		forward->putBatch(*m_batch, true);
+		forward->putKvRecord(s, n, exclude);
+	}
+}
+
+inline
+bool LogBuf::enabled() const
+{
+	return m_enabled.load(std::memory_order_relaxed);
+}
+
+inline
+AsyncWriter * LogBuf::asyncWriter() const
+{
+	return m_asyncWriter.load(std::memory_order_relaxed);
+}
+
+inline
+void LogBuf::setAsyncWriter(AsyncWriter * writer)
+{
+	m_asyncWriter.store(writer);
+}
+
+inline
+LogBuf * LogBuf::forwardBuffer() const
+{
+	return m_forward.load(std::memory_order_acquire);
+}
+
+inline
+bool LogBuf::setForwardBuffer(LogBuf * buf)
+{
+	if (LogBuf * forward = forwardBuffer())
+		forward->putBatch(*m_batch, true);
+
+	RetiredContainer retired;
+	{
+		std::lock_guard<std::mutex> topologyLock(TopologyMutex());
+		for (const LogBuf * forward = buf; forward != nullptr; forward = forward->forwardBuffer())
+			if (forward == this)
+				return false;
+
+		if (LogBuf * forward = forwardBuffer())
+			forward->m_forwarders.remove(this);
+		if (buf != nullptr)
+			buf->m_forwarders.push_back(this);
+		m_forward.store(buf, std::memory_order_release);
+		updateEnabled();
+		updateForwarded(retired);
+	}
+	Reclaim(retired);
+	return true;
+}
+
+inline
+void LogBuf::flushBatch()
+{
+	std::vector<std::shared_ptr<Batch> > batches;
+	{
+		std::lock_guard<std::mutex> topologyLock(TopologyMutex());
+		for (std::list<LogBuf *>::iterator forwarder = m_forwarders.begin(); forwarder != m_forwarders.end(); ++forwarder)
+			batches.push_back((*forwarder)->m_batch);
+	}
+	for (std::vector<std::shared_ptr<Batch> >::iterator batch = batches.begin(); batch != batches.end(); ++batch)
+		putBatch(**batch, true);
+	if (LogBuf * forward = forwardBuffer())
+		forward->putBatch(*m_batch, true);
+}
+
+inline
+FlushPolicy LogBuf::flushPolicy() const
+{
+	return FlushPolicy(static_cast<FlushPolicy::mode_t>(m_flushMode.load(std::memory_order_relaxed)), m_flushThreshold.load(std::memory_order_relaxed));
+}
+
+inline
+void LogBuf::setFlushPolicy(const FlushPolicy & policy)
+{
+	m_flushThreshold.store(policy.n, std::memory_order_relaxed);
+	m_flushMode.store(policy.mode, std::memory_order_relaxed);
+	m_unflushed.store(0, std::memory_order_relaxed);
+	m_lastFlush.store(Milliseconds(), std::memory_order_relaxed);
+}
+
+inline
+int LogBuf::flushSinks()
+{
+	int result = 0;
+	unsigned epoch;
+	SinksTable * table = acquireSinks(epoch);
+	for (std::vector<Sink>::iterator i = table->sinks.begin(); i != table->sinks.end(); ++i) {
+		// Sink held by calling thread is being used by the sink itself.
+		if (Queue(i->buf) != nullptr)
+			continue;
+
+		std::lock_guard<std::mutex> lock(*i->mutex);
+		Hold(i->buf);
+		if (std::uint64_t errors = Release(i->buf, true)) {
+			m_counters.sinkErrors.fetch_add(errors, std::memory_order_relaxed);
+			result = -1;
+		}
+	}
+	releaseSinks(epoch);
+	return result;
+}
+
+inline
+void LogBuf::flushPending()
+{
+	flushBatch();
+	if (m_unflushed.exchange(0, std::memory_order_relaxed) == 0)
+		return;
+
+	m_lastFlush.store(Milliseconds(), std::memory_order_relaxed);
+	flushSinks();
+}
+
+inline
+LogBuf::Statistics LogBuf::statistics() const
+{
+	Statistics result;
+	result.records = m_counters.records.load(std::memory_order_relaxed);
+	result.bytes = m_counters.bytes.load(std::memory_order_relaxed);
+	result.overflowCalls = m_counters.overflowCalls.load(std::memory_order_relaxed);
+	result.xsputnCalls = m_counters.xsputnCalls.load(std::memory_order_relaxed);
+	result.syncCalls = m_counters.syncCalls.load(std::memory_order_relaxed);
+	result.sinkNanoseconds = m_counters.sinkNanoseconds.load(std::memory_order_relaxed);
+	result.sinkErrors = m_counters.sinkErrors.load(std::memory_order_relaxed);
+	result.drops = m_counters.drops.load(std::memory_order_relaxed);
+	return result;
+}
+
+inline
+void LogBuf::resetStatistics()
+{
+	m_counters.records.store(0, std::memory_order_relaxed);
+	m_counters.bytes.store(0, std::memory_order_relaxed);
+	m_counters.overflowCalls.store(0, std::memory_order_relaxed);
+	m_counters.xsputnCalls.store(0, std::memory_order_relaxed);
+	m_counters.syncCalls.store(0, std::memory_order_relaxed);
+	m_counters.sinkNanoseconds.store(0, std::memory_order_relaxed);
+	m_counters.sinkErrors.store(0, std::memory_order_relaxed);
+	m_counters.drops.store(0, std::memory_order_relaxed);
+}
+
+inline
+bool LogBuf::sinkTiming() const
+{
+	return m_sinkTiming.load(std::memory_order_relaxed);
+}
+
+inline
+void LogBuf::setSinkTiming(bool enabled)
+{
+	m_sinkTiming.store(enabled, std::memory_order_relaxed);
+}
+
 inline
 LogBuf::BufsContainer & LogBuf::bufs()
 {
@@ -113,41 +998,622 @@ const LogBuf::BufsContainer & LogBuf::bufs() const
 inline
 int LogBuf::sync()
 {
-	int result = 0;
+	m_counters.syncCalls.fetch_add(1, std::memory_order_relaxed);
+	std::string & record = staging();
+	if (record.empty()) {
+		// Nothing to commit, but keep std::flush forcing attached buffers to sync.
+		flushBatch();
+		if (asyncWriter() != nullptr)
+			return 0;
 
-	//just like before (im writing this comments from the bottom)
-	//it is responsibility of each buffer to sync(), we just force syncing.
-	for (BufsContainer::iterator i = m_bufs.begin(); i != m_bufs.end(); ++i)
-	    if ((*i)->pubsync() == -1)
-			result = -1;
-	return result;
+		m_unflushed.store(0, std::memory_order_relaxed);
+		return flushSinks();
+	}
+
+	putRecord(record.data(), record.size());
+	record.clear();
+	return 0;
 }
 
 inline
 LogBuf::int_type LogBuf::overflow(int_type c)
 {
-	int_type result = c; //according to docs overflow() should return c in case of everything is fine and eof in case of something is very not fine
-
-	//note: sputc() of each buffer will call overflow if necessary.
-	for (BufsContainer::iterator i = m_bufs.begin(); i != m_bufs.end(); ++i)
-		if (traits_type::eq_int_type((*i)->sputc(traits_type::to_char_type(c)), traits_type::eof()))
-			result = traits_type::eof(); //really, eof shouldn't happen in output stream ~:|
-	return result;
+	m_counters.overflowCalls.fetch_add(1, std::memory_order_relaxed);
+	if (!traits_type::eq_int_type(c, traits_type::eof()))
+		staging().push_back(traits_type::to_char_type(c));
+	return traits_type::not_eof(c);
 }
 
 inline
 std::streamsize LogBuf::xsputn(const char_type * s, std::streamsize n)
 {
-	//TODO: it is up to buffers to put those characters, but possibly kind of error
-	//should be generated if sputn fails :/.
-	for (BufsContainer::iterator i = m_bufs.begin(); i != m_bufs.end(); ++i)
-		(*i)->sputn(s, n);
+	m_counters.xsputnCalls.fetch_add(1, std::memory_order_relaxed);
+	staging().append(s, static_cast<std::size_t>(n));
 
 	//always return n, even if there is no buffer attached - characters must be lost and
 	//not turned away somewhere into space-time of iostreams.
 	return n;
 }
 
+inline
+void LogBuf::writeRecord(const char * s, std::size_t n)
+{
+	writeSinks(s, n, nullptr, nullptr, 1);
+}
+
+inline
+void LogBuf::writeRecords(const char * s, std::size_t n, std::size_t count, const void * context)
+{
+	writeSinks(s, n, nullptr, static_cast<const LogBuf *>(context), count);
+}
+
+inline
+void LogBuf::dropRecord()
+{
+	m_counters.drops.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline
+std::uint64_t LogBuf::NextId()
+{
+	// Zero is not used, so that it can mark staging buffers, which have not been used yet.
+	static std::atomic<std::uint64_t> counter(1);
+	return counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+inline
+LogBuf::StagingSlots & LogBuf::Slots()
+{
+	// Slots are never destroyed, so that they can be used by destructors of static objects.
+	static StagingSlots * slots = new StagingSlots;
+	return *slots;
+}
+
+inline
+std::size_t LogBuf::AcquireStagingSlot()
+{
+	StagingSlots & slots = Slots();
+	std::lock_guard<std::mutex> lock(slots.mutex);
+	if (slots.free.empty())
+		return slots.count++;
+	std::size_t slot = slots.free.back();
+	slots.free.pop_back();
+	return slot;
+}
+
+inline
+void LogBuf::ReleaseStagingSlot(std::size_t slot)
+{
+	StagingSlots & slots = Slots();
+	std::lock_guard<std::mutex> lock(slots.mutex);
+	slots.free.push_back(slot);
+}
+
+inline
+std::mutex & LogBuf::TopologyMutex()
+{
+	static std::mutex mutex;
+	return mutex;
+}
+
+inline
+std::shared_ptr<std::mutex> LogBuf::SinkMutex(std::streambuf * buf)
+{
+	typedef std::map<std::streambuf *, std::weak_ptr<std::mutex> > MutexesContainer;
+
+	// Map is never destroyed, so that it can be used by destructors of static objects.
+	static MutexesContainer * mutexes = new MutexesContainer;
+	static std::size_t pruneSize = 16;
+
+	// Remove mutexes of sinks, which are no longer in any table. Map is scanned only when
+	// it has doubled since last scan, so that its cost is amortized over insertions.
+	if (mutexes->size() >= pruneSize) {
+		for (MutexesContainer::iterator i = mutexes->begin(); i != mutexes->end();)
+			if (i->second.expired())
+				i = mutexes->erase(i);
+			else
+				++i;
+		pruneSize = 2 * mutexes->size() + 16;
+	}
+
+	std::weak_ptr<std::mutex> & entry = (*mutexes)[buf];
+	std::shared_ptr<std::mutex> mutex = entry.lock();
+	if (!mutex) {
+		mutex = std::make_shared<std::mutex>();
+		entry = mutex;
+	}
+	return mutex;
+}
+
+inline
+LogBuf::HeldSinksContainer & LogBuf::HeldSinks()
+{
+	static thread_local HeldSinksContainer held;
+	return held;
+}
+
+inline
+void LogBuf::Hold(const std::streambuf * buf)
+{
+	HeldSink sink;
+	sink.buf = buf;
+	HeldSinks().push_back(std::move(sink));
+}
+
+inline
+std::uint64_t LogBuf::Release(std::streambuf * buf, bool flush)
+{
+	// Sink may queue further records, while queued ones are written or while it syncs.
+	// They are written in two rounds at most, so that a sink, which reports its own
+	// failures does not loop forever. Records queued afterwards are discarded and counted
+	// as errors. Container may grow meanwhile, so its last element is accessed each time.
+	HeldSinksContainer & held = HeldSinks();
+	std::uint64_t errors = 0;
+	for (int round = 0; round < 2; round++) {
+		if (!held.back().queued.empty()) {
+			std::string queued;
+			queued.swap(held.back().queued);
+			if (buf->sputn(queued.data(), static_cast<std::streamsize>(queued.size())) != static_cast<std::streamsize>(queued.size()))
+				errors++;
+		}
+		if (round == 0 && flush && buf->pubsync() == -1)
+			errors++;
+	}
+	if (!held.back().queued.empty())
+		errors++;
+	held.pop_back();
+	return errors;
+}
+
+inline
+std::string * LogBuf::Queue(const std::streambuf * buf)
+{
+	HeldSinksContainer & held = HeldSinks();
+	for (HeldSinksContainer::iterator i = held.begin(); i != held.end(); ++i)
+		if (i->buf == buf)
+			return & i->queued;
+	return nullptr;
+}
+
+inline
+int & LogBuf::ReadDepth()
+{
+	static thread_local int depth = 0;
+	return depth;
+}
+
+inline
+void LogBuf::Synchronize(Readers & readers)
+{
+	// Readers, which have confirmed the epoch after incrementing its counter are seen by
+	// the loop below. Others retry with the new epoch and they get current table.
+	std::lock_guard<std::mutex> lock(readers.mutex);
+	unsigned epoch = readers.epoch.fetch_add(1);
+	while (readers.counts[epoch & 1].load() != 0)
+		std::this_thread::yield();
+}
+
+inline
+void LogBuf::Reclaim(RetiredContainer & retired)
+{
+	struct Deferred
+	{
+		std::mutex mutex;
+		RetiredContainer tables;
+	};
+
+	// Deferred tables are never destroyed, so that they can be used by destructors of
+	// static objects.
+	static Deferred * deferred = new Deferred;
+
+	std::unique_lock<std::mutex> lock(deferred->mutex);
+	for (RetiredContainer::iterator i = retired.begin(); i != retired.end(); ++i)
+		deferred->tables.push_back(std::move(*i));
+	retired.clear();
+	if (ReadDepth() != 0)
+		return;
+
+	retired.swap(deferred->tables);
+	lock.unlock();
+	for (RetiredContainer::iterator i = retired.begin(); i != retired.end(); ++i)
+		Synchronize(*i->readers);
+	retired.clear();
+}
+
+inline
+bool LogBuf::Contains(const SinksTable & table, const std::streambuf * buf)
+{
+	for (std::vector<Sink>::const_iterator i = table.sinks.begin(); i != table.sinks.end(); ++i)
+		if (i->buf == buf)
+			return true;
+	return false;
+}
+
+inline
+bool LogBuf::Delivers(const LogBuf * buf, const LogBuf * until, const std::streambuf * sink)
+{
+	for (; buf != nullptr && buf != until; buf = buf->forwardBuffer()) {
+		unsigned epoch;
+		bool found = Contains(*buf->acquireSinks(epoch), sink);
+		buf->releaseSinks(epoch);
+		if (found)
+			return true;
+	}
+	return false;
+}
+
+inline
+LogBuf * LogBuf::findChild(const std::streambuf * buf) const
+{
+	for (std::list<LogBuf *>::const_iterator child = m_children.begin(); child != m_children.end(); ++child)
+		// Addresses are compared as integers, otherwise GCC may assume that a buffer, which
+		// is not LogBuf is being accessed as LogBuf and issue false -Warray-bounds warnings.
+		if (reinterpret_cast<std::uintptr_t>(static_cast<const std::streambuf *>(*child)) == reinterpret_cast<std::uintptr_t>(buf))
+			return *child;
+	return nullptr;
+}
+
+inline
+KvBuf * LogBuf::findKvBuf(const std::streambuf * buf) const
+{
+	for (std::list<KvBuf *>::const_iterator kv = m_kvBufs.begin(); kv != m_kvBufs.end(); ++kv)
+		if (reinterpret_cast<std::uintptr_t>(static_cast<const std::streambuf *>(*kv)) == reinterpret_cast<std::uintptr_t>(buf))
+			return *kv;
+	return nullptr;
+}
+
+inline
+bool LogBuf::reaches(const std::streambuf * other) const
+{
+	if (other == this)
+		return true;
+	for (BufsContainer::const_iterator i = m_bufs.begin(); i != m_bufs.end(); ++i)
+		if (*i == other)
+			return true;
+	for (std::list<LogBuf *>::const_iterator child = m_children.begin(); child != m_children.end(); ++child)
+		if ((*child)->reaches(other))
+			return true;
+	return false;
+}
+
+inline
+void LogBuf::collectSinks(SinksTable & table) const
+{
+	for (BufsContainer::const_iterator i = m_bufs.begin(); i != m_bufs.end(); ++i)
+		if (const LogBuf * child = findChild(*i))
+			child->collectSinks(table);
+		else {
+			bool duplicate = false;
+			for (std::vector<Sink>::const_iterator sink = table.sinks.begin(); sink != table.sinks.end() && !duplicate; ++sink)
+				duplicate = sink->buf == *i;
+			if (!duplicate) {
+				Sink sink = {*i, SinkMutex(*i), findKvBuf(*i), false};
+				table.sinks.push_back(sink);
+			}
+		}
+}
+
+inline
+void LogBuf::rebuild(RetiredContainer & retired)
+{
+	SinksTable * table = new SinksTable;
+	collectSinks(*table);
+	for (std::vector<Sink>::iterator sink = table->sinks.begin(); sink != table->sinks.end(); ++sink)
+		sink->forwarded = forwards(sink->buf);
+
+	// Readers still may use old table, so it is deleted by Reclaim() after grace period.
+	Retired old;
+	old.readers = m_readers;
+	old.table.reset(m_sinks.exchange(table));
+	retired.push_back(std::move(old));
+	updateEnabled();
+	for (std::list<LogBuf *>::iterator forwarder = m_forwarders.begin(); forwarder != m_forwarders.end(); ++forwarder)
+		(*forwarder)->updateForwarded(retired);
+
+	for (std::list<LogBuf *>::iterator parent = m_parents.begin(); parent != m_parents.end(); ++parent)
+		(*parent)->rebuild(retired);
+}
+
+inline
+void LogBuf::updateEnabled()
+{
+	LogBuf * forward = forwardBuffer();
+	m_enabled.store(!m_sinks.load()->sinks.empty() || (forward != nullptr && forward->enabled()), std::memory_order_relaxed);
+	for (std::list<LogBuf *>::iterator forwarder = m_forwarders.begin(); forwarder != m_forwarders.end(); ++forwarder)
+		(*forwarder)->updateEnabled();
+}
+
+inline
+bool LogBuf::forwards(const std::streambuf * buf) const
+{
+	for (const LogBuf * forward = forwardBuffer(); forward != nullptr; forward = forward->forwardBuffer())
+		if (Contains(*forward->m_sinks.load(), buf))
+			return true;
+	return false;
+}
+
+inline
+void LogBuf::updateForwarded(RetiredContainer & retired)
+{
+	SinksTable * table = new SinksTable(*m_sinks.load());
+	for (std::vector<Sink>::iterator sink = table->sinks.begin(); sink != table->sinks.end(); ++sink)
+		sink->forwarded = forwards(sink->buf);
+
+	Retired old;
+	old.readers = m_readers;
+	old.table.reset(m_sinks.exchange(table));
+	retired.push_back(std::move(old));
+	for (std::list<LogBuf *>::iterator forwarder = m_forwarders.begin(); forwarder != m_forwarders.end(); ++forwarder)
+		(*forwarder)->updateForwarded(retired);
+}
+
+inline
+void LogBuf::putRecords(const char * s, std::size_t n, std::size_t count, const LogBuf * exclude)
+{
+	// Sink used by writer thread could log something by itself. Such records are written
+	// immediately, otherwise writer could wait for itself if the queue was full.
+	m_counters.records.fetch_add(count, std::memory_order_relaxed);
+	m_counters.bytes.fetch_add(n, std::memory_order_relaxed);
+	AsyncWriter * writer = asyncWriter();
+	if (writer != nullptr && !AsyncWriter::IsWriterThread())
+		writer->push(this, s, n, count, exclude);
+	else
+		writeSinks(s, n, nullptr, exclude, count);
+
+	LogBuf * forward = forwardBuffer();
+	if (forward == nullptr)
+		return;
+
+	if (exclude == nullptr && QL_FORWARD_BATCH_SIZE > 0) {
+		Batch & batch = *m_batch;
+		bool full;
+		{
+			std::lock_guard<std::mutex> lock(batch.mutex);
+			batch.records.append(s, n);
+			batch.count += count;
+			full = batch.records.size() >= QL_FORWARD_BATCH_SIZE;
+		}
+		// Batch is left to grow, if it is being put by another thread.
+		if (full)
+			forward->putBatch(batch, false);
+	} else {
+		// Record, which excludes devices of another buffer can not be merged with the
+		// batch. Batch is put first to keep order of records.
+		forward->putBatch(*m_batch, true);
+		forward->putRecords(s, n, count, exclude);
+	}
+}
+
+inline
+void LogBuf::putBatch(Batch & batch, bool wait)
+{
+	std::unique_lock<std::recursive_mutex> putLock(batch.putMutex, std::defer_lock);
+	if (wait)
+		putLock.lock();
+	else if (!putLock.try_lock())
+		return;
+
+	// Records are moved out of the batch, so that forwarding buffer can keep batching,
+	// while they are being written. Storage is handed back afterwards to be reused.
+	std::string records;
+	std::size_t count;
+	{
+		std::lock_guard<std::mutex> lock(batch.mutex);
+		if (batch.records.empty())
+			return;
+
+		records.swap(batch.records);
+		count = batch.count;
+		batch.count = 0;
+	}
+	putRecords(records.data(), records.size(), count, nullptr);
+	records.clear();
+	std::lock_guard<std::mutex> lock(batch.mutex);
+	if (batch.records.empty())
+		batch.records.swap(records);
+}
+
+inline
+LogBuf::SinksTable * LogBuf::acquireSinks(unsigned & epoch) const
+{
+	ReadDepth()++;
+	for (;;) {
+		epoch = m_readers->epoch.load();
+		m_readers->counts[epoch & 1].fetch_add(1);
+		if (m_readers->epoch.load() == epoch)
+			return m_sinks.load();
+		m_readers->counts[epoch & 1].fetch_sub(1);
+	}
+}
+
+inline
+void LogBuf::releaseSinks(unsigned epoch) const
+{
+	m_readers->counts[epoch & 1].fetch_sub(1, std::memory_order_release);
+	ReadDepth()--;
+}
+
+inline
+bool LogBuf::flushDue(std::size_t n, std::size_t count)
+{
+	switch (m_flushMode.load(std::memory_order_relaxed)) {
+		case FlushPolicy::ALWAYS:
+			return true;
+		case FlushPolicy::NEVER:
+			return false;
+		case FlushPolicy::BYTES:
+			return claimFlush(n);
+		case FlushPolicy::RECORDS:
+			return claimFlush(count);
+		default: {
+			// Timer calls flushPending() to sync records left behind when logging stops.
+			m_unflushed.fetch_add(count, std::memory_order_relaxed);
+			std::int64_t now = Milliseconds();
+			std::int64_t last = m_lastFlush.load(std::memory_order_relaxed);
+			if (now - last < static_cast<std::int64_t>(m_flushThreshold.load(std::memory_order_relaxed)) || !m_lastFlush.compare_exchange_strong(last, now, std::memory_order_relaxed))
+				return false;
+			m_unflushed.store(0, std::memory_order_relaxed);
+			return true;
+		}
+	}
+}
+
+inline
+bool LogBuf::claimFlush(std::size_t n)
+{
+	std::size_t threshold = m_flushThreshold.load(std::memory_order_relaxed);
+	std::size_t unflushed = m_unflushed.load(std::memory_order_relaxed);
+	std::size_t desired;
+	do
+		desired = unflushed + n < threshold ? unflushed + n : 0;
+	while (!m_unflushed.compare_exchange_weak(unflushed, desired, std::memory_order_relaxed));
+	return desired == 0;
+}
+
+inline
+std::int64_t LogBuf::Milliseconds()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline
+std::string & LogBuf::staging()
+{
+	struct Staging
+	{
+		Staging():
+		    owner(0)
+		{
+		}
+
+		std::uint64_t owner;
+		std::string record;
+	};
+
+	// Deque does not invalidate references, when it grows at the end, so references
+	// returned earlier remain valid, when another LogBuf is used by the same thread.
+	// Slot of destroyed buffer is reused by another one, so staging buffer is owned by
+	// unique id of the buffer. Record left by previous owner is discarded.
+	static thread_local std::deque<Staging> stagings;
+
+	if (m_stagingSlot >= stagings.size())
+		stagings.resize(m_stagingSlot + 1);
+	Staging & staging = stagings[m_stagingSlot];
+	if (staging.owner != m_id) {
+		staging.owner = m_id;
+		staging.record.clear();
+	}
+	return staging.record;
+}
+inline
+void LogBuf::writeKvRecord(const char * s, std::size_t n, const LogBuf * exclude)
+{
+	KvRecord record(s, n);
+	if (!record.isValid()) {
+		// Notice from asynchronous writer.
+		writeSinks(s, n, nullptr, exclude, 1);
+		return;
+	}
+
+	writeSinks(s, n, & record, exclude, 1);
+}
+
+inline
+void LogBuf::writeSinks(const char * s, std::size_t n, const KvRecord * record, const LogBuf * exclude, std::size_t count)
+{
+	//it is up to buffers to put those characters; failures are only counted as sink
+	//errors. It is responsibility of each buffer to sync(), we just force syncing
+	//according to flush policy.
+	bool flush = flushDue(n, count);
+	bool timing = sinkTiming();
+	std::chrono::steady_clock::time_point start;
+	if (timing)
+		start = std::chrono::steady_clock::now();
+	std::uint64_t errors = 0;
+	Formatter formatter;
+	const char * text = record == nullptr ? s : nullptr;
+	std::size_t textSize = n;
+	unsigned epoch;
+	SinksTable * table = acquireSinks(epoch);
+	for (std::vector<Sink>::iterator i = table->sinks.begin(); i != table->sinks.end(); ++i) {
+		if (i->forwarded || (exclude != nullptr && Delivers(exclude, this, i->buf)))
+			continue;
+
+		bool kv = record != nullptr && i->kv != nullptr;
+		std::string * queue = Queue(i->buf);
+		if ((queue != nullptr || !kv) && record != nullptr && text == nullptr) {
+			// Text is rendered once, when the first sink other than KvBuf needs it.
+			record->render(formatter);
+			text = formatter.data();
+			textSize = formatter.size();
+		}
+		if (queue != nullptr) {
+			// Record written by the sink itself, whose mutex is locked by this thread.
+			queue->append(text, textSize);
+			continue;
+		}
+
+		std::lock_guard<std::mutex> lock(*i->mutex);
+		Hold(i->buf);
+		if (kv) {
+			if (!i->kv->writeKvRecord(*record))
+				errors++;
+		} else if (i->buf->sputn(text, static_cast<std::streamsize>(textSize)) != static_cast<std::streamsize>(textSize))
+			errors++;
+		errors += Release(i->buf, flush);
+	}
+	releaseSinks(epoch);
+	if (errors != 0)
+		m_counters.sinkErrors.fetch_add(errors, std::memory_order_relaxed);
+	if (timing)
+		m_counters.sinkNanoseconds.fetch_add(static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count()), std::memory_order_relaxed);
+}
+
+inline
+LogBuf::StagingSlots::StagingSlots():
+    count(0)
+{
+}
+
+inline
+LogBuf::Batch::Batch():
+    count(0)
+{
+}
+
+inline
+LogBuf::Readers::Readers():
+    epoch(0)
+{
+	counts[0].store(0, std::memory_order_relaxed);
+	counts[1].store(0, std::memory_order_relaxed);
+}
+
+inline
+LogBuf::KvTarget::KvTarget(LogBuf * owner):
+    m_owner(owner)
+{
+}
+
+inline
+void LogBuf::KvTarget::writeRecord(const char * s, std::size_t n)
+{
+	m_owner->writeKvRecord(s, n, nullptr);
+}
+
+inline
+void LogBuf::KvTarget::writeRecords(const char * s, std::size_t n, std::size_t , const void * context)
+{
+	m_owner->writeKvRecord(s, n, static_cast<const LogBuf *>(context));
+}
+
+inline
+void LogBuf::KvTarget::dropRecord()
+{
+	m_owner->dropRecord();
+}
+
+
 }
 
 #endif
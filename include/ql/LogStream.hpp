@@ -40,10 +40,12 @@ class LogStream: public std::ostream
 		 * Attach stream buffer. Attaches buffer pointed by @a buf to LogStream's
 		 * internal LogBuf buffer.
 		 * @param buf pointer to std::streambuf object.
+		 * @return @p true if buffer has been attached, @p false if attachment would create
+		 * a cycle.
 		 *
 		 * @see rdbuf(), detachBuffer(), attachStream().
 		 */
-		void attachBuffer(std::streambuf * buf);
+		bool attachBuffer(std::streambuf * buf);
 
 		/**
 		 * Detach stream buffer.
@@ -58,10 +60,12 @@ class LogStream: public std::ostream
 		 * it attaches @a stream 's internal buffer to LogStream's internal
 		 * LogBuf buffer.
 		 * @param stream reference to std::ostream object.
+		 * @return @p true if stream has been attached, @p false if attachment would create
+		 * a cycle.
 		 *
 		 * @see attachBuffer(), detachStream().
 		 */
-		void attachStream(std::ostream & stream);
+		bool attachStream(std::ostream & stream);
 
 		/**
 		 * Detach stream's buffer.
@@ -71,6 +75,14 @@ class LogStream: public std::ostream
 		 */
 		void detachStream(std::ostream & stream);
 
+		/**
+		 * Check whether stream is enabled. Stream is enabled if any device (buffer other than
+		 * LogBuf) is attached to it, directly or through other log streams. Macros check
+		 * this flag before evaluating their expressions.
+		 * @return @p true if output of the stream reaches any device, @p false otherwise.
+		 */
+		bool enabled() const;
+
 		/**
 		 * Get trace flags.
 		 * @return trace flags.
@@ -83,6 +95,30 @@ class LogStream: public std::ostream
 		 */
 		void setTraceFlags(int flags);
 
+		/**
+		 * Get flush policy.
+		 * @return flush policy.
+		 */
+		FlushPolicy flushPolicy() const;
+
+		/**
+		 * Set flush policy. Flush policy decides, when buffers attached to the stream are
+		 * forced to sync after records are written to them.
+		 * @param policy flush policy.
+		 *
+		 * @note FlushPolicy::INTERVAL policy syncs buffers, when a record is written after
+		 * the interval has elapsed. Records written before logging stops are synced by a
+		 * timer only if the timer calls LogBuf::flushPending(). Log runs such timer for its
+		 * streams (see Log::setFlushPolicy()).
+		 */
+		void setFlushPolicy(const FlushPolicy & policy);
+
+		/**
+		 * Get statistics.
+		 * @return statistics of internal LogBuf buffer.
+		 */
+		LogBuf::Statistics statistics() const;
+
 	private:
 		LogBuf m_logBuf;
 		int m_traceFlags;
@@ -94,6 +130,9 @@ LogStream::LogStream():
     std::ostream(& m_logBuf),
     m_traceFlags(Trace::FILE | Trace::LINE | Trace::FUNCTION)
 {
+	// Fill character is initialized lazily by the first call of fill(). Records copy it
+	// concurrently (see Record), so it is initialized here, before the stream is shared.
+	fill();
 }
 
 inline
@@ -108,9 +147,9 @@ LogBuf * LogStream::rdbuf()
 }
 
 inline
-void LogStream::attachBuffer(std::streambuf * buf)
+bool LogStream::attachBuffer(std::streambuf * buf)
 {
-	m_logBuf.attachBuffer(buf);
+	return m_logBuf.attachBuffer(buf);
 }
 
 inline
@@ -120,9 +159,9 @@ void LogStream::detachBuffer(std::streambuf * buf)
 }
 
 inline
-void LogStream::attachStream(std::ostream & stream)
+bool LogStream::attachStream(std::ostream & stream)
 {
-	m_logBuf.attachStream(stream);
+	return m_logBuf.attachStream(stream);
 }
 
 inline
@@ -131,6 +170,12 @@ void LogStream::detachStream(std::ostream & stream)
 	m_logBuf.detachStream(stream);
 }
 
+inline
+bool LogStream::enabled() const
+{
+	return m_logBuf.enabled();
+}
+
 inline
 int LogStream::traceFlags() const
 {
@@ -143,6 +188,24 @@ void LogStream::setTraceFlags(int flags)
 	m_traceFlags = flags;
 }
 
+inline
+FlushPolicy LogStream::flushPolicy() const
+{
+	return m_logBuf.flushPolicy();
+}
+
+inline
+void LogStream::setFlushPolicy(const FlushPolicy & policy)
+{
+	m_logBuf.setFlushPolicy(policy);
+}
+
+inline
+LogBuf::Statistics LogStream::statistics() const
+{
+	return m_logBuf.statistics();
+}
+
 }
 
 #endif
@@ -0,0 +1,407 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_MMAPFILEBUF_HPP
+#define QL_MMAPFILEBUF_HPP
+
+#include "CompressBuf.hpp"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Default size of MmapFileBuf segment in bytes.
+ */
+#ifndef QL_MMAP_SEGMENT_SIZE
+	#define QL_MMAP_SEGMENT_SIZE (16 * 1024 * 1024)
+#endif
+
+namespace ql {
+
+/**
+ * Memory-mapped file buffer. Output is written into a series of files (segments). Each
+ * segment is preallocated on disk and mapped into memory, so that writing characters is
+ * just copying them into the mapping, without any system call. Data becomes visible to
+ * other processes reading the file immediately and it is written to the disk by the kernel.
+ * Syncing the buffer does nothing.
+ *
+ * New segment is started (rotation), when record does not fit into current segment or
+ * when rotation interval elapses. Intervals are aligned to multiples of the interval
+ * since the Epoch, so for example with the interval of 3600 seconds segments are rotated
+ * at full hours. Segment names are produced from a pattern, in which following sequences
+ * are replaced:
+ * 	- @p %%n - sequence number of the segment.
+ * 	- other sequences recognized by std::strftime() - local time of segment creation.
+ * 	.
+ * If pattern does not contain @p %%n, sequence number is appended to the pattern after a
+ * dot. Existing files with the same name are overwritten. Only given number of most recent
+ * segments can be kept (retention) - older segments created by the buffer are removed.
+ *
+ * When segment is closed (on rotation or destruction of the buffer), file is truncated to
+ * the size of data, which has been written into it. If the process crashes, file keeps
+ * its preallocated size and the tail is filled with zeroes.
+ *
+ * Closed segments can be compressed (see setCompression()). Segment is compressed by a
+ * background thread into a file with the suffix of compression format appended to its
+ * name and then the segment is removed.
+ *
+ * Buffer is not thread-safe by itself. When it is attached to LogStream, writes are
+ * serialized by the log stream.
+ *
+ * @code
+ * ql::MmapFileBuf fileBuf("app-%Y%m%d-%n.log", 64 * 1024 * 1024, 24 * 3600, 7);
+ * ql::Log::Instance().combinedStream().attachBuffer(& fileBuf);
+ * @endcode
+ */
+class MmapFileBuf: public std::streambuf
+{
+	public:
+		/**
+		 * Constructor. Opens the first segment.
+		 * @param pattern segment name pattern.
+		 * @param segmentSize segment size in bytes. It is rounded up to the multiple of page
+		 * size.
+		 * @param interval rotation interval in seconds. Zero turns off time based rotation.
+		 * @param retention maximal number of segments to be kept. Zero means all the
+		 * segments are kept.
+		 */
+		explicit MmapFileBuf(const std::string & pattern, std::size_t segmentSize = QL_MMAP_SEGMENT_SIZE, unsigned long interval = 0, std::size_t retention = 0);
+
+		/**
+		 * Destructor. Closes current segment.
+		 */
+		virtual ~MmapFileBuf();
+
+		/**
+		 * Check whether segment is open.
+		 * @return @p true if current segment is open and mapped, @p false if segment could
+		 * not be created. In such case characters are discarded until next rotation.
+		 */
+		bool isOpen() const;
+
+		/**
+		 * Get name of current segment.
+		 * @return file name of current segment.
+		 */
+		const std::string & fileName() const;
+
+		/**
+		 * Get segment size.
+		 * @return segment size in bytes.
+		 */
+		std::size_t segmentSize() const;
+
+		/**
+		 * Set compression of closed segments.
+		 * @param enabled whether closed segments should be compressed.
+		 * @param format compression format.
+		 */
+		void setCompression(bool enabled, CompressBuf::format_t format = CompressBuf::LZ4);
+
+		/**
+		 * Rotate. Closes current segment and opens the next one.
+		 * @return @p true if new segment has been opened, @p false otherwise.
+		 */
+		bool rotate();
+
+	protected:
+		//std::streambuf
+		virtual int sync();
+
+		//std::streambuf
+		virtual int_type overflow(int_type c);
+
+		//std::streambuf
+		virtual std::streamsize xsputn(const char_type * s, std::streamsize n);
+
+	private:
+		MmapFileBuf(const MmapFileBuf & other);	// = delete
+
+		MmapFileBuf & operator =(const MmapFileBuf & other); // = delete
+
+		static std::size_t RoundUpToPage(std::size_t size);
+
+		/**
+		 * Compress segment and remove it.
+		 * @param fileName name of the segment.
+		 * @param compressed name of compressed file.
+		 * @param format compression format.
+		 */
+		static void CompressSegment(const std::string & fileName, const std::string & compressed, CompressBuf::format_t format);
+
+		std::string segmentName(std::time_t time) const;
+
+		bool openSegment();
+
+		void closeSegment();
+
+		/**
+		 * Rotate if rotation interval has elapsed.
+		 */
+		void checkInterval();
+
+	private:
+		std::string m_pattern;
+		std::size_t m_segmentSize;
+		unsigned long m_interval;
+		std::size_t m_retention;
+		unsigned long m_sequence;
+		std::string m_fileName;
+		std::deque<std::string> m_segments;
+		int m_fd;
+		char * m_map;
+		std::time_t m_rotateAt;
+		bool m_compress;
+		CompressBuf::format_t m_compression;
+		std::thread m_compressor;
+};
+
+
+inline
+MmapFileBuf::MmapFileBuf(const std::string & pattern, std::size_t segmentSize, unsigned long interval, std::size_t retention):
+    m_pattern(pattern),
+    m_segmentSize(RoundUpToPage(segmentSize)),
+    m_interval(interval),
+    m_retention(retention),
+    m_sequence(0),
+    m_fd(-1),
+    m_map(nullptr),
+    m_rotateAt(0),
+    m_compress(false),
+    m_compression(CompressBuf::LZ4)
+{
+	if (m_pattern.find("%n") == std::string::npos)
+		m_pattern += ".%n";
+	openSegment();
+}
+
+inline
+MmapFileBuf::~MmapFileBuf()
+{
+	closeSegment();
+	if (m_compressor.joinable())
+		m_compressor.join();
+}
+
+inline
+bool MmapFileBuf::isOpen() const
+{
+	return m_map != nullptr;
+}
+
+inline
+const std::string & MmapFileBuf::fileName() const
+{
+	return m_fileName;
+}
+
+inline
+std::size_t MmapFileBuf::segmentSize() const
+{
+	return m_segmentSize;
+}
+
+inline
+void MmapFileBuf::setCompression(bool enabled, CompressBuf::format_t format)
+{
+	m_compress = enabled;
+	m_compression = format;
+}
+
+inline
+bool MmapFileBuf::rotate()
+{
+	closeSegment();
+	return openSegment();
+}
+
+inline
+int MmapFileBuf::sync()
+{
+	return 0;
+}
+
+inline
+MmapFileBuf::int_type MmapFileBuf::overflow(int_type c)
+{
+	if (traits_type::eq_int_type(c, traits_type::eof()))
+		return traits_type::not_eof(c);
+
+	if (!rotate())
+		return traits_type::eof();
+	*pptr() = traits_type::to_char_type(c);
+	pbump(1);
+	return c;
+}
+
+inline
+std::streamsize MmapFileBuf::xsputn(const char_type * s, std::streamsize n)
+{
+	checkInterval();
+
+	// Do not split records between segments, unless record is larger than the segment.
+	std::size_t count = static_cast<std::size_t>(n);
+	std::size_t avail = static_cast<std::size_t>(epptr() - pptr());
+	if (count > avail && pptr() != pbase() && count <= m_segmentSize)
+		if (!rotate())
+			return 0;
+
+	std::size_t written = 0;
+	while (written < count) {
+		avail = static_cast<std::size_t>(epptr() - pptr());
+		if (avail == 0) {
+			if (!rotate())
+				break;
+			continue;
+		}
+		std::size_t chunk = count - written < avail ? count - written : avail;
+		std::memcpy(pptr(), s + written, chunk);
+		pbump(static_cast<int>(chunk));
+		written += chunk;
+	}
+	return static_cast<std::streamsize>(written);
+}
+
+inline
+std::size_t MmapFileBuf::RoundUpToPage(std::size_t size)
+{
+	std::size_t page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	if (size == 0)
+		size = 1;
+	return (size + page - 1) / page * page;
+}
+
+inline
+std::string MmapFileBuf::segmentName(std::time_t time) const
+{
+	char sequence[24];
+	std::snprintf(sequence, sizeof(sequence), "%lu", m_sequence);
+	std::string pattern;
+	for (std::string::size_type i = 0; i < m_pattern.size(); i++)
+		if (m_pattern[i] == '%' && i + 1 < m_pattern.size() && m_pattern[i + 1] == 'n') {
+			pattern += sequence;
+			i++;
+		} else if (m_pattern[i] == '%' && i + 1 < m_pattern.size() && m_pattern[i + 1] == '%') {
+			pattern += "%%";
+			i++;
+		} else
+			pattern += m_pattern[i];
+
+	std::tm tm;
+	localtime_r(& time, & tm);
+	std::string result(pattern.size() + 256, '\0');
+	std::size_t len = std::strftime(& result[0], result.size(), pattern.c_str(), & tm);
+	result.resize(len);
+	return result;
+}
+
+inline
+bool MmapFileBuf::openSegment()
+{
+	std::time_t now = std::time(nullptr);
+	if (m_interval != 0)
+		m_rotateAt = (now / static_cast<std::time_t>(m_interval) + 1) * static_cast<std::time_t>(m_interval);
+	m_fileName = segmentName(now);
+	m_sequence++;
+
+	m_fd = ::open(m_fileName.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (m_fd == -1)
+		return false;
+
+	m_segments.push_back(m_fileName);
+	if (m_retention != 0)
+		while (m_segments.size() > m_retention) {
+			// Segment to be removed may be still being compressed.
+			if (m_compressor.joinable())
+				m_compressor.join();
+			::unlink(m_segments.front().c_str());
+			m_segments.pop_front();
+		}
+
+	// Preallocate blocks, so that writing into the mapping does not fail with SIGBUS
+	// when the disk is full. Some file systems do not support preallocation.
+	if (int error = posix_fallocate(m_fd, 0, static_cast<off_t>(m_segmentSize))) {
+		if (error != EINVAL && error != EOPNOTSUPP) {
+			closeSegment();
+			return false;
+		}
+		if (ftruncate(m_fd, static_cast<off_t>(m_segmentSize)) == -1) {
+			closeSegment();
+			return false;
+		}
+	}
+
+	void * map = mmap(nullptr, m_segmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+	if (map == MAP_FAILED) {
+		closeSegment();
+		return false;
+	}
+	m_map = static_cast<char *>(map);
+	setp(m_map, m_map + m_segmentSize);
+	return true;
+}
+
+inline
+void MmapFileBuf::closeSegment()
+{
+	std::size_t size = static_cast<std::size_t>(pptr() - pbase());
+	setp(nullptr, nullptr);
+	if (m_map != nullptr) {
+		munmap(m_map, m_segmentSize);
+		m_map = nullptr;
+	}
+	if (m_fd != -1) {
+		if (ftruncate(m_fd, static_cast<off_t>(size)) == -1) {
+			// Nothing can be done. File keeps its preallocated size.
+		}
+		::close(m_fd);
+		m_fd = -1;
+
+		if (m_compress && !m_segments.empty() && m_segments.back() == m_fileName) {
+			if (m_compressor.joinable())
+				m_compressor.join();
+			std::string compressed = m_fileName + CompressBuf::Suffix(m_compression);
+			m_segments.back() = compressed;
+			m_compressor = std::thread(& MmapFileBuf::CompressSegment, m_fileName, compressed, m_compression);
+		}
+	}
+}
+
+inline
+void MmapFileBuf::CompressSegment(const std::string & fileName, const std::string & compressed, CompressBuf::format_t format)
+{
+	if (CompressBuf::CompressFile(fileName, compressed, format))
+		::unlink(fileName.c_str());
+	else
+		::unlink(compressed.c_str());
+}
+
+inline
+void MmapFileBuf::checkInterval()
+{
+	if (m_interval != 0 && std::time(nullptr) >= m_rotateAt)
+		rotate();
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
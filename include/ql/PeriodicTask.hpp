@@ -0,0 +1,108 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_PERIODICTASK_HPP
+#define QL_PERIODICTASK_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace ql {
+
+/**
+ * Periodic task. Calls given function on a background thread at regular intervals until
+ * task object is destroyed.
+ */
+class PeriodicTask
+{
+	public:
+		/**
+		 * Constructor. Starts the thread.
+		 * @param interval interval in milliseconds.
+		 * @param func function to be called.
+		 */
+		PeriodicTask(unsigned long interval, std::function<void()> func);
+
+		/**
+		 * Destructor. Stops the thread. Function is not called anymore once destructor
+		 * returns.
+		 */
+		~PeriodicTask();
+
+		/**
+		 * Get interval.
+		 * @return interval in milliseconds.
+		 */
+		unsigned long interval() const;
+
+	private:
+		PeriodicTask(const PeriodicTask & other);	// = delete
+
+		PeriodicTask & operator =(const PeriodicTask & other); // = delete
+
+		void run();
+
+	private:
+		unsigned long m_interval;
+		std::function<void()> m_func;
+		bool m_stop;
+		std::mutex m_mutex;
+		std::condition_variable m_cond;
+		std::thread m_thread;
+};
+
+
+inline
+PeriodicTask::PeriodicTask(unsigned long interval, std::function<void()> func):
+    m_interval(interval),
+    m_func(func),
+    m_stop(false)
+{
+	m_thread = std::thread(& PeriodicTask::run, this);
+}
+
+inline
+PeriodicTask::~PeriodicTask()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cond.notify_one();
+	m_thread.join();
+}
+
+inline
+unsigned long PeriodicTask::interval() const
+{
+	return m_interval;
+}
+
+inline
+void PeriodicTask::run()
+{
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	std::unique_lock<std::mutex> lock(m_mutex);
+	for (;;) {
+		next += std::chrono::milliseconds(m_interval);
+		if (m_cond.wait_until(lock, next, [this]() { return m_stop; }))
+			break;
+		lock.unlock();
+		m_func();
+		lock.lock();
+	}
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
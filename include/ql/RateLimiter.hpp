@@ -0,0 +1,140 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_RATELIMITER_HPP
+#define QL_RATELIMITER_HPP
+
+#include "CallSite.hpp"
+#include "LogStream.hpp"
+#include "Record.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+/**
+ * Rate limiter of a call site. Expands to a reference to static RateLimiter object.
+ * @param RATE number of records per second. Should be a constant expression.
+ * @param BURST number of records, which may be issued at once. Should be a constant
+ * expression.
+ * @return reference to RateLimiter object.
+ */
+#define QL_IMPL_RATE_LIMITER(RATE, BURST) ([]() -> ::ql::RateLimiter & { static ::ql::RateLimiter ql_rateLimiter(RATE, BURST); return ql_rateLimiter; }())
+
+namespace ql {
+
+/**
+ * Rate limiter. Rate limiter is a token bucket, which lets through at most given number
+ * of records per second on average, with bursts of given size. Bucket is implemented
+ * as a single atomic variable holding theoretical arrival time of the next record
+ * (generic cell rate algorithm), so checking the limit does not take any lock.
+ *
+ * Rate limiters are intended to be static objects created by rate limited macros (e.g.
+ * QL_WARN_RATE_LIMITED) for each call site. Limit is checked before message expression
+ * is evaluated. Records, which have been rejected are counted and summary (e.g.
+ * "Warning: suppressed 1000 similar messages") is written before the next record, which
+ * is let through.
+ */
+class RateLimiter
+{
+	public:
+		/**
+		 * Constructor.
+		 * @param rate number of records per second.
+		 * @param burst number of records, which may be issued at once.
+		 */
+		constexpr RateLimiter(double rate, unsigned burst);
+
+		/**
+		 * Acquire permission to issue a record. If permission is granted and some records
+		 * have been rejected before, summary record is written to @a stream.
+		 * @param stream log stream.
+		 * @param prefix prefix of summary record.
+		 * @param site call site.
+		 * @param function function name.
+		 * @return @p true if record can be issued, @p false if it should be suppressed.
+		 */
+		bool acquire(LogStream & stream, const char * prefix, const CallSite & site, const char * function);
+
+		/**
+		 * Acquire permission to issue a record without writing summary.
+		 * @return @p true if record can be issued, @p false if it should be suppressed.
+		 */
+		bool tryAcquire();
+
+		/**
+		 * Get number of suppressed records.
+		 * @return number of records rejected since last record has been let through.
+		 */
+		std::size_t suppressed() const;
+
+	private:
+		static std::int64_t Nanoseconds();
+
+	private:
+		std::int64_t m_interval;	///< Interval between records in nanoseconds.
+		std::int64_t m_tolerance;	///< Allowed advance of theoretical arrival time.
+		std::atomic<std::int64_t> m_arrival;	///< Theoretical arrival time of next record.
+		std::atomic<std::size_t> m_suppressed;
+};
+
+
+inline
+constexpr RateLimiter::RateLimiter(double rate, unsigned burst):
+    m_interval(static_cast<std::int64_t>(1e9 / rate)),
+    m_tolerance(static_cast<std::int64_t>(1e9 / rate) * (burst > 0 ? burst : 1)),
+    m_arrival(0),
+    m_suppressed(0)
+{
+}
+
+inline
+bool RateLimiter::acquire(LogStream & stream, const char * prefix, const CallSite & site, const char * function)
+{
+	if (!tryAcquire())
+		return false;
+
+	std::size_t suppressed = m_suppressed.exchange(0, std::memory_order_relaxed);
+	if (suppressed != 0)
+		Record(stream).stream() << prefix << "suppressed " << suppressed << " similar messages" << Trace(stream.traceFlags(), site, function) << Record::End;
+	return true;
+}
+
+inline
+bool RateLimiter::tryAcquire()
+{
+	std::int64_t now = Nanoseconds();
+	std::int64_t arrival = m_arrival.load(std::memory_order_relaxed);
+	for (;;) {
+		std::int64_t next = (arrival > now ? arrival : now) + m_interval;
+		if (next - now > m_tolerance) {
+			m_suppressed.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		if (m_arrival.compare_exchange_weak(arrival, next, std::memory_order_relaxed))
+			return true;
+	}
+}
+
+inline
+std::size_t RateLimiter::suppressed() const
+{
+	return m_suppressed.load(std::memory_order_relaxed);
+}
+
+inline
+std::int64_t RateLimiter::Nanoseconds()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
@@ -0,0 +1,225 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_RECORD_HPP
+#define QL_RECORD_HPP
+
+#include "CallSite.hpp"
+#include "LogStream.hpp"
+#include "RecordBuf.hpp"
+#include "Trace.hpp"
+
+#include <memory>
+#include <vector>
+
+/**
+ * Attributes of out-of-line cold functions. Such functions are not inlined into callers
+ * and compiler places them away from hot code (e.g. in .text.unlikely section). Branch
+ * leading to a call of cold function is considered unlikely, so compiler moves the whole
+ * branch out of the hot part of the caller. Attributes should be given with the
+ * definition (not declaration) of inline function.
+ */
+#ifdef __GNUC__
+	#define QL_IMPL_COLD __attribute__((cold, noinline))
+#else
+	#define QL_IMPL_COLD
+#endif
+
+namespace ql {
+
+/**
+ * Record. Record is a short-living object used by macros to format a single message. It
+ * borrows thread-local output stream with its own put area (see RecordBuf), so that
+ * formatting neither calls virtual functions of LogBuf for each character, nor touches
+ * formatting state of LogStream shared by other threads. Record is committed to the log
+ * stream, when its output stream is synced (for example by End() manipulator or
+ * std::endl). Uncommitted characters are discarded, when record is destroyed. Committing
+ * a record does not imply syncing buffers attached to the log stream - this is decided by
+ * flush policy of the log stream.
+ *
+ * Streams are pooled per thread, so records may be nested (e.g. if function called
+ * within message expression logs something by itself).
+ *
+ * Typical usage is a temporary object, which lives until the end of full expression.
+ * @code
+ * ql::Record(ql::Log::Instance().noteStream()).stream() << "x is " << x << ql::Record::End;
+ * @endcode
+ *
+ * Constructors, destructor and Commit() are cold functions, which are never inlined.
+ * Compiler considers code, which creates a record unlikely to be executed and places it
+ * away from hot code.
+ */
+class Record
+{
+	public:
+		/**
+		 * Constructor. Formatting flags, precision and fill character are copied from
+		 * @a logStream.
+		 * @param logStream log stream, which is going to receive the record.
+		 */
+		explicit Record(LogStream & logStream);
+
+		/**
+		 * Constructor. Record is committed to both streams. Devices reachable from both
+		 * streams receive the record once. Formatting flags, precision and fill character
+		 * are copied from @a logStream.
+		 * @param logStream log stream, which is going to receive the record.
+		 * @param extraStream log stream, which is going to receive the record in addition
+		 * to @a logStream (e.g. stream of a Category).
+		 */
+		Record(LogStream & logStream, LogStream & extraStream);
+
+		/**
+		 * Destructor.
+		 */
+		~Record();
+
+		/**
+		 * Get output stream.
+		 * @return output stream, which formats the record.
+		 */
+		std::ostream & stream();
+
+		/**
+		 * Record end manipulator. Puts new line character and commits the record. Record
+		 * is not committed if stream is in bad state.
+		 * @param stream record stream.
+		 * @return @a stream.
+		 */
+		static std::ostream & End(std::ostream & stream);
+
+		/**
+		 * Put trace, new line character and commit the record. Function is cold and it
+		 * is never inlined, so that the whole branch of a macro, which issues a record is
+		 * moved away from hot code of the caller.
+		 * @param stream record stream.
+		 * @param logStream log stream, which provides trace flags.
+		 * @param site call site.
+		 * @param function function name.
+		 */
+		static void Commit(std::ostream & stream, const LogStream & logStream, const CallSite & site, const char * function);
+
+	private:
+		class Stream: public std::ostream
+		{
+			public:
+				Stream();
+
+				RecordBuf & buf();
+
+			private:
+				RecordBuf m_buf;
+		};
+
+		typedef std::vector<std::unique_ptr<Stream> > StreamsContainer;
+
+	private:
+		Record(const Record & other);	// = delete
+
+		Record & operator =(const Record & other); // = delete
+
+		static StreamsContainer & Streams();
+
+		static std::size_t & Depth();
+
+		void init(LogStream & logStream, LogBuf * extraTarget);
+
+	private:
+		Stream * m_stream;
+};
+
+
+inline QL_IMPL_COLD
+Record::Record(LogStream & logStream)
+{
+	init(logStream, nullptr);
+}
+
+inline QL_IMPL_COLD
+Record::Record(LogStream & logStream, LogStream & extraStream)
+{
+	init(logStream, extraStream.rdbuf());
+}
+
+inline QL_IMPL_COLD
+Record::~Record()
+{
+	m_stream->buf().discard();
+	Depth()--;
+}
+
+inline
+std::ostream & Record::stream()
+{
+	return *m_stream;
+}
+
+inline
+std::ostream & Record::End(std::ostream & stream)
+{
+	// Bad stream means that the record has been rejected (e.g. by Deduplicator::Filter).
+	if (stream.put('\n'))
+		stream.rdbuf()->pubsync();
+	return stream;
+}
+
+inline QL_IMPL_COLD
+void Record::Commit(std::ostream & stream, const LogStream & logStream, const CallSite & site, const char * function)
+{
+	stream << Trace(logStream.traceFlags(), site, function) << End;
+}
+
+inline
+Record::StreamsContainer & Record::Streams()
+{
+	static thread_local StreamsContainer streams;
+	return streams;
+}
+
+inline
+std::size_t & Record::Depth()
+{
+	static thread_local std::size_t depth = 0;
+	return depth;
+}
+
+inline
+void Record::init(LogStream & logStream, LogBuf * extraTarget)
+{
+	StreamsContainer & streams = Streams();
+	std::size_t & depth = Depth();
+	if (depth == streams.size())
+		streams.push_back(std::unique_ptr<Stream>(new Stream));
+	m_stream = streams[depth++].get();
+
+	m_stream->buf().setTarget(logStream.rdbuf());
+	m_stream->buf().setExtraTarget(extraTarget);
+	m_stream->clear();
+	m_stream->flags(logStream.flags());
+	m_stream->precision(logStream.precision());
+	m_stream->fill(logStream.fill());
+	m_stream->width(0);
+}
+
+inline
+Record::Stream::Stream():
+    std::ostream(& m_buf)
+{
+}
+
+inline
+RecordBuf & Record::Stream::buf()
+{
+	return m_buf;
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
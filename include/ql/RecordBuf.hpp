@@ -0,0 +1,200 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_RECORDBUF_HPP
+#define QL_RECORDBUF_HPP
+
+#include "LogBuf.hpp"
+
+#include <vector>
+
+/**
+ * Initial size of record buffer put area. Buffer grows if record does not fit.
+ */
+#ifndef QL_RECORD_BUFFER_SIZE
+	#define QL_RECORD_BUFFER_SIZE 256
+#endif
+
+namespace ql {
+
+/**
+ * Record buffer. Record buffer owns a put area, so that characters of a record are
+ * accumulated in contiguous memory without calling virtual functions for each character.
+ * Only overflow() is overridden, so strings are copied into the put area by
+ * std::streambuf::xsputn() and the buffer is reached only, when the put area is full.
+ * When sync() is called (for example by std::endl), complete record is passed to the
+ * target LogBuf at once. If extra target is set, record is passed to it as well, but
+ * devices reachable from the target are skipped, so that they receive the record once.
+ *
+ * Record buffer is not thread-safe. It is intended to be used by a single thread.
+ *
+ * @see Record.
+ */
+class RecordBuf: public std::streambuf
+{
+	public:
+		/**
+		 * Constructor.
+		 * @param target target log buffer.
+		 */
+		explicit RecordBuf(LogBuf * target = nullptr);
+
+		/**
+		 * Get target.
+		 * @return target log buffer.
+		 */
+		LogBuf * target() const;
+
+		/**
+		 * Set target.
+		 * @param target log buffer, which is going to receive records.
+		 */
+		void setTarget(LogBuf * target);
+
+		/**
+		 * Get extra target.
+		 * @return extra target log buffer or @p nullptr if not set.
+		 */
+		LogBuf * extraTarget() const;
+
+		/**
+		 * Set extra target.
+		 * @param target log buffer, which is going to receive records in addition to
+		 * target or @p nullptr.
+		 */
+		void setExtraTarget(LogBuf * target);
+
+		/**
+		 * Get record characters put so far.
+		 * @return pointer to the first character of the record.
+		 */
+		const char * data() const;
+
+		/**
+		 * Get size of the record put so far.
+		 * @return number of characters.
+		 */
+		std::size_t size() const;
+
+		/**
+		 * Discard characters put so far.
+		 */
+		void discard();
+
+	protected:
+		//std::streambuf
+		virtual int sync();
+
+		//std::streambuf
+		virtual int_type overflow(int_type c);
+
+	private:
+		/**
+		 * Grow put area, so that it can hold at least @a n more characters.
+		 * @param n number of characters.
+		 */
+		void reserve(std::size_t n);
+
+	private:
+		LogBuf * m_target;
+		LogBuf * m_extraTarget;
+		std::vector<char> m_buffer;
+};
+
+
+inline
+RecordBuf::RecordBuf(LogBuf * target):
+    m_target(target),
+    m_extraTarget(nullptr),
+    m_buffer(QL_RECORD_BUFFER_SIZE)
+{
+	setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+}
+
+inline
+LogBuf * RecordBuf::target() const
+{
+	return m_target;
+}
+
+inline
+void RecordBuf::setTarget(LogBuf * target)
+{
+	m_target = target;
+}
+
+inline
+LogBuf * RecordBuf::extraTarget() const
+{
+	return m_extraTarget;
+}
+
+inline
+void RecordBuf::setExtraTarget(LogBuf * target)
+{
+	m_extraTarget = target;
+}
+
+inline
+const char * RecordBuf::data() const
+{
+	return pbase();
+}
+
+inline
+std::size_t RecordBuf::size() const
+{
+	return static_cast<std::size_t>(pptr() - pbase());
+}
+
+inline
+void RecordBuf::discard()
+{
+	setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+}
+
+inline
+int RecordBuf::sync()
+{
+	if (m_target != nullptr)
+		m_target->putRecord(data(), size());
+	if (m_extraTarget != nullptr)
+		m_extraTarget->putRecord(data(), size(), m_target);
+	discard();
+	return 0;
+}
+
+inline
+RecordBuf::int_type RecordBuf::overflow(int_type c)
+{
+	if (traits_type::eq_int_type(c, traits_type::eof()))
+		return traits_type::not_eof(c);
+
+	reserve(1);
+	*pptr() = traits_type::to_char_type(c);
+	pbump(1);
+	return c;
+}
+
+inline
+void RecordBuf::reserve(std::size_t n)
+{
+	std::size_t used = size();
+	std::size_t capacity = m_buffer.size();
+	while (capacity - used < n)
+		capacity *= 2;
+	m_buffer.resize(capacity);
+	setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+	pbump(static_cast<int>(used));
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
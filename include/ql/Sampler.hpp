@@ -0,0 +1,193 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_SAMPLER_HPP
+#define QL_SAMPLER_HPP
+
+#include "CallSite.hpp"
+#include "LogStream.hpp"
+#include "Record.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+/**
+ * Sampler of a call site. Expands to a reference to static Sampler object.
+ * @param MODE one of Sampler::mode_t values.
+ * @param PARAM sampling parameter. Should be a constant expression.
+ * @return reference to Sampler object.
+ */
+#define QL_IMPL_SAMPLER(MODE, PARAM) ([]() -> ::ql::Sampler & { static ::ql::Sampler ql_sampler(::ql::Sampler::MODE, PARAM); return ql_sampler; }())
+
+namespace ql {
+
+/**
+ * Sampler. Decides, which records issued from a call site are written. Following modes
+ * are available:
+ * 	- EVERY_N - every n-th record is written, starting with the first one.
+ * 	- FIRST_N - only first n records are written.
+ * 	- PROBABILITY - each record is written with given probability. Random numbers are
+ * 	generated by thread-local xorshift generator.
+ * 	.
+ * Sampler counts records issued from its call site (with atomic counters), so that
+ * records written in EVERY_N and PROBABILITY modes are annotated with
+ * "(sampled 1 of N, total M)", where N is number of records issued since previous
+ * written record (including the current one) and M is total number of records issued.
+ *
+ * Samplers are intended to be static objects created by sampling macros (e.g.
+ * QL_DEBUG_EVERY_N). Message expression is passed to the sampler as a function, which is
+ * called only for records that are going to be written, so skipped records cost neither
+ * evaluation of the expression nor formatting.
+ */
+class Sampler
+{
+	public:
+		enum mode_t {
+			EVERY_N,
+			FIRST_N,
+			PROBABILITY
+		};
+
+	public:
+		/**
+		 * Constructor.
+		 * @param mode sampling mode.
+		 * @param param @a n for EVERY_N and FIRST_N modes, probability for PROBABILITY mode.
+		 */
+		constexpr Sampler(mode_t mode, double param);
+
+		/**
+		 * Log record if it is sampled.
+		 * @param stream log stream.
+		 * @param prefix message prefix.
+		 * @param site call site.
+		 * @param function function name.
+		 * @param message function, which puts message into given std::ostream.
+		 */
+		template <typename FUNC>
+		void log(LogStream & stream, const char * prefix, const CallSite & site, const char * function, FUNC message);
+
+		/**
+		 * Get number of records issued. In FIRST_N mode records are no longer counted,
+		 * once first n of them have been written.
+		 * @return total number of records issued from the call site.
+		 */
+		std::uint64_t count() const;
+
+		/**
+		 * Get number of records written.
+		 * @return number of records, which have been sampled.
+		 */
+		std::uint64_t sampled() const;
+
+	private:
+		/**
+		 * Decide whether record should be written.
+		 * @param count number of the record (starting from 1).
+		 * @return @p true if record should be written.
+		 */
+		bool sample(std::uint64_t count) const;
+
+		/**
+		 * Generate random number.
+		 * @return random number in range [0, 1).
+		 */
+		static double Random();
+
+	private:
+		mode_t m_mode;
+		double m_param;
+		std::atomic<std::uint64_t> m_count;
+		std::atomic<std::uint64_t> m_sampled;
+		std::atomic<std::uint64_t> m_last;	///< Number of last written record.
+};
+
+
+inline
+constexpr Sampler::Sampler(mode_t mode, double param):
+    m_mode(mode),
+    m_param(param),
+    m_count(0),
+    m_sampled(0),
+    m_last(0)
+{
+}
+
+template <typename FUNC>
+QL_IMPL_COLD
+void Sampler::log(LogStream & stream, const char * prefix, const CallSite & site, const char * function, FUNC message)
+{
+	// Once first n records have been written, call site stops counting, so that it does
+	// not keep contending for the counter.
+	if (m_mode == FIRST_N && static_cast<double>(m_count.load(std::memory_order_relaxed)) >= m_param)
+		return;
+
+	std::uint64_t count = m_count.fetch_add(1, std::memory_order_relaxed) + 1;
+	if (!sample(count))
+		return;
+
+	m_sampled.fetch_add(1, std::memory_order_relaxed);
+	std::uint64_t last = m_last.exchange(count, std::memory_order_relaxed);
+	Record record(stream);
+	std::ostream & s = record.stream();
+	s << prefix;
+	message(s);
+	if (m_mode != FIRST_N)
+		s << " (sampled 1 of " << (count > last ? count - last : 1) << ", total " << count << ")";
+	s << Trace(stream.traceFlags(), site, function) << Record::End;
+}
+
+inline
+std::uint64_t Sampler::count() const
+{
+	return m_count.load(std::memory_order_relaxed);
+}
+
+inline
+std::uint64_t Sampler::sampled() const
+{
+	return m_sampled.load(std::memory_order_relaxed);
+}
+
+inline
+bool Sampler::sample(std::uint64_t count) const
+{
+	switch (m_mode) {
+		case EVERY_N:
+			return m_param <= 1.0 || (count - 1) % static_cast<std::uint64_t>(m_param) == 0;
+		case FIRST_N:
+			return static_cast<double>(count) <= m_param;
+		default:
+			return Random() < m_param;
+	}
+}
+
+inline
+double Sampler::Random()
+{
+	// xorshift64* generator.
+	static thread_local std::uint64_t state = 0;
+	if (state == 0) {
+		state = static_cast<std::uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count()) ^ (static_cast<std::uint64_t>(std::hash<std::thread::id>()(std::this_thread::get_id())) << 1) ^ reinterpret_cast<std::uintptr_t>(& state);
+		if (state == 0)
+			state = 0x9E3779B97F4A7C15ULL;
+	}
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return static_cast<double>((state * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
@@ -0,0 +1,707 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_SHMRINGBUF_HPP
+#define QL_SHMRINGBUF_HPP
+
+#include "TimeStamp.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <streambuf>
+#include <string>
+#include <thread>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Default number of slots in shared memory ring. It is rounded up to the power of two.
+ */
+#ifndef QL_SHM_SLOT_COUNT
+	#define QL_SHM_SLOT_COUNT 65536
+#endif
+
+/**
+ * Default size of a slot in shared memory ring in bytes, including slot header.
+ */
+#ifndef QL_SHM_SLOT_SIZE
+	#define QL_SHM_SLOT_SIZE 256
+#endif
+
+/**
+ * Time in milliseconds, after which reader skips a slot, which has been claimed by a
+ * producer, but producer did not start to write it.
+ */
+#ifndef QL_SHM_CLAIM_TIMEOUT
+	#define QL_SHM_CLAIM_TIMEOUT 1000
+#endif
+
+namespace ql {
+
+/**
+ * Shared memory ring buffer. Buffer sends records to a ring placed in POSIX shared
+ * memory segment (shm_open()), which is shared by many processes. Records are drained
+ * from the ring by a single reader, typically ql-collector process, which merges them and
+ * writes them to files. This way worker processes do not need to open their own files.
+ * Records are delimited by new line characters.
+ *
+ * Ring consists of fixed size slots. Record, which does not fit into a single slot,
+ * occupies consecutive slots. Writing is lock-free: producer claims slots by advancing
+ * ring tail with compare-and-swap, marks each slot as being written by its process,
+ * copies the record and commits the slots. When the ring is full, record is dropped and
+ * counted. Reader consumes committed slots in order. If producer dies in the middle of
+ * writing, reader notices that process owning the slot does not exist anymore and skips
+ * the slot. Slot, which has been claimed, but which producer did not start to write, is
+ * skipped after QL_SHM_CLAIM_TIMEOUT milliseconds. Producers and the reader must share
+ * PID namespace.
+ *
+ * Segment is created by whichever process opens it first. Existing segment keeps its
+ * geometry. Segment is not removed, when buffers are destroyed.
+ *
+ * Buffer is not thread-safe by itself. When it is attached to LogStream, writes are
+ * serialized by the log stream.
+ *
+ * @code
+ * ql::ShmRingBuf ringBuf("/myapp-log");
+ * ql::Log::Instance().combinedStream().attachBuffer(& ringBuf);
+ * @endcode
+ */
+class ShmRingBuf: public std::streambuf
+{
+	public:
+		/**
+		 * Segment header.
+		 */
+		struct Header
+		{
+			char magic[8];				///< Magic characters "QLSHMRNG".
+			std::uint32_t version;		///< Format version.
+			std::uint32_t headerSize;	///< Size of the header in bytes.
+			std::uint32_t slotSize;		///< Size of a slot in bytes.
+			std::uint32_t slotCount;	///< Number of slots.
+			std::atomic<std::uint32_t> ready;	///< Set to VERSION, when segment has been initialized.
+			alignas(64) std::atomic<std::uint64_t> tail;	///< Number of slots claimed by producers.
+			alignas(64) std::atomic<std::uint64_t> head;	///< Number of slots consumed by the reader.
+			std::atomic<std::uint64_t> dropped;	///< Number of records dropped by producers.
+			std::atomic<std::uint64_t> skipped;	///< Number of slots skipped by the reader.
+		};
+
+		/**
+		 * Slot header. Slot header is followed by the record characters.
+		 */
+		struct Slot
+		{
+			std::atomic<std::uint64_t> state;	///< Slot sequence number and its state.
+			std::int64_t time;		///< Time of the record in nanoseconds since the Epoch.
+			std::uint32_t size;		///< Number of characters in this slot.
+			std::uint32_t count;	///< Number of slots occupied by the record or zero for subsequent slots.
+			std::int32_t pid;		///< Process, which has written the record.
+			std::uint32_t reserved;
+		};
+
+		/**
+		 * Ring reader. Reader consumes records from the ring. There must be only one reader
+		 * of a segment at a time.
+		 */
+		class Reader
+		{
+			public:
+				struct Record
+				{
+					std::int64_t time;	///< Time of the record in nanoseconds since the Epoch.
+					int pid;			///< Process, which has written the record.
+					std::string text;	///< Record characters.
+				};
+
+			public:
+				/**
+				 * Constructor. Opens the segment or creates it, if it does not exist.
+				 * @param name segment name.
+				 * @param slotCount number of slots, if segment is created.
+				 * @param slotSize slot size in bytes, if segment is created.
+				 */
+				explicit Reader(const std::string & name, std::size_t slotCount = QL_SHM_SLOT_COUNT, std::size_t slotSize = QL_SHM_SLOT_SIZE);
+
+				/**
+				 * Destructor.
+				 */
+				~Reader();
+
+				/**
+				 * Check whether segment is open.
+				 * @return @p true if segment has been opened or created, @p false otherwise.
+				 */
+				bool isOpen() const;
+
+				/**
+				 * Read next record.
+				 * @param record record to be filled.
+				 * @return @p true if record has been read, @p false if no complete record is
+				 * available.
+				 */
+				bool read(Record & record);
+
+				/**
+				 * Get number of dropped records.
+				 * @return number of records dropped by producers, because the ring was full.
+				 */
+				std::uint64_t droppedCount() const;
+
+				/**
+				 * Get number of skipped slots.
+				 * @return number of slots skipped, because their producers have died.
+				 */
+				std::uint64_t skippedCount() const;
+
+			private:
+				Reader(const Reader & other);	// = delete
+
+				Reader & operator =(const Reader & other); // = delete
+
+				/**
+				 * Check whether reader should stop waiting for a slot.
+				 * @param ticket sequence number of the slot.
+				 * @param state state of the slot.
+				 * @return @p true if slot should be skipped, @p false otherwise.
+				 */
+				bool stalled(std::uint64_t ticket, std::uint64_t state);
+
+				/**
+				 * Free consumed slots.
+				 * @param ticket sequence number of the first slot.
+				 * @param count number of slots.
+				 */
+				void release(std::uint64_t ticket, std::uint64_t count);
+
+			private:
+				char * m_image;
+				std::size_t m_imageSize;
+				std::uint64_t m_stallTicket;
+				std::chrono::steady_clock::time_point m_stallSince;
+		};
+
+		static const std::uint32_t VERSION = 1;	///< Version of segment format.
+
+	public:
+		/**
+		 * Constructor. Opens the segment or creates it, if it does not exist.
+		 * @param name segment name. Name should start with a slash.
+		 * @param slotCount number of slots, if segment is created.
+		 * @param slotSize slot size in bytes, if segment is created.
+		 */
+		explicit ShmRingBuf(const std::string & name, std::size_t slotCount = QL_SHM_SLOT_COUNT, std::size_t slotSize = QL_SHM_SLOT_SIZE);
+
+		/**
+		 * Destructor. Incomplete record (not terminated by new line character) is written
+		 * to the ring.
+		 */
+		virtual ~ShmRingBuf();
+
+		/**
+		 * Check whether segment is open.
+		 * @return @p true if segment has been opened or created, @p false otherwise.
+		 */
+		bool isOpen() const;
+
+		/**
+		 * Get segment name.
+		 * @return name of the segment.
+		 */
+		const std::string & name() const;
+
+		/**
+		 * Write a record to the ring.
+		 * @param s record characters.
+		 * @param n number of characters.
+		 * @return @p true if record has been written, @p false if it has been dropped.
+		 */
+		bool write(const char * s, std::size_t n);
+
+		/**
+		 * Get number of dropped records.
+		 * @return number of records dropped by all producers of the segment.
+		 */
+		std::uint64_t droppedCount() const;
+
+		/**
+		 * Remove the segment. Processes, which have the segment open, keep using it.
+		 * @param name segment name.
+		 * @return @p true on success, @p false otherwise.
+		 */
+		static bool Unlink(const std::string & name);
+
+	protected:
+		//std::streambuf
+		virtual int_type overflow(int_type c);
+
+		//std::streambuf
+		virtual std::streamsize xsputn(const char_type * s, std::streamsize n);
+
+	private:
+		enum : std::uint64_t {
+			PID_MASK = 0xffffff,	///< Bits of slot state, which hold process ID of the producer.
+			COMMITTED = PID_MASK	///< Slot state bits of committed slot.
+		};
+
+		ShmRingBuf(const ShmRingBuf & other);	// = delete
+
+		ShmRingBuf & operator =(const ShmRingBuf & other); // = delete
+
+		/**
+		 * Open the segment or create it.
+		 * @param name segment name.
+		 * @param slotCount number of slots, if segment is created.
+		 * @param slotSize slot size in bytes, if segment is created.
+		 * @param imageSize variable, which receives size of the mapping.
+		 * @return segment mapping or @p nullptr on failure.
+		 */
+		static char * Map(const std::string & name, std::size_t slotCount, std::size_t slotSize, std::size_t & imageSize);
+
+		static Slot * SlotAt(char * image, std::uint64_t ticket);
+
+		static char * Payload(Slot * slot);
+
+		static std::uint64_t FreeState(std::uint64_t ticket);
+
+		static std::uint64_t WritingState(std::uint64_t ticket, std::uint64_t pid);
+
+		static std::uint64_t CommittedState(std::uint64_t ticket);
+
+		/**
+		 * Get process ID. Process ID is cached and the cache is reset in the child process
+		 * after fork().
+		 * @return process ID.
+		 */
+		static std::uint64_t Pid();
+
+		static std::atomic<std::uint64_t> & CachedPid();
+
+		static void ResetPid();
+
+		Header * header() const;
+
+	private:
+		std::string m_name;
+		char * m_image;
+		std::size_t m_imageSize;
+		std::string m_partial;	///< Incomplete record.
+};
+
+
+inline
+ShmRingBuf::Reader::Reader(const std::string & name, std::size_t slotCount, std::size_t slotSize):
+    m_image(Map(name, slotCount, slotSize, m_imageSize)),
+    m_stallTicket(0)
+{
+}
+
+inline
+ShmRingBuf::Reader::~Reader()
+{
+	if (m_image != nullptr)
+		munmap(m_image, m_imageSize);
+}
+
+inline
+bool ShmRingBuf::Reader::isOpen() const
+{
+	return m_image != nullptr;
+}
+
+inline
+bool ShmRingBuf::Reader::read(Record & record)
+{
+	if (m_image == nullptr)
+		return false;
+
+	Header * h = reinterpret_cast<Header *>(m_image);
+	for (;;) {
+		std::uint64_t ticket = h->head.load(std::memory_order_relaxed);
+		Slot * slot = SlotAt(m_image, ticket);
+		std::uint64_t state = slot->state.load(std::memory_order_acquire);
+		if (state == CommittedState(ticket)) {
+			std::uint64_t count = slot->count;
+			if (count == 0) {
+				// Subsequent slot of a record, which producer has given up.
+				release(ticket, 1);
+				h->skipped.fetch_add(1, std::memory_order_relaxed);
+				continue;
+			}
+			// First slot is committed last, so that all slots of the record are complete.
+			record.time = slot->time;
+			record.pid = slot->pid;
+			record.text.clear();
+			for (std::uint64_t i = 0; i < count; i++) {
+				Slot * part = SlotAt(m_image, ticket + i);
+				record.text.append(Payload(part), part->size);
+			}
+			release(ticket, count);
+			return true;
+		}
+
+		if (!stalled(ticket, state))
+			return false;
+
+		if (slot->state.compare_exchange_strong(state, FreeState(ticket + h->slotCount), std::memory_order_acq_rel, std::memory_order_relaxed)) {
+			h->head.store(ticket + 1, std::memory_order_release);
+			h->skipped.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+}
+
+inline
+std::uint64_t ShmRingBuf::Reader::droppedCount() const
+{
+	if (m_image == nullptr)
+		return 0;
+	return reinterpret_cast<const Header *>(m_image)->dropped.load(std::memory_order_relaxed);
+}
+
+inline
+std::uint64_t ShmRingBuf::Reader::skippedCount() const
+{
+	if (m_image == nullptr)
+		return 0;
+	return reinterpret_cast<const Header *>(m_image)->skipped.load(std::memory_order_relaxed);
+}
+
+inline
+bool ShmRingBuf::Reader::stalled(std::uint64_t ticket, std::uint64_t state)
+{
+	std::uint64_t pid = state & PID_MASK;
+	if (pid != 0)
+		// Slot is being written. Skip it only if its producer has died.
+		return kill(static_cast<pid_t>(pid), 0) == -1 && errno == ESRCH;
+
+	Header * h = reinterpret_cast<Header *>(m_image);
+	if (ticket >= h->tail.load(std::memory_order_acquire))
+		return false;
+
+	// Slot has been claimed, but producer did not start to write it.
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (m_stallTicket != ticket || m_stallSince == std::chrono::steady_clock::time_point()) {
+		m_stallTicket = ticket;
+		m_stallSince = now;
+		return false;
+	}
+	return now - m_stallSince >= std::chrono::milliseconds(QL_SHM_CLAIM_TIMEOUT);
+}
+
+inline
+void ShmRingBuf::Reader::release(std::uint64_t ticket, std::uint64_t count)
+{
+	Header * h = reinterpret_cast<Header *>(m_image);
+	for (std::uint64_t i = 0; i < count; i++)
+		SlotAt(m_image, ticket + i)->state.store(FreeState(ticket + i + h->slotCount), std::memory_order_release);
+	h->head.store(ticket + count, std::memory_order_release);
+	m_stallSince = std::chrono::steady_clock::time_point();
+}
+
+inline
+ShmRingBuf::ShmRingBuf(const std::string & name, std::size_t slotCount, std::size_t slotSize):
+    m_name(name),
+    m_image(Map(name, slotCount, slotSize, m_imageSize))
+{
+}
+
+inline
+ShmRingBuf::~ShmRingBuf()
+{
+	if (!m_partial.empty())
+		write(m_partial.data(), m_partial.size());
+	if (m_image != nullptr)
+		munmap(m_image, m_imageSize);
+}
+
+inline
+bool ShmRingBuf::isOpen() const
+{
+	return m_image != nullptr;
+}
+
+inline
+const std::string & ShmRingBuf::name() const
+{
+	return m_name;
+}
+
+inline
+bool ShmRingBuf::write(const char * s, std::size_t n)
+{
+	if (m_image == nullptr)
+		return false;
+
+	Header * h = header();
+	std::size_t payload = h->slotSize - sizeof(Slot);
+	std::uint64_t slotCount = h->slotCount;
+	std::uint64_t count = n == 0 ? 1 : (n + payload - 1) / payload;
+	if (count > slotCount) {
+		h->dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+
+	std::time_t sec;
+	long nsec;
+	TimeStamp::Now(sec, nsec);
+
+	std::uint64_t ticket = h->tail.load(std::memory_order_relaxed);
+	do {
+		if (ticket + count - h->head.load(std::memory_order_acquire) > slotCount) {
+			h->dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	} while (!h->tail.compare_exchange_weak(ticket, ticket + count, std::memory_order_relaxed, std::memory_order_relaxed));
+
+	std::uint64_t pid = Pid();
+	for (std::uint64_t i = 0; i < count; i++) {
+		std::uint64_t expected = FreeState(ticket + i);
+		if (!SlotAt(m_image, ticket + i)->state.compare_exchange_strong(expected, WritingState(ticket + i, pid), std::memory_order_acquire, std::memory_order_relaxed)) {
+			// Reader has given up waiting for the slot. Hand over slots taken so far as
+			// leftovers, which reader discards.
+			for (std::uint64_t j = 0; j < i; j++) {
+				Slot * slot = SlotAt(m_image, ticket + j);
+				slot->size = 0;
+				slot->count = 0;
+				slot->state.store(CommittedState(ticket + j), std::memory_order_release);
+			}
+			h->dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+	}
+
+	for (std::uint64_t i = 0; i < count; i++) {
+		Slot * slot = SlotAt(m_image, ticket + i);
+		std::size_t offset = static_cast<std::size_t>(i) * payload;
+		std::size_t size = n - offset < payload ? n - offset : payload;
+		slot->time = static_cast<std::int64_t>(sec) * 1000000000 + nsec;
+		slot->size = static_cast<std::uint32_t>(size);
+		slot->count = i == 0 ? static_cast<std::uint32_t>(count) : 0;
+		slot->pid = static_cast<std::int32_t>(pid);
+		std::memcpy(Payload(slot), s + offset, size);
+	}
+
+	// Commit first slot last, so that reader sees complete record.
+	for (std::uint64_t i = count; i-- > 0;)
+		SlotAt(m_image, ticket + i)->state.store(CommittedState(ticket + i), std::memory_order_release);
+	return true;
+}
+
+inline
+std::uint64_t ShmRingBuf::droppedCount() const
+{
+	if (m_image == nullptr)
+		return 0;
+	return header()->dropped.load(std::memory_order_relaxed);
+}
+
+inline
+bool ShmRingBuf::Unlink(const std::string & name)
+{
+	return shm_unlink(name.c_str()) == 0;
+}
+
+inline
+ShmRingBuf::int_type ShmRingBuf::overflow(int_type c)
+{
+	if (traits_type::eq_int_type(c, traits_type::eof()))
+		return traits_type::not_eof(c);
+
+	char_type ch = traits_type::to_char_type(c);
+	xsputn(& ch, 1);
+	return c;
+}
+
+inline
+std::streamsize ShmRingBuf::xsputn(const char_type * s, std::streamsize n)
+{
+	const char * end = s + n;
+	while (s < end) {
+		const char * nl = static_cast<const char *>(std::memchr(s, '\n', static_cast<std::size_t>(end - s)));
+		if (nl == nullptr) {
+			m_partial.append(s, end);
+			break;
+		}
+		if (m_partial.empty())
+			write(s, static_cast<std::size_t>(nl + 1 - s));
+		else {
+			m_partial.append(s, nl + 1);
+			write(m_partial.data(), m_partial.size());
+			m_partial.clear();
+		}
+		s = nl + 1;
+	}
+	return n;
+}
+
+inline
+char * ShmRingBuf::Map(const std::string & name, std::size_t slotCount, std::size_t slotSize, std::size_t & imageSize)
+{
+	imageSize = 0;
+
+	bool created = true;
+	int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0660);
+	if (fd == -1 && errno == EEXIST) {
+		created = false;
+		fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0660);
+	}
+	if (fd == -1)
+		return nullptr;
+
+	std::size_t size = 0;
+	if (created) {
+		std::size_t count = 1;
+		while (count < slotCount)
+			count *= 2;
+		slotCount = count;
+		// Keep slots aligned to cache lines.
+		slotSize = (slotSize < 2 * sizeof(Slot) ? 2 * sizeof(Slot) : slotSize + 63) / 64 * 64;
+		size = sizeof(Header) + slotCount * slotSize;
+		if (ftruncate(fd, static_cast<off_t>(size)) == -1) {
+			::close(fd);
+			shm_unlink(name.c_str());
+			return nullptr;
+		}
+	} else {
+		// Wait for the creator to set the size of the segment.
+		struct stat st;
+		for (int i = 0; fstat(fd, & st) == 0 && static_cast<std::size_t>(st.st_size) < sizeof(Header); i++) {
+			if (i == 1000) {
+				::close(fd);
+				return nullptr;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		size = static_cast<std::size_t>(st.st_size);
+	}
+
+	void * map = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	::close(fd);
+	if (map == MAP_FAILED)
+		return nullptr;
+
+	char * image = static_cast<char *>(map);
+	Header * h;
+	if (created) {
+		h = new (image) Header;
+		std::memcpy(h->magic, "QLSHMRNG", sizeof(h->magic));
+		h->version = VERSION;
+		h->headerSize = sizeof(Header);
+		h->slotSize = static_cast<std::uint32_t>(slotSize);
+		h->slotCount = static_cast<std::uint32_t>(slotCount);
+		h->tail.store(0, std::memory_order_relaxed);
+		h->head.store(0, std::memory_order_relaxed);
+		h->dropped.store(0, std::memory_order_relaxed);
+		h->skipped.store(0, std::memory_order_relaxed);
+		for (std::uint64_t i = 0; i < slotCount; i++) {
+			Slot * slot = new (SlotAt(image, i)) Slot;
+			slot->state.store(FreeState(i), std::memory_order_relaxed);
+		}
+		h->ready.store(VERSION, std::memory_order_release);
+	} else {
+		// Wait for the creator to initialize the segment.
+		h = reinterpret_cast<Header *>(image);
+		for (int i = 0; h->ready.load(std::memory_order_acquire) != VERSION; i++) {
+			if (i == 1000) {
+				munmap(map, size);
+				return nullptr;
+			}
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+		if (std::memcmp(h->magic, "QLSHMRNG", sizeof(h->magic)) != 0 || h->headerSize != sizeof(Header)
+				|| size < sizeof(Header) + static_cast<std::size_t>(h->slotCount) * h->slotSize) {
+			munmap(map, size);
+			return nullptr;
+		}
+	}
+	imageSize = size;
+	return image;
+}
+
+inline
+ShmRingBuf::Slot * ShmRingBuf::SlotAt(char * image, std::uint64_t ticket)
+{
+	const Header * h = reinterpret_cast<const Header *>(image);
+	std::size_t index = static_cast<std::size_t>(ticket & (h->slotCount - 1));
+	return reinterpret_cast<Slot *>(image + sizeof(Header) + index * h->slotSize);
+}
+
+inline
+char * ShmRingBuf::Payload(Slot * slot)
+{
+	return reinterpret_cast<char *>(slot) + sizeof(Slot);
+}
+
+inline
+std::uint64_t ShmRingBuf::FreeState(std::uint64_t ticket)
+{
+	// Highest bits of sequence number are shifted out, which is fine as long as the ring
+	// is much smaller than 2^40 slots.
+	return ticket << 24;
+}
+
+inline
+std::uint64_t ShmRingBuf::WritingState(std::uint64_t ticket, std::uint64_t pid)
+{
+	return ticket << 24 | pid;
+}
+
+inline
+std::uint64_t ShmRingBuf::CommittedState(std::uint64_t ticket)
+{
+	return ticket << 24 | COMMITTED;
+}
+
+inline
+std::uint64_t ShmRingBuf::Pid()
+{
+	static int registered = pthread_atfork(nullptr, nullptr, & ShmRingBuf::ResetPid);
+	(void)registered;
+
+	std::uint64_t pid = CachedPid().load(std::memory_order_relaxed);
+	if (pid == 0) {
+		pid = static_cast<std::uint64_t>(getpid()) & PID_MASK;
+		CachedPid().store(pid, std::memory_order_relaxed);
+	}
+	return pid;
+}
+
+inline
+std::atomic<std::uint64_t> & ShmRingBuf::CachedPid()
+{
+	static std::atomic<std::uint64_t> pid(0);
+	return pid;
+}
+
+inline
+void ShmRingBuf::ResetPid()
+{
+	CachedPid().store(0, std::memory_order_relaxed);
+}
+
+inline
+ShmRingBuf::Header * ShmRingBuf::header() const
+{
+	return reinterpret_cast<Header *>(m_image);
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
@@ -0,0 +1,727 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_SOCKETBUF_HPP
+#define QL_SOCKETBUF_HPP
+
+#include "TimeStamp.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * Default number of records, which makes SocketBuf send pending records immediately.
+ */
+#ifndef QL_SOCKET_BATCH_SIZE
+	#define QL_SOCKET_BATCH_SIZE 64
+#endif
+
+/**
+ * Default maximal number of bytes SocketBuf keeps pending, while collector is not
+ * available. Records, which do not fit, are dropped.
+ */
+#ifndef QL_SOCKET_BUFFER_SIZE
+	#define QL_SOCKET_BUFFER_SIZE (1024 * 1024)
+#endif
+
+/**
+ * Interval in milliseconds between attempts to reconnect SocketBuf to the collector.
+ */
+#ifndef QL_SOCKET_RETRY_INTERVAL
+	#define QL_SOCKET_RETRY_INTERVAL 1000
+#endif
+
+namespace ql {
+
+/**
+ * Local socket buffer. Sends records to a collector listening on Unix domain socket.
+ * Records are delimited by new line characters. Instead of sending each record, when
+ * buffer is synced, complete records are accumulated and sent in batches - with a single
+ * sendmmsg() system call for datagram sockets (one datagram per record) or send() for
+ * stream sockets. Batch is sent, when given number of records is pending or when the
+ * oldest pending record has waited for given time (maximal latency). Latency is enforced
+ * by a background thread. Syncing the buffer does not send anything; use flush() to send
+ * pending records immediately.
+ *
+ * Records are sent without blocking. If collector is not available (socket can not be
+ * connected, collector has been restarted or its receive queue is full), records are
+ * kept and buffer reconnects at most every QL_SOCKET_RETRY_INTERVAL milliseconds.
+ * Pending data is bounded; records, which do not fit, are dropped and counted. Number of
+ * dropped records is reported with a notice sent in place of them.
+ *
+ * Following framings are available:
+ * 	- RAW - records are sent as they have been written, including new line character.
+ * 	- RFC5424 - each record is sent as syslog message
+ * 	("<PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID - - MSG"). Severity is deduced from
+ * 	message prefix ("Warning: ", "Error: " etc.). Over stream sockets messages are
+ * 	prefixed by their length (octet counting, RFC 6587).
+ * 	.
+ *
+ * Buffer is thread-safe, but writes are not expected to be interleaved - when it is
+ * attached to LogStream, writes are serialized by the log stream.
+ *
+ * @code
+ * ql::SocketBuf socketBuf("/run/collector.sock", ql::SocketBuf::DGRAM, ql::SocketBuf::RFC5424);
+ * ql::Log::Instance().combinedStream().attachBuffer(& socketBuf);
+ * @endcode
+ */
+class SocketBuf: public std::streambuf
+{
+	public:
+		enum type_t {
+			STREAM,	///< Stream socket (SOCK_STREAM).
+			DGRAM	///< Datagram socket (SOCK_DGRAM).
+		};
+
+		enum framing_t {
+			RAW,
+			RFC5424
+		};
+
+	public:
+		/**
+		 * Constructor. Connects to the collector and starts the background thread.
+		 * @param path path of the collector socket.
+		 * @param type socket type.
+		 * @param framing framing of records.
+		 * @param batchSize number of pending records, which makes buffer send them.
+		 * @param maxLatency maximal time in milliseconds a record waits before it is sent.
+		 * Zero means that records are sent only in full batches or when flush() is called,
+		 * and no background thread is started.
+		 * @param bufferSize maximal number of pending bytes.
+		 */
+		explicit SocketBuf(const std::string & path, type_t type = DGRAM, framing_t framing = RAW, std::size_t batchSize = QL_SOCKET_BATCH_SIZE, unsigned long maxLatency = 100, std::size_t bufferSize = QL_SOCKET_BUFFER_SIZE);
+
+		/**
+		 * Destructor. Stops the background thread and makes last attempt to send pending
+		 * records. Incomplete record (not terminated by new line character) is sent as well.
+		 */
+		virtual ~SocketBuf();
+
+		/**
+		 * Get socket path.
+		 * @return path of the collector socket.
+		 */
+		const std::string & path() const;
+
+		/**
+		 * Check whether socket is connected.
+		 * @return @p true if socket is connected to the collector, @p false otherwise.
+		 */
+		bool isConnected() const;
+
+		/**
+		 * Get syslog facility.
+		 * @return facility used with RFC5424 framing.
+		 */
+		int facility() const;
+
+		/**
+		 * Set syslog facility.
+		 * @param facility facility code (0-23). Default is 1 (user-level messages).
+		 */
+		void setFacility(int facility);
+
+		/**
+		 * Set application name.
+		 * @param appName application name used with RFC5424 framing. By default it is the
+		 * name of the program.
+		 */
+		void setAppName(const std::string & appName);
+
+		/**
+		 * Send pending records.
+		 * @return @p true if all pending records have been sent, @p false otherwise.
+		 */
+		bool flush();
+
+		/**
+		 * Get number of pending records.
+		 * @return number of records waiting to be sent.
+		 */
+		std::size_t pendingCount() const;
+
+		/**
+		 * Get number of sent records.
+		 * @return number of records sent since buffer has been created.
+		 */
+		std::size_t sentCount() const;
+
+		/**
+		 * Get number of send calls.
+		 * @return number of system calls, which have sent records.
+		 */
+		std::size_t sendCount() const;
+
+		/**
+		 * Get number of dropped records.
+		 * @return number of records dropped since buffer has been created.
+		 */
+		std::size_t droppedCount() const;
+
+	protected:
+		//std::streambuf
+		virtual int sync();
+
+		//std::streambuf
+		virtual int_type overflow(int_type c);
+
+		//std::streambuf
+		virtual std::streamsize xsputn(const char_type * s, std::streamsize n);
+
+	private:
+		typedef std::chrono::steady_clock Clock;
+
+		struct Pending
+		{
+			std::size_t offset;	///< Offset of framed record in m_data.
+			std::size_t size;	///< Size of framed record.
+		};
+
+		SocketBuf(const SocketBuf & other);	// = delete
+
+		SocketBuf & operator =(const SocketBuf & other); // = delete
+
+		/**
+		 * Deduce syslog severity from message prefix.
+		 * @param s message.
+		 * @param n size of message.
+		 * @return syslog severity.
+		 */
+		static int Severity(const char * s, std::size_t n);
+
+		static std::string ProgramName();
+
+		/**
+		 * Frame record and append it to pending data. Mutex must be locked.
+		 * @param s record characters without terminating new line character.
+		 * @param n number of characters.
+		 */
+		void putRecord(const char * s, std::size_t n);
+
+		/**
+		 * Frame record and append it to pending data, if it fits. If it does not fit,
+		 * pending records are sent first. Mutex must be locked.
+		 * @param s record characters without terminating new line character.
+		 * @param n number of characters.
+		 * @param severity syslog severity.
+		 * @return @p true if record has been appended, @p false if it does not fit.
+		 */
+		bool appendRecord(const char * s, std::size_t n, int severity);
+
+		/**
+		 * Send pending records. Mutex must be locked.
+		 * @return @p true if all pending records have been sent, @p false otherwise.
+		 */
+		bool sendPending();
+
+		/**
+		 * Handle send error. Mutex must be locked.
+		 * @param error error number.
+		 * @return @p true if sending should be retried immediately, @p false otherwise.
+		 */
+		bool handleError(int error);
+
+		/**
+		 * Remove sent bytes from the front of pending data. Mutex must be locked.
+		 * @param bytes number of sent bytes.
+		 * @return number of records, which have been completely removed.
+		 */
+		std::size_t consume(std::size_t bytes);
+
+		bool connect();
+
+		void disconnect();
+
+		void run();
+
+	private:
+		std::string m_path;
+		type_t m_type;
+		framing_t m_framing;
+		std::size_t m_batchSize;
+		unsigned long m_maxLatency;
+		std::size_t m_bufferSize;
+		int m_facility;
+		std::string m_appName;
+		std::string m_hostName;
+		std::string m_procId;
+		int m_fd;
+		Clock::time_point m_retryAt;
+		Clock::time_point m_deadline;
+		std::string m_partial;	///< Incomplete record.
+		std::string m_data;	///< Framed records.
+		std::size_t m_head;	///< Offset of the first unsent byte in m_data.
+		std::vector<Pending> m_records;
+		std::size_t m_first;	///< Index of the first unsent record in m_records.
+		std::vector<mmsghdr> m_messages;
+		std::vector<iovec> m_iovecs;
+		std::size_t m_sent;
+		std::size_t m_sends;
+		std::size_t m_dropped;
+		std::size_t m_unreported;	///< Dropped records, which have not been reported yet.
+		bool m_stop;
+		mutable std::mutex m_mutex;
+		std::condition_variable m_cond;
+		std::thread m_thread;
+};
+
+
+inline
+SocketBuf::SocketBuf(const std::string & path, type_t type, framing_t framing, std::size_t batchSize, unsigned long maxLatency, std::size_t bufferSize):
+    m_path(path),
+    m_type(type),
+    m_framing(framing),
+    m_batchSize(batchSize != 0 ? batchSize : 1),
+    m_maxLatency(maxLatency),
+    m_bufferSize(bufferSize),
+    m_facility(1),
+    m_appName(ProgramName()),
+    m_procId(std::to_string(getpid())),
+    m_fd(-1),
+    m_head(0),
+    m_first(0),
+    m_sent(0),
+    m_sends(0),
+    m_dropped(0),
+    m_unreported(0),
+    m_stop(false)
+{
+	char hostName[256] = {};
+	if (gethostname(hostName, sizeof(hostName) - 1) == 0 && hostName[0] != '\0')
+		m_hostName = hostName;
+	else
+		m_hostName = "-";
+
+	connect();
+	if (m_maxLatency != 0)
+		m_thread = std::thread(& SocketBuf::run, this);
+}
+
+inline
+SocketBuf::~SocketBuf()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_cond.notify_one();
+	if (m_thread.joinable())
+		m_thread.join();
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_partial.empty()) {
+		putRecord(m_partial.data(), m_partial.size());
+		m_partial.clear();
+	}
+	m_retryAt = Clock::time_point();
+	sendPending();
+	disconnect();
+}
+
+inline
+const std::string & SocketBuf::path() const
+{
+	return m_path;
+}
+
+inline
+bool SocketBuf::isConnected() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_fd != -1;
+}
+
+inline
+int SocketBuf::facility() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_facility;
+}
+
+inline
+void SocketBuf::setFacility(int facility)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_facility = facility;
+}
+
+inline
+void SocketBuf::setAppName(const std::string & appName)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_appName = appName.empty() ? "-" : appName.substr(0, 48);
+}
+
+inline
+bool SocketBuf::flush()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return sendPending();
+}
+
+inline
+std::size_t SocketBuf::pendingCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_records.size() - m_first;
+}
+
+inline
+std::size_t SocketBuf::sentCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_sent;
+}
+
+inline
+std::size_t SocketBuf::sendCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_sends;
+}
+
+inline
+std::size_t SocketBuf::droppedCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_dropped;
+}
+
+inline
+int SocketBuf::sync()
+{
+	return 0;
+}
+
+inline
+SocketBuf::int_type SocketBuf::overflow(int_type c)
+{
+	if (traits_type::eq_int_type(c, traits_type::eof()))
+		return traits_type::not_eof(c);
+
+	char_type ch = traits_type::to_char_type(c);
+	xsputn(& ch, 1);
+	return c;
+}
+
+inline
+std::streamsize SocketBuf::xsputn(const char_type * s, std::streamsize n)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	const char * end = s + n;
+	while (s < end) {
+		const char * nl = static_cast<const char *>(std::memchr(s, '\n', static_cast<std::size_t>(end - s)));
+		if (nl == nullptr) {
+			m_partial.append(s, end);
+			break;
+		}
+		if (m_partial.empty())
+			putRecord(s, static_cast<std::size_t>(nl - s));
+		else {
+			m_partial.append(s, nl);
+			putRecord(m_partial.data(), m_partial.size());
+			m_partial.clear();
+		}
+		s = nl + 1;
+	}
+	return n;
+}
+
+inline
+int SocketBuf::Severity(const char * s, std::size_t n)
+{
+	static const struct {
+		const char * prefix;
+		int severity;
+	} prefixes[] = {
+		{"Debug message: ", 7},
+		{"Note: ", 5},
+		{"Warning: ", 4},
+		{"Error: ", 3},
+		{"Critical error: ", 2},
+		{"Fatal error: ", 1}
+	};
+
+	for (std::size_t i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i++) {
+		std::size_t len = std::strlen(prefixes[i].prefix);
+		if (n >= len && std::memcmp(s, prefixes[i].prefix, len) == 0)
+			return prefixes[i].severity;
+	}
+	return 6;
+}
+
+inline
+std::string SocketBuf::ProgramName()
+{
+#ifdef __GLIBC__
+	std::string name(program_invocation_short_name);
+	return name.empty() ? "-" : name.substr(0, 48);
+#else
+	return "-";
+#endif
+}
+
+inline
+void SocketBuf::putRecord(const char * s, std::size_t n)
+{
+	if (m_unreported != 0) {
+		char notice[96];
+		int len = std::snprintf(notice, sizeof(notice), "QL: %lu log records dropped due to socket buffer overflow.", static_cast<unsigned long>(m_unreported));
+		if (!appendRecord(notice, static_cast<std::size_t>(len), 4)) {
+			m_dropped++;
+			m_unreported++;
+			return;
+		}
+		m_unreported = 0;
+	}
+
+	if (!appendRecord(s, n, m_framing == RFC5424 ? Severity(s, n) : 0)) {
+		m_dropped++;
+		m_unreported++;
+		return;
+	}
+
+	if (m_records.size() - m_first >= m_batchSize)
+		sendPending();
+}
+
+inline
+bool SocketBuf::appendRecord(const char * s, std::size_t n, int severity)
+{
+	char header[TimeStamp::MAX_SIZE + 64];
+	std::size_t headerSize = 0;
+	if (m_framing == RFC5424) {
+		int len = std::snprintf(header, sizeof(header), "<%d>1 ", m_facility * 8 + severity);
+		headerSize = static_cast<std::size_t>(len);
+		headerSize += TimeStamp::Format(header + headerSize, 6, true, true);
+	}
+
+	std::size_t size = n;
+	if (m_framing == RFC5424)
+		size += headerSize + 1 + m_hostName.size() + 1 + m_appName.size() + 1 + m_procId.size() + 5;
+	else
+		size += 1;
+	char length[24];
+	std::size_t lengthSize = 0;
+	if (m_framing == RFC5424 && m_type == STREAM)
+		lengthSize = static_cast<std::size_t>(std::snprintf(length, sizeof(length), "%lu ", static_cast<unsigned long>(size)));
+
+	if (m_data.size() - m_head + lengthSize + size > m_bufferSize) {
+		// Make room by sending, what can be sent.
+		sendPending();
+		if (m_data.size() - m_head + lengthSize + size > m_bufferSize)
+			return false;
+	}
+
+	if (m_records.size() == m_first) {
+		// Nothing is pending, so that data can be reused from the beginning.
+		m_data.clear();
+		m_records.clear();
+		m_head = 0;
+		m_first = 0;
+		if (m_maxLatency != 0) {
+			m_deadline = Clock::now() + std::chrono::milliseconds(m_maxLatency);
+			m_cond.notify_one();
+		}
+	}
+
+	Pending record;
+	record.offset = m_data.size();
+	record.size = lengthSize + size;
+	if (m_framing == RFC5424) {
+		m_data.append(length, lengthSize);
+		m_data.append(header, headerSize);
+		m_data += ' ';
+		m_data += m_hostName;
+		m_data += ' ';
+		m_data += m_appName;
+		m_data += ' ';
+		m_data += m_procId;
+		m_data += " - - ";
+		m_data.append(s, n);
+	} else {
+		m_data.append(s, n);
+		m_data += '\n';
+	}
+	m_records.push_back(record);
+	return true;
+}
+
+inline
+bool SocketBuf::sendPending()
+{
+	while (m_first < m_records.size()) {
+		if (m_fd == -1 && !connect())
+			return false;
+
+		if (m_type == DGRAM) {
+			std::size_t count = std::min<std::size_t>(m_records.size() - m_first, UIO_MAXIOV);
+			m_messages.resize(count);
+			m_iovecs.resize(count);
+			for (std::size_t i = 0; i < count; i++) {
+				const Pending & record = m_records[m_first + i];
+				m_iovecs[i].iov_base = & m_data[record.offset];
+				m_iovecs[i].iov_len = record.size;
+				std::memset(& m_messages[i], 0, sizeof(mmsghdr));
+				m_messages[i].msg_hdr.msg_iov = & m_iovecs[i];
+				m_messages[i].msg_hdr.msg_iovlen = 1;
+			}
+			int sent = sendmmsg(m_fd, m_messages.data(), static_cast<unsigned int>(count), MSG_DONTWAIT | MSG_NOSIGNAL);
+			if (sent == -1) {
+				if (!handleError(errno))
+					return false;
+				continue;
+			}
+			m_sends++;
+			std::size_t bytes = 0;
+			for (std::size_t i = 0; i < static_cast<std::size_t>(sent); i++)
+				bytes += m_records[m_first + i].size;
+			m_sent += consume(bytes);
+		} else {
+			// Single contiguous buffer is sent, so that writev() would not gain anything,
+			// while send() accepts MSG_NOSIGNAL and does not raise SIGPIPE.
+			ssize_t sent = send(m_fd, m_data.data() + m_head, m_data.size() - m_head, MSG_DONTWAIT | MSG_NOSIGNAL);
+			if (sent == -1) {
+				if (!handleError(errno))
+					return false;
+				continue;
+			}
+			m_sends++;
+			m_sent += consume(static_cast<std::size_t>(sent));
+		}
+	}
+	return true;
+}
+
+inline
+bool SocketBuf::handleError(int error)
+{
+	switch (error) {
+		case EINTR:
+			return true;
+		case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+		case EWOULDBLOCK:
+#endif
+		case ENOBUFS:
+			// Collector is alive, but it does not keep up. Try again later.
+			return false;
+		case EMSGSIZE:
+			// Datagram is too large to be ever sent. Drop it.
+			m_dropped += consume(m_records[m_first].size);
+			return true;
+		default:
+			disconnect();
+			m_retryAt = Clock::now() + std::chrono::milliseconds(QL_SOCKET_RETRY_INTERVAL);
+			return false;
+	}
+}
+
+inline
+std::size_t SocketBuf::consume(std::size_t bytes)
+{
+	std::size_t result = 0;
+	m_head += bytes;
+	while (m_first < m_records.size() && m_records[m_first].offset + m_records[m_first].size <= m_head) {
+		m_first++;
+		result++;
+	}
+
+	if (m_first == m_records.size()) {
+		m_data.clear();
+		m_records.clear();
+		m_head = 0;
+		m_first = 0;
+	} else if (m_head > m_data.size() / 2) {
+		// Compact, so that data does not grow while records are sent partially.
+		m_data.erase(0, m_head);
+		m_records.erase(m_records.begin(), m_records.begin() + static_cast<std::ptrdiff_t>(m_first));
+		for (std::vector<Pending>::iterator i = m_records.begin(); i != m_records.end(); ++i)
+			if (i->offset >= m_head)
+				i->offset -= m_head;
+			else {
+				// Partially sent record.
+				i->size -= m_head - i->offset;
+				i->offset = 0;
+			}
+		m_head = 0;
+		m_first = 0;
+	}
+	return result;
+}
+
+inline
+bool SocketBuf::connect()
+{
+	if (Clock::now() < m_retryAt)
+		return false;
+
+	sockaddr_un addr;
+	std::memset(& addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (m_path.size() >= sizeof(addr.sun_path))
+		return false;
+	std::memcpy(addr.sun_path, m_path.c_str(), m_path.size());
+
+	m_fd = socket(AF_UNIX, (m_type == STREAM ? SOCK_STREAM : SOCK_DGRAM) | SOCK_CLOEXEC, 0);
+	if (m_fd != -1 && ::connect(m_fd, reinterpret_cast<sockaddr *>(& addr), sizeof(addr)) == 0)
+		return true;
+
+	disconnect();
+	m_retryAt = Clock::now() + std::chrono::milliseconds(QL_SOCKET_RETRY_INTERVAL);
+	return false;
+}
+
+inline
+void SocketBuf::disconnect()
+{
+	if (m_fd != -1) {
+		::close(m_fd);
+		m_fd = -1;
+	}
+	// Partially sent record can not be completed on a new connection.
+	if (m_type == STREAM && m_first < m_records.size() && m_records[m_first].offset < m_head)
+		m_dropped += consume(m_records[m_first].offset + m_records[m_first].size - m_head);
+}
+
+inline
+void SocketBuf::run()
+{
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (!m_stop) {
+		if (m_first == m_records.size())
+			m_cond.wait(lock);
+		else if (Clock::now() < m_deadline)
+			m_cond.wait_until(lock, m_deadline);
+		else if (!sendPending())
+			m_deadline = std::max(Clock::now() + std::chrono::milliseconds(m_maxLatency), m_retryAt);
+	}
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
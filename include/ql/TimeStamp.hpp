@@ -0,0 +1,209 @@
+/**
+ * @file
+ * @brief .
+ */
+
+#ifndef QL_TIMESTAMP_HPP
+#define QL_TIMESTAMP_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <ctime>
+
+#include <time.h>
+
+namespace ql {
+
+/**
+ * Time stamp. Provides wall-clock time and its textual representation for log records.
+ *
+ * Converting time to broken-down local time (localtime()) and formatting it (strftime())
+ * is expensive, thus formatted date and time are cached per thread and refreshed only
+ * when second changes. Sub-second part is formatted separately. On platforms which
+ * provide it, coarse real-time clock (CLOCK_REALTIME_COARSE) is used, if fraction of
+ * second is not printed. Resolution of coarse clock is typically a few milliseconds, so
+ * it would print wrong milliseconds and records issued within the same tick would be
+ * indistinguishable.
+ */
+class TimeStamp
+{
+	public:
+		enum {
+			MAX_SIZE = 40	///< Maximal length of formatted time stamp, including terminating null character.
+		};
+
+	public:
+		/**
+		 * Get current time.
+		 * @param sec seconds since epoch.
+		 * @param nsec nanoseconds.
+		 * @param precise whether precise clock should be used. If @p false, faster, coarse
+		 * clock may be used instead, which typically has resolution of few milliseconds.
+		 */
+		static void Now(std::time_t & sec, long & nsec, bool precise = true);
+
+		/**
+		 * Format time stamp.
+		 * @param buf output buffer, which must be able to hold at least MAX_SIZE characters.
+		 * @param sec seconds since epoch.
+		 * @param nsec nanoseconds.
+		 * @param digits number of fractional second digits. Zero, three, six or nine
+		 * digits may be requested.
+		 * @param utc whether to use UTC instead of local time.
+		 * @param iso whether to use ISO 8601 format ("YYYY-MM-DDThh:mm:ss" followed by
+		 * fraction of second and time zone designator) instead of "YYYY-MM-DD hh:mm:ss".
+		 * @return length of time stamp. Buffer is null-terminated.
+		 */
+		static std::size_t Format(char * buf, std::time_t sec, long nsec, int digits = 0, bool utc = false, bool iso = false);
+
+		/**
+		 * Format current time stamp.
+		 * @param buf output buffer, which must be able to hold at least MAX_SIZE characters.
+		 * @param digits number of fractional second digits.
+		 * @param utc whether to use UTC instead of local time.
+		 * @param iso whether to use ISO 8601 format.
+		 * @return length of time stamp. Buffer is null-terminated.
+		 */
+		static std::size_t Format(char * buf, int digits = 0, bool utc = false, bool iso = false);
+
+	private:
+		struct Cache
+		{
+			Cache();
+
+			std::time_t sec;
+			bool utc;
+			bool iso;
+			char dateTime[24];	///< Formatted date and time without fraction.
+			std::size_t dateTimeSize;
+			char zone[8];	///< ISO 8601 time zone designator.
+			std::size_t zoneSize;
+		};
+
+	private:
+		static void Refresh(Cache & cache, std::time_t sec, bool utc, bool iso);
+};
+
+
+inline
+void TimeStamp::Now(std::time_t & sec, long & nsec, bool precise)
+{
+#if defined(CLOCK_REALTIME)
+	timespec ts;
+	#if defined(CLOCK_REALTIME_COARSE)
+		clock_gettime(precise ? CLOCK_REALTIME : CLOCK_REALTIME_COARSE, & ts);
+	#else
+		(void)precise;
+		clock_gettime(CLOCK_REALTIME, & ts);
+	#endif
+	sec = ts.tv_sec;
+	nsec = ts.tv_nsec;
+#else
+	(void)precise;
+	std::chrono::nanoseconds now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch());
+	sec = static_cast<std::time_t>(now.count() / 1000000000);
+	nsec = static_cast<long>(now.count() % 1000000000);
+#endif
+}
+
+inline
+std::size_t TimeStamp::Format(char * buf, std::time_t sec, long nsec, int digits, bool utc, bool iso)
+{
+	static thread_local Cache cache;
+
+	if (cache.sec != sec || cache.utc != utc || cache.iso != iso)
+		Refresh(cache, sec, utc, iso);
+
+	char * p = buf;
+	std::memcpy(p, cache.dateTime, cache.dateTimeSize);
+	p += cache.dateTimeSize;
+	if (digits > 0) {
+		if (digits > 9)
+			digits = 9;
+		*p++ = '.';
+		long fraction = nsec;
+		for (int i = digits; i < 9; i++)
+			fraction /= 10;
+		for (int i = digits - 1; i >= 0; i--) {
+			p[i] = static_cast<char>('0' + fraction % 10);
+			fraction /= 10;
+		}
+		p += digits;
+	}
+	if (iso) {
+		std::memcpy(p, cache.zone, cache.zoneSize);
+		p += cache.zoneSize;
+	}
+	*p = '\0';
+	return static_cast<std::size_t>(p - buf);
+}
+
+inline
+std::size_t TimeStamp::Format(char * buf, int digits, bool utc, bool iso)
+{
+	std::time_t sec;
+	long nsec;
+	Now(sec, nsec, digits > 0);
+	return Format(buf, sec, nsec, digits, utc, iso);
+}
+
+inline
+TimeStamp::Cache::Cache():
+    sec(-1),
+    utc(false),
+    iso(false),
+    dateTimeSize(0),
+    zoneSize(0)
+{
+	dateTime[0] = '\0';
+	zone[0] = '\0';
+}
+
+inline
+void TimeStamp::Refresh(Cache & cache, std::time_t sec, bool utc, bool iso)
+{
+	std::tm tm;
+#if defined(_WIN32)
+	if (utc)
+		gmtime_s(& tm, & sec);
+	else
+		localtime_s(& tm, & sec);
+#else
+	if (utc)
+		gmtime_r(& sec, & tm);
+	else
+		localtime_r(& sec, & tm);
+#endif
+	cache.dateTimeSize = std::strftime(cache.dateTime, sizeof(cache.dateTime), iso ? "%Y-%m-%dT%H:%M:%S" : "%Y-%m-%d %H:%M:%S", & tm);
+
+	cache.zoneSize = 0;
+	if (iso) {
+		if (utc)
+			cache.zone[cache.zoneSize++] = 'Z';
+		else {
+			// strftime() produces "+hhmm", while ISO 8601 extended format requires "+hh:mm".
+			char offset[8];
+			if (std::strftime(offset, sizeof(offset), "%z", & tm) == 5) {
+				std::memcpy(cache.zone, offset, 3);
+				cache.zone[3] = ':';
+				std::memcpy(cache.zone + 4, offset + 3, 2);
+				cache.zoneSize = 6;
+			}
+		}
+	}
+	cache.zone[cache.zoneSize] = '\0';
+
+	cache.sec = sec;
+	cache.utc = utc;
+	cache.iso = iso;
+}
+
+}
+
+#endif
+
+//(c)MP: Copyright © 2017, Michał Policht. All rights reserved.
+//(c)MP: Redistribution and use in source and binary forms, with or without modification, are permitted provided that the following conditions are met: 1. Redistributions of source code must retain the above copyright notice, this list of conditions and the following disclaimer. 2. Redistributions in binary form must reproduce the above copyright notice, this list of conditions and the following disclaimer in the documentation and/or other materials provided with the distribution.
+//(c)MP: THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//(c)MP: The above copyright statement is OSI approved, Simplified BSD License without 3. clause.
@@ -1,14 +1,24 @@
 #ifndef QL_TRACE_HPP
 #define QL_TRACE_HPP
 
-#include <ostream>
-#include <iomanip>
+#include "CallSite.hpp"
+#include "TimeStamp.hpp"
+
+#include <cstring>
 #include <ctime>
+#include <ostream>
 
 namespace ql {
 
 /**
  * Trace.
+ *
+ * Flags MSEC, USEC, NSEC, UTC and ISO8601 modify the format of date and they take effect
+ * only if DATE flag is set. By default local time is printed with one second precision
+ * ("YYYY-MM-DD hh:mm:ss").
+ *
+ * If trace is constructed with call site descriptor, pre-rendered suffix of the call
+ * site is used instead of formatting file, line and function for each record.
  */
 struct Trace
 {
@@ -16,15 +26,41 @@ struct Trace
 		FILE = 1,
 		LINE = 2,
 		FUNCTION = 4,
-		DATE = 8
+		DATE = 8,
+		MSEC = 16,	///< Print date with milliseconds.
+		USEC = 32,	///< Print date with microseconds.
+		NSEC = 64,	///< Print date with nanoseconds.
+		UTC = 128,	///< Print date in UTC instead of local time.
+		ISO8601 = 256	///< Print date in ISO 8601 format with time zone designator ("YYYY-MM-DDThh:mm:ss+hh:mm").
 	};
 
 	Trace(int flags, const char * file, std::size_t line, const char * function);
 
+	Trace(int flags, const CallSite & site, const char * function);
+
+	/**
+	 * Format current date according to flags.
+	 * @param buf output buffer, which must be able to hold at least TimeStamp::MAX_SIZE
+	 * characters.
+	 * @return length of formatted date.
+	 */
+	std::size_t formatDate(char * buf) const;
+
+	/**
+	 * Format given date according to flags.
+	 * @param buf output buffer, which must be able to hold at least TimeStamp::MAX_SIZE
+	 * characters.
+	 * @param sec seconds since epoch.
+	 * @param nsec nanoseconds.
+	 * @return length of formatted date.
+	 */
+	std::size_t formatDate(char * buf, std::time_t sec, long nsec) const;
+
 	int flags;
 	const char * file;
 	std::size_t line;
 	const char * function;
+	const CallSite * site;
 };
 
 inline
@@ -32,8 +68,33 @@ Trace::Trace(int p_flags, const char * p_file, std::size_t p_line, const char *
     flags(p_flags),
     file(p_file),
     line(p_line),
-    function(p_function)
+    function(p_function),
+    site(nullptr)
+{
+}
+
+inline
+Trace::Trace(int p_flags, const CallSite & p_site, const char * p_function):
+    flags(p_flags),
+    file(p_site.file()),
+    line(p_site.line()),
+    function(p_function),
+    site(& p_site)
+{
+}
+
+inline
+std::size_t Trace::formatDate(char * buf) const
 {
+	int digits = flags & NSEC ? 9 : flags & USEC ? 6 : flags & MSEC ? 3 : 0;
+	return TimeStamp::Format(buf, digits, (flags & UTC) != 0, (flags & ISO8601) != 0);
+}
+
+inline
+std::size_t Trace::formatDate(char * buf, std::time_t sec, long nsec) const
+{
+	int digits = flags & NSEC ? 9 : flags & USEC ? 6 : flags & MSEC ? 3 : 0;
+	return TimeStamp::Format(buf, sec, nsec, digits, (flags & UTC) != 0, (flags & ISO8601) != 0);
 }
 
 }
@@ -41,34 +102,49 @@ Trace::Trace(int p_flags, const char * p_file, std::size_t p_line, const char *
 inline
 std::ostream & operator <<(std::ostream & s, const ql::Trace & trace)
 {
-	if (trace.flags != 0) {
-		s << " ";
-		char sep = '[';
-		if (trace.flags & ql::Trace::FILE) {
-			s << sep << "file: " << trace.file;
-			sep = ' ';
-		}
-		if (trace.flags & ql::Trace::LINE) {
-			s << sep << "line: " << trace.line;
-			sep = ' ';
-		}
-		if (trace.flags & ql::Trace::FUNCTION) {
-			s << sep << "function: " << trace.function;
-			sep = ' ';
-		}
-		if (trace.flags & ql::Trace::DATE) {
-			std::time_t t = std::time(0);
-#ifdef QL_NO_STD_PUT_TIME
-			char buff[128];	// 20 chars would be enough, but let's set it to paranoic size and avoid adaptative calls.
-			std::strftime(buff, sizeof(buff), "%Y-%m-%d %H:%M:%S", std::localtime(& t));
-			s << sep << "date: " << buff;
-#else
-			s << sep << "date: " << std::put_time(std::localtime(& t), "%Y-%m-%d %H:%M:%S");
-#endif
-			sep = ' ';
-		}
-		s << "]";
+	if (trace.flags == 0)
+		return s;
+
+	if (trace.site != nullptr) {
+		const std::string & suffix = trace.site->suffix(trace.flags, trace.function);
+		if (!(trace.flags & ql::Trace::DATE))
+			return s.write(suffix.data(), static_cast<std::streamsize>(suffix.size()));
+
+		char buff[ql::TimeStamp::MAX_SIZE + 16] = " [date: ";
+		std::size_t size = std::strlen(buff);
+		size += trace.formatDate(buff + size);
+		buff[size++] = ']';
+		if (suffix.empty())
+			return s.write(buff, static_cast<std::streamsize>(size));
+
+		// Replace closing bracket of the suffix with the date.
+		buff[1] = ' ';
+		s.write(suffix.data(), static_cast<std::streamsize>(suffix.size() - 1));
+		return s.write(buff + 1, static_cast<std::streamsize>(size - 1));
+	}
+
+	s << " ";
+	char sep = '[';
+	if (trace.flags & ql::Trace::FILE) {
+		s << sep << "file: " << trace.file;
+		sep = ' ';
+	}
+	if (trace.flags & ql::Trace::LINE) {
+		s << sep << "line: " << trace.line;
+		sep = ' ';
+	}
+	if (trace.flags & ql::Trace::FUNCTION) {
+		s << sep << "function: " << trace.function;
+		sep = ' ';
+	}
+	if (trace.flags & ql::Trace::DATE) {
+		char buff[ql::TimeStamp::MAX_SIZE];
+		std::size_t size = trace.formatDate(buff);
+		s << sep << "date: ";
+		s.write(buff, static_cast<std::streamsize>(size));
+		sep = ' ';
 	}
+	s << "]";
 	return s;
 }
 
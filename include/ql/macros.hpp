@@ -7,6 +7,14 @@
 #define QL_MACROS_HPP
 
 #include "Log.hpp"
+#include "Record.hpp"
+#include "RateLimiter.hpp"
+#include "Deduplicator.hpp"
+#include "Sampler.hpp"
+#include "Formatter.hpp"
+#include "BinaryLog.hpp"
+#include "KvRecord.hpp"
+#include "Category.hpp"
 
 #ifdef QL_NO_LOG			///< Turns off QL_DEBUG, QL_NOTE and QL_WARN macros.
     #define QL_NO_DEBUG	///< Turns off QL_DEBUG macro.
@@ -14,16 +22,205 @@
     #define QL_NO_WARN		///< Turns off QL_WARN macro.
 #endif
 
+#if QL_MIN_LEVEL > QL_LEVEL_DEBUG && !defined(QL_NO_DEBUG)
+    #define QL_NO_DEBUG
+#endif
+#if QL_MIN_LEVEL > QL_LEVEL_NOTE && !defined(QL_NO_NOTE)
+    #define QL_NO_NOTE
+#endif
+#if QL_MIN_LEVEL > QL_LEVEL_INFO && !defined(QL_NO_INFO)
+    #define QL_NO_INFO
+#endif
+#if QL_MIN_LEVEL > QL_LEVEL_WARN && !defined(QL_NO_WARN)
+    #define QL_NO_WARN
+#endif
+#if QL_MIN_LEVEL > QL_LEVEL_ERROR && !defined(QL_NO_ERROR)
+    #define QL_NO_ERROR
+#endif
+
+/**
+ * Log instance used by macros, which do not take log argument. By default it is
+ * ql::Log::Instance(). For example, to log to thread-local instances:
+ * @code
+ * #define QL_LOG_INSTANCE ::ql::Log::ThreadInstance()
+ * @endcode
+ * Expression is evaluated several times by each macro, so it should be cheap. Macro has
+ * to be defined consistently in all translation units.
+ */
+#ifndef QL_LOG_INSTANCE
+	#define QL_LOG_INSTANCE ::ql::Log::Instance()
+#endif
+
+/**
+ * Log message to the stream. Internal macro used by other macros. Stream is checked
+ * whether it is enabled before anything else is evaluated, thus if stream does not reach
+ * any device, neither @a EXPR is evaluated nor the trace is formatted. Message is
+ * formatted by thread-local Record stream and passed to the log stream as a whole. Whether
+ * attached buffers are synced afterwards depends on flush policy of the stream (see
+ * Log::setFlushPolicy()). Trace is rendered from static call site descriptor.
+ * @param LEVEL one of QL_LEVEL_* values.
+ * @param STREAM name of Log member function, which returns LogStream.
+ * @param PREFIX message prefix.
+ * @param EXPR expression containing message.
+ * @return void.
+ */
+#define QL_IMPL_LOG(LEVEL, STREAM, PREFIX, EXPR) QL_IMPL_LOG_TO(QL_LOG_INSTANCE, LEVEL, STREAM, PREFIX, EXPR)
+
+/**
+ * Log message to the stream of given log. Internal macro used by other macros.
+ * @param LOG log instance. Expression is evaluated more than once.
+ * @param LEVEL one of QL_LEVEL_* values.
+ * @param STREAM name of Log member function, which returns LogStream.
+ * @param PREFIX message prefix.
+ * @param EXPR expression containing message.
+ * @return void.
+ *
+ * @see QL_IMPL_LOG.
+ */
+#define QL_IMPL_LOG_TO(LOG, LEVEL, STREAM, PREFIX, EXPR) (!(LOG).STREAM().enabled() ? (void)0 : QL_IMPL_RECORD_TO(LOG, LEVEL, STREAM, PREFIX, EXPR))
+
+/**
+ * Format and commit record. Internal macro used by other macros. Message expression is
+ * put at the call site, so that variables used in it are passed to insertion operators
+ * by value, but Record constructor, destructor and Record::Commit() are cold functions.
+ * Compiler moves the whole expression out of the hot part of the calling function.
+ * @param LEVEL one of QL_LEVEL_* values.
+ * @param STREAM name of Log member function, which returns LogStream.
+ * @param PREFIX message prefix.
+ * @param EXPR expression containing message.
+ * @return void.
+ */
+#define QL_IMPL_RECORD(LEVEL, STREAM, PREFIX, EXPR) QL_IMPL_RECORD_TO(QL_LOG_INSTANCE, LEVEL, STREAM, PREFIX, EXPR)
+
+/**
+ * Format and commit record to the stream of given log. Internal macro used by other
+ * macros.
+ * @param LOG log instance. Expression is evaluated more than once.
+ * @param LEVEL one of QL_LEVEL_* values.
+ * @param STREAM name of Log member function, which returns LogStream.
+ * @param PREFIX message prefix.
+ * @param EXPR expression containing message.
+ * @return void.
+ *
+ * @see QL_IMPL_RECORD.
+ */
+#define QL_IMPL_RECORD_TO(LOG, LEVEL, STREAM, PREFIX, EXPR) ::ql::Record::Commit(::ql::Record((LOG).STREAM()).stream() << PREFIX << EXPR, (LOG).STREAM(), QL_CALL_SITE(LEVEL), __FUNCTION__)
+
+/**
+ * Log rate limited message. Internal macro used by other macros. Rate limit is checked
+ * after the stream is checked whether it is enabled, but before @a EXPR is evaluated.
+ * @param LEVEL one of QL_LEVEL_* values.
+ * @param STREAM name of Log member function, which returns LogStream.
+ * @param PREFIX message prefix.
+ * @param RATE number of records per second.
+ * @param BURST number of records, which may be issued at once.
+ * @param EXPR expression containing message.
+ * @return void.
+ *
+ * @see ql::RateLimiter.
+ */
+#define QL_IMPL_LOG_RATE_LIMITED(LEVEL, STREAM, PREFIX, RATE, BURST, EXPR) (!QL_LOG_INSTANCE.STREAM().enabled() || !QL_IMPL_RATE_LIMITER(RATE, BURST).acquire(QL_LOG_INSTANCE.STREAM(), PREFIX, QL_CALL_SITE(LEVEL), __FUNCTION__) ? (void)0 : QL_IMPL_RECORD(LEVEL, STREAM, PREFIX, EXPR))
+
+/**
+ * Log deduplicated message. Internal macro used by other macros. Message, which is the
+ * same as previous message issued from the call site is suppressed.
+ * @param LEVEL one of QL_LEVEL_* values.
+ * @param STREAM name of Log member function, which returns LogStream.
+ * @param PREFIX message prefix.
+ * @param EXPR expression containing message.
+ * @return void.
+ *
+ * @see ql::Deduplicator.
+ */
+#define QL_IMPL_LOG_DEDUP(LEVEL, STREAM, PREFIX, EXPR) (!QL_LOG_INSTANCE.STREAM().enabled() ? (void)0 : QL_IMPL_DEDUPLICATOR().commit(::ql::Record(QL_LOG_INSTANCE.STREAM()).stream() << PREFIX << EXPR, QL_LOG_INSTANCE.STREAM(), PREFIX, QL_CALL_SITE(LEVEL), __FUNCTION__))
+
+/**
+ * Log sampled message. Internal macro used by other macros. Message expression is
+ * wrapped in a lambda, which is called by the sampler only if record is sampled.
+ * @param LEVEL one of QL_LEVEL_* values.
+ * @param STREAM name of Log member function, which returns LogStream.
+ * @param PREFIX message prefix.
+ * @param MODE one of ql::Sampler::mode_t values.
+ * @param PARAM sampling parameter.
+ * @param EXPR expression containing message.
+ * @return void.
+ *
+ * @see ql::Sampler.
+ */
+#define QL_IMPL_LOG_SAMPLED(LEVEL, STREAM, PREFIX, MODE, PARAM, EXPR) (!QL_LOG_INSTANCE.STREAM().enabled() ? (void)0 : QL_IMPL_SAMPLER(MODE, PARAM).log(QL_LOG_INSTANCE.STREAM(), PREFIX, QL_CALL_SITE(LEVEL), __FUNCTION__, [&](std::ostream & ql_stream) { ql_stream << EXPR; }))
+
+/**
+ * Log formatted message. Internal macro used by other macros. Number of "{}" placeholders
+ * in format string is checked against number of arguments at compile time. Arguments are
+ * evaluated only if stream is enabled. Record is formatted into thread-local buffer
+ * without iostreams and passed to the log stream as a whole.
+ * @param LEVEL one of QL_LEVEL_* values.
+ * @param STREAM name of Log member function, which returns LogStream.
+ * @param PREFIX message prefix.
+ * @param ... format string literal followed by arguments.
+ * @return void.
+ *
+ * @see ql::Formatter.
+ */
+#define QL_IMPL_LOGF(LEVEL, STREAM, PREFIX, ...) (!QL_LOG_INSTANCE.STREAM().enabled() ? (void)0 : (QL_IMPL_FORMAT_CHECK(__VA_ARGS__), ::ql::Formatter::Write(QL_LOG_INSTANCE.STREAM(), PREFIX, QL_CALL_SITE(LEVEL), __FUNCTION__, __VA_ARGS__)))
+
+/**
+ * Log binary record. Internal macro used by other macros. Arguments are evaluated only if
+ * active binary log accepts the level. Only call site ID, time stamp and raw bytes of the
+ * arguments are recorded - message is rendered later.
+ * @param LEVEL one of QL_LEVEL_* values.
+ * @param ... format string literal followed by arguments.
+ * @return void.
+ *
+ * @see ql::BinaryLog.
+ */
+#define QL_IMPL_LOG_BIN(LEVEL, ...) (!::ql::BinaryLog::Enabled(LEVEL) ? (void)0 : (QL_IMPL_FORMAT_CHECK(__VA_ARGS__), ::ql::BinaryLog::Write(QL_CALL_SITE(LEVEL), __FUNCTION__, __VA_ARGS__)))
+
+/**
+ * Log structured record. Internal macro used by other macros. Arguments are evaluated
+ * only if stream is enabled.
+ * @param LEVEL one of QL_LEVEL_* values.
+ * @param STREAM name of Log member function, which returns LogStream.
+ * @param PREFIX message prefix.
+ * @param ... message followed by key, value pairs.
+ * @return void.
+ *
+ * @see ql::KvRecord.
+ */
+#define QL_IMPL_LOG_KV(LEVEL, STREAM, PREFIX, ...) (!QL_LOG_INSTANCE.STREAM().enabled() ? (void)0 : ::ql::KvRecord::Write(QL_LOG_INSTANCE.STREAM(), PREFIX, QL_CALL_SITE(LEVEL), __FUNCTION__, __VA_ARGS__))
+
+/**
+ * Log message of a category. Internal macro used by other macros. Compile-time level of
+ * the category (see QL_DECLARE_CATEGORY_MIN_LEVEL) is checked first. It is a constant
+ * expression, so if @a LEVEL is lower, compiler discards the rest of the expression -
+ * neither code nor string literals nor call site descriptors are emitted, provided that
+ * optimization is enabled. Otherwise level of the category is checked. Category and its
+ * effective level are cached by the call site (see ql::Category::Site), so if the level is
+ * disabled, the check costs a single relaxed load and comparison. Record is put to the
+ * level stream and to the stream of the category; device reachable from both receives it
+ * once. Name of the category is put after the prefix.
+ * @param LEVEL one of QL_LEVEL_* values.
+ * @param STREAM name of Log member function, which returns LogStream.
+ * @param PREFIX message prefix.
+ * @param CAT name of category accessor declared with QL_DECLARE_CATEGORY.
+ * @param EXPR expression containing message.
+ * @return void.
+ *
+ * @see ql::Category.
+ */
+#define QL_IMPL_LOG_CAT(LEVEL, STREAM, PREFIX, CAT, EXPR) (LEVEL < QL_IMPL_CATEGORY_MIN_LEVEL(CAT) || !QL_IMPL_CATEGORY_SITE().enabled(LEVEL, CAT, QL_LOG_INSTANCE.STREAM()) ? (void)0 : ::ql::Record::Commit(::ql::Record(QL_LOG_INSTANCE.STREAM(), CAT().stream()).stream() << PREFIX << '[' << CAT().name() << "] " << EXPR, QL_LOG_INSTANCE.STREAM(), QL_CALL_SITE(LEVEL), __FUNCTION__))
+
 /**
  * Debug message. This kind of messages are intended to be utilized during development.
  * This macro should be turned off for releases. It can be turned off by defining
  * QL_NO_DEBUG before including this file.
  * @param EXPR expression containing debug message. Expression is injected into LogStream
- * object thus standard ostream syntax may be used.
- * @return reference to LogStream object or (void)0.
+ * object thus standard ostream syntax may be used. Expression is not evaluated if debug stream
+ * is disabled.
+ * @return void.
  */
 #ifndef QL_NO_DEBUG
-    #define QL_DEBUG(EXPR) ::ql::Log::Instance().debugStream() << "Debug message: " << EXPR << ::ql::Trace(::ql::Log::Instance().debugStream().traceFlags(), __FILE__, __LINE__, __FUNCTION__) << std::endl
+    #define QL_DEBUG(EXPR) QL_IMPL_LOG(QL_LEVEL_DEBUG, debugStream, "Debug message: ", EXPR)
 #else
 	#define QL_DEBUG(EXPR) (void)0
 #endif
@@ -33,10 +230,10 @@
  * @param EXPR expression containing notice. Expression is injected into LogStream
  * object thus standard ostream syntax may be used. This macro can be turned off by
  * defining QL_NO_NOTE before including this file.
- * @return reference to LogStream object or (void)0.
+ * @return void.
  */
 #ifndef QL_NO_NOTE
-    #define QL_NOTE(EXPR) ::ql::Log::Instance().noteStream() << "Note: " << EXPR << ::ql::Trace(::ql::Log::Instance().noteStream().traceFlags(), __FILE__, __LINE__, __FUNCTION__) << std::endl
+    #define QL_NOTE(EXPR) QL_IMPL_LOG(QL_LEVEL_NOTE, noteStream, "Note: ", EXPR)
 #else
 	#define QL_NOTE(EXPR) (void)0
 #endif
@@ -47,10 +244,10 @@
  * @param EXPR expression containing warning message. Expression is injected into LogStream
  * object thus standard ostream syntax may be used. This macro can be turned off by defining
  * QL_NO_WARN before including this file.
- * @return reference to LogStream object or (void)0.
+ * @return void.
  */
 #ifndef QL_NO_WARN
-    #define QL_WARN(EXPR) ::ql::Log::Instance().warnStream() << "Warning: " << EXPR << ::ql::Trace(::ql::Log::Instance().warnStream().traceFlags(), __FILE__, __LINE__, __FUNCTION__) << std::endl
+    #define QL_WARN(EXPR) QL_IMPL_LOG(QL_LEVEL_WARN, warnStream, "Warning: ", EXPR)
 #else
 	#define QL_WARN(EXPR) (void)0
 #endif
@@ -61,16 +258,18 @@
  * @param EXPR expression containing error message. Expression is injected into LogStream
  * object thus standard ostream syntax may be used. This macro can be turned off by defining
  * QL_NO_ERROR before including this file.
- * @return reference to LogStream object or (void)0.
+ * @return void.
  */
 #ifndef QL_NO_ERROR
-    #define QL_ERROR(EXPR) ::ql::Log::Instance().errorStream() << "Error: " << EXPR << ::ql::Trace(::ql::Log::Instance().errorStream().traceFlags(), __FILE__, __LINE__, __FUNCTION__) << std::endl
+    #define QL_ERROR(EXPR) QL_IMPL_LOG(QL_LEVEL_ERROR, errorStream, "Error: ", EXPR)
 #else
 	#define QL_ERROR(EXPR) (void)0
 #endif
 
 /**
 * Critical error. Sends critical error message to LogStream and exits with EXIT_FAILURE code.
+* Active binary log and Log are flushed before exit, so that pending asynchronous records
+* are not lost.
 * This macro should never be turned off, however it can be turned off by defining
 * QL_NO_CRITICAL before including this file.
 * @param EXPR expression containing critical error message. Expression is injected into LogStream
@@ -78,13 +277,14 @@
 * @return (void)0 or void.
  */
 #ifndef QL_NO_CRITICAL
-    #define QL_CRITICAL(EXPR) ::ql::Log::Instance().criticalStream() << "Critical error: " << EXPR << ::ql::Trace(::ql::Log::Instance().criticalStream().traceFlags(), __FILE__, __LINE__, __FUNCTION__) << std::endl, std::exit(EXIT_FAILURE)
+    #define QL_CRITICAL(EXPR) (::ql::BinaryLog::FlushActive(), QL_IMPL_LOG(QL_LEVEL_CRITICAL, criticalStream, "Critical error: ", EXPR), QL_LOG_INSTANCE.flush(), std::exit(EXIT_FAILURE))
 #else
 	#define QL_CRITICAL(EXPR) (void)0
 #endif
 
 /**
-* Fatal error. Sends fatal error message to LogStream and aborts execution.
+* Fatal error. Sends fatal error message to LogStream and aborts execution. Active binary
+* log and Log are flushed before abort, so that pending asynchronous records are not lost.
 * There are following differences between exit() (performed by QL_CRITICAL) and abort():
 * 	- abort() sends SIGABRT signal.
 * 	- abort() will dump core, if core dump is enabled.
@@ -99,7 +299,7 @@
 * @return (void)0 or void.
  */
 #ifndef QL_NO_FATAL
-    #define QL_FATAL(EXPR) ::ql::Log::Instance().fatalStream() << "Fatal error: " << EXPR << ::ql::Trace(::ql::Log::Instance().fatalStream().traceFlags(), __FILE__, __LINE__, __FUNCTION__) << std::endl, std::abort()
+    #define QL_FATAL(EXPR) (::ql::BinaryLog::FlushActive(), QL_IMPL_LOG(QL_LEVEL_FATAL, fatalStream, "Fatal error: ", EXPR), QL_LOG_INSTANCE.flush(), std::abort())
 #else
 	#define QL_FATAL(EXPR) (void)0
 #endif
@@ -110,14 +310,415 @@
  * line or function name in it. Macro can be turned off by defining QL_NO_INFO.
  * @param EXPR expression containing information. Expression is injected into LogStream
  * object thus standard ostream syntax may be used.
- * @return reference to LogStream object or (void)0.
+ * @return void.
  */
 #ifndef QL_NO_INFO
-    #define QL_INFO(EXPR) ::ql::Log::Instance().infoStream() << EXPR << ::ql::Trace(::ql::Log::Instance().infoStream().traceFlags(), __FILE__, __LINE__, __FUNCTION__) << std::endl
+    #define QL_INFO(EXPR) QL_IMPL_LOG(QL_LEVEL_INFO, infoStream, "", EXPR)
 #else
 	#define QL_INFO(EXPR) (void)0
 #endif
 
+/**
+ * @name Rate limited macros
+ * Rate limited variants of logging macros. Each call site lets through at most @a RATE
+ * records per second on average, with bursts of up to @a BURST records. Limit is checked
+ * before @a EXPR is evaluated, so rejected records cost neither formatting nor I/O.
+ * Number of rejected records is reported by a summary record (e.g. "Warning: suppressed
+ * 1000 similar messages"), which precedes the next record let through. Macros are turned
+ * off together with their base macros.
+ * @param RATE number of records per second. Should be a constant expression.
+ * @param BURST number of records, which may be issued at once. Should be a constant
+ * expression.
+ * @param EXPR expression containing message.
+ * @return void.
+ *
+ * @see ql::RateLimiter.
+ */
+//@{
+#ifndef QL_NO_DEBUG
+    #define QL_DEBUG_RATE_LIMITED(RATE, BURST, EXPR) QL_IMPL_LOG_RATE_LIMITED(QL_LEVEL_DEBUG, debugStream, "Debug message: ", RATE, BURST, EXPR)
+#else
+	#define QL_DEBUG_RATE_LIMITED(RATE, BURST, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_NOTE
+    #define QL_NOTE_RATE_LIMITED(RATE, BURST, EXPR) QL_IMPL_LOG_RATE_LIMITED(QL_LEVEL_NOTE, noteStream, "Note: ", RATE, BURST, EXPR)
+#else
+	#define QL_NOTE_RATE_LIMITED(RATE, BURST, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_WARN
+    #define QL_WARN_RATE_LIMITED(RATE, BURST, EXPR) QL_IMPL_LOG_RATE_LIMITED(QL_LEVEL_WARN, warnStream, "Warning: ", RATE, BURST, EXPR)
+#else
+	#define QL_WARN_RATE_LIMITED(RATE, BURST, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_ERROR
+    #define QL_ERROR_RATE_LIMITED(RATE, BURST, EXPR) QL_IMPL_LOG_RATE_LIMITED(QL_LEVEL_ERROR, errorStream, "Error: ", RATE, BURST, EXPR)
+#else
+	#define QL_ERROR_RATE_LIMITED(RATE, BURST, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_INFO
+    #define QL_INFO_RATE_LIMITED(RATE, BURST, EXPR) QL_IMPL_LOG_RATE_LIMITED(QL_LEVEL_INFO, infoStream, "", RATE, BURST, EXPR)
+#else
+	#define QL_INFO_RATE_LIMITED(RATE, BURST, EXPR) (void)0
+#endif
+//@}
+
+/**
+ * @name Deduplicating macros
+ * Deduplicating variants of logging macros. Consecutive identical messages issued from
+ * the same call site are collapsed - only the first one is written. Number of suppressed
+ * duplicates is reported by a summary record (e.g. "Warning: suppressed 1000 similar
+ * messages"), which is written before the next distinct message and every
+ * QL_DEDUP_SUMMARY_INTERVAL seconds, while duplicates keep coming. Macros are turned off
+ * together with their base macros.
+ * @param EXPR expression containing message.
+ * @return void.
+ *
+ * @see ql::Deduplicator.
+ */
+//@{
+#ifndef QL_NO_DEBUG
+    #define QL_DEBUG_DEDUP(EXPR) QL_IMPL_LOG_DEDUP(QL_LEVEL_DEBUG, debugStream, "Debug message: ", EXPR)
+#else
+	#define QL_DEBUG_DEDUP(EXPR) (void)0
+#endif
+
+#ifndef QL_NO_NOTE
+    #define QL_NOTE_DEDUP(EXPR) QL_IMPL_LOG_DEDUP(QL_LEVEL_NOTE, noteStream, "Note: ", EXPR)
+#else
+	#define QL_NOTE_DEDUP(EXPR) (void)0
+#endif
+
+#ifndef QL_NO_WARN
+    #define QL_WARN_DEDUP(EXPR) QL_IMPL_LOG_DEDUP(QL_LEVEL_WARN, warnStream, "Warning: ", EXPR)
+#else
+	#define QL_WARN_DEDUP(EXPR) (void)0
+#endif
+
+#ifndef QL_NO_ERROR
+    #define QL_ERROR_DEDUP(EXPR) QL_IMPL_LOG_DEDUP(QL_LEVEL_ERROR, errorStream, "Error: ", EXPR)
+#else
+	#define QL_ERROR_DEDUP(EXPR) (void)0
+#endif
+
+#ifndef QL_NO_INFO
+    #define QL_INFO_DEDUP(EXPR) QL_IMPL_LOG_DEDUP(QL_LEVEL_INFO, infoStream, "", EXPR)
+#else
+	#define QL_INFO_DEDUP(EXPR) (void)0
+#endif
+//@}
+
+/**
+ * @name Sampling macros
+ * Sampling variants of logging macros. Each call site keeps its own counters:
+ * 	- QL_<LEVEL>_EVERY_N(N, EXPR) - writes every @a N-th record, starting with the first one.
+ * 	- QL_<LEVEL>_FIRST_N(N, EXPR) - writes only first @a N records.
+ * 	- QL_<LEVEL>_SAMPLED(PROB, EXPR) - writes record with probability @a PROB.
+ * 	.
+ * @a EXPR is evaluated only for records, which are written. Records written by EVERY_N
+ * and SAMPLED variants are annotated with "(sampled 1 of N, total M)". Macros are turned
+ * off together with their base macros.
+ * @param N number of records. Should be a constant expression.
+ * @param PROB probability in range [0, 1]. Should be a constant expression.
+ * @param EXPR expression containing message.
+ * @return void.
+ *
+ * @see ql::Sampler.
+ */
+//@{
+#ifndef QL_NO_DEBUG
+    #define QL_DEBUG_EVERY_N(N, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_DEBUG, debugStream, "Debug message: ", EVERY_N, N, EXPR)
+    #define QL_DEBUG_FIRST_N(N, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_DEBUG, debugStream, "Debug message: ", FIRST_N, N, EXPR)
+    #define QL_DEBUG_SAMPLED(PROB, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_DEBUG, debugStream, "Debug message: ", PROBABILITY, PROB, EXPR)
+#else
+	#define QL_DEBUG_EVERY_N(N, EXPR) (void)0
+	#define QL_DEBUG_FIRST_N(N, EXPR) (void)0
+	#define QL_DEBUG_SAMPLED(PROB, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_NOTE
+    #define QL_NOTE_EVERY_N(N, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_NOTE, noteStream, "Note: ", EVERY_N, N, EXPR)
+    #define QL_NOTE_FIRST_N(N, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_NOTE, noteStream, "Note: ", FIRST_N, N, EXPR)
+    #define QL_NOTE_SAMPLED(PROB, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_NOTE, noteStream, "Note: ", PROBABILITY, PROB, EXPR)
+#else
+	#define QL_NOTE_EVERY_N(N, EXPR) (void)0
+	#define QL_NOTE_FIRST_N(N, EXPR) (void)0
+	#define QL_NOTE_SAMPLED(PROB, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_WARN
+    #define QL_WARN_EVERY_N(N, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_WARN, warnStream, "Warning: ", EVERY_N, N, EXPR)
+    #define QL_WARN_FIRST_N(N, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_WARN, warnStream, "Warning: ", FIRST_N, N, EXPR)
+    #define QL_WARN_SAMPLED(PROB, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_WARN, warnStream, "Warning: ", PROBABILITY, PROB, EXPR)
+#else
+	#define QL_WARN_EVERY_N(N, EXPR) (void)0
+	#define QL_WARN_FIRST_N(N, EXPR) (void)0
+	#define QL_WARN_SAMPLED(PROB, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_ERROR
+    #define QL_ERROR_EVERY_N(N, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_ERROR, errorStream, "Error: ", EVERY_N, N, EXPR)
+    #define QL_ERROR_FIRST_N(N, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_ERROR, errorStream, "Error: ", FIRST_N, N, EXPR)
+    #define QL_ERROR_SAMPLED(PROB, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_ERROR, errorStream, "Error: ", PROBABILITY, PROB, EXPR)
+#else
+	#define QL_ERROR_EVERY_N(N, EXPR) (void)0
+	#define QL_ERROR_FIRST_N(N, EXPR) (void)0
+	#define QL_ERROR_SAMPLED(PROB, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_INFO
+    #define QL_INFO_EVERY_N(N, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_INFO, infoStream, "", EVERY_N, N, EXPR)
+    #define QL_INFO_FIRST_N(N, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_INFO, infoStream, "", FIRST_N, N, EXPR)
+    #define QL_INFO_SAMPLED(PROB, EXPR) QL_IMPL_LOG_SAMPLED(QL_LEVEL_INFO, infoStream, "", PROBABILITY, PROB, EXPR)
+#else
+	#define QL_INFO_EVERY_N(N, EXPR) (void)0
+	#define QL_INFO_FIRST_N(N, EXPR) (void)0
+	#define QL_INFO_SAMPLED(PROB, EXPR) (void)0
+#endif
+//@}
+
+/**
+ * @name Formatting macros
+ * Formatting variants of logging macros. Message is given as format string followed by
+ * arguments, e.g. QL_DEBUGF("x={} y={}", x, y). Each "{}" placeholder is replaced by
+ * subsequent argument; "{{" and "}}" produce literal braces. Format string must be a
+ * string literal - number of placeholders is checked against number of arguments at
+ * compile time. Supported argument types are integers, floating point numbers, booleans,
+ * characters, C strings, std::string and pointers. Record is formatted without iostreams
+ * into thread-local buffer of QL_FORMAT_BUFFER_SIZE characters (longer records are
+ * truncated). Macros are turned off together with their base macros.
+ * @param ... format string literal followed by arguments.
+ * @return void.
+ *
+ * @see ql::Formatter.
+ */
+//@{
+#ifndef QL_NO_DEBUG
+    #define QL_DEBUGF(...) QL_IMPL_LOGF(QL_LEVEL_DEBUG, debugStream, "Debug message: ", __VA_ARGS__)
+#else
+	#define QL_DEBUGF(...) (void)0
+#endif
+
+#ifndef QL_NO_NOTE
+    #define QL_NOTEF(...) QL_IMPL_LOGF(QL_LEVEL_NOTE, noteStream, "Note: ", __VA_ARGS__)
+#else
+	#define QL_NOTEF(...) (void)0
+#endif
+
+#ifndef QL_NO_WARN
+    #define QL_WARNF(...) QL_IMPL_LOGF(QL_LEVEL_WARN, warnStream, "Warning: ", __VA_ARGS__)
+#else
+	#define QL_WARNF(...) (void)0
+#endif
+
+#ifndef QL_NO_ERROR
+    #define QL_ERRORF(...) QL_IMPL_LOGF(QL_LEVEL_ERROR, errorStream, "Error: ", __VA_ARGS__)
+#else
+	#define QL_ERRORF(...) (void)0
+#endif
+
+#ifndef QL_NO_CRITICAL
+    #define QL_CRITICALF(...) (::ql::BinaryLog::FlushActive(), QL_IMPL_LOGF(QL_LEVEL_CRITICAL, criticalStream, "Critical error: ", __VA_ARGS__), QL_LOG_INSTANCE.flush(), std::exit(EXIT_FAILURE))
+#else
+	#define QL_CRITICALF(...) (void)0
+#endif
+
+#ifndef QL_NO_FATAL
+    #define QL_FATALF(...) (::ql::BinaryLog::FlushActive(), QL_IMPL_LOGF(QL_LEVEL_FATAL, fatalStream, "Fatal error: ", __VA_ARGS__), QL_LOG_INSTANCE.flush(), std::abort())
+#else
+	#define QL_FATALF(...) (void)0
+#endif
+
+#ifndef QL_NO_INFO
+    #define QL_INFOF(...) QL_IMPL_LOGF(QL_LEVEL_INFO, infoStream, "", __VA_ARGS__)
+#else
+	#define QL_INFOF(...) (void)0
+#endif
+//@}
+
+/**
+ * @name Binary logging macros
+ * Binary variants of formatting macros, e.g. QL_DEBUG_BIN("x={} y={}", x, y). Records are
+ * written to active binary log (see ql::BinaryLog::SetActive()) and rendered on its writer
+ * thread or offline by ql-decode tool. Format string and argument types are checked in
+ * the same way as in formatting macros. Nothing is written if there is no active binary
+ * log. Macros are turned off together with their base macros.
+ * @param ... format string literal followed by arguments.
+ * @return void.
+ *
+ * @see ql::BinaryLog.
+ */
+//@{
+#ifndef QL_NO_DEBUG
+    #define QL_DEBUG_BIN(...) QL_IMPL_LOG_BIN(QL_LEVEL_DEBUG, __VA_ARGS__)
+#else
+	#define QL_DEBUG_BIN(...) (void)0
+#endif
+
+#ifndef QL_NO_NOTE
+    #define QL_NOTE_BIN(...) QL_IMPL_LOG_BIN(QL_LEVEL_NOTE, __VA_ARGS__)
+#else
+	#define QL_NOTE_BIN(...) (void)0
+#endif
+
+#ifndef QL_NO_WARN
+    #define QL_WARN_BIN(...) QL_IMPL_LOG_BIN(QL_LEVEL_WARN, __VA_ARGS__)
+#else
+	#define QL_WARN_BIN(...) (void)0
+#endif
+
+#ifndef QL_NO_ERROR
+    #define QL_ERROR_BIN(...) QL_IMPL_LOG_BIN(QL_LEVEL_ERROR, __VA_ARGS__)
+#else
+	#define QL_ERROR_BIN(...) (void)0
+#endif
+
+#ifndef QL_NO_INFO
+    #define QL_INFO_BIN(...) QL_IMPL_LOG_BIN(QL_LEVEL_INFO, __VA_ARGS__)
+#else
+	#define QL_INFO_BIN(...) (void)0
+#endif
+//@}
+
+/**
+ * @name Key-value macros
+ * Structured variants of logging macros, e.g. QL_WARN_KV("slow request", "user", id,
+ * "latency_us", t). Message is followed by fields given as key, value pairs. Keys must be
+ * C strings. Values may be integers, floating point numbers, booleans, characters, C
+ * strings or std::string objects. Sinks derived from ql::KvBuf receive structured record
+ * and render it as JSON or logfmt; other sinks receive text, in which fields are appended
+ * to the message as "key=value" pairs. Macros are turned off together with their base
+ * macros.
+ * @param ... message followed by key, value pairs.
+ * @return void.
+ *
+ * @see ql::KvRecord, ql::KvBuf.
+ */
+//@{
+#ifndef QL_NO_DEBUG
+    #define QL_DEBUG_KV(...) QL_IMPL_LOG_KV(QL_LEVEL_DEBUG, debugStream, "Debug message: ", __VA_ARGS__)
+#else
+	#define QL_DEBUG_KV(...) (void)0
+#endif
+
+#ifndef QL_NO_NOTE
+    #define QL_NOTE_KV(...) QL_IMPL_LOG_KV(QL_LEVEL_NOTE, noteStream, "Note: ", __VA_ARGS__)
+#else
+	#define QL_NOTE_KV(...) (void)0
+#endif
+
+#ifndef QL_NO_WARN
+    #define QL_WARN_KV(...) QL_IMPL_LOG_KV(QL_LEVEL_WARN, warnStream, "Warning: ", __VA_ARGS__)
+#else
+	#define QL_WARN_KV(...) (void)0
+#endif
+
+#ifndef QL_NO_ERROR
+    #define QL_ERROR_KV(...) QL_IMPL_LOG_KV(QL_LEVEL_ERROR, errorStream, "Error: ", __VA_ARGS__)
+#else
+	#define QL_ERROR_KV(...) (void)0
+#endif
+
+#ifndef QL_NO_INFO
+    #define QL_INFO_KV(...) QL_IMPL_LOG_KV(QL_LEVEL_INFO, infoStream, "", __VA_ARGS__)
+#else
+	#define QL_INFO_KV(...) (void)0
+#endif
+//@}
+
+/**
+ * @name Category macros
+ * Category variants of logging macros, e.g. QL_DEBUG_CAT(cacheCategory, "evicted " <<
+ * key). Record is issued only if the category lets its level through (see
+ * ql::Category::setLevel()) and either level stream or stream of the category is
+ * enabled. Macros are turned off together with their base macros and stripped at compile
+ * time below level given to QL_DECLARE_CATEGORY_MIN_LEVEL.
+ * @param CAT name of category accessor declared with QL_DECLARE_CATEGORY.
+ * @param EXPR expression containing message.
+ * @return void.
+ *
+ * @see ql::Category.
+ */
+//@{
+#ifndef QL_NO_DEBUG
+    #define QL_DEBUG_CAT(CAT, EXPR) QL_IMPL_LOG_CAT(QL_LEVEL_DEBUG, debugStream, "Debug message: ", CAT, EXPR)
+#else
+	#define QL_DEBUG_CAT(CAT, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_NOTE
+    #define QL_NOTE_CAT(CAT, EXPR) QL_IMPL_LOG_CAT(QL_LEVEL_NOTE, noteStream, "Note: ", CAT, EXPR)
+#else
+	#define QL_NOTE_CAT(CAT, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_WARN
+    #define QL_WARN_CAT(CAT, EXPR) QL_IMPL_LOG_CAT(QL_LEVEL_WARN, warnStream, "Warning: ", CAT, EXPR)
+#else
+	#define QL_WARN_CAT(CAT, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_ERROR
+    #define QL_ERROR_CAT(CAT, EXPR) QL_IMPL_LOG_CAT(QL_LEVEL_ERROR, errorStream, "Error: ", CAT, EXPR)
+#else
+	#define QL_ERROR_CAT(CAT, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_INFO
+    #define QL_INFO_CAT(CAT, EXPR) QL_IMPL_LOG_CAT(QL_LEVEL_INFO, infoStream, "", CAT, EXPR)
+#else
+	#define QL_INFO_CAT(CAT, EXPR) (void)0
+#endif
+//@}
+
+/**
+ * @name Log instance macros
+ * Variants of logging macros, which write to given log instead of QL_LOG_INSTANCE, e.g.
+ * QL_WARN_TO(tenantLog, "quota exceeded"). Stream of given log is checked whether it is
+ * enabled before @a EXPR is evaluated. Macros are turned off together with their base
+ * macros.
+ * @param LOG ql::Log object. Expression is evaluated more than once, so it should be cheap
+ * (e.g. a variable or ql::Log::ThreadInstance()).
+ * @param EXPR expression containing message.
+ * @return void.
+ *
+ * @see ql::Log.
+ */
+//@{
+#ifndef QL_NO_DEBUG
+    #define QL_DEBUG_TO(LOG, EXPR) QL_IMPL_LOG_TO(LOG, QL_LEVEL_DEBUG, debugStream, "Debug message: ", EXPR)
+#else
+	#define QL_DEBUG_TO(LOG, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_NOTE
+    #define QL_NOTE_TO(LOG, EXPR) QL_IMPL_LOG_TO(LOG, QL_LEVEL_NOTE, noteStream, "Note: ", EXPR)
+#else
+	#define QL_NOTE_TO(LOG, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_WARN
+    #define QL_WARN_TO(LOG, EXPR) QL_IMPL_LOG_TO(LOG, QL_LEVEL_WARN, warnStream, "Warning: ", EXPR)
+#else
+	#define QL_WARN_TO(LOG, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_ERROR
+    #define QL_ERROR_TO(LOG, EXPR) QL_IMPL_LOG_TO(LOG, QL_LEVEL_ERROR, errorStream, "Error: ", EXPR)
+#else
+	#define QL_ERROR_TO(LOG, EXPR) (void)0
+#endif
+
+#ifndef QL_NO_INFO
+    #define QL_INFO_TO(LOG, EXPR) QL_IMPL_LOG_TO(LOG, QL_LEVEL_INFO, infoStream, "", EXPR)
+#else
+	#define QL_INFO_TO(LOG, EXPR) (void)0
+#endif
+//@}
+
 /**
  * Assertion. Usage of this macro is analogous to standard C assert. Expression is tested
  * and if it fails fatal error is triggered. In addition to standard C assert, description
@@ -0,0 +1,152 @@
+/**
+ * @file
+ * @brief Shared memory log collector.
+ *
+ * Drains shared memory ring written by ShmRingBuf producers and writes records to
+ * standard output or to memory-mapped files (MmapFileBuf). Records are held for a short
+ * reordering window and written in the order of their time stamps, so that output of
+ * many processes is merged. On SIGINT or SIGTERM remaining records are written and
+ * statistics are printed to standard error.
+ *
+ * Usage: ql-collector [-p] [-u] [-w window] [-o pattern [-s size] [-i interval] [-r retention]] name
+ * 	- -p - prefix records with process ID of the producer.
+ * 	- -u - remove the segment on exit.
+ * 	- -w - reordering window in milliseconds (100 by default).
+ * 	- -o - write to segment files named by @a pattern instead of standard output.
+ * 	- -s - segment size in bytes.
+ * 	- -i - rotation interval in seconds.
+ * 	- -r - number of segments to be kept.
+ */
+
+#include "../include/ql/LogStream.hpp"
+#include "../include/ql/MmapFileBuf.hpp"
+#include "../include/ql/ShmRingBuf.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <thread>
+
+namespace {
+
+volatile std::sig_atomic_t stop = 0;
+
+void onSignal(int)
+{
+	stop = 1;
+}
+
+typedef std::multimap<std::int64_t, ql::ShmRingBuf::Reader::Record> Pending;
+
+void emit(ql::LogStream & output, Pending & pending, std::int64_t until, bool prefix, unsigned long & records)
+{
+	Pending::iterator end = pending.upper_bound(until);
+	for (Pending::iterator i = pending.begin(); i != end; ++i) {
+		if (prefix) {
+			char pid[24];
+			int len = std::snprintf(pid, sizeof(pid), "[%d] ", i->second.pid);
+			i->second.text.insert(0, pid, static_cast<std::size_t>(len));
+		}
+		output.rdbuf()->putRecord(i->second.text.data(), i->second.text.size());
+		records++;
+	}
+	pending.erase(pending.begin(), end);
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+	bool prefix = false;
+	bool unlink = false;
+	long window = 100;
+	const char * pattern = nullptr;
+	std::size_t segmentSize = QL_MMAP_SEGMENT_SIZE;
+	unsigned long interval = 0;
+	std::size_t retention = 0;
+	const char * name = nullptr;
+	for (int i = 1; i < argc; i++)
+		if (std::strcmp(argv[i], "-p") == 0)
+			prefix = true;
+		else if (std::strcmp(argv[i], "-u") == 0)
+			unlink = true;
+		else if (std::strcmp(argv[i], "-w") == 0 && i + 1 < argc)
+			window = std::strtol(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			pattern = argv[++i];
+		else if (std::strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+			segmentSize = std::strtoul(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+			interval = std::strtoul(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+			retention = std::strtoul(argv[++i], nullptr, 10);
+		else
+			name = argv[i];
+
+	if (name == nullptr) {
+		std::fprintf(stderr, "Usage: %s [-p] [-u] [-w window] [-o pattern [-s size] [-i interval] [-r retention]] name\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	ql::ShmRingBuf::Reader reader(name);
+	if (!reader.isOpen()) {
+		std::perror(name);
+		return EXIT_FAILURE;
+	}
+
+	ql::LogStream output;
+	ql::MmapFileBuf * fileBuf = nullptr;
+	if (pattern != nullptr) {
+		fileBuf = new ql::MmapFileBuf(pattern, segmentSize, interval, retention);
+		if (!fileBuf->isOpen()) {
+			std::perror(fileBuf->fileName().c_str());
+			delete fileBuf;
+			return EXIT_FAILURE;
+		}
+		output.attachBuffer(fileBuf);
+	} else {
+		output.attachStream(std::cout);
+		output.setFlushPolicy(ql::FlushPolicy::EveryMilliseconds(static_cast<std::size_t>(window)));
+	}
+
+	std::signal(SIGINT, onSignal);
+	std::signal(SIGTERM, onSignal);
+
+	Pending pending;
+	ql::ShmRingBuf::Reader::Record record;
+	unsigned long records = 0;
+	while (!stop) {
+		bool idle = true;
+		while (reader.read(record)) {
+			pending.insert(std::make_pair(record.time, record));
+			idle = false;
+		}
+
+		std::time_t sec;
+		long nsec;
+		ql::TimeStamp::Now(sec, nsec, false);
+		emit(output, pending, static_cast<std::int64_t>(sec) * 1000000000 + nsec - window * 1000000, prefix, records);
+		if (idle)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	while (reader.read(record))
+		pending.insert(std::make_pair(record.time, record));
+	emit(output, pending, std::numeric_limits<std::int64_t>::max(), prefix, records);
+	output.flush();
+
+	if (fileBuf != nullptr) {
+		output.detachBuffer(fileBuf);
+		delete fileBuf;
+	}
+	if (unlink)
+		ql::ShmRingBuf::Unlink(name);
+
+	std::fprintf(stderr, "%lu records written, %lu dropped by producers, %lu slots skipped\n", records, static_cast<unsigned long>(reader.droppedCount()), static_cast<unsigned long>(reader.skippedCount()));
+	return EXIT_SUCCESS;
+}
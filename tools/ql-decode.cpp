@@ -0,0 +1,46 @@
+/**
+ * @file
+ * @brief Binary log decoder.
+ *
+ * Renders binary log file written by BinaryLog in file mode and prints the records as
+ * text. Records are printed with file, line, function and date (with microseconds) trace.
+ *
+ * Usage: ql-decode [-u] file
+ * 	- -u - print dates in UTC.
+ */
+
+#include "../include/ql/BinaryLog.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+int main(int argc, char * argv[])
+{
+	int traceFlags = ql::Trace::FILE | ql::Trace::LINE | ql::Trace::FUNCTION | ql::Trace::DATE | ql::Trace::USEC;
+	const char * fileName = nullptr;
+	for (int i = 1; i < argc; i++)
+		if (std::strcmp(argv[i], "-u") == 0)
+			traceFlags |= ql::Trace::UTC;
+		else
+			fileName = argv[i];
+
+	if (fileName == nullptr) {
+		std::fprintf(stderr, "Usage: %s [-u] file\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	std::FILE * in = std::fopen(fileName, "rb");
+	if (in == nullptr) {
+		std::perror(fileName);
+		return EXIT_FAILURE;
+	}
+
+	bool result = ql::BinaryLog::Decode(in, stdout, traceFlags);
+	std::fclose(in);
+	if (!result) {
+		std::fprintf(stderr, "%s: not a binary log or corrupted file\n", fileName);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file
+ * @brief Flight recorder decoder.
+ *
+ * Decodes ring image left by memory-mapped FlightRecorderBuf (for example after the
+ * process has been killed) and prints recorded output in the order it was written.
+ *
+ * Usage: ql-flightdump file
+ */
+
+#include "../include/ql/FlightRecorderBuf.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+int main(int argc, char * argv[])
+{
+	if (argc != 2) {
+		std::fprintf(stderr, "Usage: %s file\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	int fd = open(argv[1], O_RDONLY);
+	if (fd == -1) {
+		std::perror(argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	struct stat st;
+	if (fstat(fd, & st) == -1 || st.st_size <= 0) {
+		std::fprintf(stderr, "%s: empty or unreadable file\n", argv[1]);
+		close(fd);
+		return EXIT_FAILURE;
+	}
+
+	std::size_t size = static_cast<std::size_t>(st.st_size);
+	void * image = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (image == MAP_FAILED) {
+		std::perror(argv[1]);
+		return EXIT_FAILURE;
+	}
+
+	bool result = ql::FlightRecorderBuf::DumpImage(static_cast<const char *>(image), size, STDOUT_FILENO);
+	munmap(image, size);
+	if (!result) {
+		std::fprintf(stderr, "%s: not a flight recorder image\n", argv[1]);
+		return EXIT_FAILURE;
+	}
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file
+ * @brief Local socket collector.
+ *
+ * Listens on Unix domain socket and prints everything SocketBuf sends to it. Datagrams
+ * are printed one per line. Stream connections are accepted one after another, so that
+ * the collector can be used to test reconnection. On SIGINT or SIGTERM, number of
+ * received messages (datagrams or connections) and bytes is printed to standard error.
+ *
+ * Usage: ql-listen [-s] path
+ * 	- -s - use stream socket instead of datagram socket.
+ */
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+volatile std::sig_atomic_t stop = 0;
+
+void onSignal(int)
+{
+	stop = 1;
+}
+
+}
+
+int main(int argc, char * argv[])
+{
+	bool stream = false;
+	const char * path = nullptr;
+	for (int i = 1; i < argc; i++)
+		if (std::strcmp(argv[i], "-s") == 0)
+			stream = true;
+		else
+			path = argv[i];
+
+	sockaddr_un addr;
+	std::memset(& addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (path == nullptr || std::strlen(path) >= sizeof(addr.sun_path)) {
+		std::fprintf(stderr, "Usage: %s [-s] path\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+	std::strcpy(addr.sun_path, path);
+
+	// Interrupt blocking calls instead of restarting them.
+	struct sigaction action;
+	std::memset(& action, 0, sizeof(action));
+	action.sa_handler = onSignal;
+	sigaction(SIGINT, & action, nullptr);
+	sigaction(SIGTERM, & action, nullptr);
+
+	int fd = socket(AF_UNIX, stream ? SOCK_STREAM : SOCK_DGRAM, 0);
+	unlink(path);
+	if (fd == -1 || bind(fd, reinterpret_cast<sockaddr *>(& addr), sizeof(addr)) == -1 || (stream && listen(fd, 1) == -1)) {
+		std::perror(path);
+		return EXIT_FAILURE;
+	}
+
+	std::vector<char> buffer(65536);
+	unsigned long messages = 0;
+	unsigned long bytes = 0;
+	while (!stop) {
+		int client = fd;
+		if (stream) {
+			client = accept(fd, nullptr, nullptr);
+			if (client == -1)
+				continue;
+		}
+		do {
+			ssize_t len = recv(client, buffer.data(), buffer.size(), 0);
+			if (len == -1 && errno == EINTR)
+				continue;
+			if (len <= 0)
+				break;
+			std::fwrite(buffer.data(), 1, static_cast<std::size_t>(len), stdout);
+			if (!stream) {
+				if (buffer[static_cast<std::size_t>(len) - 1] != '\n')
+					std::fputc('\n', stdout);
+				messages++;
+			}
+			bytes += static_cast<unsigned long>(len);
+		} while (!stop);
+		std::fflush(stdout);
+		if (stream) {
+			close(client);
+			messages++;
+		}
+	}
+
+	close(fd);
+	unlink(path);
+	std::fprintf(stderr, "%lu %s, %lu bytes received\n", messages, stream ? "connections" : "datagrams", bytes);
+	return EXIT_SUCCESS;
+}